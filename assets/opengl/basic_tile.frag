@@ -7,13 +7,18 @@ uniform sampler2D tile;// Name hardcoded in renderer_impl_x.cpp. TODO: Add const
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+    flat vec4 Tile;
 } fs_in;
 
 out vec4 FragColor;
 
-void main() {
-    FragColor = texture(tile, fs_in.TexCoords).rgba;
-    if (texture(tile, fs_in.TexCoords).a == 0) { gl_FragDepth = 1; return; }
+// Pieces that repeat have UVs relative to their tile rect, which wrap around so the rect repeats
+// once per UV unit. Other pieces have an empty rect and use their UVs as they are.
+vec2 tile_uv(vec2 uv, vec4 rect) {
+    return rect.zw == vec2(0) ? uv : rect.xy + fract(uv) * rect.zw;
+}
 
-    gl_FragDepth = gl_FragCoord.z;
+void main() {
+    FragColor = texture(tile, tile_uv(fs_in.TexCoords, fs_in.Tile)).rgba;
+    if (FragColor.a == 0) discard;
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
 #version 430 core
 
 in vec2 TexCoords;
+flat in vec4 Tile;
 uniform sampler2D tex;
 
+// Pieces that repeat have UVs relative to their tile rect, which wrap around so the rect repeats
+// once per UV unit. Other pieces have an empty rect and use their UVs as they are.
+vec2 tile_uv(vec2 uv, vec4 rect) {
+    return rect.zw == vec2(0) ? uv : rect.xy + fract(uv) * rect.zw;
+}
+
 void main()
 {
-    if (texture(tex, TexCoords).a == 0) { gl_FragDepth = 1; return; }
-
-    gl_FragDepth = gl_FragCoord.z;
+    if (texture(tex, tile_uv(TexCoords, Tile)).a == 0) discard;
 }
\ No newline at end of file
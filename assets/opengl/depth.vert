@@ -1,13 +1,16 @@
 #version 430 core
-in vec3 iPos;
-in vec2 iTexCoords;
+layout(location = 0) in vec3 iPos;
+layout(location = 1) in vec2 iTexCoords;
+layout(location = 2) in vec4 iTile;
 
 layout (location = 0) uniform mat4 model;
 layout (location = 3) uniform mat4 lightSpaceMatrix;
 
 out vec2 TexCoords;
+flat out vec4 Tile;
 
 void main() {
     TexCoords = iTexCoords;
+    Tile = iTile;
     gl_Position = lightSpaceMatrix * model * vec4(iPos, 1.0);
 }
\ No newline at end of file
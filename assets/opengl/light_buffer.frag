@@ -0,0 +1,179 @@
+#version 430 core
+// Values of aryibi::renderer::ShadowFilter.
+#define SHADOW_FILTER_OFF 1u
+#define SHADOW_FILTER_HARDWARE_PCF 2u
+#define SHADOW_FILTER_POISSON_4 3u
+#define SHADOW_FILTER_POISSON_8 4u
+#define SHADOW_FILTER_GRID_25 5u
+// How far from the fragment the soft filters look, in shadow atlas texels.
+#define SHADOW_FILTER_RADIUS 10.0
+
+// Lights the surfaces in front at the resolution of the light buffer (See
+// Renderer::set_light_buffer_divisor()). The lighting is the same as in shaded_tile.frag.
+
+layout(location = 0) uniform mat4 inverseViewProjection;
+
+// Texture units hardcoded in renderer.cpp.
+layout(binding = 0) uniform sampler2D depth;// Depth of the surfaces in front
+layout(binding = 1) uniform sampler2D shadow;
+layout(binding = 3) uniform sampler2DShadow shadowCompare;
+
+struct DirectionalLight {
+/// Color RGB is color, alpha is light intensity
+/// lightAtlasPos XY is atlas pos, Z is tile size
+/// shadowFilter is one of SHADOW_FILTER_*
+                            // base // aligned
+    vec4 color;             // 16   // 0
+    mat4 lightSpaceMatrix;  // 64   // 16
+    vec3 lightAtlasPos;     // 12   // 80
+    uint shadowFilter;      // 4    // 92
+                                    // 96
+};
+
+struct PointLight {
+/// Color RGB is color, alpha is light intensity
+/// lightAtlasPos XY is atlas pos, Z is tile size
+                            // base // aligned
+    vec4 color;             // 16   // 0
+    mat4 lightSpaceMatrix;  // 64   // 16
+    vec3 lightAtlasPos;     // 12   // 80
+    float radius;           // 4    // 92
+    vec3 position;          // 12   // 96
+    uint shadowFilter;      // 4    // 108
+                                    // 112
+};
+
+// common::ShaderLightInfo
+layout(std140, binding = 5) uniform Lights {
+                                // base // aligned
+    vec3 ambientLightColor;     // 12   // 0
+    uint directionalLightCount; // 4    // 12
+    vec2 gridOrigin;            // 8    // 16
+    vec2 tileSize;              // 8    // 24
+    uvec2 gridSize;             // 8    // 32
+    uint pointLightCount;       // 4    // 40
+    uint lightBuffer;           // 4    // 44
+    vec2 viewSize;              // 8    // 48
+                                        // 64
+} lights;
+
+layout(std430, binding = 6) readonly buffer DirectionalLights {
+    DirectionalLight directionalLights[];
+};
+
+layout(std430, binding = 7) readonly buffer PointLights {
+    PointLight pointLights[];
+};
+
+// Two numbers per tile of the light grid: where its list of point lights starts within this same
+// array, and how many lights it has (See common::LightTileGrid).
+layout(std430, binding = 8) readonly buffer LightTiles {
+    uint lightTiles[];
+};
+
+out vec4 FragColor;
+
+// The first 4 points are spread over the whole disk too, so that they can be used alone.
+const vec2 poissonDisk[8] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379)
+);
+
+float ShadowCalculation(vec2 lightAtlasPos, float lightAtlasSize, uint shadowFilter, vec4 fragPosLightSpace)
+{
+    if (shadowFilter == SHADOW_FILTER_OFF) return 0.0;
+
+    // perform perspective divide (not really neccesary for ortho projection, but whatever)
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    // transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
+    vec2 projCoords2D = lightAtlasPos + projCoords.xy * lightAtlasSize;
+    float currentDepth = projCoords.z;
+    float bias = 0.0005;
+
+    // Lights can be left without a tile when the atlas is full. They cast no shadows then.
+    if (currentDepth == 0 || lightAtlasSize == 0.0) return 0.0;
+
+    // Neighbouring fragments can run different point lights (See main()), so implicit derivatives
+    // are undefined here. The atlas has no mipmaps, so level 0 is always the right one.
+    if (shadowFilter == SHADOW_FILTER_HARDWARE_PCF) {
+        return 1.0 - textureLod(shadowCompare, vec3(projCoords2D, currentDepth - bias), 0.0);
+    }
+
+    float f_shadow = 0.0;
+    vec2 texelSize = 1.0 / textureSize(shadow, 0);
+    if (shadowFilter == SHADOW_FILTER_GRID_25) {
+        for (int x = -2; x <= 2; ++x)
+        {
+            for (int y = -2; y <= 2; ++y)
+            {
+                float pcfDepth = textureLod(shadow, projCoords2D + vec2(x, y) * texelSize * SHADOW_FILTER_RADIUS / 2.0, 0.0).r;
+                f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+            }
+        }
+        return f_shadow / 25.0;
+    }
+
+    // Rotating the disk on every pixel turns the banding of few samples into noise.
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    int sampleCount = shadowFilter == SHADOW_FILTER_POISSON_4 ? 4 : 8;
+    for (int i = 0; i < sampleCount; ++i) {
+        vec2 offset = rotation * poissonDisk[i] * texelSize * SHADOW_FILTER_RADIUS;
+        float pcfDepth = textureLod(shadow, projCoords2D + offset, 0.0).r;
+        f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+    }
+    return f_shadow / float(sampleCount);
+}
+
+vec3 ComputeLight(vec3 fragPos) {
+    vec3 light = lights.ambientLightColor;
+    for (int directional_i = 0; directional_i < lights.directionalLightCount; ++directional_i) {
+        vec4 FragPosLightSpace = directionalLights[directional_i].lightSpaceMatrix * vec4(fragPos, 1.0);
+        vec3 light_forward = normalize(directionalLights[directional_i].lightSpaceMatrix[2].xyz);
+        // Assume our normal is always facing the camera
+        vec3 this_normal = vec3(0, 0, 1);
+        float light_strength = dot(this_normal, -light_forward) * directionalLights[directional_i].color.a;
+        light_strength = max(light_strength, 0.0);
+        light += light_strength * directionalLights[directional_i].color.rgb *
+            (1.0 - ShadowCalculation(directionalLights[directional_i].lightAtlasPos.xy,
+            directionalLights[directional_i].lightAtlasPos.z,
+            directionalLights[directional_i].shadowFilter, FragPosLightSpace));
+    }
+    // Only the point lights that overlap the tile of the light grid this fragment is in can light it.
+    ivec2 light_tile = clamp(ivec2(floor((fragPos.xy - lights.gridOrigin) / lights.tileSize)),
+                             ivec2(0), ivec2(lights.gridSize) - 1);
+    uint light_tile_i = uint(light_tile.y) * lights.gridSize.x + uint(light_tile.x);
+    uint tile_lights_start = lightTiles[2 * light_tile_i];
+    uint tile_lights_count = lightTiles[2 * light_tile_i + 1];
+    for (uint tile_light_i = 0; tile_light_i < tile_lights_count; ++tile_light_i) {
+        uint point_i = lightTiles[tile_lights_start + tile_light_i];
+        vec4 FragPosLightSpace = pointLights[point_i].lightSpaceMatrix * vec4(fragPos, 1.0);
+        vec3 light_pos = pointLights[point_i].position;
+        vec3 light_dir_vec = normalize(light_pos - fragPos);
+        // Assume our normal is always facing the camera
+        vec3 this_normal = vec3(0, 0, 1);
+        float light_strength = dot(this_normal, light_dir_vec) * pointLights[point_i].color.a;
+        light_strength *= min(1.0, (pointLights[point_i].radius - distance(light_pos, fragPos)) / pointLights[point_i].radius);
+        light_strength = max(light_strength, 0.0);
+        light += light_strength * pointLights[point_i].color.rgb *
+        (1.0 - ShadowCalculation(pointLights[point_i].lightAtlasPos.xy,
+        pointLights[point_i].lightAtlasPos.z,
+        pointLights[point_i].shadowFilter, FragPosLightSpace));
+    }
+    return light;
+}
+
+void main() {
+    float surfaceDepth = texelFetch(depth, ivec2(gl_FragCoord.xy), 0).r;
+    // Nothing lit was drawn here.
+    if (surfaceDepth == 1.0) {
+        FragColor = vec4(lights.ambientLightColor, 1.0);
+        return;
+    }
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(depth, 0)) * 2.0 - 1.0;
+    vec4 fragPos = inverseViewProjection * vec4(ndc, surfaceDepth * 2.0 - 1.0, 1.0);
+    FragColor = vec4(ComputeLight(fragPos.xyz / fragPos.w), 1.0);
+}
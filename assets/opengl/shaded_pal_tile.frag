@@ -9,11 +9,18 @@ uniform sampler2D palette;// Name hardcoded in renderer_impl_x.cpp. TODO: Add co
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+    flat vec4 Tile;
     vec4 FragPosLightSpace;
 } fs_in;
 
 out vec4 FragColor;
 
+// Pieces that repeat have UVs relative to their tile rect, which wrap around so the rect repeats
+// once per UV unit. Other pieces have an empty rect and use their UVs as they are.
+vec2 tile_uv(vec2 uv, vec4 rect) {
+    return rect.zw == vec2(0) ? uv : rect.xy + fract(uv) * rect.zw;
+}
+
 float ShadowCalculation(vec4 fragPosLightSpace)
 {
     // perform perspective divide (not really neccesary for ortho projection, but whatever)
@@ -21,7 +28,7 @@ float ShadowCalculation(vec4 fragPosLightSpace)
     // transform to [0,1] range
     projCoords = projCoords * 0.5 + 0.5;
     // projCoords = vec3(projCoords.x, 1.0 - projCoords.y, projCoords.z);
-    float closestDepth = texture(shadow, projCoords.xy).r;
+    float closestDepth = textureLod(shadow, projCoords.xy, 0.0).r;
     float currentDepth = projCoords.z;
     float bias = 0.0005;
 
@@ -33,7 +40,7 @@ float ShadowCalculation(vec4 fragPosLightSpace)
     {
         for(int y = -1; y <= 1; ++y)
         {
-            float pcfDepth = texture(shadow, projCoords.xy + vec2(x, y) * texelSize).r;
+            float pcfDepth = textureLod(shadow, projCoords.xy + vec2(x, y) * texelSize, 0.0).r;
             f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
         }
     }
@@ -42,13 +49,13 @@ float ShadowCalculation(vec4 fragPosLightSpace)
 }
 
 void main() {
+    vec4 original_color = texture(tile, tile_uv(fs_in.TexCoords, fs_in.Tile));
+    // Discarding instead of writing gl_FragDepth lets the depth test run before the shader, so
+    // covered fragments aren't shaded at all.
+    if (original_color.a == 0) discard;
     float f_shadow = ShadowCalculation(fs_in.FragPosLightSpace);
-    vec4 original_color = texture(tile, fs_in.TexCoords);
 
     // 0 is transparent
     if(original_color.r == 0) FragColor = vec4(0);
     else FragColor = texelFetch(palette, max(ivec2(original_color.rg * 255.0- vec2(f_shadow + 1, 0)), ivec2(0,0)), 0);
-    if (original_color.a == 0) { gl_FragDepth = 99999; return; }
-
-    gl_FragDepth = gl_FragCoord.z;
 }
\ No newline at end of file
@@ -1,7 +1,8 @@
 #version 430 core
 
-in vec3 iPos;
-in vec2 iTexCoords;
+layout(location = 0) in vec3 iPos;
+layout(location = 1) in vec2 iTexCoords;
+layout(location = 2) in vec4 iTile;
 
 layout(location = 0) uniform mat4 model;
 layout(location = 1) uniform mat4 projection;
@@ -11,6 +12,7 @@ layout(location = 3) uniform mat4 lightSpaceMatrix;
 out VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+    flat vec4 Tile;
     vec4 FragPosLightSpace;
 } vs_out;
 
@@ -18,6 +20,7 @@ void main()
 {
     vs_out.FragPos = vec3(model * vec4(iPos, 1.0));
     vs_out.TexCoords = iTexCoords;
+    vs_out.Tile = iTile;
     vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
     gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
 }
\ No newline at end of file
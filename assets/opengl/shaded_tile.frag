@@ -1,19 +1,29 @@
 #version 430 core
-#define MAX_DIRECTIONAL_LIGHTS 5
-#define MAX_POINT_LIGHTS 20
+// Values of aryibi::renderer::ShadowFilter.
+#define SHADOW_FILTER_OFF 1u
+#define SHADOW_FILTER_HARDWARE_PCF 2u
+#define SHADOW_FILTER_POISSON_4 3u
+#define SHADOW_FILTER_POISSON_8 4u
+#define SHADOW_FILTER_GRID_25 5u
+// How far from the fragment the soft filters look, in shadow atlas texels.
+#define SHADOW_FILTER_RADIUS 10.0
 
 in vec2 TexCoords;
 
 uniform sampler2D tile;// Name hardcoded in renderer_impl_x.cpp. TODO: Add constexpr variable in separate file
 uniform sampler2D shadow;// Name hardcoded in renderer_impl_x.cpp. TODO: Add constexpr variable in separate file
+uniform sampler2DShadow shadowCompare;// The shadow atlas again, with depth comparison. Name hardcoded in renderer_types.cpp
+uniform sampler2D lightBuffer;// The light of the frame, when it has a light buffer. Name hardcoded in renderer_types.cpp
 
 struct DirectionalLight {
 /// Color RGB is color, alpha is light intensity
 /// lightAtlasPos XY is atlas pos, Z is tile size
+/// shadowFilter is one of SHADOW_FILTER_*
                             // base // aligned
     vec4 color;             // 16   // 0
     mat4 lightSpaceMatrix;  // 64   // 16
-    vec3 lightAtlasPos;     // 16   // 80
+    vec3 lightAtlasPos;     // 12   // 80
+    uint shadowFilter;      // 4    // 92
                                     // 96
 };
 
@@ -22,31 +32,68 @@ struct PointLight {
 /// lightAtlasPos XY is atlas pos, Z is tile size
                             // base // aligned
     vec4 color;             // 16   // 0
-    float radius;           // 4    // 16
-    mat4 lightSpaceMatrix;  // 64   // 32
-    vec3 lightAtlasPos;     // 16   // 96
+    mat4 lightSpaceMatrix;  // 64   // 16
+    vec3 lightAtlasPos;     // 12   // 80
+    float radius;           // 4    // 92
+    vec3 position;          // 12   // 96
+    uint shadowFilter;      // 4    // 108
                                     // 112
 };
 
+// common::ShaderLightInfo
 layout(std140, binding = 5) uniform Lights {
-                                                                // base // aligned
-    DirectionalLight directionalLights[MAX_DIRECTIONAL_LIGHTS]; // 480  // 0
-    uint directionalLightCount;                                 // 4    // 480
-    PointLight pointLights[MAX_POINT_LIGHTS];                   // 2240 // 496
-    uint pointLightCount;                                       // 4    // 2736
-    vec3 ambientLightColor;                                     // 12   // 2752
-                                                                        // 2768
+                                // base // aligned
+    vec3 ambientLightColor;     // 12   // 0
+    uint directionalLightCount; // 4    // 12
+    vec2 gridOrigin;            // 8    // 16
+    vec2 tileSize;              // 8    // 24
+    uvec2 gridSize;             // 8    // 32
+    uint pointLightCount;       // 4    // 40
+    uint lightBuffer;           // 4    // 44
+    vec2 viewSize;              // 8    // 48
+                                        // 64
 } lights;
 
+layout(std430, binding = 6) readonly buffer DirectionalLights {
+    DirectionalLight directionalLights[];
+};
+
+layout(std430, binding = 7) readonly buffer PointLights {
+    PointLight pointLights[];
+};
+
+// Two numbers per tile of the light grid: where its list of point lights starts within this same
+// array, and how many lights it has (See common::LightTileGrid).
+layout(std430, binding = 8) readonly buffer LightTiles {
+    uint lightTiles[];
+};
+
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+    flat vec4 Tile;
 } fs_in;
 
 out vec4 FragColor;
 
-float ShadowCalculation(vec2 lightAtlasPos, float lightAtlasSize, vec4 fragPosLightSpace)
+// Pieces that repeat have UVs relative to their tile rect, which wrap around so the rect repeats
+// once per UV unit. Other pieces have an empty rect and use their UVs as they are.
+vec2 tile_uv(vec2 uv, vec4 rect) {
+    return rect.zw == vec2(0) ? uv : rect.xy + fract(uv) * rect.zw;
+}
+
+// The first 4 points are spread over the whole disk too, so that they can be used alone.
+const vec2 poissonDisk[8] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379)
+);
+
+float ShadowCalculation(vec2 lightAtlasPos, float lightAtlasSize, uint shadowFilter, vec4 fragPosLightSpace)
 {
+    if (shadowFilter == SHADOW_FILTER_OFF) return 0.0;
+
     // perform perspective divide (not really neccesary for ortho projection, but whatever)
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     // transform to [0,1] range
@@ -55,50 +102,91 @@ float ShadowCalculation(vec2 lightAtlasPos, float lightAtlasSize, vec4 fragPosLi
     float currentDepth = projCoords.z;
     float bias = 0.0005;
 
-    if (currentDepth == 0) return 0.0;
+    // Lights can be left without a tile when the atlas is full. They cast no shadows then.
+    if (currentDepth == 0 || lightAtlasSize == 0.0) return 0.0;
+
+    // Neighbouring fragments can run different point lights (See main()), so implicit derivatives
+    // are undefined here. The atlas has no mipmaps, so level 0 is always the right one.
+    if (shadowFilter == SHADOW_FILTER_HARDWARE_PCF) {
+        return 1.0 - textureLod(shadowCompare, vec3(projCoords2D, currentDepth - bias), 0.0);
+    }
 
     float f_shadow = 0.0;
     vec2 texelSize = 1.0 / textureSize(shadow, 0);
-    for (int x = -2; x <= 2; ++x)
-    {
-        for (int y = -2; y <= 2; ++y)
+    if (shadowFilter == SHADOW_FILTER_GRID_25) {
+        for (int x = -2; x <= 2; ++x)
         {
-            float pcfDepth = texture(shadow, projCoords2D + vec2(x, y) * texelSize * 5.0).r;
-            f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+            for (int y = -2; y <= 2; ++y)
+            {
+                float pcfDepth = textureLod(shadow, projCoords2D + vec2(x, y) * texelSize * SHADOW_FILTER_RADIUS / 2.0, 0.0).r;
+                f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+            }
         }
+        return f_shadow / 25.0;
     }
-    f_shadow /= 25.0;
-    return f_shadow;
+
+    // Rotating the disk on every pixel turns the banding of few samples into noise.
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    int sampleCount = shadowFilter == SHADOW_FILTER_POISSON_4 ? 4 : 8;
+    for (int i = 0; i < sampleCount; ++i) {
+        vec2 offset = rotation * poissonDisk[i] * texelSize * SHADOW_FILTER_RADIUS;
+        float pcfDepth = textureLod(shadow, projCoords2D + offset, 0.0).r;
+        f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+    }
+    return f_shadow / float(sampleCount);
 }
 
-void main() {
+vec3 ComputeLight(vec3 fragPos) {
     vec3 light = lights.ambientLightColor;
     for (int directional_i = 0; directional_i < lights.directionalLightCount; ++directional_i) {
-        vec4 FragPosLightSpace = lights.directionalLights[directional_i].lightSpaceMatrix * vec4(fs_in.FragPos, 1.0);
-        vec3 light_forward = normalize(lights.directionalLights[directional_i].lightSpaceMatrix[2].xyz);
+        vec4 FragPosLightSpace = directionalLights[directional_i].lightSpaceMatrix * vec4(fragPos, 1.0);
+        vec3 light_forward = normalize(directionalLights[directional_i].lightSpaceMatrix[2].xyz);
         // Assume our normal is always facing the camera
         vec3 this_normal = vec3(0, 0, 1);
-        float light_strength = dot(this_normal, -light_forward) * lights.directionalLights[directional_i].color.a;
+        float light_strength = dot(this_normal, -light_forward) * directionalLights[directional_i].color.a;
         light_strength = max(light_strength, 0.0);
-        light += light_strength * lights.directionalLights[directional_i].color.rgb *
-            (1.0 - ShadowCalculation(lights.directionalLights[directional_i].lightAtlasPos.xy,
-            lights.directionalLights[directional_i].lightAtlasPos.z, FragPosLightSpace));
+        light += light_strength * directionalLights[directional_i].color.rgb *
+            (1.0 - ShadowCalculation(directionalLights[directional_i].lightAtlasPos.xy,
+            directionalLights[directional_i].lightAtlasPos.z,
+            directionalLights[directional_i].shadowFilter, FragPosLightSpace));
     }
-    for (int point_i = 0; point_i < lights.pointLightCount; ++point_i) {
-        vec4 FragPosLightSpace = lights.pointLights[point_i].lightSpaceMatrix * vec4(fs_in.FragPos, 1.0);
-        vec3 light_pos = lights.pointLights[point_i].lightSpaceMatrix[3].xyz;
-        vec3 light_dir_vec = normalize(light_pos - fs_in.FragPos);
+    // Only the point lights that overlap the tile of the light grid this fragment is in can light it.
+    ivec2 light_tile = clamp(ivec2(floor((fragPos.xy - lights.gridOrigin) / lights.tileSize)),
+                             ivec2(0), ivec2(lights.gridSize) - 1);
+    uint light_tile_i = uint(light_tile.y) * lights.gridSize.x + uint(light_tile.x);
+    uint tile_lights_start = lightTiles[2 * light_tile_i];
+    uint tile_lights_count = lightTiles[2 * light_tile_i + 1];
+    for (uint tile_light_i = 0; tile_light_i < tile_lights_count; ++tile_light_i) {
+        uint point_i = lightTiles[tile_lights_start + tile_light_i];
+        vec4 FragPosLightSpace = pointLights[point_i].lightSpaceMatrix * vec4(fragPos, 1.0);
+        vec3 light_pos = pointLights[point_i].position;
+        vec3 light_dir_vec = normalize(light_pos - fragPos);
         // Assume our normal is always facing the camera
         vec3 this_normal = vec3(0, 0, 1);
-        float light_strength = dot(this_normal, light_dir_vec) * lights.pointLights[point_i].color.a;
-        light_strength *= min(1.0, (lights.pointLights[point_i].radius - distance(light_pos, fs_in.FragPos)) / lights.pointLights[point_i].radius);
+        float light_strength = dot(this_normal, light_dir_vec) * pointLights[point_i].color.a;
+        light_strength *= min(1.0, (pointLights[point_i].radius - distance(light_pos, fragPos)) / pointLights[point_i].radius);
         light_strength = max(light_strength, 0.0);
-        light += light_strength * lights.pointLights[point_i].color.rgb *
-        (1.0 - ShadowCalculation(lights.pointLights[point_i].lightAtlasPos.xy,
-        lights.pointLights[point_i].lightAtlasPos.z, FragPosLightSpace));
+        light += light_strength * pointLights[point_i].color.rgb *
+        (1.0 - ShadowCalculation(pointLights[point_i].lightAtlasPos.xy,
+        pointLights[point_i].lightAtlasPos.z,
+        pointLights[point_i].shadowFilter, FragPosLightSpace));
     }
-    FragColor = texture(tile, fs_in.TexCoords).rgba * vec4(light, 1.0);
-    if (texture(tile, fs_in.TexCoords).a == 0) { gl_FragDepth = 1.0; return; }
+    return light;
+}
+
+void main() {
+    vec4 color = texture(tile, tile_uv(fs_in.TexCoords, fs_in.Tile));
+    // Discarding instead of writing gl_FragDepth lets the depth test run before the shader, so
+    // covered fragments aren't lit at all.
+    if (color.a == 0) discard;
 
-    gl_FragDepth = gl_FragCoord.z;
-}
\ No newline at end of file
+    vec3 light;
+    if (lights.lightBuffer != 0u) {
+        // Already computed for the surface in front (See Renderer::set_light_buffer_divisor()).
+        light = texture(lightBuffer, (fs_in.FragPos.xy - lights.gridOrigin) / lights.viewSize).rgb;
+    } else {
+        light = ComputeLight(fs_in.FragPos);
+    }
+    FragColor = color * vec4(light, 1.0);
+}
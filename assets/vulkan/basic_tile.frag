@@ -3,15 +3,20 @@
 layout (location = 0) in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+    flat vec4 Tile;
 } vs_out;
 
 layout (set = 1, binding = 0) uniform sampler2D tile;
 
 layout (location = 0) out vec4 FragColor;
 
-void main() {
-    FragColor = texture(tile, vs_out.TexCoords).rgba;
-    if (texture(tile, vs_out.TexCoords).a == 0) { gl_FragDepth = 1; return; }
+// Pieces that repeat have UVs relative to their tile rect, which wrap around so the rect repeats
+// once per UV unit. Other pieces have an empty rect and use their UVs as they are.
+vec2 tile_uv(vec2 uv, vec4 rect) {
+    return rect.zw == vec2(0) ? uv : rect.xy + fract(uv) * rect.zw;
+}
 
-    gl_FragDepth = gl_FragCoord.z;
+void main() {
+    FragColor = texture(tile, tile_uv(vs_out.TexCoords, vs_out.Tile)).rgba;
+    if (FragColor.a == 0) discard;
 }
\ No newline at end of file
@@ -1,14 +1,16 @@
 #version 460
 
 layout (location = 0) in vec2 TexCoords;
+layout (location = 1) flat in vec4 Tile;
 
 layout (set = 1, binding = 0) uniform sampler2D tile;
 
-void main() {
-    if (texture(tile, TexCoords).a == 0) {
-        gl_FragDepth = 1;
-        return;
-    }
+// Pieces that repeat have UVs relative to their tile rect, which wrap around so the rect repeats
+// once per UV unit. Other pieces have an empty rect and use their UVs as they are.
+vec2 tile_uv(vec2 uv, vec4 rect) {
+    return rect.zw == vec2(0) ? uv : rect.xy + fract(uv) * rect.zw;
+}
 
-    gl_FragDepth = gl_FragCoord.z;
+void main() {
+    if (texture(tile, tile_uv(TexCoords, Tile)).a == 0) discard;
 }
\ No newline at end of file
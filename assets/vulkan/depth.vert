@@ -1,8 +1,10 @@
 #version 460
 layout (location = 0) in vec3 iPos;
 layout (location = 1) in vec2 iTexCoords;
+layout (location = 2) in vec4 iTile;
 
 layout (location = 0) out vec2 TexCoords;
+layout (location = 1) flat out vec4 Tile;
 
 layout (set = 0, binding = 0) uniform UniformData {
     mat4 projection;
@@ -25,5 +27,6 @@ layout (push_constant) uniform Constants {
 void main() {
     mat4 model = transforms[transform_index];
     TexCoords = iTexCoords;
+    Tile = iTile;
     gl_Position = light_mats[light_mat_index] * model * vec4(iPos, 1.0);
 }
\ No newline at end of file
@@ -3,11 +3,18 @@
 layout (location = 0) in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+    flat vec4 Tile;
     vec4 FragPosLightSpace;
 } vs_out;
 
 layout (location = 0) out vec4 FragColor;
 
+// Pieces that repeat have UVs relative to their tile rect, which wrap around so the rect repeats
+// once per UV unit. Other pieces have an empty rect and use their UVs as they are.
+vec2 tile_uv(vec2 uv, vec4 rect) {
+    return rect.zw == vec2(0) ? uv : rect.xy + fract(uv) * rect.zw;
+}
+
 layout (set = 1, binding = 0) uniform sampler2D shadow;
 layout (set = 1, binding = 1) uniform sampler2D palette;
 
@@ -19,7 +26,7 @@ float ShadowCalculation(vec4 fragPosLightSpace) {
     // transform to [0,1] range
     projCoords = projCoords * 0.5 + 0.5;
     // projCoords = vec3(projCoords.x, 1.0 - projCoords.y, projCoords.z);
-    float closestDepth = texture(shadow, projCoords.xy).r;
+    float closestDepth = textureLod(shadow, projCoords.xy, 0.0).r;
     float currentDepth = projCoords.z;
     float bias = 0.0005;
 
@@ -29,7 +36,7 @@ float ShadowCalculation(vec4 fragPosLightSpace) {
     vec2 texelSize = 1.0 / textureSize(shadow, 0);
     for (int x = -1; x <= 1; ++x) {
         for (int y = -1; y <= 1; ++y) {
-            float pcfDepth = texture(shadow, projCoords.xy + vec2(x, y) * texelSize).r;
+            float pcfDepth = textureLod(shadow, projCoords.xy + vec2(x, y) * texelSize, 0.0).r;
             f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
         }
     }
@@ -38,13 +45,13 @@ float ShadowCalculation(vec4 fragPosLightSpace) {
 }
 
 void main() {
+    vec4 original_color = texture(tile, tile_uv(vs_out.TexCoords, vs_out.Tile));
+    // Discarding instead of writing gl_FragDepth lets the depth test run before the shader, so
+    // covered fragments aren't shaded at all.
+    if (original_color.a == 0) discard;
     float f_shadow = ShadowCalculation(vs_out.FragPosLightSpace);
-    vec4 original_color = texture(tile, vs_out.TexCoords);
 
     // 0 is transparent
     if (original_color.r == 0) FragColor = vec4(0);
     else FragColor = texelFetch(palette, max(ivec2(original_color.rg * 255.0 - vec2(f_shadow + 1, 0)), ivec2(0,0)), 0);
-    if (original_color.a == 0) { gl_FragDepth = 1.0; return; }
-
-    gl_FragDepth = gl_FragCoord.z;
 }
\ No newline at end of file
@@ -2,10 +2,12 @@
 
 layout (location = 0) in vec3 iPos;
 layout (location = 1) in vec2 iTexCoords;
+layout (location = 2) in vec4 iTile;
 
 layout (location = 0) out VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+    flat vec4 Tile;
     vec4 FragPosLightSpace;
 } vs_out;
 
@@ -31,6 +33,7 @@ void main() {
     mat4 model = transforms[transform_index];
     vs_out.FragPos = vec3(model * vec4(iPos, 1.0));
     vs_out.TexCoords = iTexCoords;
+    vs_out.Tile = iTile;
     vs_out.FragPosLightSpace = light_mats[light_mat_index] * vec4(vs_out.FragPos, 1.0);
     gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
 }
\ No newline at end of file
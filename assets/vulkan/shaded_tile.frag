@@ -1,11 +1,18 @@
 #version 460
-#define MAX_DIRECTIONAL_LIGHTS 5
-#define MAX_POINT_LIGHTS 20
+// Values of aryibi::renderer::ShadowFilter.
+#define SHADOW_FILTER_OFF 1u
+#define SHADOW_FILTER_HARDWARE_PCF 2u
+#define SHADOW_FILTER_POISSON_4 3u
+#define SHADOW_FILTER_POISSON_8 4u
+#define SHADOW_FILTER_GRID_25 5u
+// How far from the fragment the soft filters look, in shadow atlas texels.
+#define SHADOW_FILTER_RADIUS 10.0
 
 struct DirectionalLight {
     vec4 color;
     mat4 lightSpaceMatrix;
     vec3 lightAtlasPos;
+    uint shadowFilter;
 };
 
 struct PointLight {
@@ -13,29 +20,67 @@ struct PointLight {
     mat4 lightSpaceMatrix;
     vec3 lightAtlasPos;
     float radius;
+    vec3 position;
+    uint shadowFilter;
 };
 
 layout (location = 0) in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+    flat vec4 Tile;
 } vs_out;
 
 layout (location = 0) out vec4 FragColor;
 
+// Pieces that repeat have UVs relative to their tile rect, which wrap around so the rect repeats
+// once per UV unit. Other pieces have an empty rect and use their UVs as they are.
+vec2 tile_uv(vec2 uv, vec4 rect) {
+    return rect.zw == vec2(0) ? uv : rect.xy + fract(uv) * rect.zw;
+}
+
 layout (set = 1, binding = 0) uniform sampler2D shadow;
 layout (set = 1, binding = 1) uniform sampler2D palette; // Unused
+layout (set = 1, binding = 2) uniform sampler2DShadow shadowCompare; // The shadow atlas again, with depth comparison
 
 layout (set = 2, binding = 0) uniform sampler2D tile;
 
+// common::ShaderLightInfo
 layout (std140, set = 3, binding = 0) uniform Lights {
-    DirectionalLight directionalLights[MAX_DIRECTIONAL_LIGHTS];
-    PointLight pointLights[MAX_POINT_LIGHTS];
     vec3 ambientLightColor;
-    uint pointLightCount;
     uint directionalLightCount;
+    vec2 gridOrigin;
+    vec2 tileSize;
+    uvec2 gridSize;
+    uint pointLightCount;
+    uint lightBuffer; // Always 0, this backend only supports a light buffer divisor of 1
+    vec2 viewSize;
 } lights;
 
-float ShadowCalculation(vec2 lightAtlasPos, float lightAtlasSize, vec4 fragPosLightSpace) {
+layout (std430, set = 3, binding = 1) readonly buffer DirectionalLights {
+    DirectionalLight directionalLights[];
+};
+
+layout (std430, set = 3, binding = 2) readonly buffer PointLights {
+    PointLight pointLights[];
+};
+
+// Two numbers per tile of the light grid: where its list of point lights starts within this same
+// array, and how many lights it has (See common::LightTileGrid).
+layout (std430, set = 3, binding = 3) readonly buffer LightTiles {
+    uint lightTiles[];
+};
+
+// The first 4 points are spread over the whole disk too, so that they can be used alone.
+const vec2 poissonDisk[8] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379)
+);
+
+float ShadowCalculation(vec2 lightAtlasPos, float lightAtlasSize, uint shadowFilter, vec4 fragPosLightSpace) {
+    if (shadowFilter == SHADOW_FILTER_OFF) return 0.0;
+
     // perform perspective divide (not really neccesary for ortho projection, but whatever)
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     // transform to [0,1] range
@@ -44,50 +89,80 @@ float ShadowCalculation(vec2 lightAtlasPos, float lightAtlasSize, vec4 fragPosLi
     float currentDepth = projCoords.z;
     float bias = 0.0005;
 
-    if (currentDepth == 0) return 0.0;
+    // Lights can be left without a tile when the atlas is full. They cast no shadows then.
+    if (currentDepth == 0 || lightAtlasSize == 0.0) return 0.0;
+
+    // Neighbouring fragments can run different point lights (See main()), so implicit derivatives
+    // are undefined here. The atlas has no mipmaps, so level 0 is always the right one.
+    if (shadowFilter == SHADOW_FILTER_HARDWARE_PCF) {
+        return 1.0 - textureLod(shadowCompare, vec3(projCoords2D, currentDepth - bias), 0.0);
+    }
 
     float f_shadow = 0.0;
     vec2 texelSize = 1.0 / textureSize(shadow, 0);
-    for (int x = -2; x <= 2; ++x)
-    {
-        for (int y = -2; y <= 2; ++y)
+    if (shadowFilter == SHADOW_FILTER_GRID_25) {
+        for (int x = -2; x <= 2; ++x)
         {
-            float pcfDepth = texture(shadow, projCoords2D + vec2(x, y) * texelSize * 5.0).r;
-            f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+            for (int y = -2; y <= 2; ++y)
+            {
+                float pcfDepth = textureLod(shadow, projCoords2D + vec2(x, y) * texelSize * SHADOW_FILTER_RADIUS / 2.0, 0.0).r;
+                f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+            }
         }
+        return f_shadow / 25.0;
     }
-    f_shadow /= 25.0;
-    return f_shadow;
+
+    // Rotating the disk on every pixel turns the banding of few samples into noise.
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    int sampleCount = shadowFilter == SHADOW_FILTER_POISSON_4 ? 4 : 8;
+    for (int i = 0; i < sampleCount; ++i) {
+        vec2 offset = rotation * poissonDisk[i] * texelSize * SHADOW_FILTER_RADIUS;
+        float pcfDepth = textureLod(shadow, projCoords2D + offset, 0.0).r;
+        f_shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+    }
+    return f_shadow / float(sampleCount);
 }
 
 void main() {
+    vec4 color = texture(tile, tile_uv(vs_out.TexCoords, vs_out.Tile));
+    // Discarding instead of writing gl_FragDepth lets the depth test run before the shader, so
+    // covered fragments aren't lit at all.
+    if (color.a == 0) discard;
+
     vec3 light = lights.ambientLightColor;
     for (int directional_i = 0; directional_i < lights.directionalLightCount; ++directional_i) {
-        vec4 FragPosLightSpace = lights.directionalLights[directional_i].lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
-        vec3 light_forward = normalize(lights.directionalLights[directional_i].lightSpaceMatrix[2].xyz);
+        vec4 FragPosLightSpace = directionalLights[directional_i].lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
+        vec3 light_forward = normalize(directionalLights[directional_i].lightSpaceMatrix[2].xyz);
         // Assume our normal is always facing the camera
         vec3 this_normal = vec3(0, 0, 1);
-        float light_strength = dot(this_normal, -light_forward) * lights.directionalLights[directional_i].color.a;
+        float light_strength = dot(this_normal, -light_forward) * directionalLights[directional_i].color.a;
         light_strength = max(light_strength, 0.0);
-        light += light_strength * lights.directionalLights[directional_i].color.rgb *
-        (1.0 - ShadowCalculation(lights.directionalLights[directional_i].lightAtlasPos.xy,
-        lights.directionalLights[directional_i].lightAtlasPos.z, FragPosLightSpace));
+        light += light_strength * directionalLights[directional_i].color.rgb *
+        (1.0 - ShadowCalculation(directionalLights[directional_i].lightAtlasPos.xy,
+        directionalLights[directional_i].lightAtlasPos.z,
+        directionalLights[directional_i].shadowFilter, FragPosLightSpace));
     }
-    for (int point_i = 0; point_i < lights.pointLightCount; ++point_i) {
-        vec4 FragPosLightSpace = lights.pointLights[point_i].lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
-        vec3 light_pos = lights.pointLights[point_i].lightSpaceMatrix[3].xyz;
+    // Only the point lights that overlap the tile of the light grid this fragment is in can light it.
+    ivec2 light_tile = clamp(ivec2(floor((vs_out.FragPos.xy - lights.gridOrigin) / lights.tileSize)),
+                             ivec2(0), ivec2(lights.gridSize) - 1);
+    uint light_tile_i = uint(light_tile.y) * lights.gridSize.x + uint(light_tile.x);
+    uint tile_lights_start = lightTiles[2 * light_tile_i];
+    uint tile_lights_count = lightTiles[2 * light_tile_i + 1];
+    for (uint tile_light_i = 0; tile_light_i < tile_lights_count; ++tile_light_i) {
+        uint point_i = lightTiles[tile_lights_start + tile_light_i];
+        vec4 FragPosLightSpace = pointLights[point_i].lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
+        vec3 light_pos = pointLights[point_i].position;
         vec3 light_dir_vec = normalize(light_pos - vs_out.FragPos);
         // Assume our normal is always facing the camera
         vec3 this_normal = vec3(0, 0, 1);
-        float light_strength = dot(this_normal, light_dir_vec) * lights.pointLights[point_i].color.a;
-        light_strength *= min(1.0, (lights.pointLights[point_i].radius - distance(light_pos, vs_out.FragPos)) / lights.pointLights[point_i].radius);
+        float light_strength = dot(this_normal, light_dir_vec) * pointLights[point_i].color.a;
+        light_strength *= min(1.0, (pointLights[point_i].radius - distance(light_pos, vs_out.FragPos)) / pointLights[point_i].radius);
         light_strength = max(light_strength, 0.0);
-        light += light_strength * lights.pointLights[point_i].color.rgb *
-        (1.0 - ShadowCalculation(lights.pointLights[point_i].lightAtlasPos.xy,
-        lights.pointLights[point_i].lightAtlasPos.z, FragPosLightSpace));
+        light += light_strength * pointLights[point_i].color.rgb *
+        (1.0 - ShadowCalculation(pointLights[point_i].lightAtlasPos.xy,
+        pointLights[point_i].lightAtlasPos.z,
+        pointLights[point_i].shadowFilter, FragPosLightSpace));
     }
-    FragColor = texture(tile, vs_out.TexCoords).rgba * vec4(light, 1.0);
-    if (texture(tile, vs_out.TexCoords).a == 0) { gl_FragDepth = 1.0; return; }
-
-    gl_FragDepth = gl_FragCoord.z;
+    FragColor = color * vec4(light, 1.0);
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include <anton/math/vector3.hpp>
 #include <anton/math/vector4.hpp>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <limits>
 #include <memory>
 #include <vector>
@@ -24,6 +26,7 @@ namespace aryibi::renderer {
 using namespace anton; // For integer types
 
 class Renderer;
+class MeshBuilder;
 struct ColorPalette;
 
 class TextureHandle {
@@ -87,9 +90,17 @@ private:
     friend class RenderTilesetContext;
     friend bool operator==(TextureHandle const&, TextureHandle const&);
     friend bool operator!=(TextureHandle const&, TextureHandle const&);
+    friend struct std::hash<TextureHandle>;
 
     struct impl;
-    std::unique_ptr<impl> p_impl;
+    /// The impl is stored inline instead of on the heap, since sprites create and copy handles all
+    /// the time (Every solver that returns a new Sprite does). Each backend checks in the
+    /// constructor that its impl fits, and that it can be left without destroying it.
+    static constexpr usize impl_size = 32;
+    static constexpr usize impl_alignment = 8;
+    alignas(impl_alignment) unsigned char impl_storage[impl_size];
+    /// Always points to impl_storage.
+    impl* p_impl;
 };
 
 /// Compares the internal handle.
@@ -141,14 +152,55 @@ struct MeshHandle {
 
 private:
     friend class MeshBuilder;
+    friend class DynMeshHandle;
     friend class Renderer;
 
     struct impl;
     std::unique_ptr<impl> p_impl;
 };
 
+/// A mesh that can be modified after creating it, meant for meshes that change very often
+/// (Animated water, moving entities baked into a layer...). Create one with
+/// MeshBuilder::finish_dynamic().
+/// Modifications are kept in CPU memory and uploaded right before drawing the mesh, into buffers
+/// that the GPU is guaranteed not to be reading at that moment, so updating never stalls.
+class DynMeshHandle {
+public:
+    /// Dynamic meshes are only meant to be created by MeshBuilder.
+    DynMeshHandle();
+    /// The DynMeshHandle destructor won't actually unload the underlying mesh. Use unload() for
+    /// that.
+    ~DynMeshHandle();
+    DynMeshHandle(DynMeshHandle const&);
+    DynMeshHandle& operator=(DynMeshHandle const&);
+
+    /// Returns true if the mesh exists and has not been unloaded.
+    [[nodiscard]] bool exists() const;
+    /// Destroys the underlying mesh. Does nothing if the mesh was already unloaded previously.
+    void unload();
+
+    /// Replaces the quads starting at first_quad with the ones added to a mesh builder and resets
+    /// the builder's internal state, like MeshBuilder::finish() does. Grows the mesh if needed.
+    void update(usize first_quad, MeshBuilder const& data);
+    /// Changes how many quads the mesh has. New quads are degenerate, so they are never drawn.
+    void resize(usize quad_count);
+    [[nodiscard]] usize quad_count() const;
+
+    /// Returns a handle that can be used in draw commands, which always draws the contents this
+    /// mesh has at the moment of drawing. It must NOT be unloaded; unload this handle instead.
+    [[nodiscard]] MeshHandle mesh() const;
+
+private:
+    friend class MeshBuilder;
+
+    struct impl;
+    std::unique_ptr<impl> p_impl;
+};
+
 /// Represents a GLSL shader handle. A regular shader must have the following
-/// structure: Vertex shader: in vec3 iPos; in vec2 iTexCoords; layout(location
+/// structure: Vertex shader: layout(location = 0) in vec3 iPos; layout(location = 1)
+/// in vec2 iTexCoords; layout(location = 2) in vec4 iTile; // The rect the UVs repeat
+/// inside of, empty if they don't (See MeshBuilder::add_repeating_sprite()) layout(location
 /// = 0) uniform mat4 model; layout(location = 1) uniform mat4 projection;
 /// layout(location = 2) uniform mat4 view;
 /// layout(location = 3) uniform mat4 lightSpaceMatrix; // If lighting is
@@ -239,9 +291,36 @@ struct DrawCmd {
     ShaderHandle shader;
     Transform transform;
     bool cast_shadows = false;
+    /// Whether the texture has texels that are neither fully opaque nor fully transparent.
+    /// Transparent commands are drawn from back to front, blended over what's behind them, and the
+    /// ones at the same depth in the order they were submitted. That is always correct, so it's
+    /// the default.
+    /// Setting it to false is an optimization for commands whose texels are all either fully
+    /// opaque or fully transparent: Opaque commands are drawn first, from front to back, so that
+    /// the fragments they cover are never shaded, and commands at the same depth are drawn in
+    /// whatever order needs the fewest state changes. Texels with alpha 0 are discarded.
+    bool transparent = true;
+};
+
+/// How the edges of shadows are smoothed. From cheapest to most expensive.
+enum class ShadowFilter : u32 {
+    /// Use the filter set with Renderer::set_shadow_filter(). Only valid for lights.
+    renderer_default,
+    /// No shadows at all. The light goes through everything.
+    off,
+    /// A single lookup, filtered by the hardware between the 4 nearest texels (2x2 PCF).
+    hardware_pcf,
+    /// 4 lookups in a Poisson disk rotated on every pixel.
+    poisson_4,
+    /// 8 lookups in a Poisson disk rotated on every pixel.
+    poisson_8,
+    /// 25 lookups in a 5x5 grid. The smoothest one.
+    grid_25,
 };
 
 struct Light {
+    ShadowFilter shadow_filter = ShadowFilter::renderer_default;
+
 private:
     friend class Renderer;
     /// The position within the light atlas, in UV coordinates.
@@ -264,6 +343,38 @@ struct PointLight : Light {
     float intensity;
 };
 
+/// What the last call to Renderer::draw() did.
+struct FrameStats {
+    /// Commands in the DrawCmdList.
+    usize commands = 0;
+    /// Commands that weren't drawn because their mesh was completely outside the camera view.
+    usize culled_commands = 0;
+    /// Commands drawn into the shadow maps, adding up all the lights.
+    usize shadow_draws = 0;
+    /// Shadow casters that weren't drawn into the shadow map of a light because they were outside
+    /// of its volume, adding up all the lights.
+    usize culled_shadow_draws = 0;
+    /// Tiles of the shadow atlas (One per light that got one) that were drawn again.
+    usize shadow_tiles_drawn = 0;
+    /// Tiles of the shadow atlas that kept their contents from previous frames, because neither
+    /// their light nor their casters changed (Or because of the refresh budget).
+    usize shadow_tiles_cached = 0;
+    /// Tiles the screen was split into for lighting. Each one only runs the point lights that
+    /// overlap it.
+    usize light_tiles = 0;
+    /// Point lights listed in the light tiles, adding up all of them.
+    usize tiled_point_lights = 0;
+    /// Times a command of the color pass used a different shader, texture or vertex buffer than
+    /// the one drawn before it. Commands are sorted to keep these low.
+    usize shader_switches = 0;
+    usize texture_switches = 0;
+    usize mesh_buffer_switches = 0;
+    /// Binds, uniform uploads and push constants of Renderer::draw() that were sent to the GPU
+    /// driver, and the ones that were skipped because they matched the state already set.
+    usize state_changes_issued = 0;
+    usize state_changes_elided = 0;
+};
+
 struct DrawCmdList {
     Camera camera;
     std::vector<DrawCmd> commands;
@@ -272,8 +383,57 @@ struct DrawCmdList {
     Color ambient_light_color = colors::black;
 };
 
+class MeshRegionWriter;
+
+namespace common {
+/// Splits the space for the sum of piece_counts quads starting at begin into one writer per
+/// element, in order. See common::reserve_regions() in renderer/common/mesh_kernels.hpp.
+std::vector<MeshRegionWriter> make_region_writers(float* begin,
+                                                  std::vector<usize> const& piece_counts);
+} // namespace common
+
+/// Writes sprites into a region of a mesh reserved with MeshBuilder::reserve_regions(). Each writer
+/// owns its region exclusively, so different writers can be used from different threads at once.
+class MeshRegionWriter {
+public:
+    MeshRegionWriter() = default;
+
+    /// Same as MeshBuilder::add_sprite(). The region must have space left for all the pieces of
+    /// the sprite.
+    void add_sprite(sprites::Sprite const& spr,
+                    anton::math::Vector3 offset,
+                    float vertical_slope = 0,
+                    float horizontal_slope = 0,
+                    float z_min = std::numeric_limits<float>::min(),
+                    float z_max = std::numeric_limits<float>::max());
+
+    /// Fills the rest of the region with degenerate quads, which are never rasterized. Must be
+    /// called if fewer pieces than the ones reserved were written.
+    void fill_remaining();
+
+    /// How many more sprite pieces fit in this region.
+    [[nodiscard]] usize remaining_pieces() const;
+
+private:
+    friend std::vector<MeshRegionWriter> common::make_region_writers(float*,
+                                                                     std::vector<usize> const&);
+    MeshRegionWriter(float* region_begin, float* region_end);
+
+    float* cursor = nullptr;
+    float* end = nullptr;
+};
+
 class MeshBuilder {
 public:
+    /// Result of finish_async().
+    struct AsyncMesh {
+        MeshHandle mesh;
+        /// Becomes ready once the mesh data is in GPU memory. Until then, draw commands that use
+        /// the mesh are skipped. The renderer checks for finished uploads when drawing a frame, so
+        /// don't wait on this from the thread that draws.
+        std::shared_future<void> ready;
+    };
+
     MeshBuilder();
     ~MeshBuilder();
     MeshBuilder(MeshBuilder const&);
@@ -292,11 +452,35 @@ public:
                     float horizontal_slope = 0,
                     float z_min = std::numeric_limits<float>::min(),
                     float z_max = std::numeric_limits<float>::max());
+    /// Same as add_sprite(), but the source of each piece is repeated across its destination,
+    /// repeat.x times horizontally and repeat.y times vertically, so a single quad can cover an
+    /// area made of many identical tiles. Works with any source rect, not only whole textures.
+    void add_repeating_sprite(sprites::Sprite const& spr,
+                              anton::math::Vector2 repeat,
+                              anton::math::Vector3 offset,
+                              float vertical_slope = 0,
+                              float horizontal_slope = 0,
+                              float z_min = std::numeric_limits<float>::min(),
+                              float z_max = std::numeric_limits<float>::max());
+
+    /// Reserves one contiguous region of the mesh per element of piece_counts, each one with space
+    /// for that many sprite pieces, placed in order after the data added until now. Returns a
+    /// writer for each region. Writers can be used in parallel, but they are invalidated by any
+    /// other call to this builder, so all of them must be done before calling finish().
+    [[nodiscard]] std::vector<MeshRegionWriter>
+    reserve_regions(std::vector<usize> const& piece_counts);
 
     /// Returns a mesh with the data added until now and resets the meshbuilder's internal state.
     [[nodiscard]] MeshHandle finish() const;
+    /// Same as finish(), but doesn't wait for the mesh data to reach the GPU, so it never stalls
+    /// rendering. Useful for streaming meshes in while the game is running.
+    [[nodiscard]] AsyncMesh finish_async() const;
+    /// Same as finish(), but the mesh can be modified later on (See DynMeshHandle).
+    [[nodiscard]] DynMeshHandle finish_dynamic() const;
 
 private:
+    friend class DynMeshHandle;
+
     struct impl;
     std::unique_ptr<impl> p_impl;
 };
@@ -320,11 +504,34 @@ public:
     explicit Renderer(windowing::WindowHandle result);
     ~Renderer();
 
+    /// Draws a list of commands. Commands whose mesh is completely outside the camera view are
+    /// skipped, so the cost of big lists mostly depends on how much of them is visible.
     void draw(DrawCmdList const& commands, Framebuffer const& output_fb);
+    [[nodiscard]] FrameStats const& frame_stats() const;
     void clear(Framebuffer& fb, anton::math::Vector4 color);
 
     void set_shadow_resolution(u32 width, u32 height);
     [[nodiscard]] anton::math::Vector2 get_shadow_resolution() const;
+    /// The shadow map of a light is only drawn again when the light or its casters change. This
+    /// limits how many outdated shadow maps are drawn per frame, the rest keep their old contents
+    /// for a few more frames. 0 (The default) means no limit.
+    void set_shadow_refresh_budget(u32 tiles);
+    /// Draws every shadow map again in the next frame. Needed after changing the pixels of a
+    /// texture used by shadow casters, which isn't noticed otherwise.
+    void invalidate_shadows();
+    /// The filter used by lights whose shadow_filter is ShadowFilter::renderer_default.
+    /// ShadowFilter::grid_25 by default.
+    void set_shadow_filter(ShadowFilter filter);
+    [[nodiscard]] ShadowFilter get_shadow_filter() const;
+    /// By default (Divisor 1) the lit shader lights every fragment it draws, including the ones
+    /// drawn over later, running every light that reaches them. With a bigger divisor, lighting is
+    /// computed once per frame into a light buffer that many times smaller on each side, only for
+    /// the surfaces in front, and the lit shader reads it with a single bilinear lookup. Much
+    /// cheaper with many lights or lots of overdraw, but lighting gets blurrier.
+    /// Only the OpenGL backend has light buffers for now. The Vulkan one always lights every
+    /// fragment, and asserts that the divisor is 1.
+    void set_light_buffer_divisor(u32 divisor);
+    [[nodiscard]] u32 get_light_buffer_divisor() const;
     void set_palette(ColorPalette const&);
 
     // Returns the default lit shader. The handle will be valid until the renderer
@@ -345,6 +552,7 @@ public:
 private:
     friend class TextureHandle;
     friend class MeshHandle;
+    friend class DynMeshHandle;
     friend class MeshBuilder;
 
     windowing::WindowHandle window;
@@ -354,8 +562,6 @@ private:
 
 } // namespace aryibi::renderer
 
-#include <functional>
-
 namespace std {
 
 template<> struct hash<aryibi::renderer::TextureHandle> {
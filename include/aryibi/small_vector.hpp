@@ -0,0 +1,158 @@
+#ifndef ARYIBI_SMALL_VECTOR_HPP
+#define ARYIBI_SMALL_VECTOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace aryibi {
+
+/// A vector that stores up to N elements inline before falling back to the heap. Meant for the
+/// many tiny arrays (like sprite pieces) that would otherwise need a heap allocation each.
+/// Only trivially copyable types are supported, since elements are moved around with memcpy.
+/// Shrinking never frees memory, so a SmallVector that is reused doesn't allocate again once it's
+/// big enough.
+template<typename T, std::size_t N> class SmallVector {
+    static_assert(std::is_trivially_copyable_v<T>, "SmallVector only supports trivially copyable "
+                                                   "types");
+    static_assert(N > 0, "SmallVector must have some inline capacity");
+
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector() = default;
+    SmallVector(std::initializer_list<T> list) { assign(list.begin(), list.end()); }
+    SmallVector(SmallVector const& other) { assign(other.begin(), other.end()); }
+    SmallVector(SmallVector&& other) noexcept { steal(other); }
+    ~SmallVector() { free_heap(); }
+
+    SmallVector& operator=(SmallVector const& other) {
+        if (this != &other)
+            assign(other.begin(), other.end());
+        return *this;
+    }
+    SmallVector& operator=(SmallVector&& other) noexcept {
+        if (this != &other) {
+            free_heap();
+            steal(other);
+        }
+        return *this;
+    }
+
+    void assign(const T* first, const T* last) {
+        const size_type count = static_cast<size_type>(last - first);
+        reserve(count);
+        if (count > 0)
+            std::memcpy(static_cast<void*>(data_ptr), first, count * sizeof(T));
+        element_count = count;
+    }
+
+    void reserve(size_type new_capacity) {
+        if (new_capacity <= element_capacity)
+            return;
+        void* memory = std::malloc(new_capacity * sizeof(T));
+        if (memory == nullptr)
+            throw std::bad_alloc();
+        T* new_data = static_cast<T*>(memory);
+        if (element_count > 0)
+            std::memcpy(static_cast<void*>(new_data), data_ptr, element_count * sizeof(T));
+        free_heap();
+        data_ptr = new_data;
+        element_capacity = new_capacity;
+    }
+
+    /// New elements are value-initialized.
+    void resize(size_type new_size) {
+        if (new_size > element_count) {
+            grow_to(new_size);
+            std::fill(data_ptr + element_count, data_ptr + new_size, T{});
+        }
+        element_count = new_size;
+    }
+
+    void push_back(T const& value) {
+        if (element_count == element_capacity) {
+            // The value could be inside of this vector, so copy it before reallocating.
+            const T copy = value;
+            grow_to(element_count + 1);
+            data_ptr[element_count++] = copy;
+            return;
+        }
+        data_ptr[element_count++] = value;
+    }
+    template<typename... Args> T& emplace_back(Args&&... args) {
+        push_back(T{std::forward<Args>(args)...});
+        return back();
+    }
+    void pop_back() { --element_count; }
+    void clear() { element_count = 0; }
+
+    [[nodiscard]] T* data() { return data_ptr; }
+    [[nodiscard]] const T* data() const { return data_ptr; }
+    [[nodiscard]] size_type size() const { return element_count; }
+    [[nodiscard]] size_type capacity() const { return element_capacity; }
+    [[nodiscard]] bool empty() const { return element_count == 0; }
+    /// @returns Whether the elements are stored inline (No heap allocation was needed).
+    [[nodiscard]] bool is_inline() const { return data_ptr == inline_data(); }
+
+    T& operator[](size_type i) { return data_ptr[i]; }
+    T const& operator[](size_type i) const { return data_ptr[i]; }
+    T& front() { return data_ptr[0]; }
+    T const& front() const { return data_ptr[0]; }
+    T& back() { return data_ptr[element_count - 1]; }
+    T const& back() const { return data_ptr[element_count - 1]; }
+
+    iterator begin() { return data_ptr; }
+    iterator end() { return data_ptr + element_count; }
+    const_iterator begin() const { return data_ptr; }
+    const_iterator end() const { return data_ptr + element_count; }
+
+private:
+    T* inline_data() { return reinterpret_cast<T*>(inline_storage); }
+    const T* inline_data() const { return reinterpret_cast<const T*>(inline_storage); }
+
+    void grow_to(size_type min_capacity) {
+        if (min_capacity > element_capacity)
+            reserve(std::max(min_capacity, element_capacity * 2));
+    }
+    void free_heap() {
+        if (!is_inline())
+            std::free(data_ptr);
+        data_ptr = inline_data();
+        element_capacity = N;
+    }
+    /// Takes the contents of other, leaving it empty. This vector must not own heap memory.
+    void steal(SmallVector& other) {
+        if (other.is_inline()) {
+            if (other.element_count > 0)
+                std::memcpy(static_cast<void*>(inline_data()), other.data_ptr,
+                            other.element_count * sizeof(T));
+            data_ptr = inline_data();
+            element_capacity = N;
+        } else {
+            data_ptr = other.data_ptr;
+            element_capacity = other.element_capacity;
+            other.data_ptr = other.inline_data();
+            other.element_capacity = N;
+        }
+        element_count = other.element_count;
+        other.element_count = 0;
+    }
+
+    alignas(T) unsigned char inline_storage[N * sizeof(T)];
+    T* data_ptr = inline_data();
+    size_type element_count = 0;
+    size_type element_capacity = N;
+};
+
+} // namespace aryibi
+
+#endif // ARYIBI_SMALL_VECTOR_HPP
@@ -0,0 +1,101 @@
+#ifndef ARYIBI_SPRITE_ANIMATION_HPP
+#define ARYIBI_SPRITE_ANIMATION_HPP
+
+#include "aryibi/sprites.hpp"
+
+#include <array>
+#include <vector>
+
+namespace aryibi::sprites {
+
+/// An animated 4 or 8-directional sprite sheet. The pieces of every direction and frame are
+/// computed once on creation, so getting the current frame is just a table lookup.
+/// The sheet must have directions along one axis (In the same order as solve_8_directional() or
+/// solve_4_directional() expect them) and animation frames along the other one.
+class SpriteSheetAnimation {
+public:
+    struct Settings {
+        /// Can be 4 or 8.
+        anton::u32 direction_count = 8;
+        anton::u32 frame_count = 1;
+        /// If true, directions are laid out along the X axis (columns) and frames along the Y
+        /// axis (rows). Otherwise it's the other way around. Unlike the directional solvers, this
+        /// isn't guessed from the size of the texture.
+        bool directions_horizontal = true;
+        /// Seconds each frame lasts.
+        float frame_duration = 0.1f;
+        anton::math::Vector2 target_size = {1, 1};
+    };
+
+    SpriteSheetAnimation() = default;
+    SpriteSheetAnimation(TextureChunk const&, Settings const&);
+
+    /// @returns The piece to draw for a direction at a given time since the animation started.
+    /// The animation loops.
+    [[nodiscard]] Sprite::Piece const& frame(direction::Direction dir, float time) const {
+        return frame_at(dir, frame_index(time));
+    }
+    /// @returns The piece to draw for a direction and frame index.
+    [[nodiscard]] Sprite::Piece const& frame_at(direction::Direction dir,
+                                                anton::u32 frame) const {
+        return pieces[direction_rows[dir & 0xFu] * settings.frame_count + frame];
+    }
+    /// @returns The frame index that should be shown at a given time.
+    [[nodiscard]] anton::u32 frame_index(float time) const;
+    /// Overwrites a sprite with the given frame. Doesn't allocate if the sprite is reused.
+    void write_frame(direction::Direction dir, float time, Sprite& out) const;
+
+    [[nodiscard]] renderer::TextureHandle const& texture() const { return tex; }
+    [[nodiscard]] Settings const& get_settings() const { return settings; }
+    /// @returns How long a full loop of the animation takes, in seconds.
+    [[nodiscard]] float duration() const {
+        return settings.frame_duration * static_cast<float>(settings.frame_count);
+    }
+
+private:
+    renderer::TextureHandle tex;
+    Settings settings;
+    /// Maps every Direction value to the index of its row (Or column) in the sheet.
+    std::array<anton::u8, 16> direction_rows{};
+    /// Indexed by direction row * frame_count + frame.
+    std::vector<Sprite::Piece> pieces;
+};
+
+/// Animates many sprites at once. Animator state is stored as a structure of arrays, so advancing
+/// thousands of animators is a tight loop over a few contiguous arrays.
+class SpriteAnimatorGroup {
+public:
+    using AnimatorID = anton::u32;
+
+    /// Adds an animator. The animation must outlive this group.
+    AnimatorID add(SpriteSheetAnimation const&, direction::Direction dir, float speed = 1.f);
+    void clear();
+    [[nodiscard]] std::size_t size() const { return times.size(); }
+
+    /// Advances every animator by dt seconds, scaled by its speed.
+    void advance(float dt);
+
+    void set_direction(AnimatorID id, direction::Direction dir) { directions[id] = dir; }
+    void set_speed(AnimatorID id, float speed) { speeds[id] = speed; }
+    void restart(AnimatorID id) { times[id] = 0; }
+
+    /// @returns The piece that an animator should currently show.
+    [[nodiscard]] Sprite::Piece const& current_piece(AnimatorID id) const {
+        return animations[id]->frame(directions[id], times[id]);
+    }
+    /// Writes the current piece of every animator to out, in order. out must have space for
+    /// size() pieces.
+    void current_pieces(Sprite::Piece* out) const;
+
+private:
+    std::vector<float> times;
+    std::vector<float> speeds;
+    /// Cached SpriteSheetAnimation::duration() of each animator, used to wrap times around.
+    std::vector<float> durations;
+    std::vector<direction::Direction> directions;
+    std::vector<SpriteSheetAnimation const*> animations;
+};
+
+} // namespace aryibi::sprites
+
+#endif // ARYIBI_SPRITE_ANIMATION_HPP
@@ -0,0 +1,99 @@
+#ifndef ARYIBI_SPRITE_CACHE_HPP
+#define ARYIBI_SPRITE_CACHE_HPP
+
+#include "aryibi/sprites.hpp"
+
+#include <memory>
+#include <unordered_map>
+
+namespace aryibi::sprites {
+
+/// Interns the results of the sprite solvers. Solving the same chunk with the same parameters
+/// twice returns the same sprite instead of solving it again, which is useful when thousands of
+/// entities and tiles share only a handful of distinct sprites.
+/// Sprites are keyed by solver, texture, chunk rect and solver parameters (direction, connection
+/// mask and/or target size).
+class SpriteCache {
+public:
+    /// An immutable, shared reference to a cached sprite. Stays valid even after the sprite is
+    /// evicted from the cache.
+    using SpriteRef = std::shared_ptr<const Sprite>;
+
+    struct Stats {
+        anton::u64 hits = 0;
+        anton::u64 misses = 0;
+        /// How many sprites are currently cached.
+        std::size_t entries = 0;
+        /// Approximate amount of memory used by the cache, in bytes.
+        std::size_t memory_used = 0;
+
+        /// @returns The fraction of lookups that were hits, or 0 if there were no lookups.
+        [[nodiscard]] float hit_rate() const {
+            const anton::u64 lookups = hits + misses;
+            return lookups == 0 ? 0.f : static_cast<float>(hits) / static_cast<float>(lookups);
+        }
+    };
+
+    /// Cached version of solve_8_directional().
+    SpriteRef
+    get_8_directional(TextureChunk const&, direction::Direction, anton::math::Vector2 target_size);
+    /// Cached version of solve_4_directional().
+    SpriteRef
+    get_4_directional(TextureChunk const&, direction::Direction, anton::math::Vector2 target_size);
+    /// Cached version of solve_normal().
+    SpriteRef get_normal(TextureChunk const&, anton::math::Vector2 target_size);
+    /// Cached version of solve_rpgmaker_a2().
+    SpriteRef get_rpgmaker_a2(TextureChunk const&, anton::u8 connection_mask);
+    SpriteRef get_rpgmaker_a2(TextureChunk const&, Tile8Connections const&);
+    /// Cached version of solve_rpgmaker_a4_wall().
+    SpriteRef get_rpgmaker_a4_wall(TextureChunk const&, anton::u8 connection_mask);
+    SpriteRef get_rpgmaker_a4_wall(TextureChunk const&, Tile4Connections const&);
+
+    /// Removes every sprite that uses the given texture. Call this BEFORE unloading the texture:
+    /// Texture IDs may be reused by new textures after that, so stale sprites could be returned
+    /// for them.
+    void invalidate(renderer::TextureHandle const&);
+    /// Removes every sprite from the cache. Doesn't reset the hit/miss counters.
+    void clear();
+
+    [[nodiscard]] Stats stats() const;
+    void reset_stats();
+
+private:
+    enum class Solver : anton::u8 {
+        directional_8,
+        directional_4,
+        normal,
+        rpgmaker_a2,
+        rpgmaker_a4_wall
+    };
+    struct Key {
+        Solver solver;
+        /// Direction or connection mask, depending on the solver.
+        anton::u8 parameter;
+        std::size_t texture;
+        Rect2D rect;
+        anton::math::Vector2 target_size;
+
+        bool operator==(Key const&) const;
+    };
+    struct KeyHash {
+        std::size_t operator()(Key const&) const;
+    };
+
+    template<typename F> SpriteRef get_or_solve(Key const&, F&& solve);
+    static Key make_key(Solver,
+                        TextureChunk const&,
+                        anton::u8 parameter,
+                        anton::math::Vector2 target_size);
+
+    std::unordered_map<Key, SpriteRef, KeyHash> sprites;
+    anton::u64 hits = 0;
+    anton::u64 misses = 0;
+    /// Bytes allocated by the cached sprites' piece containers beyond their inline storage.
+    std::size_t piece_heap_memory = 0;
+};
+
+} // namespace aryibi::sprites
+
+#endif // ARYIBI_SPRITE_CACHE_HPP
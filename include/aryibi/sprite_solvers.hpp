@@ -10,6 +10,12 @@ namespace aryibi::sprites {
 /// The sprites must be in this order (left to right or up to down)
 /// down, down_right, right, up_right, up, up_left, left, down_left
 Sprite solve_8_directional(TextureChunk const&, direction::Direction dir, anton::math::Vector2 target_size);
+/// Same as above, but overwrites an existing sprite instead. Reusing a sprite this way doesn't
+/// allocate any memory, which makes it the preferred option for sprites solved every frame.
+void solve_8_directional(TextureChunk const&,
+                         direction::Direction dir,
+                         anton::math::Vector2 target_size,
+                         Sprite& out);
 
 /// Solves a 4-directional sprite atlas contained in a texture chunk.
 /// Accepts both horizontally and vertically-stored sprite atlases.
@@ -17,20 +23,76 @@ Sprite solve_8_directional(TextureChunk const&, direction::Direction dir, anton:
 /// The sprites must be in this order (left to right or up to down)
 /// down, right, up, left
 Sprite solve_4_directional(TextureChunk const&, direction::Direction dir, anton::math::Vector2 target_size);
+/// Same as above, but overwrites an existing sprite instead (See solve_8_directional()).
+void solve_4_directional(TextureChunk const&,
+                         direction::Direction dir,
+                         anton::math::Vector2 target_size,
+                         Sprite& out);
 
 /// Solves a normal tile from a TextureChunk, which literally means "copy the data from this
 /// TextureChunk to a Sprite".
 Sprite solve_normal(TextureChunk const&, anton::math::Vector2 target_size);
+/// Same as above, but overwrites an existing sprite instead (See solve_8_directional()).
+void solve_normal(TextureChunk const&, anton::math::Vector2 target_size, Sprite& out);
 
 /// Solves a RPGMaker A2 autotile from a set of 8 connections (Depicting what the tile is connected
 /// to).
 Sprite solve_rpgmaker_a2(TextureChunk const&, Tile8Connections const& connections);
 
+/// Same as above, but takes the connections as a mask (See Tile8Connections::mask()). The
+/// minitiles for every possible mask are precomputed at compile time, so this is just a table
+/// lookup.
+Sprite solve_rpgmaker_a2(TextureChunk const&, anton::u8 connection_mask);
+/// Same as above, but overwrites an existing sprite instead (See solve_8_directional()).
+void solve_rpgmaker_a2(TextureChunk const&, anton::u8 connection_mask, Sprite& out);
+
 /// Solves a RPGMaker A4 wall autotile from a set of 4 connections (Depicting what the tile is
 /// connected to). RPGMaker A4 walls only work with CONVEX shapes, so trying to do an inner corner
 /// will result in a broken autotile.
 Sprite solve_rpgmaker_a4_wall(TextureChunk const&, Tile4Connections const& connections);
 
+/// Same as above, but takes the connections as a mask (See Tile4Connections::mask()). Like the A2
+/// solver, this is just a lookup into a table precomputed at compile time.
+Sprite solve_rpgmaker_a4_wall(TextureChunk const&, anton::u8 connection_mask);
+/// Same as above, but overwrites an existing sprite instead (See solve_8_directional()).
+void solve_rpgmaker_a4_wall(TextureChunk const&, anton::u8 connection_mask, Sprite& out);
+
+/// Calculates the connection mask (See Tile8Connections::mask()) of every tile inside a rect of a
+/// grid. The masks are written to out_masks[x + y * grid.width], so out_masks must be as big as the
+/// grid. Entries outside of the rect are left untouched.
+void compute_tile8_masks(TileIDGrid const& grid, TileRect rect, anton::u8* out_masks);
+
+/// Solves every tile of a grid as a RPGMaker A2 autotile in a single call.
+/// @param chunks The autotile chunk of each tile ID (chunks[id]). Tiles whose ID is out of range
+/// are considered empty and get zero-sized pieces.
+/// @param out_pieces Where to write the pieces. Each tile has 4 pieces, which are written to
+/// out_pieces[(x + y * grid.width) * 4 ...]. Their destinations are already offset by the tile
+/// position, so the buffer can be added to a mesh as is.
+void solve_rpgmaker_a2_grid(TileIDGrid const& grid,
+                            std::vector<TextureChunk> const& chunks,
+                            Sprite::Piece* out_pieces);
+
+/// Same as the full grid version, but only re-solves the tiles inside a dirty rect plus a one
+/// tile border around it, which are all the tiles whose connections may have changed after
+/// editing the tiles inside the rect.
+void solve_rpgmaker_a2_grid(TileIDGrid const& grid,
+                            std::vector<TextureChunk> const& chunks,
+                            TileRect dirty,
+                            Sprite::Piece* out_pieces);
+
+/// Solves every tile of a grid as a RPGMaker A4 wall autotile in a single call. Works exactly like
+/// solve_rpgmaker_a2_grid(), except that diagonal connections are ignored.
+void solve_rpgmaker_a4_wall_grid(TileIDGrid const& grid,
+                                 std::vector<TextureChunk> const& chunks,
+                                 Sprite::Piece* out_pieces);
+
+/// Same as the full grid version, but only re-solves the tiles inside a dirty rect plus a one
+/// tile border around it.
+void solve_rpgmaker_a4_wall_grid(TileIDGrid const& grid,
+                                 std::vector<TextureChunk> const& chunks,
+                                 TileRect dirty,
+                                 Sprite::Piece* out_pieces);
+
 } // namespace aryibi::sprites
 
 #endif // ARYIBI_SPRITE_SOLVERS_HPP
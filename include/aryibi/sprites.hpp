@@ -2,6 +2,7 @@
 #define ARYIBI_SPRITES_HPP
 
 #include "aryibi/renderer.hpp"
+#include "aryibi/small_vector.hpp"
 #include <anton/math/math.hpp>
 
 namespace aryibi::sprites {
@@ -39,15 +40,21 @@ struct TextureChunk {
 };
 
 struct Sprite {
-    /// Texture of the sprite.
-    renderer::TextureHandle texture;
     struct Piece {
         /// Where this piece is gathering texture data from, in UV coordinates.
         Rect2D source;
         /// The destination of the source texture. Measured in tiles.
         Rect2D destination;
     };
-    using PieceContainer = std::vector<Piece>;
+    /// Most sprites have between 1 and 4 pieces, so they are stored inline and creating a sprite
+    /// doesn't need a heap allocation.
+    using PieceContainer = SmallVector<Piece, 4>;
+
+    Sprite() = default;
+    Sprite(renderer::TextureHandle const& texture, PieceContainer pieces);
+
+    /// Texture of the sprite.
+    renderer::TextureHandle texture;
     /// The "pieces" that make up this sprite. A sprite is basically a puzzle of different pieces,
     /// each one having its own texture UV source and destination rect.
     PieceContainer pieces;
@@ -64,10 +71,39 @@ struct Sprite {
 struct Tile8Connections {
     bool down = false, down_right = false, right = false, up_right = false, up = false,
          up_left = false, left = false, down_left = false;
+
+    /// Packs the connections into a bitmask, one bit per member in declaration order (down is
+    /// bit 0, down_left is bit 7).
+    [[nodiscard]] anton::u8 mask() const;
+    /// Unpacks a bitmask created by mask().
+    static Tile8Connections from_mask(anton::u8 mask);
 };
 /// Needed for some of the solvers.
 struct Tile4Connections {
     bool down = false, right = false, up = false, left = false;
+
+    /// Packs the connections into a bitmask, one bit per member in declaration order (down is
+    /// bit 0, left is bit 3).
+    [[nodiscard]] anton::u8 mask() const;
+    /// Unpacks a bitmask created by mask().
+    static Tile4Connections from_mask(anton::u8 mask);
+};
+
+/// A non-owning view over a row-major grid of tile IDs, used by the grid solvers. Row 0 is the
+/// bottom row, so the "up" neighbour of the tile at (x, y) is the one at (x, y + 1). Two tiles are
+/// connected if they have the same ID. Tiles outside of the grid are never connected.
+struct TileIDGrid {
+    const anton::u32* ids = nullptr;
+    anton::u32 width = 0;
+    anton::u32 height = 0;
+
+    [[nodiscard]] anton::u32 at(anton::u32 x, anton::u32 y) const { return ids[x + y * width]; }
+};
+
+/// A rect of tiles inside a TileIDGrid, measured in tiles.
+struct TileRect {
+    anton::u32 x = 0, y = 0;
+    anton::u32 width = 0, height = 0;
 };
 
 } // namespace aryibi::sprites
@@ -0,0 +1,100 @@
+#ifndef ARYIBI_TEXTURE_ATLAS_HPP
+#define ARYIBI_TEXTURE_ATLAS_HPP
+
+#include "aryibi/sprites.hpp"
+
+#include <vector>
+
+namespace aryibi::sprites {
+
+class TextureAtlas;
+
+/// Packs many images into a few big textures (pages), so that sprites coming from different
+/// tilesets or character sheets can be drawn without rebinding textures. Images are placed with a
+/// skyline bottom-left packer, tallest first.
+/// Usage: Add every image with add_image() (keeping the IDs returned), call build() once and then
+/// use TextureAtlas::chunk() to get the TextureChunks to pass to the solvers.
+class TextureAtlasBuilder {
+public:
+    using ImageID = anton::u32;
+
+    struct Settings {
+        anton::u32 page_width = 2048;
+        anton::u32 page_height = 2048;
+        /// Empty pixels to leave around each image, to avoid texture bleeding when sampling near
+        /// the edges of an image.
+        anton::u32 padding = 2;
+        /// Fill the padding of each image with copies of its edge pixels instead of leaving it
+        /// transparent. Prevents seams when using linear filtering.
+        bool extrude_edges = true;
+        /// Color type of the images and the pages. Can be rgba (4 bytes per pixel) or
+        /// indexed_palette (2 bytes per pixel).
+        renderer::TextureHandle::ColorType color_type = renderer::TextureHandle::ColorType::rgba;
+        renderer::TextureHandle::FilteringMethod filter =
+            renderer::TextureHandle::FilteringMethod::point;
+    };
+
+    TextureAtlasBuilder() = default;
+    explicit TextureAtlasBuilder(Settings const&);
+
+    /// Adds an image to the atlas. The data is copied, so it can be freed right after calling
+    /// this.
+    /// @param data Pixels of the image, in the color type given in the settings.
+    /// @throws std::runtime_error If the image doesn't fit in a page (Including its padding).
+    ImageID add_image(anton::u32 width, anton::u32 height, const void* data);
+    /// Adds only a part of an image to the atlas. Useful for packing individual texture chunks
+    /// out of a bigger image. TextureAtlas::chunk() will be relative to this region.
+    /// @param region The region of the image to add, in UV coordinates.
+    /// @throws std::runtime_error If the region doesn't fit in a page (Including its padding).
+    ImageID add_image_region(anton::u32 width, anton::u32 height, const void* data, Rect2D region);
+
+    /// Packs every image added and uploads the resulting pages to the GPU.
+    [[nodiscard]] TextureAtlas build() const;
+
+private:
+    struct Image {
+        anton::u32 width;
+        anton::u32 height;
+        std::vector<anton::u8> pixels;
+    };
+
+    [[nodiscard]] anton::u32 bytes_per_pixel() const;
+
+    Settings settings;
+    std::vector<Image> images;
+};
+
+/// The result of TextureAtlasBuilder::build().
+class TextureAtlas {
+public:
+    /// Where an image was placed inside the atlas.
+    struct Placement {
+        anton::u32 page = 0;
+        /// UV rect of the image inside the page.
+        Rect2D rect;
+    };
+
+    /// @returns A chunk containing the whole image.
+    [[nodiscard]] TextureChunk chunk(TextureAtlasBuilder::ImageID) const;
+    /// Remaps a rect of an image to the atlas.
+    /// @param rect The rect to remap, in UV coordinates relative to the original image.
+    [[nodiscard]] TextureChunk chunk(TextureAtlasBuilder::ImageID, Rect2D const& rect) const;
+
+    [[nodiscard]] std::vector<renderer::TextureHandle> const& pages() const { return page_list; }
+    [[nodiscard]] Placement const& placement(TextureAtlasBuilder::ImageID id) const {
+        return placements[id];
+    }
+
+    /// Unloads all the pages of the atlas. Just like with textures, this must be done manually.
+    void unload();
+
+private:
+    friend class TextureAtlasBuilder;
+
+    std::vector<renderer::TextureHandle> page_list;
+    std::vector<Placement> placements;
+};
+
+} // namespace aryibi::sprites
+
+#endif // ARYIBI_TEXTURE_ATLAS_HPP
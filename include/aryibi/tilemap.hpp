@@ -0,0 +1,122 @@
+#ifndef ARYIBI_TILEMAP_HPP
+#define ARYIBI_TILEMAP_HPP
+
+#include "aryibi/renderer.hpp"
+#include "aryibi/sprites.hpp"
+
+#include <limits>
+#include <vector>
+
+namespace aryibi::tilemap {
+
+/// How the sprite of a tile is solved.
+enum class TileKind : anton::u8 {
+    /// See sprites::solve_normal().
+    normal,
+    /// See sprites::solve_rpgmaker_a2(). Connects to neighbouring tiles with the same ID.
+    rpgmaker_a2,
+    /// See sprites::solve_rpgmaker_a4_wall(). Connects to neighbouring tiles with the same ID.
+    rpgmaker_a4_wall
+};
+
+struct TileType {
+    sprites::TextureChunk chunk;
+    TileKind kind = TileKind::normal;
+};
+
+/// A grid of tiles that is split into fixed-size square chunks, each one with its own mesh.
+/// Editing tiles only marks the affected chunks as dirty, and rebuild_dirty() rebuilds their meshes
+/// later on, so editing a single tile never requires rebuilding the whole layer.
+/// Tiles are 1x1 tile units big, and row 0 is the bottom row (Like sprites::TileIDGrid).
+class TileMapLayer {
+public:
+    /// Tile IDs that aren't a valid index into Settings::tile_types are empty.
+    static constexpr anton::u32 empty_tile = std::numeric_limits<anton::u32>::max();
+
+    struct Settings {
+        /// Size of the layer, in tiles.
+        anton::u32 width = 0;
+        anton::u32 height = 0;
+        /// Size of each side of a chunk, in tiles.
+        anton::u32 chunk_size = 32;
+        /// The texture all the tile types belong to. Every chunk is drawn with it.
+        renderer::TextureHandle texture;
+        /// The tile types, indexed by tile ID.
+        std::vector<TileType> tile_types;
+        /// Merge rectangles of identical normal tiles into a single quad that repeats the tile
+        /// (See renderer::MeshBuilder::add_repeating_sprite()), which greatly reduces the vertex
+        /// count of big uniform areas (Water, grass...). Autotiles are left as is.
+        bool merge_repeating_tiles = false;
+    };
+
+    struct Chunk {
+        /// Only valid if has_mesh is true.
+        renderer::MeshHandle mesh;
+        /// False if the chunk has no tiles, or if it has never been built.
+        bool has_mesh = false;
+        /// Where the chunk is placed relative to the layer. The mesh vertices are relative to this
+        /// position, which keeps their values small no matter how big the layer is.
+        anton::math::Vector3 position;
+        /// The area covered by the chunk, relative to the layer, in tile units.
+        sprites::Rect2D bounds;
+        bool dirty = true;
+    };
+
+    /// Creates a layer full of empty tiles. Every chunk starts dirty.
+    explicit TileMapLayer(Settings const&);
+    /// The TileMapLayer destructor won't unload the chunk meshes. Use unload() for that.
+    ~TileMapLayer() = default;
+
+    [[nodiscard]] anton::u32 tile(anton::u32 x, anton::u32 y) const;
+    /// Changes a tile and marks every chunk whose mesh may change because of it as dirty. Since
+    /// autotiles depend on their neighbours, this includes the chunks on the other side of a border
+    /// if the tile lies on one.
+    void set_tile(anton::u32 x, anton::u32 y, anton::u32 id);
+    /// Same as calling set_tile() for every tile inside a rect, but faster.
+    void fill(sprites::TileRect rect, anton::u32 id);
+
+    /// Rebuilds the meshes of up to max_chunks dirty chunks, in the order they were marked as
+    /// dirty. Use a small budget to spread the cost of big edits across several frames.
+    /// @returns How many chunks were rebuilt.
+    std::size_t rebuild_dirty(std::size_t max_chunks = std::numeric_limits<std::size_t>::max());
+    [[nodiscard]] std::size_t dirty_chunk_count() const { return dirty_chunks.size(); }
+
+    /// Appends a draw command for every chunk that has a mesh.
+    /// @param position Where to place the layer.
+    void add_draw_commands(renderer::DrawCmdList& commands,
+                           renderer::ShaderHandle const& shader,
+                           anton::math::Vector3 position,
+                           bool cast_shadows = false) const;
+
+    [[nodiscard]] std::vector<Chunk> const& chunks() const { return chunk_list; }
+    [[nodiscard]] Settings const& settings() const { return layer_settings; }
+
+    /// Unloads the meshes of every chunk and marks them all as dirty.
+    void unload();
+
+private:
+    void mark_dirty(sprites::TileRect rect);
+    void rebuild_chunk(anton::u32 chunk_index);
+    /// Finds the biggest rectangle of tiles with the same ID as the one at (x, y) that can be
+    /// merged into a single quad, growing first to the right and then upwards, without leaving
+    /// chunk_rect. Marks the tiles in it as merged.
+    sprites::TileRect merge_tiles(sprites::TileRect chunk_rect, anton::u32 x, anton::u32 y);
+
+    Settings layer_settings;
+    anton::u32 chunks_x;
+    anton::u32 chunks_y;
+    std::vector<anton::u32> tiles;
+    std::vector<Chunk> chunk_list;
+    /// Indices into chunk_list, in the order they were marked as dirty.
+    std::vector<anton::u32> dirty_chunks;
+    /// Scratch space reused between rebuilds so that rebuilding doesn't allocate.
+    std::vector<anton::u8> masks;
+    /// One per tile of a chunk. Whether the tile was already merged into a bigger quad.
+    std::vector<bool> merged;
+    sprites::Sprite sprite;
+    renderer::MeshBuilder builder;
+};
+
+} // namespace aryibi::tilemap
+
+#endif // ARYIBI_TILEMAP_HPP
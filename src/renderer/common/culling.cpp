@@ -0,0 +1,228 @@
+#include "renderer/common/culling.hpp"
+#include "renderer/common/mesh_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <thread>
+
+#if defined(__AVX__)
+#    define ARYIBI_CULLING_AVX
+#    include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define ARYIBI_CULLING_SSE2
+#    include <emmintrin.h>
+#endif
+
+namespace aml = anton::math;
+
+namespace aryibi::renderer::common {
+
+namespace {
+
+/// Lists smaller than this are culled by the calling thread alone, since starting threads costs
+/// more than testing them.
+constexpr std::size_t min_rects_per_thread = 1u << 16;
+
+bool overlaps(PackedRects const& rects, std::size_t i, sprites::Rect2D const& view) {
+    return rects.max_x[i] >= view.start.x && rects.min_x[i] <= view.end.x &&
+           rects.max_y[i] >= view.start.y && rects.min_y[i] <= view.end.y;
+}
+
+} // namespace
+
+void PackedRects::clear() {
+    min_x.clear();
+    min_y.clear();
+    max_x.clear();
+    max_y.clear();
+}
+
+void PackedRects::push_back(sprites::Rect2D const& rect, aml::Vector2 offset) {
+    min_x.push_back(rect.start.x + offset.x);
+    min_y.push_back(rect.start.y + offset.y);
+    max_x.push_back(rect.end.x + offset.x);
+    max_y.push_back(rect.end.y + offset.y);
+}
+
+sprites::Rect2D unbounded_rect() {
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    return {{-inf, -inf}, {inf, inf}};
+}
+
+sprites::Rect2D empty_rect() {
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    return {{inf, inf}, {-inf, -inf}};
+}
+
+sprites::Rect2D vertex_bounds(const float* vertices, std::size_t vertex_count) {
+    sprites::Rect2D bounds = empty_rect();
+    for (std::size_t i = 0; i < vertex_count; ++i) {
+        const float* vertex = vertices + i * floats_per_vertex;
+        bounds.start.x = std::min(bounds.start.x, vertex[0]);
+        bounds.start.y = std::min(bounds.start.y, vertex[1]);
+        bounds.end.x = std::max(bounds.end.x, vertex[0]);
+        bounds.end.y = std::max(bounds.end.y, vertex[1]);
+    }
+    return bounds;
+}
+
+sprites::Rect2D camera_view_rect(Camera const& camera, float width, float height) {
+    // Same as the projection matrices the backends build.
+    const aml::Vector2 size{width / camera.unit_size, height / camera.unit_size};
+    const aml::Vector2 position{camera.position.x, camera.position.y};
+    if (camera.center_view)
+        return {position - size / 2.f, position + size / 2.f};
+    return {{position.x, position.y - size.y}, {position.x + size.x, position.y}};
+}
+
+sprites::Rect2D point_light_rect(PointLight const& light) {
+    const aml::Vector2 position{light.position.x, light.position.y};
+    const aml::Vector2 radius{light.radius, light.radius};
+    return {position - radius, position + radius};
+}
+
+sprites::Rect2D directional_light_rect(Camera const& camera,
+                                       aml::Vector3 rotation,
+                                       float width,
+                                       float height,
+                                       float near,
+                                       float far) {
+    // The light matrix is translate(camera) * rotate_z * rotate_y * rotate_x, so rotate the corners
+    // of the camera volume (Relative to the camera) in that order and take their bounds.
+    const auto view = camera_view_rect(camera, width, height);
+    const float sin_x = std::sin(rotation.x), cos_x = std::cos(rotation.x);
+    const float sin_y = std::sin(rotation.y), cos_y = std::cos(rotation.y);
+    const float sin_z = std::sin(rotation.z), cos_z = std::cos(rotation.z);
+    sprites::Rect2D bounds = empty_rect();
+    for (const float corner_x : {view.start.x, view.end.x}) {
+        for (const float corner_y : {view.start.y, view.end.y}) {
+            // The camera looks at -Z.
+            for (const float corner_z : {-near, -far}) {
+                float x = corner_x - camera.position.x;
+                float y = corner_y - camera.position.y;
+                float z = corner_z;
+                // Around X.
+                const float x_rotated_y = cos_x * y - sin_x * z;
+                z = sin_x * y + cos_x * z;
+                y = x_rotated_y;
+                // Around Y. The final Z doesn't matter.
+                const float y_rotated_x = cos_y * x + sin_y * z;
+                x = y_rotated_x;
+                // Around Z.
+                const float z_rotated_x = cos_z * x - sin_z * y;
+                y = sin_z * x + cos_z * y;
+                x = z_rotated_x;
+
+                bounds.start.x = std::min(bounds.start.x, x + camera.position.x);
+                bounds.start.y = std::min(bounds.start.y, y + camera.position.y);
+                bounds.end.x = std::max(bounds.end.x, x + camera.position.x);
+                bounds.end.y = std::max(bounds.end.y, y + camera.position.y);
+            }
+        }
+    }
+    return bounds;
+}
+
+sprites::Rect2D intersect_rects(sprites::Rect2D const& a, sprites::Rect2D const& b) {
+    return {{std::max(a.start.x, b.start.x), std::max(a.start.y, b.start.y)},
+            {std::min(a.end.x, b.end.x), std::min(a.end.y, b.end.y)}};
+}
+
+std::size_t cull_rects(
+    PackedRects const& rects, sprites::Rect2D view, std::size_t first, std::size_t count, u8* visible) {
+    const std::size_t end = first + count;
+    std::size_t visible_count = 0;
+    std::size_t i = first;
+#if defined(ARYIBI_CULLING_AVX)
+    const __m256 view_min_x = _mm256_set1_ps(view.start.x);
+    const __m256 view_min_y = _mm256_set1_ps(view.start.y);
+    const __m256 view_max_x = _mm256_set1_ps(view.end.x);
+    const __m256 view_max_y = _mm256_set1_ps(view.end.y);
+    for (; i + 8 <= end; i += 8) {
+        const __m256 inside_x =
+            _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&rects.max_x[i]), view_min_x, _CMP_GE_OQ),
+                          _mm256_cmp_ps(_mm256_loadu_ps(&rects.min_x[i]), view_max_x, _CMP_LE_OQ));
+        const __m256 inside_y =
+            _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&rects.max_y[i]), view_min_y, _CMP_GE_OQ),
+                          _mm256_cmp_ps(_mm256_loadu_ps(&rects.min_y[i]), view_max_y, _CMP_LE_OQ));
+        const unsigned mask = _mm256_movemask_ps(_mm256_and_ps(inside_x, inside_y));
+        for (unsigned lane = 0; lane < 8; ++lane) {
+            visible[i + lane] = (mask >> lane) & 1u;
+            visible_count += visible[i + lane];
+        }
+    }
+#elif defined(ARYIBI_CULLING_SSE2)
+    const __m128 view_min_x = _mm_set1_ps(view.start.x);
+    const __m128 view_min_y = _mm_set1_ps(view.start.y);
+    const __m128 view_max_x = _mm_set1_ps(view.end.x);
+    const __m128 view_max_y = _mm_set1_ps(view.end.y);
+    for (; i + 4 <= end; i += 4) {
+        const __m128 inside_x = _mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(&rects.max_x[i]), view_min_x),
+                                           _mm_cmple_ps(_mm_loadu_ps(&rects.min_x[i]), view_max_x));
+        const __m128 inside_y = _mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(&rects.max_y[i]), view_min_y),
+                                           _mm_cmple_ps(_mm_loadu_ps(&rects.min_y[i]), view_max_y));
+        const unsigned mask = _mm_movemask_ps(_mm_and_ps(inside_x, inside_y));
+        for (unsigned lane = 0; lane < 4; ++lane) {
+            visible[i + lane] = (mask >> lane) & 1u;
+            visible_count += visible[i + lane];
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        visible[i] = overlaps(rects, i, view);
+        visible_count += visible[i];
+    }
+    return visible_count;
+}
+
+std::size_t cull_rects(PackedRects const& rects, sprites::Rect2D view, std::vector<u8>& visible) {
+    const std::size_t count = rects.size();
+    visible.resize(count);
+    const std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t thread_count = std::min(max_threads, count / min_rects_per_thread);
+    if (thread_count <= 1)
+        return cull_rects(rects, view, 0, count, visible.data());
+
+    const std::size_t rects_per_thread = (count + thread_count - 1) / thread_count;
+    std::vector<std::future<std::size_t>> others;
+    for (std::size_t first = rects_per_thread; first < count; first += rects_per_thread) {
+        const std::size_t range = std::min(rects_per_thread, count - first);
+        others.push_back(std::async(std::launch::async, [&rects, view, first, range, &visible]() {
+            return cull_rects(rects, view, first, range, visible.data());
+        }));
+    }
+    std::size_t visible_count = cull_rects(rects, view, 0, rects_per_thread, visible.data());
+    for (auto& other : others) { visible_count += other.get(); }
+    return visible_count;
+}
+
+void ShadowCasterLists::set_commands(std::vector<DrawCmd> const& commands,
+                                     PackedRects const& bounds) {
+    caster_commands.clear();
+    caster_bounds.clear();
+    for (u32 i = 0; i < commands.size(); ++i) {
+        if (!commands[i].cast_shadows)
+            continue;
+        caster_commands.push_back(i);
+        caster_bounds.push_back(
+            {{bounds.min_x[i], bounds.min_y[i]}, {bounds.max_x[i], bounds.max_y[i]}});
+    }
+    light_count = 0;
+    total_draws = 0;
+}
+
+void ShadowCasterLists::add_light(sprites::Rect2D const& area) {
+    if (light_count == lights.size())
+        lights.emplace_back();
+    auto& casters = lights[light_count++];
+    casters.clear();
+    total_draws += cull_rects(caster_bounds, area, overlapping);
+    for (std::size_t i = 0; i < caster_commands.size(); ++i) {
+        if (overlapping[i])
+            casters.push_back(caster_commands[i]);
+    }
+}
+
+} // namespace aryibi::renderer::common
@@ -0,0 +1,101 @@
+#ifndef ARYIBI_COMMON_CULLING_HPP
+#define ARYIBI_COMMON_CULLING_HPP
+
+#include "aryibi/renderer.hpp"
+#include "aryibi/sprites.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace aryibi::renderer::common {
+
+/// Many rects on the XY plane, stored one component per array so that they can be tested against
+/// another rect several at a time.
+struct PackedRects {
+    std::vector<float> min_x;
+    std::vector<float> min_y;
+    std::vector<float> max_x;
+    std::vector<float> max_y;
+
+    void clear();
+    /// Appends rect moved by offset.
+    void push_back(sprites::Rect2D const& rect, anton::math::Vector2 offset = {0, 0});
+    [[nodiscard]] std::size_t size() const { return min_x.size(); }
+};
+
+/// A rect that overlaps every other one. Used for meshes whose bounds aren't known beforehand,
+/// like dynamic ones.
+sprites::Rect2D unbounded_rect();
+/// A rect that doesn't overlap anything.
+sprites::Rect2D empty_rect();
+
+/// The bounds of some vertices on the XY plane. The result is inverted (start > end) if there are
+/// no vertices, so that it doesn't overlap anything.
+sprites::Rect2D vertex_bounds(const float* vertices, std::size_t vertex_count);
+
+/// The area of the XY plane shown by a camera, which is orthographic and looks at -Z, so Z doesn't
+/// matter.
+/// @param width, height The size of the output, in pixels.
+sprites::Rect2D camera_view_rect(Camera const& camera, float width, float height);
+
+/// The area of the XY plane that a point light can light. Light fades to nothing at its radius, so
+/// casters outside of it can't shadow anything lit by it.
+sprites::Rect2D point_light_rect(PointLight const& light);
+
+/// The bounds on the XY plane of the volume covered by the shadow map of a directional light, which
+/// is the volume shown by the camera rotated around the camera position.
+/// @param width, height The size of the output, in pixels.
+/// @param near, far The depth range of the camera projection.
+sprites::Rect2D directional_light_rect(Camera const& camera,
+                                       anton::math::Vector3 rotation,
+                                       float width,
+                                       float height,
+                                       float near,
+                                       float far);
+
+/// The area covered by both rects. The result is inverted if they don't overlap.
+sprites::Rect2D intersect_rects(sprites::Rect2D const& a, sprites::Rect2D const& b);
+
+/// Tests the rects in [first, first + count) against view, setting visible[i] to 1 if rect i
+/// overlaps it and to 0 otherwise. Uses AVX or SSE2 when available. Different ranges can be
+/// tested from different threads at once.
+/// @returns How many of the rects overlap view.
+std::size_t
+cull_rects(PackedRects const& rects, sprites::Rect2D view, std::size_t first, std::size_t count, u8* visible);
+
+/// Tests every rect against view (See the other overload). Huge lists are split between several
+/// threads. visible is resized to the number of rects.
+/// @returns How many of the rects overlap view.
+std::size_t cull_rects(PackedRects const& rects, sprites::Rect2D view, std::vector<u8>& visible);
+
+/// The commands that have to be drawn into the shadow map of each light of a frame. Shadow casters
+/// are only drawn for the lights whose area they overlap, instead of for every light.
+class ShadowCasterLists {
+public:
+    /// Starts a new frame, with no lights.
+    /// @param bounds The world bounds of every command, in the same order.
+    void set_commands(std::vector<DrawCmd> const& commands, PackedRects const& bounds);
+    /// Lists the casters that overlap area for the next light. Lights are numbered from 0 in the
+    /// order they are added.
+    void add_light(sprites::Rect2D const& area);
+
+    /// The indices of the commands to draw for a light, in the order they were given.
+    [[nodiscard]] std::vector<u32> const& casters(std::size_t light) const { return lights[light]; }
+    /// How many commands cast shadows at all.
+    [[nodiscard]] std::size_t caster_count() const { return caster_commands.size(); }
+    /// How many commands are drawn into the shadow maps, adding up all the lights.
+    [[nodiscard]] std::size_t draw_count() const { return total_draws; }
+
+private:
+    std::vector<u32> caster_commands;
+    PackedRects caster_bounds;
+    /// Only the first light_count lists are used. The rest are kept to reuse their memory.
+    std::vector<std::vector<u32>> lights;
+    std::size_t light_count = 0;
+    std::size_t total_draws = 0;
+    std::vector<u8> overlapping;
+};
+
+} // namespace aryibi::renderer::common
+
+#endif // ARYIBI_COMMON_CULLING_HPP
@@ -0,0 +1,160 @@
+#include "renderer/common/draw_order.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
+
+namespace aryibi::renderer::common {
+
+namespace {
+
+/// The widest digit a radix pass sorts by. Histograms of 11 bit digits still fit in the L1 cache.
+constexpr u32 max_radix_bits = 11;
+
+/// value, wrapped to its lowest bits.
+constexpr u64 field(u64 value, u32 bits) { return value & ((u64(1) << bits) - 1); }
+
+/// A run of consecutive bits that differ between keys, and how far it has to be shifted right to
+/// pack it right after the previous runs.
+struct KeyBits {
+    u32 shift;
+    u64 mask;
+};
+
+/// Splits the set bits of mask into runs of consecutive bits, from the least significant one.
+/// Returns how many runs there are, which start out unshifted.
+u32 find_bit_runs(u64 mask, std::array<KeyBits, 32>& runs) {
+    u32 run_count = 0;
+    u32 bit = 0;
+    while (bit < 64) {
+        if (!((mask >> bit) & 1)) {
+            ++bit;
+            continue;
+        }
+        const u32 start = bit;
+        while (bit < 64 && ((mask >> bit) & 1)) { ++bit; }
+        const u64 below_end = bit == 64 ? ~u64(0) : field(~u64(0), bit);
+        runs[run_count++] = {start, below_end & ~field(~u64(0), start)};
+    }
+    return run_count;
+}
+
+/// Packs the varying bits of every key into entries, counting the digits of every radix pass on
+/// the way, then sorts the entries by them and writes the sorted commands back.
+template<typename EntryVector>
+void radix_sort(std::vector<u64> const& keys,
+                std::vector<u32>& commands,
+                std::array<KeyBits, 32> const& runs,
+                u32 run_count,
+                u32 varying_bits,
+                EntryVector& entries,
+                EntryVector& scratch,
+                std::vector<u32>& histograms) {
+    using Key = decltype(entries[0].key);
+    const std::size_t count = keys.size();
+    const u32 pass_count = (varying_bits + max_radix_bits - 1) / max_radix_bits;
+    // Spread the bits evenly between the passes, to keep the histograms small.
+    const u32 radix_bits = (varying_bits + pass_count - 1) / pass_count;
+    const u32 radix_size = 1u << radix_bits;
+    const Key digit_mask = radix_size - 1;
+    histograms.assign(pass_count * radix_size, 0);
+    entries.resize(count);
+    scratch.resize(count);
+
+    for (std::size_t i = 0; i < count; ++i) {
+        u64 packed = 0;
+        for (u32 run = 0; run < run_count; ++run) {
+            packed |= (keys[i] & runs[run].mask) >> runs[run].shift;
+        }
+        const auto key = static_cast<Key>(packed);
+        entries[i] = {key, commands[i]};
+        for (u32 pass = 0; pass < pass_count; ++pass) {
+            ++histograms[pass * radix_size + ((key >> (pass * radix_bits)) & digit_mask)];
+        }
+    }
+
+    for (u32 pass = 0; pass < pass_count; ++pass) {
+        u32* histogram = histograms.data() + pass * radix_size;
+        // Turn the counts into where the first key with each digit goes.
+        u32 offset = 0;
+        for (u32 digit = 0; digit < radix_size; ++digit) {
+            const u32 digit_start = offset;
+            offset += histogram[digit];
+            histogram[digit] = digit_start;
+        }
+        const u32 shift = pass * radix_bits;
+        for (const auto& entry : entries) {
+            scratch[histogram[(entry.key >> shift) & digit_mask]++] = entry;
+        }
+        entries.swap(scratch);
+    }
+
+    for (std::size_t i = 0; i < count; ++i) { commands[i] = entries[i].command; }
+}
+
+} // namespace
+
+u16 depth_bucket(float distance, float near, float far, bool transparent) {
+    constexpr float max_bucket = 0xFFFF;
+    const float normalized = std::clamp((distance - near) / (far - near), 0.f, 1.f);
+    const u16 bucket = static_cast<u16>(normalized * max_bucket);
+    return transparent ? 0xFFFF - bucket : bucket;
+}
+
+u64 make_sort_key(
+    DrawPass pass, bool transparent, u16 depth, u32 shader, u32 texture, u32 mesh_buffer) {
+    if (transparent) {
+        // Stable sorting keeps the submission order of transparent commands at the same depth.
+        shader = texture = mesh_buffer = 0;
+    }
+    u64 key = field(static_cast<u32>(pass), sort_key_bits::pass);
+    key = key << sort_key_bits::transparent | (transparent ? 1 : 0);
+    key = key << sort_key_bits::depth | field(depth, sort_key_bits::depth);
+    key = key << sort_key_bits::shader | field(shader, sort_key_bits::shader);
+    key = key << sort_key_bits::texture | field(texture, sort_key_bits::texture);
+    key = key << sort_key_bits::mesh_buffer | field(mesh_buffer, sort_key_bits::mesh_buffer);
+    return key;
+}
+
+void DrawSorter::clear() {
+    keys.clear();
+    commands.clear();
+}
+
+void DrawSorter::add(u32 command, u64 key) {
+    keys.push_back(key);
+    commands.push_back(command);
+}
+
+void DrawSorter::sort() {
+    if (keys.size() < 2)
+        return;
+
+    // Bits that every key shares don't change the order, and most of them do: The pass, depth and
+    // id fields are much wider than what a frame uses. Pack the others together at the bottom of
+    // the keys, in the same order, so that the radix passes only go over them.
+    u64 varying = 0;
+    for (const u64 key : keys) { varying |= key ^ keys[0]; }
+    if (varying == 0)
+        return;
+    std::array<KeyBits, 32> runs;
+    const u32 run_count = find_bit_runs(varying, runs);
+    u32 varying_bits = 0;
+    for (u32 run = 0; run < run_count; ++run) {
+        // Where the run goes in the packed key.
+        const u32 packed_shift = varying_bits;
+        varying_bits += static_cast<u32>(std::bitset<64>(runs[run].mask).count());
+        runs[run].shift -= packed_shift;
+    }
+
+    if (varying_bits <= 32) {
+        radix_sort(keys, commands, runs, run_count, varying_bits, narrow_entries, narrow_scratch,
+                   histograms);
+    } else {
+        radix_sort(keys, commands, runs, run_count, varying_bits, wide_entries, wide_scratch,
+                   histograms);
+    }
+}
+
+} // namespace aryibi::renderer::common
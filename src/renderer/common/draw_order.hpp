@@ -0,0 +1,77 @@
+#ifndef ARYIBI_COMMON_DRAW_ORDER_HPP
+#define ARYIBI_COMMON_DRAW_ORDER_HPP
+
+#include <anton/types.hpp>
+
+#include <vector>
+
+namespace aryibi::renderer::common {
+
+using namespace anton; // For integer types
+
+/// Bits of each field of a draw sort key, from the most significant one to the least. Ids that
+/// don't fit in their field are wrapped, which only costs some extra state changes.
+namespace sort_key_bits {
+constexpr u32 pass = 2;
+constexpr u32 transparent = 1;
+constexpr u32 depth = 16;
+constexpr u32 shader = 10;
+constexpr u32 texture = 20;
+constexpr u32 mesh_buffer = 15;
+static_assert(pass + transparent + depth + shader + texture + mesh_buffer == 64);
+} // namespace sort_key_bits
+
+/// The passes commands can be sorted into. Only the color pass is sorted for now.
+enum class DrawPass : u32 { color };
+
+/// Quantizes the distance from the camera to a command so that sorting by it draws opaque
+/// commands from front to back, which lets the depth test reject the fragments they cover before
+/// shading them, and transparent ones from back to front, so that they are blended over what's
+/// behind them.
+/// @param near, far The range of distances the camera shows. Distances outside of it are clamped.
+u16 depth_bucket(float distance, float near, float far, bool transparent);
+
+/// Packs everything the commands of a pass are sorted by into a single number. Opaque commands go
+/// before transparent ones, then they are sorted by depth, and opaque commands at the same depth
+/// are grouped by shader, texture and vertex buffer so that consecutive draws share as much state
+/// as possible. Transparent commands leave those fields empty instead, so the ones at the same
+/// depth are drawn in the order they were submitted, since they blend over each other.
+u64 make_sort_key(
+    DrawPass pass, bool transparent, u16 depth, u32 shader, u32 texture, u32 mesh_buffer);
+
+/// Sorts the commands of a frame by their sort keys. Keeps its memory between frames.
+class DrawSorter {
+public:
+    /// Removes every command.
+    void clear();
+    void add(u32 command, u64 key);
+    /// Sorts the commands added since the last clear() by key (LSD radix sort). Bits that are the
+    /// same in every key are left out first, so a frame only takes as many passes as the bits that
+    /// tell its commands apart need, with digits of up to 11 bits. Commands with the same key keep
+    /// the order they were added in.
+    void sort();
+    /// The commands, sorted if sort() was called after adding the last one.
+    [[nodiscard]] std::vector<u32> const& order() const { return commands; }
+
+private:
+    /// Keys and commands are moved together, so that each radix pass only writes one array.
+    template<typename Key> struct Entry {
+        Key key;
+        u32 command;
+    };
+
+    /// The keys of the commands, in the order they were added.
+    std::vector<u64> keys;
+    std::vector<u32> commands;
+    /// Keys whose varying bits fit in 32 bits are sorted as such, which halves the memory each
+    /// radix pass moves. Each radix pass writes to the scratch vector, which is then swapped.
+    std::vector<Entry<u32>> narrow_entries;
+    std::vector<Entry<u32>> narrow_scratch;
+    std::vector<Entry<u64>> wide_entries;
+    std::vector<Entry<u64>> wide_scratch;
+    std::vector<u32> histograms;
+};
+
+} // namespace aryibi::renderer::common
+
+#endif // ARYIBI_COMMON_DRAW_ORDER_HPP
@@ -0,0 +1,118 @@
+#include "renderer/common/light_tiles.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <thread>
+
+namespace aml = anton::math;
+
+namespace aryibi::renderer::common {
+
+namespace {
+
+/// Rows are split between threads only when there are more light tests than this per thread,
+/// since starting threads costs more than listing a few lights.
+constexpr std::size_t min_tests_per_thread = 1u << 14;
+
+/// The tile of the grid that contains coordinate, clamped to the grid.
+u32 tile_at(float coordinate, float origin, float tile_size, u32 tile_count) {
+    const float tile = std::floor((coordinate - origin) / tile_size);
+    return static_cast<u32>(std::clamp(tile, 0.f, static_cast<float>(tile_count - 1)));
+}
+
+} // namespace
+
+void LightTileGrid::build(sprites::Rect2D const& view,
+                          u32 width,
+                          u32 height,
+                          PackedRects const& lights,
+                          u32 tile_pixels) {
+    grid_width = std::max(1u, (width + tile_pixels - 1) / tile_pixels);
+    grid_height = std::max(1u, (height + tile_pixels - 1) / tile_pixels);
+    grid_origin = view.start;
+    view_size = view.end - view.start;
+    // The last tile of each row and column goes past the view if the output size isn't a multiple
+    // of the tile size.
+    tile_size = {(view.end.x - view.start.x) * tile_pixels / std::max(1u, width),
+                 (view.end.y - view.start.y) * tile_pixels / std::max(1u, height)};
+    if (rows.size() < grid_height)
+        rows.resize(grid_height);
+
+    const std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t thread_count =
+        std::min<std::size_t>({max_threads, grid_height,
+                               lights.size() * grid_height / min_tests_per_thread});
+    if (thread_count <= 1) {
+        build_rows(lights, 0, grid_height);
+    } else {
+        const u32 rows_per_thread = (grid_height + thread_count - 1) / thread_count;
+        std::vector<std::future<void>> others;
+        for (u32 first = rows_per_thread; first < grid_height; first += rows_per_thread) {
+            const u32 count = std::min(rows_per_thread, grid_height - first);
+            others.push_back(std::async(std::launch::async, [this, &lights, first, count]() {
+                build_rows(lights, first, count);
+            }));
+        }
+        build_rows(lights, 0, rows_per_thread);
+        for (auto& other : others) { other.get(); }
+    }
+
+    tile_data.resize(2 * tile_count());
+    for (u32 y = 0; y < grid_height; ++y) {
+        const Row& row = rows[y];
+        const u32 row_start = tile_data.size();
+        for (u32 x = 0; x < grid_width; ++x) {
+            const u32 tile = y * grid_width + x;
+            tile_data[2 * tile] = row_start + row.tile_starts[x];
+            tile_data[2 * tile + 1] = row.tile_starts[x + 1] - row.tile_starts[x];
+        }
+        tile_data.insert(tile_data.end(), row.indices.begin(), row.indices.end());
+    }
+}
+
+void LightTileGrid::build_rows(PackedRects const& lights, u32 first, u32 count) {
+    const float grid_end_x = grid_origin.x + tile_size.x * grid_width;
+    for (u32 y = first; y < first + count; ++y) {
+        Row& row = rows[y];
+        const sprites::Rect2D row_rect{{grid_origin.x, grid_origin.y + tile_size.y * y},
+                                       {grid_end_x, grid_origin.y + tile_size.y * (y + 1)}};
+        row.overlapping.resize(lights.size());
+        cull_rects(lights, row_rect, 0, lights.size(), row.overlapping.data());
+
+        // Count the lights of each tile into the start of the next one, so that after adding them
+        // up tile_starts[x] is where the list of tile x starts.
+        row.tile_starts.assign(grid_width + 1, 0);
+        for (std::size_t i = 0; i < lights.size(); ++i) {
+            if (!row.overlapping[i])
+                continue;
+            const u32 first_x = tile_at(lights.min_x[i], grid_origin.x, tile_size.x, grid_width);
+            const u32 last_x = tile_at(lights.max_x[i], grid_origin.x, tile_size.x, grid_width);
+            for (u32 x = first_x; x <= last_x; ++x) { ++row.tile_starts[x + 1]; }
+        }
+        for (u32 x = 0; x < grid_width; ++x) { row.tile_starts[x + 1] += row.tile_starts[x]; }
+
+        // Fill the lists using tile_starts[x] as the cursor of tile x, which leaves it at the start
+        // of tile x + 1. Shifting them back by one tile restores them.
+        row.indices.resize(row.tile_starts[grid_width]);
+        for (std::size_t i = 0; i < lights.size(); ++i) {
+            if (!row.overlapping[i])
+                continue;
+            const u32 first_x = tile_at(lights.min_x[i], grid_origin.x, tile_size.x, grid_width);
+            const u32 last_x = tile_at(lights.max_x[i], grid_origin.x, tile_size.x, grid_width);
+            for (u32 x = first_x; x <= last_x; ++x) { row.indices[row.tile_starts[x]++] = i; }
+        }
+        for (u32 x = grid_width; x > 0; --x) { row.tile_starts[x] = row.tile_starts[x - 1]; }
+        row.tile_starts[0] = 0;
+    }
+}
+
+void LightTileGrid::write_info(ShaderLightInfo& info) const {
+    info.grid_origin = grid_origin;
+    info.tile_size = tile_size;
+    info.grid_width = grid_width;
+    info.grid_height = grid_height;
+    info.view_size = view_size;
+}
+
+} // namespace aryibi::renderer::common
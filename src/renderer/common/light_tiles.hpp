@@ -0,0 +1,114 @@
+#ifndef ARYIBI_COMMON_LIGHT_TILES_HPP
+#define ARYIBI_COMMON_LIGHT_TILES_HPP
+
+#include "renderer/common/culling.hpp"
+
+#include <anton/math/matrix4.hpp>
+#include <anton/math/vector2.hpp>
+#include <anton/math/vector3.hpp>
+#include <anton/math/vector4.hpp>
+#include <anton/types.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace aryibi::renderer::common {
+
+using namespace anton; // For integer types
+
+/// A directional light as read by shaded_tile.frag (std430).
+struct ShaderDirectionalLight {
+    /// RGB is color, alpha is intensity.
+    anton::math::Vector4 color;
+    anton::math::Matrix4 light_space_matrix;
+    /// XY is the position of the tile in the shadow atlas, Z is its size.
+    anton::math::Vector3 light_atlas_pos;
+    /// One of the values of ShadowFilter, never renderer_default.
+    u32 shadow_filter;
+};
+static_assert(sizeof(ShaderDirectionalLight) == 96);
+
+/// A point light as read by shaded_tile.frag (std430).
+struct ShaderPointLight {
+    /// RGB is color, alpha is intensity.
+    anton::math::Vector4 color;
+    anton::math::Matrix4 light_space_matrix;
+    /// XY is the position of the tile in the shadow atlas, Z is its size.
+    anton::math::Vector3 light_atlas_pos;
+    float radius;
+    anton::math::Vector3 position;
+    /// One of the values of ShadowFilter, never renderer_default.
+    u32 shadow_filter;
+};
+static_assert(sizeof(ShaderPointLight) == 112);
+
+/// Everything else shaded_tile.frag needs to light a fragment (std140).
+struct ShaderLightInfo {
+    anton::math::Vector3 ambient_light_color;
+    u32 directional_light_count;
+    /// Where the first tile of the light grid starts, in world units. Also where the view starts.
+    anton::math::Vector2 grid_origin;
+    /// The size of each tile of the light grid, in world units.
+    anton::math::Vector2 tile_size;
+    u32 grid_width;
+    u32 grid_height;
+    u32 point_light_count;
+    /// 1 if the light was already computed into a light buffer that covers the view, 0 otherwise.
+    u32 light_buffer;
+    /// The size of the view, in world units.
+    anton::math::Vector2 view_size;
+    anton::math::Vector2 _pad0;
+};
+static_assert(sizeof(ShaderLightInfo) == 64);
+
+/// Splits the view into tiles of a few pixels and lists the point lights that overlap each of
+/// them, so that fragments only go through the lights that can reach their tile instead of every
+/// light in the scene. Directional lights light everything, so they aren't listed.
+class LightTileGrid {
+public:
+    /// Size of the tiles the view is split into, in pixels.
+    static constexpr u32 default_tile_pixels = 32;
+
+    /// @param view The area of the XY plane shown by the camera.
+    /// @param width, height The size of the output, in pixels.
+    /// @param lights The area each point light can light, in the same order as the lights.
+    void build(sprites::Rect2D const& view,
+               u32 width,
+               u32 height,
+               PackedRects const& lights,
+               u32 tile_pixels = default_tile_pixels);
+
+    /// Fills the grid and view fields of info.
+    void write_info(ShaderLightInfo& info) const;
+
+    /// Two numbers per tile (Row by row, starting at grid_origin): where its list starts within
+    /// this same array, and how many lights it has. The lists of light indices go after them.
+    [[nodiscard]] std::vector<u32> const& data() const { return tile_data; }
+    [[nodiscard]] u32 tile_count() const { return grid_width * grid_height; }
+    /// How many light indices there are, adding up all the tiles.
+    [[nodiscard]] std::size_t listed_light_count() const { return tile_data.size() - 2 * tile_count(); }
+
+private:
+    struct Row {
+        /// Offset within indices of the list of each tile of the row, plus the end of the last one.
+        std::vector<u32> tile_starts;
+        std::vector<u32> indices;
+        std::vector<u8> overlapping;
+    };
+
+    /// Lists the lights of rows [first, first + count).
+    void build_rows(PackedRects const& lights, u32 first, u32 count);
+
+    anton::math::Vector2 grid_origin;
+    anton::math::Vector2 tile_size;
+    anton::math::Vector2 view_size;
+    u32 grid_width = 0;
+    u32 grid_height = 0;
+    /// Only the first grid_height rows are used. The rest are kept to reuse their memory.
+    std::vector<Row> rows;
+    std::vector<u32> tile_data;
+};
+
+} // namespace aryibi::renderer::common
+
+#endif // ARYIBI_COMMON_LIGHT_TILES_HPP
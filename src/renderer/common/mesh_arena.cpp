@@ -0,0 +1,146 @@
+#include "renderer/common/mesh_arena.hpp"
+#include "renderer/common/mesh_kernels.hpp"
+#include "util/aryibi_assert.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace aryibi::renderer::common {
+
+static_assert(MeshArena::default_page_capacity * floats_per_vertex * sizeof(float) == 28u << 20u,
+              "Update the size given in the comment of MeshArena::default_page_capacity");
+
+FreeListAllocator::FreeListAllocator(u32 capacity) :
+    total_capacity(capacity), total_free(capacity) {
+    if (capacity != 0)
+        free_ranges.emplace(0, capacity);
+}
+
+u32 FreeListAllocator::allocate(u32 size) {
+    ARYIBI_ASSERT(size != 0, "[Internal error] Tried to allocate an empty range!");
+    auto best = free_ranges.end();
+    for (auto it = free_ranges.begin(); it != free_ranges.end(); ++it) {
+        if (it->second < size || (best != free_ranges.end() && it->second >= best->second))
+            continue;
+        best = it;
+        if (best->second == size)
+            break;
+    }
+    if (best == free_ranges.end())
+        return no_space;
+
+    const u32 offset = best->first;
+    const u32 remaining = best->second - size;
+    free_ranges.erase(best);
+    if (remaining != 0)
+        free_ranges.emplace(offset + size, remaining);
+    total_free -= size;
+    return offset;
+}
+
+void FreeListAllocator::free(u32 offset, u32 size) {
+    total_free += size;
+    auto next = free_ranges.lower_bound(offset);
+    ARYIBI_ASSERT(next == free_ranges.end() || offset + size <= next->first,
+                  "[Internal error] Freed a range that overlaps a free one!");
+    // Merge with the free range that comes right after this one, if any.
+    if (next != free_ranges.end() && next->first == offset + size) {
+        size += next->second;
+        next = free_ranges.erase(next);
+    }
+    // And with the one that comes right before it.
+    if (next != free_ranges.begin()) {
+        const auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+    free_ranges.emplace_hint(next, offset, size);
+}
+
+u32 FreeListAllocator::largest_free_range() const {
+    u32 largest = 0;
+    for (const auto& [offset, size] : free_ranges) { largest = std::max(largest, size); }
+    return largest;
+}
+
+u32 MeshArena::allocate(u32 vertex_count) {
+    MeshRange range{no_mesh, FreeListAllocator::no_space, vertex_count};
+    for (u32 page = 0; page < pages.size(); ++page) {
+        range.first_vertex = pages[page].allocate(vertex_count);
+        if (range.first_vertex != FreeListAllocator::no_space) {
+            range.page = page;
+            break;
+        }
+    }
+    if (range.page == no_mesh) {
+        range.page = pages.size();
+        pages.emplace_back(std::max(vertex_count, default_page_capacity));
+        range.first_vertex = pages.back().allocate(vertex_count);
+    }
+
+    if (free_ids.empty()) {
+        meshes.push_back(range);
+        return meshes.size() - 1;
+    }
+    const u32 id = free_ids.back();
+    free_ids.pop_back();
+    meshes[id] = range;
+    return id;
+}
+
+void MeshArena::free(u32 mesh) {
+    MeshRange& range = meshes[mesh];
+    ARYIBI_ASSERT(range.page != no_mesh, "[Internal error] Freed a mesh twice!");
+    pages[range.page].free(range.first_vertex, range.vertex_count);
+    range.page = no_mesh;
+    free_ids.push_back(mesh);
+}
+
+u32 MeshArena::find_fragmented_page(u32 vertex_count) const {
+    u32 best = no_mesh;
+    for (u32 page = 0; page < pages.size(); ++page) {
+        const FreeListAllocator& allocator = pages[page];
+        if (allocator.free_space() < vertex_count || allocator.largest_free_range() >= vertex_count)
+            continue;
+        // Compacting the page with the most free space leaves the most room for later meshes.
+        if (best == no_mesh || allocator.free_space() > pages[best].free_space())
+            best = page;
+    }
+    return best;
+}
+
+std::vector<MeshArena::Move> MeshArena::compact(u32 page) {
+    std::vector<u32> page_meshes;
+    for (u32 id = 0; id < meshes.size(); ++id) {
+        if (meshes[id].page == page)
+            page_meshes.push_back(id);
+    }
+    std::sort(page_meshes.begin(), page_meshes.end(), [this](u32 a, u32 b) {
+        return meshes[a].first_vertex < meshes[b].first_vertex;
+    });
+
+    std::vector<Move> moves;
+    u32 end = 0;
+    for (const u32 id : page_meshes) {
+        MeshRange& range = meshes[id];
+        // Meshes that are next to each other in the old buffer are copied with a single move.
+        if (!moves.empty() && moves.back().from_vertex + moves.back().vertex_count ==
+                                  range.first_vertex) {
+            moves.back().vertex_count += range.vertex_count;
+        } else {
+            moves.push_back({range.first_vertex, end, range.vertex_count});
+        }
+        range.first_vertex = end;
+        end += range.vertex_count;
+    }
+
+    FreeListAllocator compacted(pages[page].capacity());
+    if (end != 0)
+        (void)compacted.allocate(end);
+    pages[page] = compacted;
+    return moves;
+}
+
+} // namespace aryibi::renderer::common
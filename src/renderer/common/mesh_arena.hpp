@@ -0,0 +1,92 @@
+#ifndef ARYIBI_COMMON_MESH_ARENA_HPP
+#define ARYIBI_COMMON_MESH_ARENA_HPP
+
+#include <anton/types.hpp>
+
+#include <limits>
+#include <map>
+#include <vector>
+
+namespace aryibi::renderer::common {
+
+using namespace anton; // For integer types
+
+/// Hands out ranges of a fixed-size buffer. Free ranges are kept sorted by offset, so freeing a
+/// range merges it with its free neighbours right away.
+class FreeListAllocator {
+public:
+    static constexpr u32 no_space = std::numeric_limits<u32>::max();
+
+    explicit FreeListAllocator(u32 capacity = 0);
+
+    /// Takes the smallest free range that fits size, which keeps the big ones around for big
+    /// allocations. size must not be 0.
+    /// @returns The offset of the allocated range, or no_space if no free range is big enough.
+    [[nodiscard]] u32 allocate(u32 size);
+    void free(u32 offset, u32 size);
+
+    [[nodiscard]] u32 capacity() const { return total_capacity; }
+    [[nodiscard]] u32 free_space() const { return total_free; }
+    [[nodiscard]] u32 largest_free_range() const;
+
+private:
+    /// Offset -> size.
+    std::map<u32, u32> free_ranges;
+    u32 total_capacity;
+    u32 total_free;
+};
+
+/// Suballocates the vertices of static meshes from a few big vertex buffers (Pages), so that
+/// drawing a mesh is just an offset (Base vertex) into a buffer that is probably already bound.
+/// This only does the bookkeeping: the backends own the buffers, create one for every page added
+/// here and move the vertices around when a page is compacted.
+/// Meshes are referred to by an ID that stays valid across compactions, so backends must look up
+/// the current range of a mesh with range() every time it's drawn.
+class MeshArena {
+public:
+    static constexpr u32 no_mesh = std::numeric_limits<u32>::max();
+    /// 1M vertices, 28MiB with 7 floats per vertex (See common::floats_per_vertex). Meshes bigger
+    /// than this get a page of their own.
+    static constexpr u32 default_page_capacity = 1u << 20;
+
+    struct MeshRange {
+        u32 page;
+        u32 first_vertex;
+        u32 vertex_count;
+    };
+
+    /// A range of vertices that has to be copied from the old buffer of a page to the new one.
+    struct Move {
+        u32 from_vertex;
+        u32 to_vertex;
+        u32 vertex_count;
+    };
+
+    /// Reserves space for a mesh. Adds a new page if none of the existing ones has a free range
+    /// big enough, so check page_count() afterwards. vertex_count must not be 0.
+    /// @returns The ID of the mesh.
+    [[nodiscard]] u32 allocate(u32 vertex_count);
+    void free(u32 mesh);
+
+    [[nodiscard]] MeshRange const& range(u32 mesh) const { return meshes[mesh]; }
+    [[nodiscard]] u32 page_count() const { return pages.size(); }
+    [[nodiscard]] u32 page_capacity(u32 page) const { return pages[page].capacity(); }
+
+    /// Looks for a page that has enough free space for vertex_count vertices, but split in
+    /// ranges that are too small. Compacting it is cheaper than adding a new page.
+    /// @returns The index of the page, or no_mesh if there's none.
+    [[nodiscard]] u32 find_fragmented_page(u32 vertex_count) const;
+    /// Moves all the meshes of a page to its start, leaving a single free range at the end. The
+    /// backend must create a new buffer for the page and apply the moves from the old one to it.
+    [[nodiscard]] std::vector<Move> compact(u32 page);
+
+private:
+    std::vector<FreeListAllocator> pages;
+    /// Indexed by mesh ID.
+    std::vector<MeshRange> meshes;
+    std::vector<u32> free_ids;
+};
+
+} // namespace aryibi::renderer::common
+
+#endif // ARYIBI_COMMON_MESH_ARENA_HPP
@@ -0,0 +1,378 @@
+#include "renderer/common/mesh_kernels.hpp"
+#include "util/aryibi_assert.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX__)
+#    define ARYIBI_MESH_KERNELS_AVX
+#    include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define ARYIBI_MESH_KERNELS_SSE2
+#    include <emmintrin.h>
+#endif
+
+namespace aml = anton::math;
+
+namespace aryibi::renderer::common {
+
+namespace {
+
+static_assert(sizeof(sprites::Sprite::Piece) == 8 * sizeof(float),
+              "The vectorized kernels load pieces as 8 contiguous floats");
+
+/// Reference implementation. Also used for the pieces left over by the vectorized loops.
+/// Leaves the tile rect of the vertices empty.
+void write_piece_scalar(sprites::Sprite::Piece const& piece,
+                        SpriteVertexParams const& params,
+                        float* out) {
+    const auto clamp = [&params](float z) { return std::min(std::max(z, params.z_min), params.z_max); };
+    const sprites::Rect2D pos_rect{
+        {piece.destination.start.x + params.offset.x, piece.destination.start.y + params.offset.y},
+        {piece.destination.end.x + params.offset.x, piece.destination.end.y + params.offset.y}};
+    const sprites::Rect2D uv_rect = piece.source;
+    const sprites::Rect2D z_map{{clamp(piece.destination.start.x * params.horizontal_slope),
+                                 clamp(piece.destination.start.y * params.vertical_slope)},
+                                {clamp(piece.destination.end.x * params.horizontal_slope),
+                                 clamp(piece.destination.end.y * params.vertical_slope)}};
+
+    /* X pos 1st vertex */ out[0] = pos_rect.start.x;
+    /* Y pos 1st vertex */ out[1] = pos_rect.start.y;
+    /* Z pos 1st vertex */ out[2] = z_map.start.x + z_map.start.y + params.offset.z;
+    /* X UV 1st vertex  */ out[3] = uv_rect.start.x;
+    /* Y UV 1st vertex  */ out[4] = uv_rect.end.y;
+    /* X pos 2nd vertex */ out[7] = pos_rect.end.x;
+    /* Y pos 2nd vertex */ out[8] = pos_rect.start.y;
+    /* Z pos 2nd vertex */ out[9] = z_map.end.x + z_map.start.y + params.offset.z;
+    /* X UV 2nd vertex  */ out[10] = uv_rect.end.x;
+    /* Y UV 2nd vertex  */ out[11] = uv_rect.end.y;
+    /* X pos 3rd vertex */ out[14] = pos_rect.start.x;
+    /* Y pos 3rd vertex */ out[15] = pos_rect.end.y;
+    /* Z pos 3rd vertex */ out[16] = z_map.start.x + z_map.end.y + params.offset.z;
+    /* X UV 3rd vertex  */ out[17] = uv_rect.start.x;
+    /* Y UV 3rd vertex  */ out[18] = uv_rect.start.y;
+    /* X pos 4th vertex */ out[21] = pos_rect.end.x;
+    /* Y pos 4th vertex */ out[22] = pos_rect.end.y;
+    /* Z pos 4th vertex */ out[23] = z_map.end.x + z_map.end.y + params.offset.z;
+    /* X UV 4th vertex  */ out[24] = uv_rect.end.x;
+    /* Y UV 4th vertex  */ out[25] = uv_rect.start.y;
+    for (std::size_t i = 0; i < vertices_per_quad; ++i) {
+        // All bits zero is both 0.f and an empty rect.
+        out[i * floats_per_vertex + tile_rect_slot] = 0.f;
+        out[i * floats_per_vertex + tile_rect_slot + 1] = 0.f;
+    }
+}
+
+u16 to_unorm16(float x) {
+    return static_cast<u16>(std::min(std::max(x, 0.f), 1.f) * 65535.f + 0.5f);
+}
+
+/// Writes a piece whose source repeats. The UVs count repetitions from the start of the source,
+/// and the source itself becomes the tile rect of the vertices.
+void write_repeating_piece_scalar(sprites::Sprite::Piece const& piece,
+                                  aml::Vector2 repeat,
+                                  SpriteVertexParams const& params,
+                                  float* out) {
+    // Tile rects can't have a negative size, so flipped sources flip the UVs instead.
+    const bool flip_x = piece.source.end.x < piece.source.start.x;
+    const bool flip_y = piece.source.end.y < piece.source.start.y;
+    const sprites::Sprite::Piece repeated{{{flip_x ? repeat.x : 0, flip_y ? repeat.y : 0},
+                                   {flip_x ? 0 : repeat.x, flip_y ? 0 : repeat.y}},
+                                  piece.destination};
+    write_piece_scalar(repeated, params, out);
+
+    const u16 tile_rect[4] = {
+        to_unorm16(std::min(piece.source.start.x, piece.source.end.x)),
+        to_unorm16(std::min(piece.source.start.y, piece.source.end.y)),
+        to_unorm16(std::abs(piece.source.end.x - piece.source.start.x)),
+        to_unorm16(std::abs(piece.source.end.y - piece.source.start.y))};
+    static_assert(sizeof(tile_rect) == 2 * sizeof(float));
+    for (std::size_t i = 0; i < vertices_per_quad; ++i) {
+        std::memcpy(out + i * floats_per_vertex + tile_rect_slot, tile_rect, sizeof(tile_rect));
+    }
+}
+
+#if defined(ARYIBI_MESH_KERNELS_AVX) || defined(ARYIBI_MESH_KERNELS_SSE2)
+
+/// A quad is 28 floats, so it is stored as 7 whole registers of 4 floats each, which cut through
+/// the vertices like this (See write_piece_scalar() for the vertex order, r is the tile rect):
+///   x0 y0 z0 u0 | v0 r  r  x1 | y1 z1 u1 v1 | r  r  x2 y2 | z2 u2 v2 r | r  x3 y3 z3 | u3 v3 r  r
+constexpr std::size_t registers_per_quad = floats_per_quad / 4;
+static_assert(floats_per_quad % 4 == 0);
+
+/// Builds the registers of whole quads from raw pieces. The registers of Ops hold one piece per
+/// 128-bit lane, and none of the operations used cross lanes, so this works the same for SSE and
+/// AVX registers. Everything that only depends on the parameters is calculated once up front.
+template<typename Ops> class QuadBuilder {
+public:
+    using V = typename Ops::V;
+
+    explicit QuadBuilder(SpriteVertexParams const& params) :
+        offset(Ops::set(params.offset.x, params.offset.y)),
+        slope(Ops::set(params.horizontal_slope, params.vertical_slope)),
+        z_min(Ops::set1(params.z_min)),
+        z_max(Ops::set1(params.z_max)),
+        z_offset(Ops::set1(params.offset.z)),
+        zero(Ops::zero()),
+        keep_x_w(Ops::mask(true, false, false, true)),
+        keep_z_w(Ops::mask(false, false, true, true)),
+        keep_x_y_z(Ops::mask(true, true, true, false)),
+        keep_y_z_w(Ops::mask(false, true, true, true)) {}
+
+    /// Calculates the registers of the quad of a piece with source S and destination D, both
+    /// loaded as (start.x, start.y, end.x, end.y). Tile rects are left empty.
+    void build(V S, V D, V* out) const {
+        // (px0, py0, px1, py1): The corners of the destination, already offset.
+        const V P = Ops::add(D, offset);
+        // (zx0, zy0, zx1, zy1), then (z00, z10, z01, z11): The final Z of each corner.
+        const V C = Ops::min(Ops::max(Ops::mul(D, slope), z_min), z_max);
+        const V Z = Ops::add(Ops::add(Ops::template shuffle<_MM_SHUFFLE(2, 0, 2, 0)>(C, C),
+                                      Ops::template shuffle<_MM_SHUFFLE(3, 3, 1, 1)>(C, C)),
+                             z_offset);
+        // (u0, t0, u1, t1): The corners of the source. The vertices of the bottom row use t1.
+        const V& T = S;
+
+        const V ZT_lo = Ops::unpacklo(Z, T);                                   // z00 u0  z10 t0
+        const V PZ_lo = Ops::unpacklo(P, Z);                                   // px0 z00 py0 z10
+        const V T_Z = Ops::template shuffle<_MM_SHUFFLE(2, 2, 1, 0)>(T, Z);    // u0  t0  z01 z01
+        const V P_Z = Ops::template shuffle<_MM_SHUFFLE(3, 3, 3, 2)>(P, Z);    // px1 py1 z11 z11
+        out[0] = Ops::template shuffle<_MM_SHUFFLE(1, 0, 1, 0)>(P, ZT_lo);     // px0 py0 z00 u0
+        out[1] = Ops::bit_and(Ops::template shuffle<_MM_SHUFFLE(2, 2, 3, 3)>(T, P),
+                              keep_x_w);                                       // t1  0   0   px1
+        out[2] = Ops::template shuffle<_MM_SHUFFLE(3, 2, 3, 2)>(PZ_lo, T);     // py0 z10 u1  t1
+        out[3] = Ops::bit_and(Ops::template shuffle<_MM_SHUFFLE(3, 0, 0, 0)>(P, P),
+                              keep_z_w);                                       // 0   0   px0 py1
+        out[4] = Ops::bit_and(Ops::template shuffle<_MM_SHUFFLE(1, 1, 0, 2)>(T_Z, T_Z),
+                              keep_x_y_z);                                     // z01 u0  t0  0
+        out[5] = Ops::bit_and(Ops::template shuffle<_MM_SHUFFLE(2, 1, 0, 0)>(P_Z, P_Z),
+                              keep_y_z_w);                                     // 0   px1 py1 z11
+        out[6] = Ops::template shuffle<_MM_SHUFFLE(0, 0, 1, 2)>(T, zero);      // u1  t0  0   0
+    }
+
+private:
+    V offset, slope, z_min, z_max, z_offset, zero;
+    V keep_x_w, keep_z_w, keep_x_y_z, keep_y_z_w;
+};
+
+#endif
+
+#if defined(ARYIBI_MESH_KERNELS_AVX)
+
+/// Processes two pieces at once, one on each 128-bit lane.
+struct AVXOps {
+    using V = __m256;
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V min(V a, V b) { return _mm256_min_ps(a, b); }
+    static V max(V a, V b) { return _mm256_max_ps(a, b); }
+    static V bit_and(V a, V b) { return _mm256_and_ps(a, b); }
+    static V zero() { return _mm256_setzero_ps(); }
+    static V set1(float x) { return _mm256_set1_ps(x); }
+    /// (x, y, x, y) on both lanes.
+    static V set(float x, float y) { return _mm256_setr_ps(x, y, x, y, x, y, x, y); }
+    /// All bits set in the elements to keep, on both lanes.
+    static V mask(bool x, bool y, bool z, bool w) {
+        const int m[4] = {x ? -1 : 0, y ? -1 : 0, z ? -1 : 0, w ? -1 : 0};
+        return _mm256_castsi256_ps(
+            _mm256_setr_epi32(m[0], m[1], m[2], m[3], m[0], m[1], m[2], m[3]));
+    }
+    static V unpacklo(V a, V b) { return _mm256_unpacklo_ps(a, b); }
+    template<int imm> static V shuffle(V a, V b) { return _mm256_shuffle_ps(a, b, imm); }
+};
+
+std::size_t write_pieces_vectorized(const sprites::Sprite::Piece* pieces,
+                                    std::size_t count,
+                                    SpriteVertexParams const& params,
+                                    float* out) {
+    const QuadBuilder<AVXOps> builder(params);
+    std::size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m256 a = _mm256_loadu_ps(reinterpret_cast<const float*>(pieces + i));
+        const __m256 b = _mm256_loadu_ps(reinterpret_cast<const float*>(pieces + i + 1));
+        // R[j] holds register j of the first quad on its low lane, and of the second on its high
+        // one. Both quads are contiguous, so their 14 registers are stored in pairs.
+        __m256 R[registers_per_quad];
+        builder.build(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31), R);
+        float* const quads = out + i * floats_per_quad;
+        _mm256_storeu_ps(quads + 0, _mm256_permute2f128_ps(R[0], R[1], 0x20));
+        _mm256_storeu_ps(quads + 8, _mm256_permute2f128_ps(R[2], R[3], 0x20));
+        _mm256_storeu_ps(quads + 16, _mm256_permute2f128_ps(R[4], R[5], 0x20));
+        _mm256_storeu_ps(quads + 24, _mm256_permute2f128_ps(R[6], R[0], 0x30));
+        _mm256_storeu_ps(quads + 32, _mm256_permute2f128_ps(R[1], R[2], 0x31));
+        _mm256_storeu_ps(quads + 40, _mm256_permute2f128_ps(R[3], R[4], 0x31));
+        _mm256_storeu_ps(quads + 48, _mm256_permute2f128_ps(R[5], R[6], 0x31));
+    }
+    return i;
+}
+
+#elif defined(ARYIBI_MESH_KERNELS_SSE2)
+
+struct SSE2Ops {
+    using V = __m128;
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V min(V a, V b) { return _mm_min_ps(a, b); }
+    static V max(V a, V b) { return _mm_max_ps(a, b); }
+    static V bit_and(V a, V b) { return _mm_and_ps(a, b); }
+    static V zero() { return _mm_setzero_ps(); }
+    static V set1(float x) { return _mm_set1_ps(x); }
+    /// (x, y, x, y)
+    static V set(float x, float y) { return _mm_setr_ps(x, y, x, y); }
+    /// All bits set in the elements to keep.
+    static V mask(bool x, bool y, bool z, bool w) {
+        return _mm_castsi128_ps(_mm_setr_epi32(x ? -1 : 0, y ? -1 : 0, z ? -1 : 0, w ? -1 : 0));
+    }
+    static V unpacklo(V a, V b) { return _mm_unpacklo_ps(a, b); }
+    template<int imm> static V shuffle(V a, V b) { return _mm_shuffle_ps(a, b, imm); }
+};
+
+std::size_t write_pieces_vectorized(const sprites::Sprite::Piece* pieces,
+                                    std::size_t count,
+                                    SpriteVertexParams const& params,
+                                    float* out) {
+    const QuadBuilder<SSE2Ops> builder(params);
+    for (std::size_t i = 0; i < count; ++i) {
+        const float* const piece = reinterpret_cast<const float*>(pieces + i);
+        __m128 R[registers_per_quad];
+        builder.build(_mm_loadu_ps(piece), _mm_loadu_ps(piece + 4), R);
+        float* const quad = out + i * floats_per_quad;
+        _mm_storeu_ps(quad + 0, R[0]);
+        _mm_storeu_ps(quad + 4, R[1]);
+        _mm_storeu_ps(quad + 8, R[2]);
+        _mm_storeu_ps(quad + 12, R[3]);
+        _mm_storeu_ps(quad + 16, R[4]);
+        _mm_storeu_ps(quad + 20, R[5]);
+        _mm_storeu_ps(quad + 24, R[6]);
+    }
+    return count;
+}
+
+#else
+
+std::size_t write_pieces_vectorized(const sprites::Sprite::Piece*,
+                                    std::size_t,
+                                    SpriteVertexParams const&,
+                                    float*) {
+    return 0;
+}
+
+#endif
+
+} // namespace
+
+void write_sprite_vertices(const sprites::Sprite::Piece* pieces,
+                           std::size_t count,
+                           SpriteVertexParams const& params,
+                           float* out) {
+    const std::size_t written = write_pieces_vectorized(pieces, count, params, out);
+    for (std::size_t i = written; i < count; ++i) {
+        write_piece_scalar(pieces[i], params, out + i * floats_per_quad);
+    }
+}
+
+void write_repeating_sprite_vertices(const sprites::Sprite::Piece* pieces,
+                                     std::size_t count,
+                                     aml::Vector2 repeat,
+                                     SpriteVertexParams const& params,
+                                     float* out) {
+    // Repeating pieces are rare (Mostly merged tilemap areas), so they don't have a vectorized
+    // version.
+    for (std::size_t i = 0; i < count; ++i) {
+        write_repeating_piece_scalar(pieces[i], repeat, params, out + i * floats_per_quad);
+    }
+}
+
+void append_sprite_vertices(VertexBuffer& vertices,
+                            sprites::Sprite const& spr,
+                            SpriteVertexParams const& params) {
+    write_sprite_vertices(spr.pieces.data(), spr.pieces.size(), params,
+                          append_uninitialized_quads(vertices, spr.pieces.size()));
+}
+
+void append_repeating_sprite_vertices(VertexBuffer& vertices,
+                                      sprites::Sprite const& spr,
+                                      aml::Vector2 repeat,
+                                      SpriteVertexParams const& params) {
+    write_repeating_sprite_vertices(spr.pieces.data(), spr.pieces.size(), repeat, params,
+                                    append_uninitialized_quads(vertices, spr.pieces.size()));
+}
+
+float* append_uninitialized_quads(VertexBuffer& vertices, std::size_t quad_count) {
+    const std::size_t prev_size = vertices.size();
+    vertices.resize(prev_size + quad_count * floats_per_quad);
+    return vertices.data() + prev_size;
+}
+
+std::vector<MeshRegionWriter> make_region_writers(float* begin,
+                                                  std::vector<usize> const& piece_counts) {
+    std::vector<MeshRegionWriter> writers;
+    writers.reserve(piece_counts.size());
+    for (const usize count : piece_counts) {
+        float* const end = begin + count * floats_per_quad;
+        writers.push_back(MeshRegionWriter(begin, end));
+        begin = end;
+    }
+    return writers;
+}
+
+std::vector<MeshRegionWriter> reserve_regions(VertexBuffer& vertices,
+                                              std::vector<usize> const& piece_counts) {
+    usize total_pieces = 0;
+    for (const usize count : piece_counts) { total_pieces += count; }
+    return make_region_writers(append_uninitialized_quads(vertices, total_pieces), piece_counts);
+}
+
+DirtyQuads write_quads(VertexBuffer& vertices, std::size_t first_quad, VertexBuffer const& source) {
+    const std::size_t prev_quad_count = vertices.size() / floats_per_quad;
+    const std::size_t first_float = first_quad * floats_per_quad;
+    if (vertices.size() < first_float + source.size())
+        vertices.resize(first_float + source.size(), 0.f);
+    std::copy(source.begin(), source.end(), vertices.begin() + first_float);
+    return {std::min(first_quad, prev_quad_count), first_quad + source.size() / floats_per_quad};
+}
+
+void write_quad_indices(u32* out, std::size_t first_quad, std::size_t quad_count) {
+    for (std::size_t i = 0; i < quad_count; ++i) {
+        const u32 base = static_cast<u32>((first_quad + i) * vertices_per_quad);
+        // Same winding as the vertex order in write_piece_scalar()
+        out[i * indices_per_quad + 0] = base + 0;
+        out[i * indices_per_quad + 1] = base + 1;
+        out[i * indices_per_quad + 2] = base + 2;
+        out[i * indices_per_quad + 3] = base + 1;
+        out[i * indices_per_quad + 4] = base + 3;
+        out[i * indices_per_quad + 5] = base + 2;
+    }
+}
+
+} // namespace aryibi::renderer::common
+
+namespace aryibi::renderer {
+
+MeshRegionWriter::MeshRegionWriter(float* region_begin, float* region_end) :
+    cursor(region_begin), end(region_end) {}
+
+void MeshRegionWriter::add_sprite(sprites::Sprite const& spr,
+                                  aml::Vector3 offset,
+                                  float vertical_slope,
+                                  float horizontal_slope,
+                                  float z_min,
+                                  float z_max) {
+    ARYIBI_ASSERT(spr.pieces.size() <= remaining_pieces(),
+                  "Not enough space left in the mesh region for this sprite!");
+    common::write_sprite_vertices(spr.pieces.data(), spr.pieces.size(),
+                                  {offset, vertical_slope, horizontal_slope, z_min, z_max}, cursor);
+    cursor += spr.pieces.size() * common::floats_per_quad;
+}
+
+void MeshRegionWriter::fill_remaining() {
+    // All the vertices of the quad are at the same position, so they have no area.
+    std::fill(cursor, end, 0.f);
+    cursor = end;
+}
+
+usize MeshRegionWriter::remaining_pieces() const {
+    return static_cast<usize>(end - cursor) / common::floats_per_quad;
+}
+
+} // namespace aryibi::renderer
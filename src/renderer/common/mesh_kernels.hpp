@@ -0,0 +1,127 @@
+#ifndef ARYIBI_COMMON_MESH_KERNELS_HPP
+#define ARYIBI_COMMON_MESH_KERNELS_HPP
+
+#include "aryibi/sprites.hpp"
+
+#include <anton/math/vector3.hpp>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// Backend-independent code shared by every renderer implementation.
+namespace aryibi::renderer::common {
+
+/// An allocator that default-initializes elements instead of value-initializing them, so resizing
+/// a vector of floats doesn't zero-fill memory that is going to be overwritten right after.
+template<typename T> struct DefaultInitAllocator : std::allocator<T> {
+    template<typename U> struct rebind {
+        using other = DefaultInitAllocator<U>;
+    };
+
+    DefaultInitAllocator() = default;
+    template<typename U> DefaultInitAllocator(DefaultInitAllocator<U> const&) noexcept {}
+
+    template<typename U>
+    void construct(U* ptr) noexcept(std::is_nothrow_default_constructible_v<U>) {
+        ::new (static_cast<void*>(ptr)) U;
+    }
+    template<typename U, typename... Args> void construct(U* ptr, Args&&... args) {
+        ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+    }
+};
+
+/// Vertex data of a mesh under construction.
+using VertexBuffer = std::vector<float, DefaultInitAllocator<float>>;
+
+/// Each vertex is: X, Y, Z position + U, V texture coordinates + the rect of the texture that the
+/// UVs repeat inside of (See tile_rect_slot), in 7 float-sized slots.
+constexpr std::size_t floats_per_vertex = 7;
+/// The slot of a vertex in which its tile rect starts. The rect takes 2 slots, which hold 4
+/// normalized 16-bit integers instead of floats: start X, start Y, width and height, in UV units.
+/// A rect with no size means the UVs are used as they are. Otherwise, they are relative to the
+/// rect, and the shaders wrap them around so the rect repeats once per UV unit.
+constexpr std::size_t tile_rect_slot = 5;
+/// Each sprite piece is drawn as two indexed triangles sharing the diagonal, so a quad only needs
+/// its 4 corners: bottom left, bottom right, top left, top right.
+constexpr std::size_t vertices_per_quad = 4;
+constexpr std::size_t indices_per_quad = 6;
+constexpr std::size_t floats_per_quad = floats_per_vertex * vertices_per_quad;
+
+/// The parameters of MeshBuilder::add_sprite() that are shared by all the pieces of a sprite.
+struct SpriteVertexParams {
+    anton::math::Vector3 offset;
+    float vertical_slope;
+    float horizontal_slope;
+    float z_min;
+    float z_max;
+};
+
+/// Writes the vertices of count pieces to out, which must have space for count * floats_per_quad
+/// floats. Uses AVX or SSE2 when available, which build each quad in registers and store it whole.
+/// AVX builds two quads at once.
+void write_sprite_vertices(const sprites::Sprite::Piece* pieces,
+                           std::size_t count,
+                           SpriteVertexParams const& params,
+                           float* out);
+
+/// Same as write_sprite_vertices(), but the source of every piece is repeated across its
+/// destination, repeat.x times horizontally and repeat.y times vertically.
+void write_repeating_sprite_vertices(const sprites::Sprite::Piece* pieces,
+                                     std::size_t count,
+                                     anton::math::Vector2 repeat,
+                                     SpriteVertexParams const& params,
+                                     float* out);
+
+/// Appends the vertices of every piece of a sprite to a vertex buffer.
+void append_sprite_vertices(VertexBuffer& vertices,
+                            sprites::Sprite const& spr,
+                            SpriteVertexParams const& params);
+
+/// Same as append_sprite_vertices(), but with write_repeating_sprite_vertices().
+void append_repeating_sprite_vertices(VertexBuffer& vertices,
+                                      sprites::Sprite const& spr,
+                                      anton::math::Vector2 repeat,
+                                      SpriteVertexParams const& params);
+
+/// Grows a vertex buffer by quad_count quads, leaving them uninitialized, and returns a pointer
+/// to the first one.
+float* append_uninitialized_quads(VertexBuffer& vertices, std::size_t quad_count);
+
+/// Grows a vertex buffer by one uninitialized region per element of piece_counts, each with space
+/// for that many quads, and returns a writer for each. Implements MeshBuilder::reserve_regions()
+/// for every backend.
+std::vector<MeshRegionWriter> reserve_regions(VertexBuffer& vertices,
+                                              std::vector<usize> const& piece_counts);
+
+/// A range of quads of a dynamic mesh that changed since it was last uploaded, so that only those
+/// have to be uploaded again.
+struct DirtyQuads {
+    std::size_t first = 0;
+    std::size_t end = 0;
+
+    [[nodiscard]] bool empty() const { return first >= end; }
+    /// Grows the range so that it also contains another one.
+    void add(DirtyQuads range) {
+        if (range.empty())
+            return;
+        first = empty() ? range.first : std::min(first, range.first);
+        end = std::max(end, range.end);
+    }
+};
+
+/// Copies the quads of source into vertices, starting at the quad first_quad. Grows vertices if
+/// needed, filling any gap before first_quad with degenerate quads.
+/// @returns The quads that changed, including the degenerate ones.
+DirtyQuads write_quads(VertexBuffer& vertices, std::size_t first_quad, VertexBuffer const& source);
+
+/// Writes the indices of quad_count quads, starting at the quad first_quad, to out, which must
+/// have space for quad_count * indices_per_quad indices. Every mesh uses the same index pattern,
+/// so backends generate it once and share the resulting index buffer between all meshes.
+void write_quad_indices(u32* out, std::size_t first_quad, std::size_t quad_count);
+
+} // namespace aryibi::renderer::common
+
+#endif // ARYIBI_COMMON_MESH_KERNELS_HPP
@@ -0,0 +1,107 @@
+#include "renderer/common/shadow_atlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace aryibi::renderer::common {
+
+float shadow_importance(sprites::Rect2D const& area, sprites::Rect2D const& view, float intensity) {
+    const float view_area = (view.end.x - view.start.x) * (view.end.y - view.start.y);
+    const float overlap_width =
+        std::min(area.end.x, view.end.x) - std::max(area.start.x, view.start.x);
+    const float overlap_height =
+        std::min(area.end.y, view.end.y) - std::max(area.start.y, view.start.y);
+    if (overlap_width <= 0 || overlap_height <= 0 || view_area <= 0 || intensity <= 0)
+        return 0;
+    return overlap_width * overlap_height / view_area * intensity;
+}
+
+u32 max_shadow_atlas_level(u32 atlas_width, u32 atlas_height, u32 min_tile_pixels) {
+    u32 level = 0;
+    u32 tile_pixels = std::min(atlas_width, atlas_height);
+    while (tile_pixels / 2 >= min_tile_pixels) {
+        tile_pixels /= 2;
+        ++level;
+    }
+    return level;
+}
+
+void ShadowAtlasAllocator::allocate(std::vector<float> const& importances,
+                                    u32 max_level,
+                                    std::vector<ShadowTile>& tiles) {
+    const std::size_t light_count = importances.size();
+    tiles.assign(light_count, {{0, 0}, 0});
+    float total_importance = 0;
+    for (const float importance : importances) { total_importance += importance; }
+    if (total_importance <= 0)
+        return;
+
+    // A tile of level L takes 1/4^L of the atlas, so the deepest level whose area still covers the
+    // share of the light is log4(1 / share), rounded up so that all the shares add up to 1 at most.
+    levels.resize(light_count);
+    order.clear();
+    for (u32 i = 0; i < light_count; ++i) {
+        if (importances[i] <= 0)
+            continue;
+        const float share = importances[i] / total_importance;
+        const float level = std::ceil(std::log2(1.f / share) / 2.f - 1e-4f);
+        levels[i] = std::min(static_cast<u32>(std::max(level, 0.f)), max_level);
+        order.push_back(i);
+    }
+
+    // Rounding up leaves part of the atlas unused, so give bigger tiles to the most important
+    // lights while the tiles still add up to the whole atlas at most.
+    auto area = [](u32 level) { return 1.f / static_cast<float>(1u << (2 * level)); };
+    float used_area = 0;
+    for (const u32 light : order) { used_area += area(levels[light]); }
+    std::stable_sort(order.begin(), order.end(),
+                     [&importances](u32 a, u32 b) { return importances[a] > importances[b]; });
+    for (bool promoted = true; promoted;) {
+        promoted = false;
+        for (const u32 light : order) {
+            const u32 level = levels[light];
+            if (level == 0 || used_area - area(level) + area(level - 1) > 1.f)
+                continue;
+            used_area += area(level - 1) - area(level);
+            levels[light] = level - 1;
+            promoted = true;
+        }
+    }
+
+    // Placing the biggest tiles first never leaves gaps that a later tile can't use.
+    std::stable_sort(order.begin(), order.end(),
+                     [this](u32 a, u32 b) { return levels[a] < levels[b]; });
+
+    free_nodes.assign(max_level + 1, {});
+    free_nodes[0].push_back({0, 0, 0});
+    for (const u32 light : order) {
+        Node node;
+        if (!take_node(levels[light], node))
+            continue;
+        const float size = 1.f / static_cast<float>(1u << node.level);
+        tiles[light] = {{node.x * size, node.y * size}, size};
+    }
+}
+
+bool ShadowAtlasAllocator::take_node(u32 level, Node& node) {
+    auto& nodes = free_nodes[level];
+    if (nodes.empty()) {
+        Node parent;
+        if (level == 0 || !take_node(level - 1, parent))
+            return false;
+        // Keep the first child and free the other three, in reverse so that they're taken in
+        // order.
+        const u32 x = parent.x * 2;
+        const u32 y = parent.y * 2;
+        nodes.push_back({level, x + 1, y + 1});
+        nodes.push_back({level, x, y + 1});
+        nodes.push_back({level, x + 1, y});
+        node = {level, x, y};
+        return true;
+    }
+    node = nodes.back();
+    nodes.pop_back();
+    return true;
+}
+
+} // namespace aryibi::renderer::common
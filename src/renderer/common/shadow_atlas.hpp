@@ -0,0 +1,62 @@
+#ifndef ARYIBI_COMMON_SHADOW_ATLAS_HPP
+#define ARYIBI_COMMON_SHADOW_ATLAS_HPP
+
+#include "aryibi/sprites.hpp"
+
+#include <anton/math/vector2.hpp>
+#include <anton/types.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace aryibi::renderer::common {
+
+using namespace anton; // For integer types
+
+/// The square of the shadow atlas given to a light, in UV coordinates.
+struct ShadowTile {
+    anton::math::Vector2 position;
+    /// 0 if the light didn't get a tile.
+    float size;
+};
+
+/// How much a light deserves a big tile of the shadow atlas: the fraction of the view it can
+/// light, times its intensity. 0 if it can't light anything within the view.
+/// @param area The area of the XY plane the light can light (Bigger for bigger radii).
+float shadow_importance(sprites::Rect2D const& area, sprites::Rect2D const& view, float intensity);
+
+/// The deepest level a tile of the atlas can be at (Each level halves the size of the tiles), so
+/// that tiles don't go below min_tile_pixels on either side.
+u32 max_shadow_atlas_level(u32 atlas_width, u32 atlas_height, u32 min_tile_pixels = 64);
+
+/// Splits the shadow atlas between lights with a quadtree. Each light asks for a tile whose area
+/// is about its share of the total importance, and tiles are placed biggest first, so they always
+/// fit unless they get clamped to max_level. Lights with no importance, or that don't fit, get no
+/// tile. Lights at the same level are placed in order, so the tiles stay in place across frames
+/// as long as their levels don't change, which keeps the shadow cache valid.
+class ShadowAtlasAllocator {
+public:
+    /// @param tiles Resized to the number of lights.
+    void allocate(std::vector<float> const& importances,
+                  u32 max_level,
+                  std::vector<ShadowTile>& tiles);
+
+private:
+    struct Node {
+        u32 level;
+        u32 x;
+        u32 y;
+    };
+
+    /// Takes a free node of the given level, splitting a bigger one if there's none.
+    [[nodiscard]] bool take_node(u32 level, Node& node);
+
+    /// Free nodes of each level.
+    std::vector<std::vector<Node>> free_nodes;
+    std::vector<u32> levels;
+    std::vector<u32> order;
+};
+
+} // namespace aryibi::renderer::common
+
+#endif // ARYIBI_COMMON_SHADOW_ATLAS_HPP
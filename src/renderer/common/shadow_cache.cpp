@@ -0,0 +1,50 @@
+#include "renderer/common/shadow_cache.hpp"
+#include "util/aryibi_assert.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace aryibi::renderer::common {
+
+void ShadowKey::add(const void* data, std::size_t size) {
+    const auto* bytes = static_cast<const u8*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+u64 next_mesh_version() {
+    // Meshes can be created from several threads at once.
+    static std::atomic<u64> version = 0;
+    return ++version;
+}
+
+void ShadowTileCache::update(std::vector<u64> const& placements, std::vector<u64> const& contents) {
+    ARYIBI_ASSERT(placements.size() == contents.size(),
+                  "[Internal error] Shadow tile keys don't match the lights!");
+    const std::size_t light_count = placements.size();
+    ++frame;
+    draw.assign(light_count, 0);
+    outdated.clear();
+    for (std::size_t i = 0; i < light_count; ++i) {
+        if (i >= tiles.size() || tiles[i].placement != placements[i])
+            draw[i] = 1;
+        else if (tiles[i].contents != contents[i])
+            outdated.push_back(i);
+    }
+    if (refresh_budget != 0 && outdated.size() > refresh_budget) {
+        std::partial_sort(outdated.begin(), outdated.begin() + refresh_budget, outdated.end(),
+                          [this](u32 a, u32 b) { return tiles[a].drawn_frame < tiles[b].drawn_frame; });
+        outdated.resize(refresh_budget);
+    }
+    for (const u32 i : outdated) { draw[i] = 1; }
+
+    tiles.resize(light_count);
+    for (std::size_t i = 0; i < light_count; ++i) {
+        if (draw[i])
+            tiles[i] = {placements[i], contents[i], frame};
+    }
+}
+
+} // namespace aryibi::renderer::common
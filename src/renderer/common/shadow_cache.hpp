@@ -0,0 +1,68 @@
+#ifndef ARYIBI_COMMON_SHADOW_CACHE_HPP
+#define ARYIBI_COMMON_SHADOW_CACHE_HPP
+
+#include <anton/types.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace aryibi::renderer::common {
+
+using namespace anton; // For integer types
+
+/// Hashes (FNV-1a) everything that ends up in a tile of the shadow atlas, so that a tile is only
+/// drawn again when its key changes.
+class ShadowKey {
+public:
+    void add(const void* data, std::size_t size);
+    /// T must have no padding bytes, since they would be hashed too.
+    template<typename T> void add(T const& value) { add(&value, sizeof(T)); }
+
+    [[nodiscard]] u64 value() const { return hash; }
+
+private:
+    u64 hash = 14695981039346656037ull;
+};
+
+/// A number never returned before. Meshes take a new one whenever their vertices change, so that
+/// the shadow tiles they are drawn into notice it.
+u64 next_mesh_version();
+
+/// Remembers what was drawn into the tile of each light in the shadow atlas, and decides which
+/// tiles have to be drawn again. Lights are identified by their index in the frame, so reordering
+/// them just makes their tiles look outdated.
+class ShadowTileCache {
+public:
+    /// Limits how many outdated tiles are drawn again per frame. The ones left out keep their old
+    /// contents and are drawn in later frames, oldest first. Tiles that were never drawn or that
+    /// moved within the atlas don't count, since they have no valid contents to keep.
+    /// @param tiles 0 means no limit.
+    void set_refresh_budget(u32 tiles) { refresh_budget = tiles; }
+    /// Forgets the contents of every tile, e.g. because the atlas was recreated.
+    void invalidate() { tiles.clear(); }
+
+    /// Decides which tiles to draw this frame, and assumes they are drawn.
+    /// @param placements The key of the rect of each light's tile within the atlas.
+    /// @param contents The key of what is drawn into each light's tile.
+    void update(std::vector<u64> const& placements, std::vector<u64> const& contents);
+
+    [[nodiscard]] bool needs_draw(std::size_t light) const { return draw[light]; }
+
+private:
+    struct Tile {
+        u64 placement = 0;
+        u64 contents = 0;
+        u64 drawn_frame = 0;
+    };
+
+    /// Tiles past the end of the vector have never been drawn.
+    std::vector<Tile> tiles;
+    std::vector<u8> draw;
+    std::vector<u32> outdated;
+    u64 frame = 0;
+    u32 refresh_budget = 0;
+};
+
+} // namespace aryibi::renderer::common
+
+#endif // ARYIBI_COMMON_SHADOW_CACHE_HPP
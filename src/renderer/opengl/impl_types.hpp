@@ -2,14 +2,22 @@
 #define ARYIBI_OPENGL_IMPL_TYPES_HPP
 
 #include "aryibi/renderer.hpp"
+#include "renderer/common/culling.hpp"
+#include "renderer/common/draw_order.hpp"
+#include "renderer/common/light_tiles.hpp"
+#include "renderer/common/mesh_arena.hpp"
+#include "renderer/common/mesh_kernels.hpp"
+#include "renderer/common/shadow_atlas.hpp"
+#include "renderer/common/shadow_cache.hpp"
+#include "renderer/opengl/state_encoder.hpp"
 
 #include <vector>
 
 namespace aryibi::renderer {
 
 struct TextureHandle::impl {
-    u32 width;
-    u32 height;
+    u32 width = 0;
+    u32 height = 0;
     ColorType color_type;
     FilteringMethod filter;
     u32 handle = 0;
@@ -18,28 +26,86 @@ struct TextureHandle::impl {
 #endif
 };
 
-struct MeshHandle::impl {
+/// The data of a dynamic mesh, shared between all the handles to it.
+struct DynMeshData {
+    /// Copy of the vertices in CPU memory. Uploaded when the mesh is drawn after modifying it.
+    common::VertexBuffer vertices;
+    u32 vbo = 0;
+    u32 vao = 0;
+    /// Size of the storage of the vertex buffer, in floats.
+    usize buffer_capacity = 0;
+    /// The quads that must be uploaded on the next sync().
+    common::DirtyQuads dirty;
+    /// Changes whenever the vertices do. See common::next_mesh_version().
+    u64 version = 0;
+
+    /// Uploads the quads modified since the last call, if any. Must only be called right
+    /// before drawing the mesh, since it binds its VAO.
+    /// @returns The index count of the mesh.
+    u32 sync();
+};
+
+/// A big vertex buffer that static meshes are suballocated from, with a VAO that reads from it.
+struct MeshPage {
     u32 vbo = 0;
     u32 vao = 0;
-    u32 vertex_count;
+};
+
+struct MeshHandle::impl {
+    /// The vertices of static meshes live in the pages of the arena. Draws look up the current
+    /// range of the mesh every time, since compacting a page moves its meshes around.
+    u32 arena_id = common::MeshArena::no_mesh;
+    /// The index buffer is shared between all meshes. See MeshBuilder::finish().
+    u32 index_count = 0;
+    /// Local bounds of the vertices, used to cull the mesh. Dynamic meshes are never culled.
+    sprites::Rect2D bounds;
+    /// Non-null if this handle was returned by DynMeshHandle::mesh().
+    DynMeshData* dyn = nullptr;
+    /// See common::next_mesh_version(). Dynamic meshes keep theirs in DynMeshData instead.
+    u64 version = 0;
+
+    /// Changes whenever the vertices of the mesh do.
+    [[nodiscard]] u64 current_version() const { return dyn ? dyn->version : version; }
+
+    /// The VAO the mesh is drawn with. Shared by the static meshes of the same page.
+    [[nodiscard]] u32 vertex_array() const;
+
+    /// Binds the VAO of the mesh and draws it. Uploads the mesh data first if it is a dynamic mesh
+    /// that has been modified.
+    void draw(StateEncoder& state) const;
+
+    /// Reserves space for a static mesh in the arena, creating the buffers of any new page. If a
+    /// page has enough free space but it's too fragmented, it is compacted first, which is cheaper
+    /// than creating a new page.
+    /// @returns The arena ID of the mesh.
+    static u32 allocate(u32 vertex_count);
+    /// Moves all the meshes of a page to the start of a new vertex buffer, which replaces the old
+    /// one.
+    static void compact_page(u32 page_index);
+
+    static inline common::MeshArena arena;
+    /// Indexed like the pages of the arena.
+    static inline std::vector<MeshPage> pages;
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
     static inline std::unordered_map<u32, u32> handle_ref_count;
 #endif
 };
 
+struct DynMeshHandle::impl {
+    DynMeshData* data = nullptr;
+};
+
 struct ShaderHandle::impl {
     u32 handle = 0;
     u32 tile_tex_location = -1;
     u32 shadow_tex_location = -1;
+    u32 shadow_compare_tex_location = -1;
+    u32 light_buffer_tex_location = -1;
     u32 palette_tex_location = -1;
 };
 
 struct MeshBuilder::impl {
-    std::vector<float> result;
-
-    static constexpr auto sizeof_vertex = 5;
-    static constexpr auto sizeof_triangle = 3 * sizeof_vertex;
-    static constexpr auto sizeof_quad = 2 * sizeof_triangle;
+    common::VertexBuffer result;
 };
 
 struct Framebuffer::impl {
@@ -59,12 +125,55 @@ struct Renderer::impl {
     ShaderHandle lit_shader;
     ShaderHandle unlit_shader;
     ShaderHandle depth_shader;
+    ShaderHandle light_buffer_shader;
     Framebuffer shadow_depth_fb;
     TextureHandle palette_texture;
 
     Framebuffer window_framebuffer;
 
+    /// The common::ShaderLightInfo of the frame.
     unsigned int lights_ubo;
+    unsigned int directional_lights_ssbo;
+    unsigned int point_lights_ssbo;
+    /// The lists of point lights of each tile of the screen (See common::LightTileGrid).
+    unsigned int light_tiles_ssbo;
+    /// Samples the shadow atlas with depth comparison, for ShadowFilter::hardware_pcf.
+    unsigned int shadow_compare_sampler;
+    ShadowFilter shadow_filter = ShadowFilter::grid_25;
+
+    /// See Renderer::set_light_buffer_divisor(). 1 means no light buffer.
+    u32 light_buffer_divisor = 1;
+    /// Depth of the surfaces in front, at the size of the light buffer.
+    Framebuffer light_depth_fb;
+    unsigned int light_buffer_fbo = 0;
+    unsigned int light_buffer_tex = 0;
+    u32 light_buffer_width = 0;
+    u32 light_buffer_height = 0;
+    unsigned int empty_vao;
+
+    /// Creates the light buffer and its depth buffer, or resizes them if their size changed.
+    void resize_light_buffer(u32 width, u32 height);
+
+    /// World bounds of the commands of the frame being drawn. Kept to reuse their memory.
+    common::PackedRects command_bounds;
+    std::vector<u8> visible_commands;
+    /// Sorts the visible commands into the order they are drawn in.
+    common::DrawSorter draw_sorter;
+    /// Every bind and uniform of Renderer::draw() goes through it, to skip the redundant ones.
+    StateEncoder state;
+    common::ShadowCasterLists shadow_casters;
+    common::ShadowAtlasAllocator shadow_atlas;
+    std::vector<float> shadow_importances;
+    std::vector<common::ShadowTile> shadow_tiles;
+    std::vector<common::ShaderDirectionalLight> shader_directional_lights;
+    std::vector<common::ShaderPointLight> shader_point_lights;
+    common::PackedRects point_light_rects;
+    common::LightTileGrid light_grid;
+    /// Tiles of the shadow atlas are only drawn again when their key changes.
+    common::ShadowTileCache shadow_cache;
+    std::vector<u64> shadow_tile_placements;
+    std::vector<u64> shadow_tile_contents;
+    FrameStats stats;
 };
 
 }
@@ -86,6 +86,55 @@ static void debug_callback(GLenum const source,
 
 namespace aryibi::renderer {
 
+void Renderer::impl::resize_light_buffer(u32 width, u32 height) {
+    if (width == light_buffer_width && height == light_buffer_height)
+        return;
+    light_buffer_width = width;
+    light_buffer_height = height;
+
+    if (light_depth_fb.exists()) {
+        light_depth_fb.resize(width, height);
+    } else {
+        TextureHandle depth;
+        depth.init(width, height, TextureHandle::ColorType::depth,
+                   TextureHandle::FilteringMethod::point);
+        light_depth_fb = Framebuffer(depth);
+    }
+
+    // Light can go over 1, so the light buffer is a float texture. Framebuffer only makes 8 bit
+    // ones, which would clamp it.
+    if (light_buffer_tex == 0) {
+        glGenTextures(1, &light_buffer_tex);
+        glGenFramebuffers(1, &light_buffer_fbo);
+    }
+    glBindTexture(GL_TEXTURE_2D, light_buffer_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindFramebuffer(GL_FRAMEBUFFER, light_buffer_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, light_buffer_tex,
+                           0);
+}
+
+u32 MeshHandle::impl::vertex_array() const {
+    return dyn ? dyn->vao : pages[arena.range(arena_id).page].vao;
+}
+
+void MeshHandle::impl::draw(StateEncoder& state) const {
+    if (dyn) {
+        state.bind_vertex_array(dyn->vao);
+        glDrawElements(GL_TRIANGLES, dyn->sync(), GL_UNSIGNED_INT, nullptr);
+        return;
+    }
+    // Static meshes are just a range of a page, so they are drawn with an offset into it.
+    const auto& range = arena.range(arena_id);
+    state.bind_vertex_array(pages[range.page].vao);
+    glDrawElementsBaseVertex(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, nullptr,
+                             range.first_vertex);
+}
+
 Renderer::~Renderer() {
     glfwTerminate();
 }
@@ -130,10 +179,28 @@ Renderer::Renderer(windowing::WindowHandle _w) : window(_w), p_impl(std::make_un
              TextureHandle::FilteringMethod::point);
     p_impl->shadow_depth_fb = Framebuffer(tex);
 
-    constexpr u64 lights_ubo_aligned_size = 2768;
+    // Linear filtering on a comparison sampler averages the results of the 4 nearest texels.
+    glGenSamplers(1, &p_impl->shadow_compare_sampler);
+    glSamplerParameteri(p_impl->shadow_compare_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(p_impl->shadow_compare_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(p_impl->shadow_compare_sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(p_impl->shadow_compare_sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(p_impl->shadow_compare_sampler, GL_TEXTURE_COMPARE_MODE,
+                        GL_COMPARE_REF_TO_TEXTURE);
+    glSamplerParameteri(p_impl->shadow_compare_sampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
     glGenBuffers(1, &p_impl->lights_ubo);
     glBindBuffer(GL_UNIFORM_BUFFER, p_impl->lights_ubo);
-    glBufferData(GL_UNIFORM_BUFFER, lights_ubo_aligned_size, nullptr, GL_DYNAMIC_DRAW);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(common::ShaderLightInfo), nullptr, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &p_impl->directional_lights_ssbo);
+    glGenBuffers(1, &p_impl->point_lights_ssbo);
+    glGenBuffers(1, &p_impl->light_tiles_ssbo);
+
+    p_impl->light_buffer_shader = ShaderHandle::from_file("assets/opengl/light_buffer.vert",
+                                                          "assets/opengl/light_buffer.frag");
+    // The light buffer pass draws a single triangle with no vertex buffer, but core profiles need a
+    // vertex array bound anyway.
+    glGenVertexArrays(1, &p_impl->empty_vao);
 
     p_impl->window_framebuffer.p_impl->handle = 0;
 }
@@ -185,40 +252,52 @@ void Renderer::draw(DrawCmdList const& draw_commands, Framebuffer const& output_
     // what we want. The camera should be placed at +Z and looking at -Z so that objects that have
     // higher Z are closer to the camera.
     aml::Matrix4 view = aml::inverse(aml::translate(draw_commands.camera.position));
+    // The range of distances from the camera that it shows.
+    constexpr float camera_near = 0.0f;
+    constexpr float camera_far = 20.0f;
     aml::Matrix4 proj;
     if (draw_commands.camera.center_view) {
-        proj = aml::orthographic_rh(
-            -camera_view_size_in_tiles.x / 2.f, camera_view_size_in_tiles.x / 2.f,
-            -camera_view_size_in_tiles.y / 2.f, camera_view_size_in_tiles.y / 2.f, 0.0f, 20.0f);
+        proj = aml::orthographic_rh(-camera_view_size_in_tiles.x / 2.f,
+                                    camera_view_size_in_tiles.x / 2.f,
+                                    -camera_view_size_in_tiles.y / 2.f,
+                                    camera_view_size_in_tiles.y / 2.f, camera_near, camera_far);
     } else {
         proj = aml::orthographic_rh(0, camera_view_size_in_tiles.x, -camera_view_size_in_tiles.y, 0,
-                                    0.0f, 20.0f);
+                                    camera_near, camera_far);
     }
     aml::Matrix4 point_light_proj = aml::perspective_rh(aml::pi / 3.f * 2.f, 1, 1.f, 10.f);
 
-    /// The light depth texture is divided into NxN tiles, each one representing a light.
-    /// This constant represents N.
-    const int light_atlas_tiles = aml::ceil(
-        aml::sqrt(draw_commands.directional_lights.size() + draw_commands.point_lights.size()));
-
-    /// Update light UBO data
-    glBindBuffer(GL_UNIFORM_BUFFER, p_impl->lights_ubo);
-    const u32 directional_lights_count = draw_commands.directional_lights.size();
-    glBufferSubData(GL_UNIFORM_BUFFER, 480, 4, &directional_lights_count);
-
-    const u32 point_lights_count = draw_commands.point_lights.size();
-    glBufferSubData(GL_UNIFORM_BUFFER, 2736, 4, &point_lights_count);
-    constexpr u64 directional_light_size_aligned = 96;
-    u64 directional_light_i = 0;
-    ARYIBI_ASSERT(draw_commands.directional_lights.size() <= 5,
-                  "Maximum directional light count (5) surpassed!");
+    /// The light depth texture is split between the lights, giving bigger tiles to the ones that
+    /// light more of the view. Lights that can't light anything within the view get no tile.
+    const auto camera_rect =
+        common::camera_view_rect(draw_commands.camera, output_fb.texture().width(),
+                                 output_fb.texture().height());
+    auto& shadow_importances = p_impl->shadow_importances;
+    shadow_importances.clear();
     for (const auto& directional_light : draw_commands.directional_lights) {
-        aml::Vector4 color{directional_light.color.fred(), directional_light.color.fgreen(),
-                           directional_light.color.fblue(), directional_light.intensity};
-        static_assert(sizeof(aml::Vector4) == 16);
-        glBufferSubData(GL_UNIFORM_BUFFER, directional_light_i * directional_light_size_aligned + 0,
-                        16, &color.r);
+        shadow_importances.push_back(
+            common::shadow_importance(camera_rect, camera_rect, directional_light.intensity));
+    }
+    for (const auto& point_light : draw_commands.point_lights) {
+        shadow_importances.push_back(common::shadow_importance(
+            common::point_light_rect(point_light), camera_rect, point_light.intensity));
+    }
+    auto& shadow_tiles = p_impl->shadow_tiles;
+    p_impl->shadow_atlas.allocate(
+        shadow_importances,
+        common::max_shadow_atlas_level(p_impl->shadow_depth_fb.texture().width(),
+                                       p_impl->shadow_depth_fb.texture().height()),
+        shadow_tiles);
+    // The shader takes the filter as a number, the values of ShadowFilter (Never renderer_default).
+    auto light_shadow_filter = [&](Light const& light) -> u32 {
+        return static_cast<u32>(light.shadow_filter == ShadowFilter::renderer_default
+                                    ? p_impl->shadow_filter
+                                    : light.shadow_filter);
+    };
 
+    auto& shader_directional_lights = p_impl->shader_directional_lights;
+    shader_directional_lights.clear();
+    for (const auto& directional_light : draw_commands.directional_lights) {
         // To create the light view, we position the light as if it were a camera and
         // then invert the matrix.
         aml::Matrix4 lightView = aml::translate(draw_commands.camera.position);
@@ -230,40 +309,23 @@ void Renderer::draw(DrawCmdList const& draw_commands, Framebuffer const& output_
                      aml::rotate_x(directional_light.rotation.x);
         lightView = aml::inverse(lightView);
         directional_light.matrix = proj * lightView;
-        static_assert(sizeof(aml::Matrix4) == 64);
-        static_assert(sizeof(aml::Vector2) == 8);
-        glBufferSubData(GL_UNIFORM_BUFFER,
-                        directional_light_i * directional_light_size_aligned + 16, 64,
-                        directional_light.matrix.get_raw());
-        directional_light.light_atlas_pos = {
-            (float)(directional_light_i % light_atlas_tiles) / (float)light_atlas_tiles,
-            (float)(directional_light_i / light_atlas_tiles) / (float)light_atlas_tiles};
-        directional_light.light_atlas_size = 1.f / (float)light_atlas_tiles;
-        glBufferSubData(GL_UNIFORM_BUFFER,
-                        directional_light_i * directional_light_size_aligned + 80, 8,
-                        &directional_light.light_atlas_pos.x);
-        glBufferSubData(GL_UNIFORM_BUFFER,
-                        directional_light_i * directional_light_size_aligned + 88, 4,
-                        &directional_light.light_atlas_size);
-        ++directional_light_i;
+        const auto& tile = shadow_tiles[shader_directional_lights.size()];
+        directional_light.light_atlas_pos = tile.position;
+        directional_light.light_atlas_size = tile.size;
+
+        auto& shader_light = shader_directional_lights.emplace_back();
+        shader_light.color = {directional_light.color.fred(), directional_light.color.fgreen(),
+                              directional_light.color.fblue(), directional_light.intensity};
+        shader_light.light_space_matrix = directional_light.matrix;
+        shader_light.light_atlas_pos = {directional_light.light_atlas_pos, tile.size};
+        shader_light.shadow_filter = light_shadow_filter(directional_light);
     }
 
-    ARYIBI_ASSERT(draw_commands.directional_lights.size() <= 20,
-                  "Maximum point light count (20) surpassed!");
-    constexpr u64 point_light_size_aligned = 112;
-    constexpr u64 point_lights_offset = 496;
-    u64 point_light_i = 0;
+    auto& shader_point_lights = p_impl->shader_point_lights;
+    auto& point_light_rects = p_impl->point_light_rects;
+    shader_point_lights.clear();
+    point_light_rects.clear();
     for (const auto& point_light : draw_commands.point_lights) {
-        aml::Vector4 color{point_light.color.fred(), point_light.color.fgreen(),
-                           point_light.color.fblue(), point_light.intensity};
-        static_assert(sizeof(aml::Vector4) == 16);
-        glBufferSubData(GL_UNIFORM_BUFFER,
-                        point_lights_offset + point_light_i * point_light_size_aligned + 0, 16,
-                        &color.r);
-        glBufferSubData(GL_UNIFORM_BUFFER,
-                        point_lights_offset + point_light_i * point_light_size_aligned + 16, 4,
-                        &point_light.radius);
-
         // To create the light view, we position the light as if it were a camera and
         // then invert the matrix.
         // Point lights directly look at the scene, with no rotation because it's already looking at -Z (towards the scene).
@@ -271,118 +333,291 @@ void Renderer::draw(DrawCmdList const& draw_commands, Framebuffer const& output_
             aml::translate(point_light.position);
         lightView = aml::inverse(lightView);
         point_light.matrix = point_light_proj * lightView;
-        static_assert(sizeof(aml::Matrix4) == 64);
-        static_assert(sizeof(aml::Vector2) == 8);
-        glBufferSubData(GL_UNIFORM_BUFFER,
-                        point_lights_offset + point_light_i * point_light_size_aligned + 32, 64,
-                        point_light.matrix.get_raw());
-        point_light.light_atlas_pos = {
-            (float)((directional_lights_count + point_light_i) % light_atlas_tiles) /
-                (float)light_atlas_tiles,
-            (float)((directional_lights_count + point_light_i) / light_atlas_tiles) /
-                (float)light_atlas_tiles};
-        point_light.light_atlas_size = 1.f / (float)light_atlas_tiles;
-        glBufferSubData(GL_UNIFORM_BUFFER,
-                        point_lights_offset + point_light_i * point_light_size_aligned + 96, 8,
-                        &point_light.light_atlas_pos.x);
-        glBufferSubData(GL_UNIFORM_BUFFER,
-                        point_lights_offset + point_light_i * point_light_size_aligned + 104, 4,
-                        &point_light.light_atlas_size);
-        ++point_light_i;
+        const auto& tile =
+            shadow_tiles[shader_directional_lights.size() + shader_point_lights.size()];
+        point_light.light_atlas_pos = tile.position;
+        point_light.light_atlas_size = tile.size;
+
+        auto& shader_light = shader_point_lights.emplace_back();
+        shader_light.color = {point_light.color.fred(), point_light.color.fgreen(),
+                              point_light.color.fblue(), point_light.intensity};
+        shader_light.light_space_matrix = point_light.matrix;
+        shader_light.light_atlas_pos = {point_light.light_atlas_pos, tile.size};
+        shader_light.radius = point_light.radius;
+        shader_light.position = point_light.position;
+        shader_light.shadow_filter = light_shadow_filter(point_light);
+        // Lights that don't light anything aren't listed in any tile.
+        point_light_rects.push_back(point_light.intensity > 0
+                                        ? common::point_light_rect(point_light)
+                                        : common::empty_rect());
     }
-    aml::Vector3 ambient_light_color{draw_commands.ambient_light_color.fred(),
-                                     draw_commands.ambient_light_color.fgreen(),
-                                     draw_commands.ambient_light_color.fblue()};
-    glBufferSubData(GL_UNIFORM_BUFFER, 2752, 12, &ambient_light_color.x);
 
+    /// With a light buffer, lighting is computed once per pixel of it (See
+    /// set_light_buffer_divisor()). Otherwise it's computed by every fragment of every lit command.
+    const u32 light_buffer_divisor = p_impl->light_buffer_divisor;
+    const bool use_light_buffer = light_buffer_divisor > 1;
+    const u32 output_width = output_fb.texture().width();
+    const u32 output_height = output_fb.texture().height();
+    const u32 light_buffer_width =
+        std::max(1u, (output_width + light_buffer_divisor - 1) / light_buffer_divisor);
+    const u32 light_buffer_height =
+        std::max(1u, (output_height + light_buffer_divisor - 1) / light_buffer_divisor);
+    if (use_light_buffer)
+        p_impl->resize_light_buffer(light_buffer_width, light_buffer_height);
+
+    /// Only the point lights that overlap a tile of the screen are run for its fragments.
+    p_impl->light_grid.build(camera_rect, output_width, output_height, point_light_rects);
+    p_impl->stats.light_tiles = p_impl->light_grid.tile_count();
+    p_impl->stats.tiled_point_lights = p_impl->light_grid.listed_light_count();
+
+    common::ShaderLightInfo light_info{};
+    light_info.ambient_light_color = {draw_commands.ambient_light_color.fred(),
+                                      draw_commands.ambient_light_color.fgreen(),
+                                      draw_commands.ambient_light_color.fblue()};
+    light_info.directional_light_count = shader_directional_lights.size();
+    light_info.point_light_count = shader_point_lights.size();
+    light_info.light_buffer = use_light_buffer;
+    p_impl->light_grid.write_info(light_info);
+    glBindBuffer(GL_UNIFORM_BUFFER, p_impl->lights_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(light_info), &light_info);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    glUseProgram(p_impl->depth_shader.p_impl->handle);
-    glBindFramebuffer(GL_FRAMEBUFFER, p_impl->shadow_depth_fb.p_impl->handle);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glDepthFunc(GL_LEQUAL);
-    glActiveTexture(GL_TEXTURE0);
-    int light_index = 0;
+    // Storage buffers are allocated again every frame (Letting the driver orphan the old ones), and
+    // never empty, since empty buffers can't be bound.
+    auto upload_storage = [](unsigned int buffer, const void* data, usize size) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<usize>(size, 16), nullptr, GL_DYNAMIC_DRAW);
+        if (size != 0)
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+    };
+    upload_storage(p_impl->directional_lights_ssbo, shader_directional_lights.data(),
+                   shader_directional_lights.size() * sizeof(common::ShaderDirectionalLight));
+    upload_storage(p_impl->point_lights_ssbo, shader_point_lights.data(),
+                   shader_point_lights.size() * sizeof(common::ShaderPointLight));
+    upload_storage(p_impl->light_tiles_ssbo, p_impl->light_grid.data().data(),
+                   p_impl->light_grid.data().size() * sizeof(u32));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    p_impl->command_bounds.clear();
+    for (const auto& cmd : draw_commands.commands) {
+        p_impl->command_bounds.push_back(cmd.mesh.p_impl->bounds,
+                                         {cmd.transform.position.x, cmd.transform.position.y});
+    }
+
+    // Each light only draws the casters within the volume of its shadow map. Point lights don't
+    // light anything past their radius, so casters beyond it can't shadow anything either.
+    auto& shadow_casters = p_impl->shadow_casters;
+    shadow_casters.set_commands(draw_commands.commands, p_impl->command_bounds);
     for (const auto& directional_light : draw_commands.directional_lights) {
-        static const auto light_atlas_pos_location =
-            glGetUniformLocation(p_impl->depth_shader.p_impl->handle, "light_atlas_pos");
-        static const auto light_atlas_size_location =
-            glGetUniformLocation(p_impl->depth_shader.p_impl->handle, "light_atlas_size");
-        glViewport(directional_light.light_atlas_pos.x * p_impl->shadow_depth_fb.texture().width(),
-                   directional_light.light_atlas_pos.y * p_impl->shadow_depth_fb.texture().height(),
-                   directional_light.light_atlas_size * p_impl->shadow_depth_fb.texture().width(),
-                   directional_light.light_atlas_size * p_impl->shadow_depth_fb.texture().height());
-        glUniformMatrix4fv(3, 1, GL_FALSE, directional_light.matrix.get_raw()); // Light view matrix
-        for (const auto& cmd : draw_commands.commands) {
-            if (!cmd.cast_shadows)
-                continue;
-            aml::Matrix4 model = aml::translate(cmd.transform.position);
+        shadow_casters.add_light(
+            directional_light.light_atlas_size == 0
+                ? common::empty_rect()
+                : common::directional_light_rect(draw_commands.camera, directional_light.rotation,
+                                                 output_fb.texture().width(),
+                                                 output_fb.texture().height(), 0.0f, 20.0f));
+    }
+    for (const auto& point_light : draw_commands.point_lights) {
+        shadow_casters.add_light(point_light.light_atlas_size == 0
+                                     ? common::empty_rect()
+                                     : common::point_light_rect(point_light));
+    }
+    const usize light_count =
+        draw_commands.directional_lights.size() + draw_commands.point_lights.size();
+    p_impl->stats.culled_shadow_draws =
+        shadow_casters.caster_count() * light_count - shadow_casters.draw_count();
+
+    // Only draw the tiles of the shadow atlas whose light or casters changed since they were last
+    // drawn. The matrix of a light already includes its placement relative to the camera.
+    const auto shadow_atlas_width = p_impl->shadow_depth_fb.texture().width();
+    const auto shadow_atlas_height = p_impl->shadow_depth_fb.texture().height();
+    auto& tile_placements = p_impl->shadow_tile_placements;
+    auto& tile_contents = p_impl->shadow_tile_contents;
+    tile_placements.clear();
+    tile_contents.clear();
+    auto add_shadow_tile_keys = [&](Light const& light, usize light_index) {
+        common::ShadowKey placement;
+        placement.add(light.light_atlas_pos);
+        placement.add(light.light_atlas_size);
+        placement.add(shadow_atlas_width);
+        placement.add(shadow_atlas_height);
+        tile_placements.push_back(placement.value());
+
+        common::ShadowKey contents;
+        contents.add(light.matrix);
+        for (const u32 cmd_index : shadow_casters.casters(light_index)) {
+            const auto& cmd = draw_commands.commands[cmd_index];
+            contents.add(cmd.transform.position);
+            contents.add(cmd.mesh.p_impl->current_version());
+            contents.add(cmd.texture.p_impl->handle);
+        }
+        tile_contents.push_back(contents.value());
+    };
+    for (const auto& directional_light : draw_commands.directional_lights) {
+        add_shadow_tile_keys(directional_light, tile_placements.size());
+    }
+    for (const auto& point_light : draw_commands.point_lights) {
+        add_shadow_tile_keys(point_light, tile_placements.size());
+    }
+    p_impl->shadow_cache.update(tile_placements, tile_contents);
+    // Lights that didn't get a tile in the atlas have nothing to draw or to keep.
+    p_impl->stats.shadow_tiles_drawn = 0;
+    p_impl->stats.shadow_tiles_cached = 0;
+    auto count_shadow_tile = [&](Light const& light, usize light_index) {
+        if (light.light_atlas_size == 0)
+            return;
+        if (p_impl->shadow_cache.needs_draw(light_index))
+            ++p_impl->stats.shadow_tiles_drawn;
+        else
+            ++p_impl->stats.shadow_tiles_cached;
+    };
+    for (usize i = 0; i < draw_commands.directional_lights.size(); ++i) {
+        count_shadow_tile(draw_commands.directional_lights[i], i);
+    }
+    for (usize i = 0; i < draw_commands.point_lights.size(); ++i) {
+        count_shadow_tile(draw_commands.point_lights[i],
+                          draw_commands.directional_lights.size() + i);
+    }
+    p_impl->stats.shadow_draws = 0;
 
-            glBindVertexArray(cmd.mesh.p_impl->vao);
-            glBindTexture(GL_TEXTURE_2D, cmd.texture.p_impl->handle);
-            glUniformMatrix4fv(0, 1, GL_FALSE, model.get_raw()); // Model matrix
-            glDrawArrays(GL_TRIANGLES, 0, cmd.mesh.p_impl->vertex_count);
+    // Anything could have changed GL state since the last frame (ImGui, loading textures...).
+    auto& state = p_impl->state;
+    state.reset();
 
-            ++light_index;
+    state.use_program(p_impl->depth_shader.p_impl->handle);
+    glBindFramebuffer(GL_FRAMEBUFFER, p_impl->shadow_depth_fb.p_impl->handle);
+    glDepthFunc(GL_LEQUAL);
+    // The tiles that aren't drawn again keep their contents, so only clear the ones that are.
+    glEnable(GL_SCISSOR_TEST);
+    auto draw_shadow_tile = [&](Light const& light, usize light_index) {
+        if (light.light_atlas_size == 0 || !p_impl->shadow_cache.needs_draw(light_index))
+            return;
+        const int tile_x = light.light_atlas_pos.x * shadow_atlas_width;
+        const int tile_y = light.light_atlas_pos.y * shadow_atlas_height;
+        const int tile_width = light.light_atlas_size * shadow_atlas_width;
+        const int tile_height = light.light_atlas_size * shadow_atlas_height;
+        glViewport(tile_x, tile_y, tile_width, tile_height);
+        glScissor(tile_x, tile_y, tile_width, tile_height);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        state.set_matrix(3, light.matrix); // Light view matrix
+        for (const u32 cmd_index : shadow_casters.casters(light_index)) {
+            const auto& cmd = draw_commands.commands[cmd_index];
+            state.bind_texture(0, cmd.texture.p_impl->handle);
+            state.set_matrix(0, aml::translate(cmd.transform.position)); // Model matrix
+            cmd.mesh.p_impl->draw(state);
         }
+        p_impl->stats.shadow_draws += shadow_casters.casters(light_index).size();
+    };
+    usize light_index = 0;
+    for (const auto& directional_light : draw_commands.directional_lights) {
+        draw_shadow_tile(directional_light, light_index++);
     }
     for (const auto& point_light : draw_commands.point_lights) {
-        static const auto light_atlas_pos_location =
-            glGetUniformLocation(p_impl->depth_shader.p_impl->handle, "light_atlas_pos");
-        static const auto light_atlas_size_location =
-            glGetUniformLocation(p_impl->depth_shader.p_impl->handle, "light_atlas_size");
-        glViewport(point_light.light_atlas_pos.x * p_impl->shadow_depth_fb.texture().width(),
-                   point_light.light_atlas_pos.y * p_impl->shadow_depth_fb.texture().height(),
-                   point_light.light_atlas_size * p_impl->shadow_depth_fb.texture().width(),
-                   point_light.light_atlas_size * p_impl->shadow_depth_fb.texture().height());
-        glUniformMatrix4fv(3, 1, GL_FALSE, point_light.matrix.get_raw()); // Light view matrix
-        for (const auto& cmd : draw_commands.commands) {
-            if (!cmd.cast_shadows)
-                continue;
-            aml::Matrix4 model = aml::translate(cmd.transform.position);
-
-            glBindVertexArray(cmd.mesh.p_impl->vao);
-            glBindTexture(GL_TEXTURE_2D, cmd.texture.p_impl->handle);
-            glUniformMatrix4fv(0, 1, GL_FALSE, model.get_raw()); // Model matrix
-            glDrawArrays(GL_TRIANGLES, 0, cmd.mesh.p_impl->vertex_count);
+        draw_shadow_tile(point_light, light_index++);
+    }
+    glDisable(GL_SCISSOR_TEST);
+
+    // Skip the commands whose mesh is completely outside the camera view.
+    const usize visible_count =
+        common::cull_rects(p_impl->command_bounds, camera_rect, p_impl->visible_commands);
+    p_impl->stats.commands = draw_commands.commands.size();
+    p_impl->stats.culled_commands = draw_commands.commands.size() - visible_count;
+    // Opaque commands go front to back so that the fragments they cover are rejected before
+    // shading them, and commands at the same depth are grouped by the state they use.
+    p_impl->draw_sorter.clear();
+    for (u32 i = 0; i < draw_commands.commands.size(); ++i) {
+        if (!p_impl->visible_commands[i])
+            continue;
+        const auto& cmd = draw_commands.commands[i];
+        const float distance = draw_commands.camera.position.z - cmd.transform.position.z;
+        p_impl->draw_sorter.add(
+            i, common::make_sort_key(
+                   common::DrawPass::color, cmd.transparent,
+                   common::depth_bucket(distance, camera_near, camera_far, cmd.transparent),
+                   cmd.shader.p_impl->handle, cmd.texture.p_impl->handle,
+                   cmd.mesh.p_impl->vertex_array()));
+    }
+    p_impl->draw_sorter.sort();
+
+    // Every lit shader reads the same lights and shadow atlas.
+    const u32 shadow_atlas_texture = p_impl->shadow_depth_fb.texture().p_impl->handle;
+    auto bind_lights = [&]() {
+        state.bind_texture(1, shadow_atlas_texture);
+        state.bind_texture(3, shadow_atlas_texture);
+        state.bind_sampler(3, p_impl->shadow_compare_sampler);
+        state.bind_uniform_buffer(5, p_impl->lights_ubo);
+        state.bind_storage_buffer(6, p_impl->directional_lights_ssbo);
+        state.bind_storage_buffer(7, p_impl->point_lights_ssbo);
+        state.bind_storage_buffer(8, p_impl->light_tiles_ssbo);
+    };
 
-            ++light_index;
+    if (use_light_buffer) {
+        glViewport(0, 0, light_buffer_width, light_buffer_height);
+
+        // Find the surfaces in front, at the resolution of the light buffer. Only the commands that
+        // read the light buffer matter.
+        const aml::Matrix4 view_projection = proj * view;
+        state.use_program(p_impl->depth_shader.p_impl->handle);
+        glBindFramebuffer(GL_FRAMEBUFFER, p_impl->light_depth_fb.p_impl->handle);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        state.set_matrix(3, view_projection); // Camera matrix
+        for (const u32 i : p_impl->draw_sorter.order()) {
+            const auto& cmd = draw_commands.commands[i];
+            if (cmd.shader.p_impl->light_buffer_tex_location == static_cast<u32>(-1))
+                continue;
+            state.bind_texture(0, cmd.texture.p_impl->handle);
+            state.set_matrix(0, aml::translate(cmd.transform.position)); // Model matrix
+            cmd.mesh.p_impl->draw(state);
         }
+
+        // And light them, once per pixel of the light buffer.
+        state.use_program(p_impl->light_buffer_shader.p_impl->handle);
+        glBindFramebuffer(GL_FRAMEBUFFER, p_impl->light_buffer_fbo);
+        glDisable(GL_DEPTH_TEST);
+        state.set_matrix(0, aml::inverse(view_projection)); // Inverse camera matrix
+        // Texture units hardcoded in light_buffer.frag
+        state.bind_texture(0, p_impl->light_depth_fb.texture().p_impl->handle);
+        bind_lights();
+        state.bind_vertex_array(p_impl->empty_vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
     }
 
-    glViewport(0, 0, output_fb.texture().width(), output_fb.texture().height());
+    glViewport(0, 0, output_width, output_height);
     glBindFramebuffer(GL_FRAMEBUFFER, output_fb.p_impl->handle);
-    for (const auto& cmd : draw_commands.commands) {
+    p_impl->stats.shader_switches = 0;
+    p_impl->stats.texture_switches = 0;
+    p_impl->stats.mesh_buffer_switches = 0;
+    u32 last_shader = -1, last_texture = -1, last_vertex_array = -1;
+    for (const u32 i : p_impl->draw_sorter.order()) {
+        const auto& cmd = draw_commands.commands[i];
+        p_impl->stats.shader_switches += cmd.shader.p_impl->handle != last_shader;
+        p_impl->stats.texture_switches += cmd.texture.p_impl->handle != last_texture;
+        p_impl->stats.mesh_buffer_switches += cmd.mesh.p_impl->vertex_array() != last_vertex_array;
+        last_shader = cmd.shader.p_impl->handle;
+        last_texture = cmd.texture.p_impl->handle;
+        last_vertex_array = cmd.mesh.p_impl->vertex_array();
         bool is_lit = cmd.shader.p_impl->shadow_tex_location != static_cast<u32>(-1);
         bool is_paletted = cmd.shader.p_impl->palette_tex_location != static_cast<u32>(-1);
-        aml::Matrix4 model = aml::translate(cmd.transform.position);
-
-        glUseProgram(cmd.shader.p_impl->handle);
-        glUniformMatrix4fv(0, 1, GL_FALSE, model.get_raw()); // Model matrix
-        glUniformMatrix4fv(1, 1, GL_FALSE, proj.get_raw());  // Projection matrix
-        glUniformMatrix4fv(2, 1, GL_FALSE, view.get_raw());  // View matrix
-        glBindVertexArray(cmd.mesh.p_impl->vao);
-
-        glUniform1i(cmd.shader.p_impl->tile_tex_location,
-                    0); // Set tile sampler2D to GL_TEXTURE0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cmd.texture.p_impl->handle);
-        glBindBufferBase(GL_UNIFORM_BUFFER, 5, p_impl->lights_ubo);
-        if (is_lit) {
-            glUniform1i(cmd.shader.p_impl->shadow_tex_location,
-                        1); // Set shadow sampler2D to GL_TEXTURE1
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, p_impl->shadow_depth_fb.texture().p_impl->handle);
-        }
-        if (is_paletted) {
-            glUniform1i(cmd.shader.p_impl->palette_tex_location,
-                        2); // Set palette sampler2D to GL_TEXTURE2
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, p_impl->palette_texture.p_impl->handle);
-        }
 
-        glDrawArrays(GL_TRIANGLES, 0, cmd.mesh.p_impl->vertex_count);
+        // The samplers of every shader are already set to their texture units (See
+        // ShaderHandle::from_file()).
+        state.use_program(cmd.shader.p_impl->handle);
+        state.set_matrix(0, aml::translate(cmd.transform.position)); // Model matrix
+        state.set_matrix(1, proj);                                   // Projection matrix
+        state.set_matrix(2, view);                                   // View matrix
+        state.bind_texture(0, cmd.texture.p_impl->handle);
+        if (is_lit)
+            bind_lights();
+        if (use_light_buffer &&
+            cmd.shader.p_impl->light_buffer_tex_location != static_cast<u32>(-1))
+            state.bind_texture(4, p_impl->light_buffer_tex);
+        if (is_paletted)
+            state.bind_texture(2, p_impl->palette_texture.p_impl->handle);
+
+        cmd.mesh.p_impl->draw(state);
     }
+    p_impl->stats.state_changes_issued = state.issued();
+    p_impl->stats.state_changes_elided = state.elided();
 }
 
 void Renderer::clear(Framebuffer& fb, aml::Vector4 color) {
@@ -430,11 +665,33 @@ void Renderer::set_palette(ColorPalette const& palette) {
 
 void Renderer::set_shadow_resolution(u32 width, u32 height) {
     p_impl->shadow_depth_fb.resize(width, height);
+    p_impl->shadow_cache.invalidate();
+}
+
+void Renderer::set_shadow_refresh_budget(u32 tiles) { p_impl->shadow_cache.set_refresh_budget(tiles); }
+
+void Renderer::invalidate_shadows() { p_impl->shadow_cache.invalidate(); }
+
+void Renderer::set_shadow_filter(ShadowFilter filter) {
+    ARYIBI_ASSERT(filter != ShadowFilter::renderer_default,
+                  "The renderer can't use its own default shadow filter!");
+    p_impl->shadow_filter = filter;
+}
+
+ShadowFilter Renderer::get_shadow_filter() const { return p_impl->shadow_filter; }
+
+void Renderer::set_light_buffer_divisor(u32 divisor) {
+    ARYIBI_ASSERT(divisor != 0, "The light buffer divisor can't be 0!");
+    p_impl->light_buffer_divisor = divisor;
 }
 
+u32 Renderer::get_light_buffer_divisor() const { return p_impl->light_buffer_divisor; }
+
 aml::Vector2 Renderer::get_shadow_resolution() const {
     return {(float)p_impl->shadow_depth_fb.texture().width(),
             (float)p_impl->shadow_depth_fb.texture().height()};
 }
 
+FrameStats const& Renderer::frame_stats() const { return p_impl->stats; }
+
 } // namespace aryibi::renderer
\ No newline at end of file
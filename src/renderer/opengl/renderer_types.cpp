@@ -14,7 +14,10 @@
 #include <anton/math/vector4.hpp>
 #include "util/aryibi_assert.hpp"
 
+#include <algorithm>
 #include <memory>
+#include <new>
+#include <type_traits>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
@@ -24,7 +27,11 @@ namespace aml = anton::math;
 
 namespace aryibi::renderer {
 
-TextureHandle::TextureHandle() : p_impl(std::make_unique<impl>()) {}
+TextureHandle::TextureHandle() : p_impl(new (impl_storage) impl()) {
+    static_assert(sizeof(impl) <= impl_size && alignof(impl) <= impl_alignment &&
+                      std::is_trivially_destructible_v<impl>,
+                  "TextureHandle::impl must fit in the inline storage of the handle");
+}
 TextureHandle::~TextureHandle() {
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
     if (p_impl->handle == 0 || glfwGetCurrentContext() == nullptr)
@@ -34,7 +41,7 @@ TextureHandle::~TextureHandle() {
     impl::handle_ref_count[p_impl->handle]--;
 #endif
 }
-TextureHandle::TextureHandle(TextureHandle const& other) : p_impl(std::make_unique<impl>()) {
+TextureHandle::TextureHandle(TextureHandle const& other) : p_impl(new (impl_storage) impl()) {
     *p_impl = *other.p_impl;
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
     impl::handle_ref_count[p_impl->handle]++;
@@ -206,43 +213,43 @@ void TextureHandle::unload() {
 MeshHandle::MeshHandle() : p_impl(std::make_unique<impl>()) {}
 MeshHandle::~MeshHandle() {
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
-    if (p_impl->vao == 0 || glfwGetCurrentContext() == nullptr)
+    if (p_impl->arena_id == common::MeshArena::no_mesh || glfwGetCurrentContext() == nullptr)
         return;
-    ARYIBI_ASSERT(impl::handle_ref_count[p_impl->vao] != 1,
+    ARYIBI_ASSERT(impl::handle_ref_count[p_impl->arena_id] != 1,
                   "All handles to a mesh were destroyed without unloading them first!!");
-    impl::handle_ref_count[p_impl->vao]--;
+    impl::handle_ref_count[p_impl->arena_id]--;
 #endif
 }
 MeshHandle::MeshHandle(MeshHandle const& other) : p_impl(std::make_unique<impl>()) {
     *p_impl = *other.p_impl;
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
-    impl::handle_ref_count[p_impl->vao]++;
+    impl::handle_ref_count[p_impl->arena_id]++;
 #endif
 }
 MeshHandle& MeshHandle::operator=(MeshHandle const& other) {
     if (this != &other) {
         *p_impl = *other.p_impl;
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
-        impl::handle_ref_count[p_impl->vao]++;
+        impl::handle_ref_count[p_impl->arena_id]++;
 #endif
     }
     return *this;
 }
 
 bool MeshHandle::exists() const {
-    ARYIBI_ASSERT((bool)(p_impl->vao) ^ (bool)(p_impl->vbo),
-                  "[Internal error] Only VAO or VBO exist, but not both at once?");
-    return p_impl->vao;
+    return p_impl->arena_id != common::MeshArena::no_mesh || p_impl->dyn;
 }
 void MeshHandle::unload() {
+    // Non-existent meshes are silently ignored
+    if (p_impl->arena_id == common::MeshArena::no_mesh)
+        return;
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
-    impl::handle_ref_count[p_impl->vao] = 0;
+    impl::handle_ref_count[p_impl->arena_id] = 0;
 #endif
-    // Zeros (non-existent meshes) are silently ignored
-    glDeleteVertexArrays(1, &p_impl->vao);
-    p_impl->vao = 0;
-    glDeleteBuffers(1, &p_impl->vbo);
-    p_impl->vbo = 0;
+    // OpenGL synchronizes buffer writes implicitly, so the range can be reused by the next mesh
+    // right away even if a draw that is still in flight reads from it.
+    impl::arena.free(p_impl->arena_id);
+    p_impl->arena_id = common::MeshArena::no_mesh;
 }
 
 ShaderHandle::ShaderHandle() : p_impl(std::make_unique<impl>()) {}
@@ -314,10 +321,40 @@ ShaderHandle ShaderHandle::from_file(fs::path const& vert_path, fs::path const&
     shader.p_impl->handle = prog;
     shader.p_impl->tile_tex_location = glGetUniformLocation(prog, "tile");
     shader.p_impl->shadow_tex_location = glGetUniformLocation(prog, "shadow");
+    shader.p_impl->shadow_compare_tex_location = glGetUniformLocation(prog, "shadowCompare");
+    shader.p_impl->light_buffer_tex_location = glGetUniformLocation(prog, "lightBuffer");
     shader.p_impl->palette_tex_location = glGetUniformLocation(prog, "palette");
+    // Samplers always read the same texture units, so they are only set once. Renderer::draw()
+    // binds each texture to its unit. Locations of -1 are ignored.
+    glProgramUniform1i(prog, shader.p_impl->tile_tex_location, 0);
+    glProgramUniform1i(prog, shader.p_impl->shadow_tex_location, 1);
+    glProgramUniform1i(prog, shader.p_impl->palette_tex_location, 2);
+    glProgramUniform1i(prog, shader.p_impl->shadow_compare_tex_location, 3);
+    glProgramUniform1i(prog, shader.p_impl->light_buffer_tex_location, 4);
     return shader;
 }
 
+/// Every mesh uses the same index pattern, so a single index buffer is shared by all of them and
+/// grown when a bigger mesh is created. Growing it keeps the same buffer name, so the VAOs of the
+/// meshes created before still reference a valid (And larger) index buffer.
+/// Binds the buffer to the currently bound VAO.
+static void bind_quad_index_buffer(usize quad_count) {
+    static u32 buffer = 0;
+    static usize buffer_quad_count = 0;
+    if (buffer == 0)
+        glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    if (quad_count <= buffer_quad_count)
+        return;
+
+    constexpr usize min_quad_count = 1024;
+    buffer_quad_count = std::max({quad_count, buffer_quad_count * 2, min_quad_count});
+    std::vector<u32> indices(buffer_quad_count * common::indices_per_quad);
+    common::write_quad_indices(indices.data(), 0, buffer_quad_count);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(u32), indices.data(),
+                 GL_STATIC_DRAW);
+}
+
 MeshBuilder::MeshBuilder() : p_impl(std::make_unique<impl>()) { p_impl->result.reserve(256); }
 MeshBuilder::~MeshBuilder() = default;
 MeshBuilder::MeshBuilder(MeshBuilder const& other) : p_impl(std::make_unique<impl>()) {
@@ -336,92 +373,225 @@ void MeshBuilder::add_sprite(sprites::Sprite const& spr,
                              float horizontal_slope,
                              float z_min,
                              float z_max) {
-    const auto add_piece = [&](sprites::Sprite::Piece const& piece, std::size_t base_n) {
-        auto& result = p_impl->result;
-        const sprites::Rect2D pos_rect{
-            {piece.destination.start.x + offset.x, piece.destination.start.y + offset.y},
-            {piece.destination.end.x + offset.x, piece.destination.end.y + offset.y}};
-        const sprites::Rect2D uv_rect = piece.source;
-        const sprites::Rect2D z_map{
-            {aml::clamp(piece.destination.start.x * horizontal_slope, z_min, z_max),
-             aml::clamp(piece.destination.start.y * vertical_slope, z_min, z_max)},
-            {aml::clamp(piece.destination.end.x * horizontal_slope, z_min, z_max),
-             aml::clamp(piece.destination.end.y * vertical_slope, z_min, z_max)}};
-
-        // First triangle //
-        // First triangle //
-        /* X pos 1st vertex */ result[base_n + 0] = pos_rect.start.x;
-        /* Y pos 1st vertex */ result[base_n + 1] = pos_rect.start.y;
-        /* Z pos 1st vertex */ result[base_n + 2] = z_map.start.x + z_map.start.y + offset.z;
-        /* X UV 1st vertex  */ result[base_n + 3] = uv_rect.start.x;
-        /* Y UV 1st vertex  */ result[base_n + 4] = uv_rect.end.y;
-        /* X pos 2nd vertex */ result[base_n + 5] = pos_rect.end.x;
-        /* Y pos 2nd vertex */ result[base_n + 6] = pos_rect.start.y;
-        /* Z pos 2nd vertex */ result[base_n + 7] = z_map.end.x + z_map.start.y + offset.z;
-        /* X UV 2nd vertex  */ result[base_n + 8] = uv_rect.end.x;
-        /* Y UV 2nd vertex  */ result[base_n + 9] = uv_rect.end.y;
-        /* X pos 3rd vertex */ result[base_n + 10] = pos_rect.start.x;
-        /* Y pos 3rd vertex */ result[base_n + 11] = pos_rect.end.y;
-        /* Z pos 3rd vertex */ result[base_n + 12] = z_map.start.x + z_map.end.y + offset.z;
-        /* X UV 2nd vertex  */ result[base_n + 13] = uv_rect.start.x;
-        /* Y UV 2nd vertex  */ result[base_n + 14] = uv_rect.start.y;
-
-        // Second triangle //
-        /* X pos 1st vertex */ result[base_n + 15] = pos_rect.end.x;
-        /* Y pos 1st vertex */ result[base_n + 16] = pos_rect.start.y;
-        /* Z pos 1st vertex */ result[base_n + 17] = z_map.end.x + z_map.start.y + offset.z;
-        /* X UV 1st vertex  */ result[base_n + 18] = uv_rect.end.x;
-        /* Y UV 1st vertex  */ result[base_n + 19] = uv_rect.end.y;
-        /* X pos 2nd vertex */ result[base_n + 20] = pos_rect.end.x;
-        /* Y pos 2nd vertex */ result[base_n + 21] = pos_rect.end.y;
-        /* Z pos 2nd vertex */ result[base_n + 22] = z_map.end.x + z_map.end.y + offset.z;
-        /* X UV 2nd vertex  */ result[base_n + 23] = uv_rect.end.x;
-        /* Y UV 2nd vertex  */ result[base_n + 24] = uv_rect.start.y;
-        /* X pos 3rd vertex */ result[base_n + 25] = pos_rect.start.x;
-        /* Y pos 3rd vertex */ result[base_n + 26] = pos_rect.end.y;
-        /* Z pos 3rd vertex */ result[base_n + 27] = z_map.start.x + z_map.end.y + offset.z;
-        /* X UV 3rd vertex  */ result[base_n + 28] = uv_rect.start.x;
-        /* Y UV 3rd vertex  */ result[base_n + 29] = uv_rect.start.y;
-    };
-
-    const auto prev_size = p_impl->result.size();
-    p_impl->result.resize(prev_size + spr.pieces.size() * impl::sizeof_quad);
-    for (std::size_t i = 0; i < spr.pieces.size(); ++i) {
-        add_piece(spr.pieces[i], prev_size + i * impl::sizeof_quad);
-    }
+    common::append_sprite_vertices(
+        p_impl->result, spr, {offset, vertical_slope, horizontal_slope, z_min, z_max});
 }
 
-MeshHandle MeshBuilder::finish() const {
-    MeshHandle mesh;
-    glGenVertexArrays(1, &mesh.p_impl->vao);
-    glGenBuffers(1, &mesh.p_impl->vbo);
+void MeshBuilder::add_repeating_sprite(sprites::Sprite const& spr,
+                                       aml::Vector2 repeat,
+                                       aml::Vector3 offset,
+                                       float vertical_slope,
+                                       float horizontal_slope,
+                                       float z_min,
+                                       float z_max) {
+    common::append_repeating_sprite_vertices(
+        p_impl->result, spr, repeat, {offset, vertical_slope, horizontal_slope, z_min, z_max});
+}
 
-    // Fill buffer
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.p_impl->vbo);
-    glBufferData(GL_ARRAY_BUFFER, p_impl->result.size() * sizeof(float), p_impl->result.data(),
-                 GL_STATIC_DRAW);
+std::vector<MeshRegionWriter>
+MeshBuilder::reserve_regions(std::vector<usize> const& piece_counts) {
+    return common::reserve_regions(p_impl->result, piece_counts);
+}
 
-    glBindVertexArray(mesh.p_impl->vao);
+/// Sets the vertex format of a VAO and binds a vertex buffer to it. Leaves the VAO bound.
+static void setup_vertex_array(u32 vao, u32 vbo) {
+    glBindVertexArray(vao);
     // Vertex Positions
     glEnableVertexAttribArray(0); // location 0
     glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
-    glBindVertexBuffer(0, mesh.p_impl->vbo, 0, impl::sizeof_vertex * sizeof(float));
+    glBindVertexBuffer(0, vbo, 0, common::floats_per_vertex * sizeof(float));
     glVertexAttribBinding(0, 0);
     // UV Positions
     glEnableVertexAttribArray(1); // location 1
     glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
-    glBindVertexBuffer(1, mesh.p_impl->vbo, 0, impl::sizeof_vertex * sizeof(float));
+    glBindVertexBuffer(1, vbo, 0, common::floats_per_vertex * sizeof(float));
     glVertexAttribBinding(1, 1);
+    // Tile rects
+    glEnableVertexAttribArray(2); // location 2
+    glVertexAttribFormat(2, 4, GL_UNSIGNED_SHORT, GL_TRUE,
+                         common::tile_rect_slot * sizeof(float));
+    glBindVertexBuffer(2, vbo, 0, common::floats_per_vertex * sizeof(float));
+    glVertexAttribBinding(2, 2);
+}
+
+void MeshHandle::impl::compact_page(u32 page_index) {
+    MeshPage& page = pages[page_index];
+    const auto moves = arena.compact(page_index);
+    constexpr usize sizeof_vertex = common::floats_per_vertex * sizeof(float);
+
+    u32 vbo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+    glBufferData(GL_COPY_WRITE_BUFFER, arena.page_capacity(page_index) * sizeof_vertex, nullptr,
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, page.vbo);
+    for (const auto& move : moves) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            move.from_vertex * sizeof_vertex, move.to_vertex * sizeof_vertex,
+                            move.vertex_count * sizeof_vertex);
+    }
+    glDeleteBuffers(1, &page.vbo);
+    page.vbo = vbo;
+    setup_vertex_array(page.vao, page.vbo);
+    glBindVertexArray(0);
+}
+
+u32 MeshHandle::impl::allocate(u32 vertex_count) {
+    if (const u32 page = arena.find_fragmented_page(vertex_count);
+        page != common::MeshArena::no_mesh) {
+        compact_page(page);
+    }
+
+    const u32 mesh = arena.allocate(vertex_count);
+    while (pages.size() < arena.page_count()) {
+        MeshPage& page = pages.emplace_back();
+        glGenVertexArrays(1, &page.vao);
+        glGenBuffers(1, &page.vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, page.vbo);
+        glBufferData(GL_ARRAY_BUFFER,
+                     arena.page_capacity(pages.size() - 1) * common::floats_per_vertex *
+                         sizeof(float),
+                     nullptr, GL_STATIC_DRAW);
+        setup_vertex_array(page.vao, page.vbo);
+        bind_quad_index_buffer(0);
+        glBindVertexArray(0);
+    }
+    return mesh;
+}
+
+MeshHandle MeshBuilder::finish() const {
+    const usize vertex_count = p_impl->result.size() / common::floats_per_vertex;
+    const usize quad_count = p_impl->result.size() / common::floats_per_quad;
+
+    MeshHandle mesh;
+    // Empty meshes still take a vertex, so that they exist.
+    mesh.p_impl->arena_id = MeshHandle::impl::allocate(std::max<usize>(vertex_count, 1));
+    mesh.p_impl->index_count = quad_count * common::indices_per_quad;
+    mesh.p_impl->bounds = common::vertex_bounds(p_impl->result.data(), vertex_count);
+    mesh.p_impl->version = common::next_mesh_version();
+    const auto& range = MeshHandle::impl::arena.range(mesh.p_impl->arena_id);
+    const MeshPage& page = MeshHandle::impl::pages[range.page];
 
-    mesh.p_impl->vertex_count = p_impl->result.size() / impl::sizeof_vertex;
+    // Fill buffer
+    glBindBuffer(GL_ARRAY_BUFFER, page.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, range.first_vertex * common::floats_per_vertex * sizeof(float),
+                    p_impl->result.size() * sizeof(float), p_impl->result.data());
+    // Every page VAO shares the same index buffer, so growing it while any of them is bound is
+    // enough.
+    glBindVertexArray(page.vao);
+    bind_quad_index_buffer(quad_count);
+    glBindVertexArray(0);
 
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
-    MeshHandle::impl::handle_ref_count[mesh.p_impl->vao] = 1;
+    MeshHandle::impl::handle_ref_count[mesh.p_impl->arena_id] = 1;
 #endif
     p_impl->result.clear();
     return mesh;
 }
 
+MeshBuilder::AsyncMesh MeshBuilder::finish_async() const {
+    // OpenGL synchronizes uploads implicitly, so the mesh can be used right away.
+    std::promise<void> uploaded;
+    uploaded.set_value();
+    return {finish(), uploaded.get_future().share()};
+}
+
+DynMeshHandle MeshBuilder::finish_dynamic() const {
+    DynMeshHandle mesh;
+    mesh.p_impl->data = new DynMeshData();
+    DynMeshData& data = *mesh.p_impl->data;
+    glGenVertexArrays(1, &data.vao);
+    glGenBuffers(1, &data.vbo);
+    setup_vertex_array(data.vao, data.vbo);
+    glBindVertexArray(0);
+
+    data.vertices = p_impl->result;
+    data.dirty = {0, data.vertices.size() / common::floats_per_quad};
+    data.version = common::next_mesh_version();
+    p_impl->result.clear();
+    return mesh;
+}
+
+u32 DynMeshData::sync() {
+    const usize quad_count = vertices.size() / common::floats_per_quad;
+    if (!dirty.empty()) {
+        // Leaves the VAO bound, since the mesh is about to be drawn anyway.
+        glBindVertexArray(vao);
+        bind_quad_index_buffer(quad_count);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (vertices.size() > buffer_capacity) {
+            // New storage starts empty, so every quad has to be uploaded again.
+            buffer_capacity = std::max(vertices.size(), buffer_capacity * 2);
+            glBufferData(GL_ARRAY_BUFFER, buffer_capacity * sizeof(float), nullptr, GL_STREAM_DRAW);
+            dirty = {0, quad_count};
+        }
+        // The driver stages the data if the GPU is still reading the buffer, so writing only the
+        // quads that changed doesn't wait for it either.
+        const usize end = std::min(dirty.end, quad_count);
+        if (dirty.first < end) {
+            constexpr usize sizeof_quad = common::floats_per_quad * sizeof(float);
+            glBufferSubData(GL_ARRAY_BUFFER, dirty.first * sizeof_quad,
+                            (end - dirty.first) * sizeof_quad,
+                            vertices.data() + dirty.first * common::floats_per_quad);
+        }
+        dirty = {};
+    }
+    return quad_count * common::indices_per_quad;
+}
+
+DynMeshHandle::DynMeshHandle() : p_impl(std::make_unique<impl>()) {}
+DynMeshHandle::~DynMeshHandle() = default;
+DynMeshHandle::DynMeshHandle(DynMeshHandle const& other) : p_impl(std::make_unique<impl>()) {
+    *p_impl = *other.p_impl;
+}
+DynMeshHandle& DynMeshHandle::operator=(DynMeshHandle const& other) {
+    if (this != &other) {
+        *p_impl = *other.p_impl;
+    }
+    return *this;
+}
+
+bool DynMeshHandle::exists() const { return p_impl->data; }
+void DynMeshHandle::unload() {
+    if (!p_impl->data)
+        return;
+    glDeleteVertexArrays(1, &p_impl->data->vao);
+    glDeleteBuffers(1, &p_impl->data->vbo);
+    delete p_impl->data;
+    p_impl->data = nullptr;
+}
+
+void DynMeshHandle::update(usize first_quad, MeshBuilder const& data) {
+    ARYIBI_ASSERT(exists(), "Tried to update a dynamic mesh that doesn't exist!");
+    p_impl->data->dirty.add(
+        common::write_quads(p_impl->data->vertices, first_quad, data.p_impl->result));
+    p_impl->data->version = common::next_mesh_version();
+    data.p_impl->result.clear();
+}
+
+void DynMeshHandle::resize(usize quad_count) {
+    ARYIBI_ASSERT(exists(), "Tried to resize a dynamic mesh that doesn't exist!");
+    const usize prev_quad_count = this->quad_count();
+    p_impl->data->vertices.resize(quad_count * common::floats_per_quad, 0.f);
+    // Only new quads need uploading. Removed ones are just not drawn anymore.
+    p_impl->data->dirty.add({prev_quad_count, quad_count});
+    p_impl->data->version = common::next_mesh_version();
+}
+
+usize DynMeshHandle::quad_count() const {
+    return exists() ? p_impl->data->vertices.size() / common::floats_per_quad : 0;
+}
+
+MeshHandle DynMeshHandle::mesh() const {
+    MeshHandle mesh;
+    if (exists()) {
+        mesh.p_impl->dyn = p_impl->data;
+        mesh.p_impl->bounds = common::unbounded_rect();
+    }
+    return mesh;
+}
+
 Framebuffer::Framebuffer() : p_impl(std::make_unique<impl>()) {
     p_impl->handle = static_cast<unsigned int>(-1);
 }
@@ -530,7 +700,7 @@ namespace std {
 std::size_t
 hash<aryibi::renderer::TextureHandle>::operator()(aryibi::renderer::TextureHandle const& tex) const
     noexcept {
-    return reinterpret_cast<std::size_t>(tex.imgui_id());
+    return static_cast<std::size_t>(tex.p_impl->handle);
 }
 
 } // namespace std
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "renderer/opengl/state_encoder.hpp"
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+namespace aryibi::renderer {
+
+void StateEncoder::reset() {
+    program = unknown;
+    active_texture_unit = unknown;
+    textures.fill(unknown);
+    samplers.fill(unknown);
+    uniform_buffers.fill(unknown);
+    storage_buffers.fill(unknown);
+    vertex_array = unknown;
+    uniforms.fill(ProgramUniforms{});
+    program_uniforms = nullptr;
+    next_uniforms = 0;
+    issued_count = 0;
+    elided_count = 0;
+}
+
+bool StateEncoder::change(u32& current, u32 value) {
+    if (current == value) {
+        ++elided_count;
+        return false;
+    }
+    current = value;
+    ++issued_count;
+    return true;
+}
+
+void StateEncoder::use_program(u32 new_program) {
+    if (!change(program, new_program))
+        return;
+    glUseProgram(program);
+
+    // Uniforms belong to the program, so remember them separately for each one.
+    program_uniforms = nullptr;
+    for (auto& entry : uniforms) {
+        if (entry.program == program)
+            program_uniforms = &entry;
+    }
+    if (!program_uniforms) {
+        program_uniforms = &uniforms[next_uniforms];
+        next_uniforms = (next_uniforms + 1) % tracked_programs;
+        *program_uniforms = ProgramUniforms{};
+        program_uniforms->program = program;
+    }
+}
+
+void StateEncoder::bind_texture(u32 unit, u32 texture) {
+    if (!change(textures[unit], texture))
+        return;
+    if (active_texture_unit != unit) {
+        active_texture_unit = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void StateEncoder::bind_sampler(u32 unit, u32 sampler) {
+    if (change(samplers[unit], sampler))
+        glBindSampler(unit, sampler);
+}
+
+void StateEncoder::bind_uniform_buffer(u32 binding, u32 buffer) {
+    if (change(uniform_buffers[binding], buffer))
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+}
+
+void StateEncoder::bind_storage_buffer(u32 binding, u32 buffer) {
+    if (change(storage_buffers[binding], buffer))
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+
+void StateEncoder::bind_vertex_array(u32 vao) {
+    if (change(vertex_array, vao))
+        glBindVertexArray(vao);
+}
+
+void StateEncoder::set_matrix(u32 location, anton::math::Matrix4 const& matrix) {
+    if (program_uniforms && location < matrix_locations) {
+        auto& known_matrix = program_uniforms->matrices[location];
+        if (program_uniforms->known[location] &&
+            std::memcmp(&known_matrix, &matrix, sizeof(matrix)) == 0) {
+            ++elided_count;
+            return;
+        }
+        known_matrix = matrix;
+        program_uniforms->known[location] = true;
+    }
+    ++issued_count;
+    glUniformMatrix4fv(location, 1, GL_FALSE, matrix.get_raw());
+}
+
+} // namespace aryibi::renderer
@@ -0,0 +1,75 @@
+#ifndef ARYIBI_OPENGL_STATE_ENCODER_HPP
+#define ARYIBI_OPENGL_STATE_ENCODER_HPP
+
+#include <anton/math/matrix4.hpp>
+#include <anton/types.hpp>
+
+#include <array>
+
+namespace aryibi::renderer {
+
+using namespace anton; // For integer types
+
+/// Issues GL state changes, skipping the ones that match the state it last set. Everything it
+/// tracks lives in fixed size arrays, so it never allocates.
+class StateEncoder {
+public:
+    /// Texture units used by the shaders (See the units hardcoded in ShaderHandle::from_file()).
+    static constexpr u32 texture_units = 5;
+    /// Uniform and shader storage buffer binding points used by the shaders.
+    static constexpr u32 buffer_bindings = 9;
+    /// Matrix uniforms are remembered for this many programs, and only at locations below
+    /// matrix_locations. Other ones are always uploaded.
+    static constexpr u32 tracked_programs = 8;
+    static constexpr u32 matrix_locations = 4;
+
+    /// Forgets the state. Must be called before using the encoder if anything else might have
+    /// changed GL state since it was last used.
+    void reset();
+
+    void use_program(u32 program);
+    void bind_texture(u32 unit, u32 texture);
+    void bind_sampler(u32 unit, u32 sampler);
+    void bind_uniform_buffer(u32 binding, u32 buffer);
+    void bind_storage_buffer(u32 binding, u32 buffer);
+    void bind_vertex_array(u32 vao);
+    /// Sets a mat4 uniform of the program in use.
+    void set_matrix(u32 location, anton::math::Matrix4 const& matrix);
+
+    /// State changes that were sent to GL since the last reset().
+    [[nodiscard]] usize issued() const { return issued_count; }
+    /// State changes that were skipped since the last reset(), because they matched the state.
+    [[nodiscard]] usize elided() const { return elided_count; }
+
+private:
+    /// What GL names are set to when their state isn't known.
+    static constexpr u32 unknown = -1;
+
+    struct ProgramUniforms {
+        u32 program = unknown;
+        std::array<anton::math::Matrix4, matrix_locations> matrices;
+        std::array<bool, matrix_locations> known{};
+    };
+
+    /// Counts a state change, returning whether it has to be issued. Updates current if so.
+    bool change(u32& current, u32 value);
+
+    u32 program = unknown;
+    u32 active_texture_unit = unknown;
+    std::array<u32, texture_units> textures;
+    std::array<u32, texture_units> samplers;
+    std::array<u32, buffer_bindings> uniform_buffers;
+    std::array<u32, buffer_bindings> storage_buffers;
+    u32 vertex_array = unknown;
+    std::array<ProgramUniforms, tracked_programs> uniforms;
+    /// The entry of uniforms of the program in use, or nullptr if it doesn't have one.
+    ProgramUniforms* program_uniforms = nullptr;
+    /// The entry of uniforms to give to the next program that doesn't have one.
+    u32 next_uniforms = 0;
+    usize issued_count = 0;
+    usize elided_count = 0;
+};
+
+} // namespace aryibi::renderer
+
+#endif // ARYIBI_OPENGL_STATE_ENCODER_HPP
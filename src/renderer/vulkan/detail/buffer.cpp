@@ -42,6 +42,10 @@ namespace aryibi::renderer {
         std::memcpy(buffer.mapped, data, size);
     }
 
+    void SingleBuffer::write(const void* data, const usize size, const usize offset) {
+        std::memcpy(static_cast<char*>(buffer.mapped) + offset, data, size);
+    }
+
     bool SingleBuffer::exists() const {
         return buffer.handle;
     }
@@ -54,10 +58,21 @@ namespace aryibi::renderer {
         return buf_size;
     }
 
+    usize SingleBuffer::capacity() const {
+        return buffer.capacity;
+    }
+
     void SingleBuffer::destroy() {
         destroy_raw_buffer(buffer);
     }
 
+    RawBuffer SingleBuffer::release() {
+        auto released = buffer;
+        buffer = {};
+        buf_size = 0;
+        return released;
+    }
+
     vk::Buffer SingleBuffer::handle() const {
         return buffer.handle;
     }
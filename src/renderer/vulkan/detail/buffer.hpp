@@ -19,11 +19,17 @@ namespace aryibi::renderer {
         void create(const vk::BufferUsageFlags flags);
         void resize(const usize size);
         void write(const void* data, const usize size);
+        // Writes size bytes starting at offset, leaving the rest of the buffer as it is. Doesn't resize the buffer, so
+        // the range must be within its capacity.
+        void write(const void* data, const usize size, const usize offset);
         void destroy();
+        // Gives up the ownership of the underlying buffer, leaving this one empty.
+        [[nodiscard]] RawBuffer release();
 
         [[nodiscard]] bool exists() const;
         [[nodiscard]] void* buf() const;
         [[nodiscard]] usize size() const;
+        [[nodiscard]] usize capacity() const;
         [[nodiscard]] vk::Buffer handle() const;
         [[nodiscard]] vk::DescriptorBufferInfo info() const;
     };
@@ -66,4 +66,8 @@ namespace aryibi::renderer {
         context().device.graphics.waitIdle();
         context().device.logical.freeCommandBuffers(transient, command_buffer);
     }
+
+    void free_transient(const vk::CommandBuffer command_buffer) {
+        context().device.logical.freeCommandBuffers(transient, command_buffer);
+    }
 } // namespace aryibi::renderer
\ No newline at end of file
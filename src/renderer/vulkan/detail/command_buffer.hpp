@@ -12,6 +12,8 @@ namespace aryibi::renderer {
     [[nodiscard]] std::vector<vk::CommandBuffer> make_command_buffers(const usize size);
     [[nodiscard]] vk::CommandBuffer begin_transient();
     void end_transient(const vk::CommandBuffer command_buffer);
+    // Frees a command buffer returned by begin_transient() that was submitted manually instead of with end_transient().
+    void free_transient(const vk::CommandBuffer command_buffer);
 } // namespace aryibi::renderer
 
 #endif //ARYIBI_VULKAN_COMMAND_BUFFER_HPP
@@ -0,0 +1,65 @@
+#include "command_encoder.hpp"
+
+#include <algorithm>
+
+namespace aryibi::renderer {
+    CommandEncoder::CommandEncoder(const vk::CommandBuffer command_buffer) : commands(command_buffer) {}
+
+    void CommandEncoder::bind_pipeline(const Pipeline& new_pipeline) {
+        if (new_pipeline.handle == pipeline) {
+            ++elided_count;
+            return;
+        }
+        pipeline = new_pipeline.handle;
+        commands.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+        ++issued_count;
+
+        // Pipelines with different layouts might not be compatible with the sets and push constants bound for the old one,
+        // so they are all considered unbound.
+        if (new_pipeline.layout != layout) {
+            layout = new_pipeline.layout;
+            sets.fill(vk::DescriptorSet{});
+            constant_count = 0;
+        }
+    }
+
+    void CommandEncoder::bind_descriptor_sets(const vk::DescriptorSet* new_sets, const u32 count) {
+        u32 first = 0;
+        while (first < count && new_sets[first] == sets[first]) {
+            ++first;
+        }
+        u32 last = count;
+        while (last > first && new_sets[last - 1] == sets[last - 1]) {
+            --last;
+        }
+        elided_count += count - (last - first);
+        if (first == last) {
+            return;
+        }
+
+        std::copy(new_sets + first, new_sets + last, sets.begin() + first);
+        commands.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, first, last - first, new_sets + first, 0, nullptr);
+        issued_count += last - first;
+    }
+
+    void CommandEncoder::push_constants(const u32* new_constants, const u32 count) {
+        if (count == constant_count && std::equal(new_constants, new_constants + count, constants.begin())) {
+            ++elided_count;
+            return;
+        }
+        std::copy(new_constants, new_constants + count, constants.begin());
+        constant_count = count;
+        commands.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0, count * sizeof(u32), new_constants);
+        ++issued_count;
+    }
+
+    void CommandEncoder::bind_vertex_buffer(const vk::Buffer buffer) {
+        if (buffer == vertex_buffer) {
+            ++elided_count;
+            return;
+        }
+        vertex_buffer = buffer;
+        commands.bindVertexBuffers(0, vertex_buffer, static_cast<vk::DeviceSize>(0));
+        ++issued_count;
+    }
+} // namespace aryibi::renderer
@@ -0,0 +1,66 @@
+#ifndef ARYIBI_VULKAN_COMMAND_ENCODER_HPP
+#define ARYIBI_VULKAN_COMMAND_ENCODER_HPP
+
+#include "pipeline.hpp"
+#include "types.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <cstddef>
+
+namespace aryibi::renderer {
+    // Records binds and push constants into a command buffer, skipping the ones that match what's already bound. Everything
+    // it tracks lives in fixed size arrays, so it never allocates.
+    class CommandEncoder {
+    public:
+        // The most descriptor sets and push constant words any of the pipelines use.
+        static constexpr u32 max_descriptor_sets = 4;
+        static constexpr u32 max_push_constants = 2;
+
+        CommandEncoder() = default;
+        explicit CommandEncoder(vk::CommandBuffer command_buffer);
+
+        void bind_pipeline(const Pipeline& pipeline);
+        // Binds sets to set numbers [0, count) of the pipeline bound last. Only the range of them that changed is bound.
+        void bind_descriptor_sets(const vk::DescriptorSet* sets, u32 count);
+        template <std::size_t N>
+        void bind_descriptor_sets(const std::array<vk::DescriptorSet, N>& sets) {
+            static_assert(N <= max_descriptor_sets);
+            bind_descriptor_sets(sets.data(), N);
+        }
+        // Pushes constants to the vertex stage of the pipeline bound last, starting at offset 0.
+        void push_constants(const u32* constants, u32 count);
+        template <std::size_t N>
+        void push_constants(const std::array<u32, N>& constants) {
+            static_assert(N <= max_push_constants);
+            push_constants(constants.data(), N);
+        }
+        void bind_vertex_buffer(vk::Buffer buffer);
+
+        [[nodiscard]] vk::CommandBuffer command_buffer() const {
+            return commands;
+        }
+        // State changes recorded into the command buffer.
+        [[nodiscard]] usize issued() const {
+            return issued_count;
+        }
+        // State changes skipped because they matched what was already bound.
+        [[nodiscard]] usize elided() const {
+            return elided_count;
+        }
+
+    private:
+        vk::CommandBuffer commands{};
+        vk::Pipeline pipeline{};
+        vk::PipelineLayout layout{};
+        std::array<vk::DescriptorSet, max_descriptor_sets> sets{};
+        std::array<u32, max_push_constants> constants{};
+        u32 constant_count = 0;
+        vk::Buffer vertex_buffer{};
+        usize issued_count = 0;
+        usize elided_count = 0;
+    };
+} // namespace aryibi::renderer
+
+#endif //ARYIBI_VULKAN_COMMAND_ENCODER_HPP
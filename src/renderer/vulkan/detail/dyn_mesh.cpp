@@ -1,5 +1,12 @@
 #include "dyn_mesh.hpp"
 
 namespace aryibi::renderer {
-    // TODO: idk lol.
+    void DynMesh::mark_dirty(const common::DirtyQuads quads) {
+        for (auto& frame_dirty : dirty) {
+            frame_dirty.add(quads);
+        }
+        vertex_count = vertices.size() / common::floats_per_vertex;
+        index_count = vertices.size() / common::floats_per_quad * common::indices_per_quad;
+        version = common::next_mesh_version();
+    }
 } // namespace aryibi::renderer
@@ -1,15 +1,29 @@
 #ifndef ARBIYI_VULKAN_DYN_MESH_HPP
 #define ARBIYI_VULKAN_DYN_MESH_HPP
 
+#include "renderer/common/mesh_kernels.hpp"
+#include "renderer/common/shadow_cache.hpp"
+#include "constants.hpp"
 #include "buffer.hpp"
 #include "types.hpp"
 
+#include <array>
+
 namespace aryibi::renderer {
     struct DynMesh {
+        // One host-visible buffer per frame in flight, so that modifying the mesh never touches a buffer the GPU may be reading.
         Buffer vbo;
-        Buffer ibo;
+        // Copy of the vertices in CPU memory. The buffer of each frame is synchronized with it right before drawing.
+        common::VertexBuffer vertices;
+        // The quads that the buffer of each frame is missing.
+        std::array<common::DirtyQuads, meta::max_in_flight> dirty{};
         usize vertex_count;
         usize index_count;
+        // Changes whenever the vertices do. See common::next_mesh_version().
+        u64 version;
+
+        // Marks some quads as modified in the buffers of every frame. Must be called after modifying the vertices.
+        void mark_dirty(common::DirtyQuads quads);
     };
 } // namespace aryibi::renderer
 
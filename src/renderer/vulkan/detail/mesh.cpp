@@ -3,16 +3,20 @@
 
 namespace aryibi::renderer {
     Mesh make_mesh(const std::vector<f32>& vertices) {
+        return make_mesh(vertices.data(), vertices.size());
+    }
+
+    Mesh make_mesh(const f32* vertices, const usize vertex_float_count) {
         Mesh mesh{};
 
         RawBuffer::CreateInfo vertex_info{}; {
             vertex_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
             vertex_info.flags = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst;
-            vertex_info.capacity = vertices.size() * sizeof(f32);
+            vertex_info.capacity = vertex_float_count * sizeof(f32);
         }
         mesh.vbo = make_raw_buffer(vertex_info);
-        copy_data_to_local(vertices.data(), vertices.size() * sizeof(f32), mesh.vbo);
-        mesh.vertex_count = vertices.size() * sizeof(f32) / sizeof(Vertex);
+        copy_data_to_local(vertices, vertex_float_count * sizeof(f32), mesh.vbo);
+        mesh.vertex_count = vertex_float_count * sizeof(f32) / sizeof(Vertex);
 
         return mesh;
     }
@@ -15,6 +15,7 @@ namespace aryibi::renderer {
     };
 
     [[nodiscard]] Mesh make_mesh(const std::vector<f32>& vertices);
+    [[nodiscard]] Mesh make_mesh(const f32* vertices, usize vertex_float_count);
     [[nodiscard]] Mesh make_mesh(const std::vector<f32>& vertices, const std::vector<u32>& indices);
 } // namespace aryibi::renderer
 
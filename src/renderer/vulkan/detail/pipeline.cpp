@@ -73,7 +73,7 @@ namespace aryibi::renderer {
             vertex_binding.inputRate = vk::VertexInputRate::eVertex;
         }
 
-        std::array<vk::VertexInputAttributeDescription, 2> vertex_attributes{}; {
+        std::array<vk::VertexInputAttributeDescription, 3> vertex_attributes{}; {
             vertex_attributes[0].binding = 0;
             vertex_attributes[0].format = vk::Format::eR32G32B32Sfloat;
             vertex_attributes[0].location = 0;
@@ -83,6 +83,11 @@ namespace aryibi::renderer {
             vertex_attributes[1].format = vk::Format::eR32G32Sfloat;
             vertex_attributes[1].location = 1;
             vertex_attributes[1].offset = offsetof(Vertex, uvs);
+
+            vertex_attributes[2].binding = 0;
+            vertex_attributes[2].format = vk::Format::eR16G16B16A16Unorm;
+            vertex_attributes[2].location = 2;
+            vertex_attributes[2].offset = offsetof(Vertex, tile);
         }
 
         vk::PipelineVertexInputStateCreateInfo vertex_input_info{}; {
@@ -12,6 +12,8 @@ namespace aryibi::renderer {
     struct Vertex {
         f32 pos[3];
         f32 uvs[2];
+        // Normalized, see common::tile_rect_slot.
+        u16 tile[4];
     };
 
     struct Pipeline {
@@ -44,7 +44,7 @@ namespace aryibi::renderer {
         return buffer;
     }
 
-    void copy_data_to_local(const void* data, const usize size, const RawBuffer& dest) {
+    void copy_data_to_local(const void* data, const usize size, const RawBuffer& dest, const usize dest_offset) {
         RawBuffer::CreateInfo staging_info{}; {
             staging_info.flags = vk::BufferUsageFlagBits::eTransferSrc;
             staging_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
@@ -57,7 +57,7 @@ namespace aryibi::renderer {
         vk::BufferCopy copy{}; {
             copy.size = size;
             copy.srcOffset = 0;
-            copy.dstOffset = 0;
+            copy.dstOffset = dest_offset;
         }
 
         auto command_buffer = begin_transient(); {
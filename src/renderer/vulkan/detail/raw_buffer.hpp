@@ -24,7 +24,7 @@ namespace aryibi::renderer {
     };
 
     [[nodiscard]] RawBuffer make_raw_buffer(const RawBuffer::CreateInfo& info);
-    void copy_data_to_local(const void* data, const usize size, const RawBuffer& dest);
+    void copy_data_to_local(const void* data, const usize size, const RawBuffer& dest, const usize dest_offset = 0);
     void copy_data_to_local(const void* data, const usize size, const Image& dest);
     void destroy_raw_buffer(RawBuffer& buffer);
 } // namespace aryibi::renderer
@@ -1,10 +1,12 @@
 #include "render_pass.hpp"
 #include "context.hpp"
 
+#include "util/aryibi_assert.hpp"
+
 namespace aryibi::renderer {
     RenderPass& RenderPass::attach(const std::string& name, const Image::CreateInfo& info) {
         _targets.emplace_back(RenderTarget{
-            name, make_image(info)
+            name, make_image(info), info
         });
 
         return *this;
@@ -12,7 +14,7 @@ namespace aryibi::renderer {
 
     RenderPass& RenderPass::attach(const std::string& name, const Image& image) {
         _targets.emplace_back(RenderTarget{
-            name, image
+            name, image, {}
         });
 
         return *this;
@@ -20,13 +22,29 @@ namespace aryibi::renderer {
 
     void RenderPass::create(const vk::RenderPassCreateInfo& info) {
         _handle = context().device.logical.createRenderPass(info);
+        create_framebuffer();
+    }
+
+    void RenderPass::resize(const u32 width, const u32 height) {
+        context().device.logical.destroy(_framebuffer);
+        for (auto& target : _targets) {
+            ARYIBI_ASSERT(target.info.width != 0, "Only targets created by the render pass can be resized!");
+            destroy_image(target.image);
+            target.info.width = width;
+            target.info.height = height;
+            target.image = make_image(target.info);
+        }
+        create_framebuffer();
+    }
+
+    void RenderPass::create_framebuffer() {
         const auto& first = _targets.front().image;
 
         std::vector<vk::ImageView> attachments{};
         attachments.reserve(_targets.size());
 
-        for (const auto& [_, image] : _targets) {
-            attachments.emplace_back(image.view);
+        for (const auto& target : _targets) {
+            attachments.emplace_back(target.image.view);
         }
 
         vk::FramebufferCreateInfo create_info{}; {
@@ -42,8 +60,8 @@ namespace aryibi::renderer {
 
 	void RenderPass::destroy() {
         context().device.logical.destroy(_framebuffer);
-        for (auto& [_, target] : _targets) {
-            destroy_image(target);
+        for (auto& target : _targets) {
+            destroy_image(target.image);
         }
         context().device.logical.destroy(_handle);
         _targets.clear();
@@ -13,16 +13,23 @@ namespace aryibi::renderer {
     struct RenderTarget {
         std::string name{};
         Image image{};
+        // How the image was created, so that it can be created again with another size. Zero sized for attached images.
+        Image::CreateInfo info{};
     };
 
     class RenderPass {
         vk::RenderPass _handle{};
         vk::Framebuffer _framebuffer{};
         std::vector<RenderTarget> _targets{};
+
+        void create_framebuffer();
     public:
         RenderPass& attach(const std::string& name, const Image::CreateInfo& info);
         RenderPass& attach(const std::string& name, const Image& image);
         void create(const vk::RenderPassCreateInfo& info);
+        // Creates every target and the framebuffer again with a new size. The render pass itself stays the same, so
+        // pipelines made for it can still be used. Only works if every target was created by the render pass.
+        void resize(u32 width, u32 height);
         void destroy();
 
         [[nodiscard]] vk::RenderPass handle() const;
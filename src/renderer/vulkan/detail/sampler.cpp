@@ -7,6 +7,7 @@ namespace aryibi::renderer {
     static vk::Sampler point{};
     static vk::Sampler linear{};
     static vk::Sampler depth{};
+    static vk::Sampler depth_compare{};
 
     [[nodiscard]] static vk::Sampler make_point_sampler() {
         vk::SamplerCreateInfo info{}; {
@@ -74,10 +75,34 @@ namespace aryibi::renderer {
         return context().device.logical.createSampler(info);
     }
 
+    // Linear filtering with depth comparison averages the results of the 4 nearest texels.
+    [[nodiscard]] static vk::Sampler make_depth_compare_sampler() {
+        vk::SamplerCreateInfo info{}; {
+            info.magFilter = vk::Filter::eLinear;
+            info.minFilter = vk::Filter::eLinear;
+            info.addressModeU = vk::SamplerAddressMode::eClampToBorder;
+            info.addressModeV = vk::SamplerAddressMode::eClampToBorder;
+            info.addressModeW = vk::SamplerAddressMode::eClampToBorder;
+            info.anisotropyEnable = false;
+            info.maxAnisotropy = 1;
+            info.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+            info.unnormalizedCoordinates = false;
+            info.compareEnable = true;
+            info.compareOp = vk::CompareOp::eLessOrEqual;
+            info.mipmapMode = vk::SamplerMipmapMode::eNearest;
+            info.minLod = 0;
+            info.maxLod = 0;
+            info.mipLodBias = 0;
+        }
+
+        return context().device.logical.createSampler(info);
+    }
+
     void make_samplers() {
         point = make_point_sampler();
         linear = make_linear_sampler();
         depth = make_depth_sampler();
+        depth_compare = make_depth_compare_sampler();
     }
 
     vk::Sampler point_sampler() {
@@ -91,4 +116,8 @@ namespace aryibi::renderer {
     vk::Sampler depth_sampler() {
         return depth;
     }
+
+    vk::Sampler depth_compare_sampler() {
+        return depth_compare;
+    }
 } // namespace aryibi::renderer
\ No newline at end of file
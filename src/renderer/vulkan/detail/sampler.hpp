@@ -12,6 +12,7 @@ namespace aryibi::renderer {
     [[nodiscard]] vk::Sampler point_sampler();
     [[nodiscard]] vk::Sampler linear_sampler();
     [[nodiscard]] vk::Sampler depth_sampler();
+    [[nodiscard]] vk::Sampler depth_compare_sampler();
 } // namespace aryibi::renderer
 
 #endif //ARBIYI_VULKAN_SAMPLER_HPP
@@ -0,0 +1,250 @@
+#include "command_buffer.hpp"
+#include "upload_queue.hpp"
+#include "context.hpp"
+
+#include "util/aryibi_assert.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <vector>
+
+namespace aryibi::renderer {
+    struct UploadBatch {
+        vk::CommandBuffer command_buffer{};
+        vk::Fence fence{};
+        std::vector<std::promise<void>> promises{};
+        // Staging buffers of uploads too big for the ring.
+        std::vector<RawBuffer> dedicated_staging{};
+        // Sources of enqueue_buffer_move().
+        std::vector<RawBuffer> moved_from{};
+        // Where the staging data of this batch ends within the ring.
+        usize staging_end{};
+        u64 last_ticket{};
+    };
+
+    constexpr usize staging_capacity = 16 * 1024 * 1024;
+    constexpr usize staging_alignment = 16;
+
+    static RawBuffer staging{};
+    // Free space starts at head and ends at tail (Wrapping around). head == tail means that the ring is empty.
+    static usize staging_head{};
+    static usize staging_tail{};
+
+    static UploadBatch recording{};
+    static std::deque<UploadBatch> submitted{};
+    static u64 next_ticket = 1;
+    static u64 completed_ticket = 0;
+
+    [[nodiscard]] static std::optional<usize> allocate_staging(const usize size) {
+        if (!staging.handle) {
+            RawBuffer::CreateInfo staging_info{}; {
+                staging_info.flags = vk::BufferUsageFlagBits::eTransferSrc;
+                staging_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+                staging_info.capacity = staging_capacity;
+            }
+            staging = make_raw_buffer(staging_info);
+        }
+
+        const auto aligned = (size + staging_alignment - 1) / staging_alignment * staging_alignment;
+        // head never catches up with tail, otherwise a full ring would look empty.
+        if (staging_head >= staging_tail) {
+            if (staging_capacity - staging_head >= aligned) {
+                const auto offset = staging_head;
+                staging_head += aligned;
+                return offset;
+            }
+            if (staging_tail > aligned) {
+                staging_head = aligned;
+                return 0;
+            }
+        } else if (staging_tail - staging_head > aligned) {
+            const auto offset = staging_head;
+            staging_head += aligned;
+            return offset;
+        }
+        return std::nullopt;
+    }
+
+    static void complete_batch(UploadBatch& batch) {
+        for (auto& buffer : batch.dedicated_staging) {
+            destroy_raw_buffer(buffer);
+        }
+        for (auto& buffer : batch.moved_from) {
+            destroy_raw_buffer(buffer);
+        }
+        for (auto& promise : batch.promises) {
+            promise.set_value();
+        }
+        context().device.logical.destroyFence(batch.fence);
+        free_transient(batch.command_buffer);
+
+        staging_tail = batch.staging_end;
+        completed_ticket = batch.last_ticket;
+        if (submitted.size() == 1 && !recording.command_buffer) {
+            // Nothing is using the ring anymore, start again from the beginning to avoid wrapping around.
+            staging_head = staging_tail = 0;
+        }
+    }
+
+    // Blocks until the oldest submitted batch completes.
+    static void wait_oldest_batch() {
+        auto& batch = submitted.front();
+        (void)context().device.logical.waitForFences(batch.fence, true, -1);
+        complete_batch(batch);
+        submitted.pop_front();
+    }
+
+    u64 enqueue_upload(const void* data, const usize size, const RawBuffer& dest, const usize dest_offset) {
+        if (size == 0) {
+            // Nothing to copy, so it's already complete.
+            return 0;
+        }
+
+        vk::Buffer source{};
+        usize source_offset = 0;
+        if (size > staging_capacity / 2) {
+            RawBuffer::CreateInfo staging_info{}; {
+                staging_info.flags = vk::BufferUsageFlagBits::eTransferSrc;
+                staging_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+                staging_info.capacity = size;
+            }
+            auto& dedicated = recording.dedicated_staging.emplace_back(make_raw_buffer(staging_info));
+            std::memcpy(dedicated.mapped, data, size);
+            source = dedicated.handle;
+        } else {
+            auto offset = allocate_staging(size);
+            while (!offset) {
+                // The ring is full. Flush what has been recorded so far and wait for the GPU to free some space.
+                submit_uploads();
+                wait_oldest_batch();
+                offset = allocate_staging(size);
+            }
+            std::memcpy(static_cast<u8*>(staging.mapped) + *offset, data, size);
+            source = staging.handle;
+            source_offset = *offset;
+        }
+
+        if (!recording.command_buffer) {
+            recording.command_buffer = begin_transient();
+        }
+
+        vk::BufferCopy copy{}; {
+            copy.size = size;
+            copy.srcOffset = source_offset;
+            copy.dstOffset = dest_offset;
+        }
+        recording.command_buffer.copyBuffer(source, dest.handle, copy);
+
+        recording.promises.emplace_back();
+        recording.last_ticket = next_ticket;
+        return next_ticket++;
+    }
+
+    void enqueue_buffer_move(RawBuffer& source, const RawBuffer& dest, const std::vector<vk::BufferCopy>& copies) {
+        if (!recording.command_buffer) {
+            recording.command_buffer = begin_transient();
+            // A batch without uploads must not move completed_upload_ticket() backwards when it completes.
+            recording.last_ticket = next_ticket - 1;
+        }
+
+        // The source might be the destination of an earlier copy, either in this batch or in a submitted one. Waiting
+        // for the vertex input of earlier submissions too means that no frame reads the source once the batch is done.
+        vk::MemoryBarrier barrier{}; {
+            barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+        }
+        recording.command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eVertexInput,
+            vk::PipelineStageFlagBits::eTransfer,
+            {}, barrier, nullptr, nullptr);
+        if (!copies.empty()) {
+            recording.command_buffer.copyBuffer(source.handle, dest.handle, copies);
+        }
+
+        recording.moved_from.emplace_back(source);
+        source.handle = nullptr;
+        source.mapped = nullptr;
+    }
+
+    std::shared_future<void> upload_future(const u64 ticket) {
+        ARYIBI_ASSERT(ticket > completed_ticket, "Tried to get the future of a completed upload!");
+        // Tickets are consecutive, so the promise of a ticket can be found from the last ticket of its batch.
+        auto find = [ticket](UploadBatch& batch) -> std::promise<void>* {
+            const auto first_ticket = batch.last_ticket + 1 - batch.promises.size();
+            if (ticket < first_ticket || ticket > batch.last_ticket) {
+                return nullptr;
+            }
+            return &batch.promises[ticket - first_ticket];
+        };
+
+        auto promise = find(recording);
+        for (auto& batch : submitted) {
+            if (!promise) {
+                promise = find(batch);
+            }
+        }
+        ARYIBI_ASSERT(promise, "[Internal error] Upload ticket not found!");
+        return promise->get_future().share();
+    }
+
+    void submit_uploads() {
+        if (!recording.command_buffer) {
+            return;
+        }
+
+        // Make the copies visible to the draws submitted after them.
+        vk::MemoryBarrier barrier{}; {
+            barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead;
+        }
+        recording.command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eVertexInput,
+            {}, barrier, nullptr, nullptr);
+        recording.command_buffer.end();
+
+        recording.fence = context().device.logical.createFence({});
+        recording.staging_end = staging_head;
+
+        vk::SubmitInfo submit_info{}; {
+            submit_info.commandBufferCount = 1;
+            submit_info.pCommandBuffers = &recording.command_buffer;
+        }
+        context().device.graphics.submit(submit_info, recording.fence);
+
+        submitted.emplace_back(std::move(recording));
+        recording = {};
+    }
+
+    void poll_uploads() {
+        while (!submitted.empty() &&
+               context().device.logical.getFenceStatus(submitted.front().fence) == vk::Result::eSuccess) {
+            complete_batch(submitted.front());
+            submitted.pop_front();
+        }
+    }
+
+    void wait_for_upload(const u64 ticket) {
+        if (ticket <= completed_ticket) {
+            return;
+        }
+        if (ticket >= next_ticket - recording.promises.size()) {
+            submit_uploads();
+        }
+        while (ticket > completed_ticket) {
+            wait_oldest_batch();
+        }
+    }
+
+    void wait_for_all_uploads() {
+        wait_for_upload(next_ticket - 1);
+    }
+
+    u64 completed_upload_ticket() {
+        return completed_ticket;
+    }
+} // namespace aryibi::renderer
@@ -0,0 +1,35 @@
+#ifndef ARYIBI_VULKAN_UPLOAD_QUEUE_HPP
+#define ARYIBI_VULKAN_UPLOAD_QUEUE_HPP
+
+#include "raw_buffer.hpp"
+#include "types.hpp"
+
+#include <future>
+#include <vector>
+
+namespace aryibi::renderer {
+    // Copies data to GPU-only buffers without stalling the queue. The data is written to a staging ring buffer right
+    // away, and the copies are recorded into a batch that is submitted with a fence by submit_uploads().
+    // Every upload gets a ticket. Tickets grow monotonically and batches complete in order, so an upload is complete
+    // once its ticket is less or equal than completed_upload_ticket().
+    [[nodiscard]] u64 enqueue_upload(const void* data, const usize size, const RawBuffer& dest, const usize dest_offset = 0);
+    // Records copies from source into dest in the same batch as the uploads, after every upload, copy and draw submitted
+    // or enqueued so far. Used to move the contents of a buffer that pending uploads might still be writing to, or that
+    // frames in flight might still be reading, to a new one without waiting. Takes ownership of source, which is
+    // destroyed once the batch completes.
+    void enqueue_buffer_move(RawBuffer& source, const RawBuffer& dest, const std::vector<vk::BufferCopy>& copies);
+    // The future of an upload that hasn't completed yet. It becomes ready in poll_uploads(), which is called by the
+    // renderer every frame, so it must not be waited on from the thread that draws. Can only be called once per ticket.
+    [[nodiscard]] std::shared_future<void> upload_future(const u64 ticket);
+    // Submits the uploads enqueued since the last call as a single batch.
+    void submit_uploads();
+    // Releases the resources of the batches that have completed, and fulfills their futures.
+    void poll_uploads();
+    // Blocks until an upload completes. Submits it first if needed.
+    void wait_for_upload(const u64 ticket);
+    // Blocks until every upload enqueued so far completes.
+    void wait_for_all_uploads();
+    [[nodiscard]] u64 completed_upload_ticket();
+} // namespace aryibi::renderer
+
+#endif // ARYIBI_VULKAN_UPLOAD_QUEUE_HPP
@@ -1,11 +1,13 @@
 #ifndef ARYIBI_VULKAN_IMPL_TYPES_HPP
 #define ARYIBI_VULKAN_IMPL_TYPES_HPP
 
+#include "detail/command_encoder.hpp"
 #include "detail/descriptor_set.hpp"
 #include "detail/render_pass.hpp"
 #include "detail/raw_buffer.hpp"
 #include "detail/swapchain.hpp"
 #include "detail/pipeline.hpp"
+#include "detail/upload_queue.hpp"
 #include "detail/dyn_mesh.hpp"
 #include "detail/forwards.hpp"
 #include "detail/texture.hpp"
@@ -14,6 +16,13 @@
 #include "detail/mesh.hpp"
 
 #include "aryibi/renderer.hpp"
+#include "renderer/common/culling.hpp"
+#include "renderer/common/draw_order.hpp"
+#include "renderer/common/light_tiles.hpp"
+#include "renderer/common/mesh_arena.hpp"
+#include "renderer/common/mesh_kernels.hpp"
+#include "renderer/common/shadow_atlas.hpp"
+#include "renderer/common/shadow_cache.hpp"
 
 #include <vector>
 
@@ -31,18 +40,38 @@ namespace aryibi::renderer {
     };
 
     struct MeshHandle::impl {
-        Mesh handle;
+        // The vertices of static meshes live in the pages of the mesh arena (See Renderer::impl::make_arena_mesh()).
+        // Draws look up the current range of the mesh every time, since compacting a page moves its meshes around.
+        u32 arena_id = common::MeshArena::no_mesh;
+        u32 index_count = 0;
+        // Local bounds of the vertices, used to cull the mesh. Dynamic meshes are never culled.
+        sprites::Rect2D bounds{};
+        // See enqueue_upload(). Zero if the mesh was uploaded synchronously.
+        u64 upload_ticket = 0;
+        // Non-null if this handle was returned by DynMeshHandle::mesh().
+        DynMesh* dyn = nullptr;
+        // See common::next_mesh_version(). Dynamic meshes keep theirs in DynMesh instead.
+        u64 version = 0;
+
+        [[nodiscard]] bool is_resident() const {
+            return upload_ticket <= completed_upload_ticket();
+        }
+
+        // Changes whenever the vertices of the mesh do.
+        [[nodiscard]] u64 current_version() const {
+            return dyn ? dyn->version : version;
+        }
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
         static inline std::unordered_map<u32, u32> handle_ref_count;
 #endif
     };
 
-    struct MeshBuilder::impl {
-        std::vector<f32> result;
+    struct DynMeshHandle::impl {
+        DynMesh* data = nullptr;
+    };
 
-        static constexpr auto sizeof_vertex = 5;
-        static constexpr auto sizeof_triangle = 3 * sizeof_vertex;
-        static constexpr auto sizeof_quad = 2 * sizeof_triangle;
+    struct MeshBuilder::impl {
+        common::VertexBuffer result;
     };
 
     struct Framebuffer::impl {
@@ -59,11 +88,29 @@ namespace aryibi::renderer {
 
     struct ShaderHandle::impl {
         Pipeline handle;
+        // Tells the built-in pipelines apart in draw sort keys (See common::make_sort_key()).
+        u32 sort_id = 0;
     };
 
     struct Renderer::impl {
         static void enqueue_for_deletion(RawBuffer& buffer);
-        static void write_dyn_mesh(DynMesh& mesh, const std::vector<f32>& vertices);
+        // Suballocates a static mesh from the mesh arena and copies its vertices to it. If async is true, the copy is
+        // only enqueued, and mesh.upload_ticket tells when it's done.
+        static void make_arena_mesh(MeshHandle::impl& mesh, const f32* vertices, usize vertex_float_count, bool async);
+        // Frees the range of a static mesh once the frames in flight are done with it.
+        static void enqueue_mesh_free(u32 mesh);
+        // Moves all the meshes of a page of the mesh arena to the start of a new vertex buffer, which replaces the old one.
+        static void compact_mesh_page(u32 page);
+        // Binds the vertex buffer of a mesh (Uploading the dirty quads of a dynamic mesh first) and draws it. Static
+        // meshes are drawn with an offset into their page, which is only bound if it isn't bound already.
+        static void draw_mesh(CommandEncoder& encoder, const MeshHandle::impl& mesh);
+        // Which vertex buffer a mesh is drawn from: 0 for dynamic meshes, which have their own, or the page of the mesh
+        // arena plus one for static ones.
+        [[nodiscard]] static u32 mesh_buffer_id(const MeshHandle::impl& mesh);
+        /// Makes sure the shared quad index buffer has indices for at least quad_count quads.
+        static void reserve_quad_indices(usize quad_count);
+        // Uploads the quads of a dynamic mesh that the buffer of the current frame is missing, if any.
+        static void sync_dyn_mesh(DynMesh& mesh);
         [[nodiscard]] static usize load_texture(const u8* data, const TextureHandle& handle);
         void update_buffers(const DrawCmdList&);
 
@@ -96,7 +143,32 @@ namespace aryibi::renderer {
         Buffer uniform_data{};
         Buffer transforms{};
         Buffer light_mats{};
+        // common::ShaderLightInfo.
         Buffer lights_data{};
+        Buffer directional_lights_data{};
+        Buffer point_lights_data{};
+        // The lists of point lights of each tile of the screen (See common::LightTileGrid).
+        Buffer light_tiles_data{};
+
+        // World bounds of the commands of the frame being drawn. Kept to reuse their memory.
+        common::PackedRects command_bounds{};
+        std::vector<u8> visible_commands{};
+        // Sorts the visible commands into the order they are drawn in.
+        common::DrawSorter draw_sorter{};
+        common::ShadowCasterLists shadow_casters{};
+        common::ShadowAtlasAllocator shadow_atlas{};
+        std::vector<f32> shadow_importances{};
+        std::vector<common::ShadowTile> shadow_tiles{};
+        std::vector<common::ShaderDirectionalLight> shader_directional_lights{};
+        std::vector<common::ShaderPointLight> shader_point_lights{};
+        common::PackedRects point_light_rects{};
+        common::LightTileGrid light_grid{};
+        // Tiles of the shadow atlas are only drawn again when their key changes.
+        common::ShadowTileCache shadow_cache{};
+        std::vector<u64> shadow_tile_placements{};
+        std::vector<u64> shadow_tile_contents{};
+        ShadowFilter shadow_filter = ShadowFilter::grid_25;
+        FrameStats stats{};
     };
 } // namespace aryibi::renderer
 
@@ -2,18 +2,21 @@
 #include "detail/command_buffer.hpp"
 #include "detail/constants.hpp"
 #include "detail/context.hpp"
+#include "detail/upload_queue.hpp"
 #include "detail/sampler.hpp"
 #include "detail/buffer.hpp"
 
 #include "windowing/glfw/impl_types.hpp"
 #include "aryibi/renderer.hpp"
 #include "impl_types.hpp"
+#include "util/aryibi_assert.hpp"
 
 #include <anton/math/transform.hpp>
 #include <anton/math/matrix4.hpp>
 
 #include <vulkan/vulkan.hpp>
 #include <GLFW/glfw3.h>
+#include <algorithm>
 
 #include "imgui.h"
 #include "examples/imgui_impl_glfw.h"
@@ -32,24 +35,6 @@ namespace aryibi::renderer {
         aml::Matrix4 view;
     };
 
-    struct LightData {
-        struct {
-            aml::Vector4 color{};
-            aml::Matrix4 light_space_matrix{};
-            aml::Vector3 light_atlas_pos{};
-            f32 _pad0{};
-        } directional_lights[5] = {};
-        struct {
-            aml::Vector4 color{};
-            aml::Matrix4 light_space_matrix{};
-            aml::Vector3 light_atlas_pos{};
-            f32 radius{};
-        } point_lights[20] = {};
-        aml::Vector3 ambient_light_color{};
-        u32 point_light_count{};
-        u32 directional_light_count{};
-    };
-
     const static auto& ctx = context();
 
     static u32 image_index{};
@@ -58,35 +43,219 @@ namespace aryibi::renderer {
     static vk::DescriptorSetLayout texture_layout{};
     static std::vector<InternalTexture> textures{};
 
+    // Buffers waiting to be destroyed and how many frames have started since. Frames in flight might still be reading them.
     static std::vector<std::pair<RawBuffer, usize>> to_delete{};
 
     void Renderer::impl::enqueue_for_deletion(RawBuffer& buffer) {
         to_delete.emplace_back(buffer, 0);
+        buffer.handle = nullptr;
+        buffer.mapped = nullptr;
+    }
 
-        for (auto& [buf, idx] : to_delete) {
-            if (idx == meta::max_in_flight) {
-                destroy_raw_buffer(buf);
+    // Must be called once per frame, after waiting for its fence.
+    static void free_unused_buffers() {
+        for (auto& [buffer, frames] : to_delete) {
+            // Same as free_unused_meshes(): The last frame that might have used the buffer is done by now.
+            if (++frames == meta::max_in_flight) {
+                destroy_raw_buffer(buffer);
             }
-            idx++;
         }
 
         to_delete.erase(std::remove_if(to_delete.begin(), to_delete.end(), [](const auto& pair) {
-            return pair.second == meta::max_in_flight + 1;
+            return pair.second == meta::max_in_flight;
         }), to_delete.end());
+    }
 
-        buffer.handle = nullptr;
-        buffer.mapped = nullptr;
+    // Every mesh is made of quads, so all of them share a single index buffer.
+    static RawBuffer quad_indices{};
+    static usize quad_indices_quad_count{};
+
+    void Renderer::impl::reserve_quad_indices(const usize quad_count) {
+        if (quad_count <= quad_indices_quad_count) {
+            return;
+        }
+
+        // Previous frames might still be using the old buffer.
+        if (quad_indices.handle) {
+            enqueue_for_deletion(quad_indices);
+        }
+
+        constexpr usize min_quad_count = 1024;
+        quad_indices_quad_count = std::max({ quad_count, quad_indices_quad_count * 2, min_quad_count });
+        std::vector<u32> indices(quad_indices_quad_count * common::indices_per_quad);
+        common::write_quad_indices(indices.data(), 0, quad_indices_quad_count);
+
+        RawBuffer::CreateInfo index_info{}; {
+            index_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+            index_info.flags = vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst;
+            index_info.capacity = indices.size() * sizeof(u32);
+        }
+        quad_indices = make_raw_buffer(index_info);
+        // Every upload is submitted before the draws of the next frame, which are the first ones using this buffer.
+        (void)enqueue_upload(indices.data(), index_info.capacity, quad_indices);
     }
 
-    void Renderer::impl::write_dyn_mesh(DynMesh& mesh, const std::vector<f32>& vertices) {
+    void Renderer::impl::sync_dyn_mesh(DynMesh& mesh) {
         auto& vbo = mesh.vbo[frame_index];
 
+        // Empty meshes still need a buffer to bind.
         if (!vbo.exists()) {
             vbo.create(vk::BufferUsageFlagBits::eVertexBuffer);
         }
 
-        vbo.write(vertices.data(), vertices.size() * sizeof(f32));
-        mesh.vertex_count = vertices.size() / sizeof(Vertex);
+        auto& dirty = mesh.dirty[frame_index];
+        if (dirty.empty()) {
+            return;
+        }
+
+        const auto quad_count = mesh.vertices.size() / common::floats_per_quad;
+        const auto size = mesh.vertices.size() * sizeof(f32);
+        if (size > vbo.capacity()) {
+            // Growing the buffer gives it new memory, so every quad has to be written again.
+            dirty = { 0, quad_count };
+        }
+        vbo.resize(size);
+
+        // The fence of this frame has already been waited on, so the GPU isn't using this buffer anymore.
+        const auto end = std::min(dirty.end, quad_count);
+        if (dirty.first < end) {
+            constexpr auto sizeof_quad = common::floats_per_quad * sizeof(f32);
+            vbo.write(mesh.vertices.data() + dirty.first * common::floats_per_quad, (end - dirty.first) * sizeof_quad, dirty.first * sizeof_quad);
+        }
+        dirty = {};
+    }
+
+    // Static meshes are suballocated from a few big vertex buffers (Pages) instead of getting one each, so most draws
+    // don't need to bind a different vertex buffer.
+    static common::MeshArena mesh_arena{};
+    static std::vector<RawBuffer> mesh_pages{};
+    // Unloaded meshes and how many frames have started since. Frames in flight might still be reading them.
+    static std::vector<std::pair<u32, usize>> meshes_to_free{};
+    // The range of distances from the camera that it shows.
+    constexpr f32 camera_near = -10.0f;
+    constexpr f32 camera_far = 20.0f;
+
+    static_assert(sizeof(Vertex) == common::floats_per_vertex * sizeof(f32), "Vertex must match the layout of mesh data");
+
+    static RawBuffer make_mesh_page(const usize vertex_capacity) {
+        RawBuffer::CreateInfo vertex_info{}; {
+            vertex_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+            vertex_info.flags = vk::BufferUsageFlagBits::eVertexBuffer |
+                                vk::BufferUsageFlagBits::eTransferDst |
+                                vk::BufferUsageFlagBits::eTransferSrc;
+            vertex_info.capacity = vertex_capacity * sizeof(Vertex);
+        }
+        return make_raw_buffer(vertex_info);
+    }
+
+    // The depth pass loads the shadow atlas instead of clearing it, so the atlas must be in the layout the depth pass
+    // expects from the start.
+    static void prepare_shadow_atlas(const Image& atlas) {
+        auto command_buffer = begin_transient(); {
+            vk::ImageMemoryBarrier image_memory_barrier{}; {
+                image_memory_barrier.image = atlas.handle;
+                image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                image_memory_barrier.oldLayout = vk::ImageLayout::eUndefined;
+                image_memory_barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+                image_memory_barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
+                image_memory_barrier.subresourceRange.baseMipLevel = 0;
+                image_memory_barrier.subresourceRange.levelCount = 1;
+                image_memory_barrier.subresourceRange.baseArrayLayer = 0;
+                image_memory_barrier.subresourceRange.layerCount = 1;
+                image_memory_barrier.srcAccessMask = {};
+                image_memory_barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+            }
+
+            command_buffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eTopOfPipe,
+                vk::PipelineStageFlagBits::eFragmentShader,
+                vk::DependencyFlags{},
+                nullptr,
+                nullptr,
+                image_memory_barrier);
+        } end_transient(command_buffer);
+    }
+
+    void Renderer::impl::compact_mesh_page(const u32 page) {
+        std::vector<vk::BufferCopy> copies{};
+        for (const auto& move : mesh_arena.compact(page)) {
+            auto& copy = copies.emplace_back(); {
+                copy.srcOffset = move.from_vertex * sizeof(Vertex);
+                copy.dstOffset = move.to_vertex * sizeof(Vertex);
+                copy.size = move.vertex_count * sizeof(Vertex);
+            }
+        }
+
+        // Pending uploads might still be copying to the old buffer and previous frames might still be drawing from it,
+        // so the copy goes after them in the upload queue, which destroys the old buffer once it's done.
+        auto buffer = make_mesh_page(mesh_arena.page_capacity(page));
+        enqueue_buffer_move(mesh_pages[page], buffer, copies);
+        mesh_pages[page] = buffer;
+    }
+
+    void Renderer::impl::make_arena_mesh(MeshHandle::impl& mesh, const f32* vertices, const usize vertex_float_count, const bool async) {
+        const auto vertex_count = static_cast<u32>(vertex_float_count / common::floats_per_vertex);
+        // Empty meshes still take a vertex, so that they exist.
+        const auto reserved_count = std::max<u32>(vertex_count, 1);
+
+        // Compacting a fragmented page is cheaper than creating a new one.
+        if (const auto page = mesh_arena.find_fragmented_page(reserved_count); page != common::MeshArena::no_mesh) {
+            compact_mesh_page(page);
+        }
+
+        mesh.arena_id = mesh_arena.allocate(reserved_count);
+        while (mesh_pages.size() < mesh_arena.page_count()) {
+            mesh_pages.emplace_back(make_mesh_page(mesh_arena.page_capacity(mesh_pages.size())));
+        }
+
+        const auto& range = mesh_arena.range(mesh.arena_id);
+        const auto size = vertex_float_count * sizeof(f32);
+        const auto offset = range.first_vertex * sizeof(Vertex);
+        if (async) {
+            mesh.upload_ticket = enqueue_upload(vertices, size, mesh_pages[range.page], offset);
+        } else if (size != 0) {
+            copy_data_to_local(vertices, size, mesh_pages[range.page], offset);
+        }
+        mesh.index_count = vertex_count / common::vertices_per_quad * common::indices_per_quad;
+        mesh.bounds = common::vertex_bounds(vertices, vertex_count);
+        mesh.version = common::next_mesh_version();
+    }
+
+    void Renderer::impl::enqueue_mesh_free(const u32 mesh) {
+        meshes_to_free.emplace_back(mesh, 0);
+    }
+
+    // Must be called once per frame, after waiting for its fence.
+    static void free_unused_meshes() {
+        for (auto& [mesh, frames] : meshes_to_free) {
+            // The fence of this frame guarantees that the frame submitted max_in_flight frames ago is done, which is
+            // the last one that might have drawn the mesh.
+            if (++frames == meta::max_in_flight) {
+                mesh_arena.free(mesh);
+            }
+        }
+
+        meshes_to_free.erase(std::remove_if(meshes_to_free.begin(), meshes_to_free.end(), [](const auto& pair) {
+            return pair.second == meta::max_in_flight;
+        }), meshes_to_free.end());
+    }
+
+    void Renderer::impl::draw_mesh(CommandEncoder& encoder, const MeshHandle::impl& mesh) {
+        if (mesh.dyn) {
+            sync_dyn_mesh(*mesh.dyn);
+            encoder.bind_vertex_buffer(mesh.dyn->vbo[frame_index].handle());
+            encoder.command_buffer().drawIndexed(mesh.dyn->index_count, 1, 0, 0, 0);
+            return;
+        }
+
+        const auto& range = mesh_arena.range(mesh.arena_id);
+        encoder.bind_vertex_buffer(mesh_pages[range.page].handle);
+        encoder.command_buffer().drawIndexed(mesh.index_count, 1, 0, static_cast<i32>(range.first_vertex), 0);
+    }
+
+    u32 Renderer::impl::mesh_buffer_id(const MeshHandle::impl& mesh) {
+        return mesh.dyn ? 0 : mesh_arena.range(mesh.arena_id).page + 1;
     }
 
     usize Renderer::impl::load_texture(const u8* data, const TextureHandle& handle) {
@@ -125,9 +294,9 @@ namespace aryibi::renderer {
                 camera_data.projection = aml::orthographic_rh(
                     -camera_view_size_in_tiles.x / 2.f, camera_view_size_in_tiles.x / 2.f,
                     -camera_view_size_in_tiles.y / 2.f, camera_view_size_in_tiles.y / 2.f,
-                    -10.0f, 20.0f);
+                    camera_near, camera_far);
             } else {
-                camera_data.projection = aml::orthographic_rh(0, camera_view_size_in_tiles.x, -camera_view_size_in_tiles.y, 0, -10.0f, 20.0f);
+                camera_data.projection = aml::orthographic_rh(0, camera_view_size_in_tiles.x, -camera_view_size_in_tiles.y, 0, camera_near, camera_far);
             }
 
             camera_data.projection[1][1] *= -1;
@@ -168,16 +337,31 @@ namespace aryibi::renderer {
             current_main_set.update(update);
         }
 
-        const i32 light_atlas_tiles = aml::ceil(aml::sqrt(commands.directional_lights.size() + commands.point_lights.size()));
+        // The shadow atlas is split between the lights, giving bigger tiles to the ones that light more of the view.
+        // Lights that can't light anything within the view get no tile.
+        const auto camera_rect = common::camera_view_rect(commands.camera, swapchain.extent.width, swapchain.extent.height);
+        shadow_importances.clear();
+        for (const auto& light : commands.directional_lights) {
+            shadow_importances.emplace_back(common::shadow_importance(camera_rect, camera_rect, light.intensity));
+        }
+        for (const auto& light : commands.point_lights) {
+            shadow_importances.emplace_back(common::shadow_importance(common::point_light_rect(light), camera_rect, light.intensity));
+        }
+        shadow_atlas.allocate(
+            shadow_importances,
+            common::max_shadow_atlas_level(depth_pass["depth"].width, depth_pass["depth"].height),
+            shadow_tiles);
+
+        // The shader takes the filter as a number, the values of ShadowFilter (Never renderer_default).
+        auto light_shadow_filter = [this](const Light& light) {
+            return static_cast<u32>(light.shadow_filter == ShadowFilter::renderer_default ? shadow_filter : light.shadow_filter);
+        };
 
-        LightData light_data{};
         std::vector<aml::Matrix4> light_matrices{};
+        light_matrices.reserve(commands.directional_lights.size() + commands.point_lights.size());
 
-        light_data.directional_light_count = commands.directional_lights.size();
-        light_data.point_light_count = commands.point_lights.size();
-
-        light_matrices.reserve(light_data.directional_light_count + light_data.point_light_count);
-        for (usize i = 0; i < light_data.directional_light_count; ++i) {
+        shader_directional_lights.clear();
+        for (usize i = 0; i < commands.directional_lights.size(); ++i) {
             auto& light = commands.directional_lights[i];
 
             auto view = aml::translate(commands.camera.position);
@@ -186,72 +370,105 @@ namespace aryibi::renderer {
                     aml::rotate_x(light.rotation.x);
             view = aml::inverse(view);
 
-            light_data.directional_lights[i].color = {
-                light.color.fred(),
-                light.color.fgreen(),
-                light.color.fblue(),
-                light.color.falpha()
-            };
-            light.matrix = light_data.directional_lights[i].light_space_matrix = camera_data.projection * view;
-            light.light_atlas_pos = {
-                static_cast<float>(i % light_atlas_tiles) / static_cast<float>(light_atlas_tiles),
-                static_cast<float>(i / light_atlas_tiles) / static_cast<float>(light_atlas_tiles),
-            };
-            light.light_atlas_size = 1.f / static_cast<float>(light_atlas_tiles);
-            light_data.directional_lights[i].light_atlas_pos = aml::Vector3{
-                light.light_atlas_pos,
-                light.light_atlas_size
-            };
+            light.matrix = camera_data.projection * view;
+            light.light_atlas_pos = shadow_tiles[i].position;
+            light.light_atlas_size = shadow_tiles[i].size;
+
+            auto& shader_light = shader_directional_lights.emplace_back(); {
+                // Alpha is the intensity, like in the OpenGL backend.
+                shader_light.color = {
+                    light.color.fred(),
+                    light.color.fgreen(),
+                    light.color.fblue(),
+                    light.intensity
+                };
+                shader_light.light_space_matrix = light.matrix;
+                shader_light.light_atlas_pos = aml::Vector3{
+                    light.light_atlas_pos,
+                    light.light_atlas_size
+                };
+                shader_light.shadow_filter = light_shadow_filter(light);
+            }
 
             light_matrices.emplace_back(camera_data.projection * view);
         }
 
+        shader_point_lights.clear();
+        point_light_rects.clear();
         for (usize i = 0; i < commands.point_lights.size(); ++i) {
             auto& light = commands.point_lights[i];
 
             auto view = aml::translate(commands.camera.position);
             view = aml::inverse(view);
 
-            light_data.point_lights[i].color = {
-                light.color.fred(),
-                light.color.fgreen(),
-                light.color.fblue(),
-                light.color.falpha()
-            };
-            light_data.point_lights[i].radius = light.radius;
-            light.matrix = light_data.point_lights[i].light_space_matrix = camera_data.projection * view;
-            light.light_atlas_pos = {
-                static_cast<float>(light_data.directional_light_count + i % light_atlas_tiles) / static_cast<float>(light_atlas_tiles),
-                static_cast<float>(light_data.directional_light_count + i / light_atlas_tiles) / static_cast<float>(light_atlas_tiles),
-            };
-            light.light_atlas_size = 1.f / static_cast<float>(light_atlas_tiles);
-            light_data.point_lights[i].light_atlas_pos = aml::Vector3{
-                light.light_atlas_pos,
-                light.light_atlas_size
-            };
+            light.matrix = camera_data.projection * view;
+            light.light_atlas_pos = shadow_tiles[commands.directional_lights.size() + i].position;
+            light.light_atlas_size = shadow_tiles[commands.directional_lights.size() + i].size;
+
+            auto& shader_light = shader_point_lights.emplace_back(); {
+                shader_light.color = {
+                    light.color.fred(),
+                    light.color.fgreen(),
+                    light.color.fblue(),
+                    light.intensity
+                };
+                shader_light.light_space_matrix = light.matrix;
+                shader_light.light_atlas_pos = aml::Vector3{
+                    light.light_atlas_pos,
+                    light.light_atlas_size
+                };
+                shader_light.radius = light.radius;
+                shader_light.position = light.position;
+                shader_light.shadow_filter = light_shadow_filter(light);
+            }
+            // Lights that don't light anything aren't listed in any tile.
+            point_light_rects.push_back(light.intensity > 0 ? common::point_light_rect(light) : common::empty_rect());
 
             light_matrices.emplace_back(camera_data.projection * view);
         }
 
-        light_data.ambient_light_color = {
-            commands.ambient_light_color.fred(),
-            commands.ambient_light_color.fgreen(),
-            commands.ambient_light_color.fblue()
-        };
+        // Only the point lights that overlap a tile of the screen are run for its fragments.
+        light_grid.build(camera_rect, swapchain.extent.width, swapchain.extent.height, point_light_rects);
+        stats.light_tiles = light_grid.tile_count();
+        stats.tiled_point_lights = light_grid.listed_light_count();
 
-        if (lights_buffer.size() == sizeof(LightData)) {
-            lights_buffer.write(&light_data, sizeof(LightData));
-        } else {
-            lights_buffer.write(&light_data, sizeof(LightData));
+        common::ShaderLightInfo light_info{}; {
+            light_info.ambient_light_color = {
+                commands.ambient_light_color.fred(),
+                commands.ambient_light_color.fgreen(),
+                commands.ambient_light_color.fblue()
+            };
+            light_info.directional_light_count = shader_directional_lights.size();
+            light_info.point_light_count = shader_point_lights.size();
+            light_grid.write_info(light_info);
+        }
 
-            SingleUpdateBufferInfo update{}; {
-                update.binding = 0;
-                update.buffer = lights_buffer.info();
-                update.type = vk::DescriptorType::eUniformBuffer;
-            }
+        // Buffers are allocated again when they grow, so the descriptors have to point to the new ones.
+        auto write_lights_buffer = [&current_lights_set](SingleBuffer& buffer, const void* data, const usize size, const u64 binding, const vk::DescriptorType type) {
+            if (buffer.size() == size) {
+                buffer.write(data, size);
+            } else {
+                buffer.write(data, size);
 
-            current_lights_set.update(update);
-        }
+                SingleUpdateBufferInfo update{}; {
+                    update.binding = binding;
+                    update.buffer = buffer.info();
+                    update.type = type;
+                }
+
+                current_lights_set.update(update);
+            }
+        };
+        write_lights_buffer(lights_buffer, &light_info, sizeof(light_info), 0, vk::DescriptorType::eUniformBuffer);
+        write_lights_buffer(
+            directional_lights_data[frame_index], shader_directional_lights.data(),
+            shader_directional_lights.size() * sizeof(common::ShaderDirectionalLight), 1, vk::DescriptorType::eStorageBuffer);
+        write_lights_buffer(
+            point_lights_data[frame_index], shader_point_lights.data(),
+            shader_point_lights.size() * sizeof(common::ShaderPointLight), 2, vk::DescriptorType::eStorageBuffer);
+        write_lights_buffer(
+            light_tiles_data[frame_index], light_grid.data().data(),
+            light_grid.data().size() * sizeof(u32), 3, vk::DescriptorType::eStorageBuffer);
 
         if (light_mat_buffer.size() == light_matrices.size() * sizeof(aml::Matrix4)) {
             light_mat_buffer.write(light_matrices.data(), light_matrices.size() * sizeof(aml::Matrix4));
@@ -362,11 +579,12 @@ namespace aryibi::renderer {
             vk::AttachmentDescription depth_description{}; {
                 depth_description.format = vk::Format::eD16Unorm;
                 depth_description.samples = vk::SampleCountFlagBits::e1;
-                depth_description.loadOp = vk::AttachmentLoadOp::eClear;
+                // Tiles of the shadow atlas are kept across frames (See Renderer::draw()).
+                depth_description.loadOp = vk::AttachmentLoadOp::eLoad;
                 depth_description.storeOp = vk::AttachmentStoreOp::eStore;
                 depth_description.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
                 depth_description.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-                depth_description.initialLayout = vk::ImageLayout::eUndefined;
+                depth_description.initialLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
                 depth_description.finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
             }
 
@@ -386,10 +604,11 @@ namespace aryibi::renderer {
             vk::SubpassDependency subpass_dependency{}; {
                 subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
                 subpass_dependency.dstSubpass = 0;
-                subpass_dependency.srcStageMask = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+                // The previous frame samples the atlas in the color pass.
+                subpass_dependency.srcStageMask = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eFragmentShader;
                 subpass_dependency.dstStageMask = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
                 subpass_dependency.srcAccessMask = {};
-                subpass_dependency.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+                subpass_dependency.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
             }
 
             vk::RenderPassCreateInfo create_info{}; {
@@ -403,6 +622,7 @@ namespace aryibi::renderer {
             p_impl->depth_pass
                 .attach("depth", depth_create_info)
                 .create(create_info);
+            prepare_shadow_atlas(p_impl->depth_pass["depth"]);
         }
 
         /* Color pass */ {
@@ -571,7 +791,7 @@ namespace aryibi::renderer {
             }
             texture_layout = ctx.device.logical.createDescriptorSetLayout(texture_layout_info);
 
-            std::array<vk::DescriptorSetLayoutBinding, 2> palette_depth_bindings{}; {
+            std::array<vk::DescriptorSetLayoutBinding, 3> palette_depth_bindings{}; {
                 palette_depth_bindings[0].descriptorCount = 1;
                 palette_depth_bindings[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
                 palette_depth_bindings[0].binding = 0;
@@ -581,6 +801,12 @@ namespace aryibi::renderer {
                 palette_depth_bindings[1].descriptorType = vk::DescriptorType::eCombinedImageSampler;
                 palette_depth_bindings[1].binding = 1;
                 palette_depth_bindings[1].stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+                // The shadow atlas again, with depth comparison.
+                palette_depth_bindings[2].descriptorCount = 1;
+                palette_depth_bindings[2].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+                palette_depth_bindings[2].binding = 2;
+                palette_depth_bindings[2].stageFlags = vk::ShaderStageFlagBits::eFragment;
             }
             vk::DescriptorSetLayoutCreateInfo palette_depth_info{}; {
                 palette_depth_info.bindingCount = palette_depth_bindings.size();
@@ -588,15 +814,18 @@ namespace aryibi::renderer {
             }
             p_impl->palette_depth_layout = ctx.device.logical.createDescriptorSetLayout(palette_depth_info);
 
-            vk::DescriptorSetLayoutBinding lights_layout_binding{}; {
-                lights_layout_binding.descriptorCount = 1;
-                lights_layout_binding.descriptorType = vk::DescriptorType::eUniformBuffer;
-                lights_layout_binding.binding = 0;
-                lights_layout_binding.stageFlags = vk::ShaderStageFlagBits::eFragment;
+            // common::ShaderLightInfo, then the directional lights, the point lights and the light tiles.
+            std::array<vk::DescriptorSetLayoutBinding, 4> lights_layout_bindings{}; {
+                for (u32 i = 0; i < lights_layout_bindings.size(); ++i) {
+                    lights_layout_bindings[i].descriptorCount = 1;
+                    lights_layout_bindings[i].descriptorType = i == 0 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer;
+                    lights_layout_bindings[i].binding = i;
+                    lights_layout_bindings[i].stageFlags = vk::ShaderStageFlagBits::eFragment;
+                }
             }
             vk::DescriptorSetLayoutCreateInfo lights_layout_info{}; {
-                lights_layout_info.bindingCount = 1;
-                lights_layout_info.pBindings = &lights_layout_binding;
+                lights_layout_info.bindingCount = lights_layout_bindings.size();
+                lights_layout_info.pBindings = lights_layout_bindings.data();
             }
             p_impl->lights_layout = ctx.device.logical.createDescriptorSetLayout(lights_layout_info);
         }
@@ -718,14 +947,39 @@ namespace aryibi::renderer {
         /* Resources */ {
             p_impl->uniform_data.create(vk::BufferUsageFlagBits::eUniformBuffer);
             p_impl->lights_data.create(vk::BufferUsageFlagBits::eUniformBuffer);
+            p_impl->directional_lights_data.create(vk::BufferUsageFlagBits::eStorageBuffer);
+            p_impl->point_lights_data.create(vk::BufferUsageFlagBits::eStorageBuffer);
+            p_impl->light_tiles_data.create(vk::BufferUsageFlagBits::eStorageBuffer);
             p_impl->transforms.create(vk::BufferUsageFlagBits::eStorageBuffer);
             p_impl->light_mats.create(vk::BufferUsageFlagBits::eStorageBuffer);
+            // The index buffer is bound every frame, even before any mesh has been built.
+            impl::reserve_quad_indices(1);
 
             p_impl->main_set.create(p_impl->main_layout);
             p_impl->palette_depth_set.create(p_impl->palette_depth_layout);
             p_impl->lights_set.create(p_impl->lights_layout);
 
-            std::vector<SingleUpdateImageInfo> palette_depth_update(2); {
+            // Point the light buffers at something until the first frame writes them, in case some of them stay empty.
+            std::vector<UpdateBufferInfo> lights_update(4); {
+                lights_update[0].buffers = p_impl->lights_data.info();
+                lights_update[0].type = vk::DescriptorType::eUniformBuffer;
+                lights_update[0].binding = 0;
+
+                lights_update[1].buffers = p_impl->directional_lights_data.info();
+                lights_update[1].type = vk::DescriptorType::eStorageBuffer;
+                lights_update[1].binding = 1;
+
+                lights_update[2].buffers = p_impl->point_lights_data.info();
+                lights_update[2].type = vk::DescriptorType::eStorageBuffer;
+                lights_update[2].binding = 2;
+
+                lights_update[3].buffers = p_impl->light_tiles_data.info();
+                lights_update[3].type = vk::DescriptorType::eStorageBuffer;
+                lights_update[3].binding = 3;
+            }
+            p_impl->lights_set.update(lights_update);
+
+            std::vector<SingleUpdateImageInfo> palette_depth_update(3); {
                 palette_depth_update[0].type = vk::DescriptorType::eCombinedImageSampler;
                 palette_depth_update[0].binding = 0;
                 palette_depth_update[0].image = {
@@ -737,6 +991,14 @@ namespace aryibi::renderer {
                 palette_depth_update[1].type = vk::DescriptorType::eCombinedImageSampler;
                 palette_depth_update[1].binding = 1;
                 palette_depth_update[1].image = p_impl->palette_texture.info(linear_sampler());
+
+                palette_depth_update[2].type = vk::DescriptorType::eCombinedImageSampler;
+                palette_depth_update[2].binding = 2;
+                palette_depth_update[2].image = {
+                    depth_compare_sampler(),
+                    p_impl->depth_pass["depth"].view,
+                    vk::ImageLayout::eShaderReadOnlyOptimal
+                };
             }
             p_impl->palette_depth_set.update(palette_depth_update);
         }
@@ -782,7 +1044,7 @@ namespace aryibi::renderer {
     void Renderer::draw(const DrawCmdList& commands, const Framebuffer&) {
         static u64 frames = 0;
 
-        auto result = ctx.device.logical.acquireNextImageKHR(p_impl->swapchain.handle, -1, p_impl->image_available[frame_index], nullptr, &image_index);
+        (void)ctx.device.logical.acquireNextImageKHR(p_impl->swapchain.handle, -1, p_impl->image_available[frame_index], nullptr, &image_index);
 
         if (!p_impl->in_flight[frame_index]) {
             vk::FenceCreateInfo fence_create_info{}; {
@@ -792,7 +1054,9 @@ namespace aryibi::renderer {
             p_impl->in_flight[frame_index] = ctx.device.logical.createFence(fence_create_info, nullptr);
         }
 
-        ctx.device.logical.waitForFences(p_impl->in_flight[frame_index], true, -1);
+        (void)ctx.device.logical.waitForFences(p_impl->in_flight[frame_index], true, -1);
+        free_unused_meshes();
+        free_unused_buffers();
 
         auto& command_buffer = p_impl->command_buffers[image_index];
 
@@ -802,108 +1066,163 @@ namespace aryibi::renderer {
 
         command_buffer.begin(begin_info);
 
+        // Check which meshes finished uploading before deciding what to draw, and send the ones enqueued since the
+        // last frame to the GPU.
+        poll_uploads();
+        submit_uploads();
+
         p_impl->update_buffers(commands);
+        // Index buffer bindings persist across pipeline binds, so binding it once is enough.
+        command_buffer.bindIndexBuffer(quad_indices.handle, 0, vk::IndexType::eUint32);
+        // And so do all the other bindings, so a single encoder skips the redundant ones of every pass.
+        CommandEncoder encoder(command_buffer);
+
+        p_impl->command_bounds.clear();
+        for (const auto& command : commands.commands) {
+            p_impl->command_bounds.push_back(command.mesh.p_impl->bounds, {
+                command.transform.position.x,
+                command.transform.position.y
+            });
+        }
 
-        /* Shadow pass */ {
-            vk::ClearValue clear_value{}; {
-                clear_value.color = {};
-                clear_value.depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
+        // Each light only draws the casters within the volume of its shadow map. Point lights don't light anything
+        // past their radius, so casters beyond it can't shadow anything either.
+        auto& shadow_casters = p_impl->shadow_casters;
+        shadow_casters.set_commands(commands.commands, p_impl->command_bounds);
+        // Lights without a tile in the shadow atlas draw nothing.
+        for (const auto& light : commands.directional_lights) {
+            shadow_casters.add_light(light.light_atlas_size == 0 ? common::empty_rect() : common::directional_light_rect(
+                commands.camera, light.rotation,
+                p_impl->swapchain.extent.width, p_impl->swapchain.extent.height,
+                -10.0f, 20.0f));
+        }
+        // Point lights use the camera projection too.
+        const auto camera_shadow_rect = common::camera_view_rect(commands.camera, p_impl->swapchain.extent.width, p_impl->swapchain.extent.height);
+        for (const auto& light : commands.point_lights) {
+            shadow_casters.add_light(light.light_atlas_size == 0 ? common::empty_rect() : common::intersect_rects(
+                common::point_light_rect(light), camera_shadow_rect));
+        }
+        const auto light_count = commands.directional_lights.size() + commands.point_lights.size();
+        p_impl->stats.culled_shadow_draws = shadow_casters.caster_count() * light_count - shadow_casters.draw_count();
+
+        // Only draw the tiles of the shadow atlas whose light or casters changed since they were last drawn. The matrix
+        // of a light already includes its placement relative to the camera.
+        const auto& shadow_atlas = p_impl->depth_pass["depth"];
+        auto& tile_placements = p_impl->shadow_tile_placements;
+        auto& tile_contents = p_impl->shadow_tile_contents;
+        tile_placements.clear();
+        tile_contents.clear();
+        const auto add_shadow_tile_keys = [&](const Light& light, const usize light_index) {
+            common::ShadowKey placement{};
+            placement.add(light.light_atlas_pos);
+            placement.add(light.light_atlas_size);
+            placement.add(shadow_atlas.width);
+            placement.add(shadow_atlas.height);
+            tile_placements.emplace_back(placement.value());
+
+            common::ShadowKey contents{};
+            contents.add(light.matrix);
+            for (const auto j : shadow_casters.casters(light_index)) {
+                const auto& command = commands.commands[j];
+                contents.add(command.transform.position);
+                contents.add(command.mesh.p_impl->current_version());
+                // Meshes that are still being uploaded aren't drawn, so the tile has to be drawn again once they are.
+                contents.add(command.mesh.p_impl->is_resident());
+                contents.add(command.texture.p_impl->handle);
             }
+            tile_contents.emplace_back(contents.value());
+        };
+        for (const auto& light : commands.directional_lights) {
+            add_shadow_tile_keys(light, tile_placements.size());
+        }
+        for (const auto& light : commands.point_lights) {
+            add_shadow_tile_keys(light, tile_placements.size());
+        }
+        p_impl->shadow_cache.update(tile_placements, tile_contents);
+        // Lights that didn't get a tile in the atlas have nothing to draw or to keep.
+        p_impl->stats.shadow_tiles_drawn = 0;
+        p_impl->stats.shadow_tiles_cached = 0;
+        const auto count_shadow_tile = [&](const Light& light, const usize light_index) {
+            if (light.light_atlas_size == 0) {
+                return;
+            }
+            if (p_impl->shadow_cache.needs_draw(light_index)) {
+                ++p_impl->stats.shadow_tiles_drawn;
+            } else {
+                ++p_impl->stats.shadow_tiles_cached;
+            }
+        };
+        for (usize i = 0; i < commands.directional_lights.size(); ++i) {
+            count_shadow_tile(commands.directional_lights[i], i);
+        }
+        for (usize i = 0; i < commands.point_lights.size(); ++i) {
+            count_shadow_tile(commands.point_lights[i], commands.directional_lights.size() + i);
+        }
+        p_impl->stats.shadow_draws = 0;
 
+        /* Shadow pass */ {
+            // The depth pass loads the atlas instead of clearing it, since the tiles that aren't drawn again keep their
+            // contents. Each drawn tile is cleared on its own instead.
             vk::RenderPassBeginInfo render_pass_begin_info{}; {
                 render_pass_begin_info.renderArea.extent = vk::Extent2D{
-                    p_impl->depth_pass["depth"].width,
-                    p_impl->depth_pass["depth"].height
+                    shadow_atlas.width,
+                    shadow_atlas.height
                 };
                 render_pass_begin_info.framebuffer = p_impl->depth_pass.framebuffer();
                 render_pass_begin_info.renderPass = p_impl->depth_pass.handle();
-                render_pass_begin_info.clearValueCount = 1;
-                render_pass_begin_info.pClearValues = &clear_value;
             }
 
             command_buffer.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
 
-            for (usize i = 0; i < commands.directional_lights.size(); ++i) {
-                auto& light = commands.directional_lights[i];
+            const auto draw_shadow_tile = [&](const Light& light, const usize light_index) {
+                if (light.light_atlas_size == 0 || !p_impl->shadow_cache.needs_draw(light_index)) {
+                    return;
+                }
 
                 vk::Viewport viewport{}; {
-                    viewport.width = light.light_atlas_size * p_impl->depth_pass["depth"].width;
-                    viewport.height = light.light_atlas_size * p_impl->depth_pass["depth"].height;
-                    viewport.x = light.light_atlas_pos.x * p_impl->depth_pass["depth"].width;
-                    viewport.y = light.light_atlas_pos.y * p_impl->depth_pass["depth"].height;
+                    viewport.width = light.light_atlas_size * shadow_atlas.width;
+                    viewport.height = light.light_atlas_size * shadow_atlas.height;
+                    viewport.x = light.light_atlas_pos.x * shadow_atlas.width;
+                    viewport.y = light.light_atlas_pos.y * shadow_atlas.height;
                     viewport.minDepth = 0.0f;
                     viewport.maxDepth = 1.0f;
                 }
 
                 vk::Rect2D scissor{}; {
-                    scissor.extent.width = p_impl->depth_pass["depth"].width;
-                    scissor.extent.height = p_impl->depth_pass["depth"].height;
-                    scissor.offset = { { 0, 0 } };
+                    scissor.extent.width = static_cast<u32>(viewport.width);
+                    scissor.extent.height = static_cast<u32>(viewport.height);
+                    scissor.offset = vk::Offset2D{
+                        static_cast<i32>(viewport.x),
+                        static_cast<i32>(viewport.y)
+                    };
                 }
 
                 command_buffer.setViewport(0, viewport);
                 command_buffer.setScissor(0, scissor);
 
-                for (usize j = 0; j < commands.commands.size(); ++j) {
-                    auto& command = commands.commands[j];
-                    auto& mesh = command.mesh.p_impl->handle;
-                    auto& texture = textures[command.texture.p_impl->handle];
-
-                    if (!command.cast_shadows) {
-                        continue;
-                    }
-
-                    std::array constants{
-                        static_cast<u32>(j),
-                        static_cast<u32>(i)
-                    };
-
-                    std::array descriptor_sets{
-                        p_impl->main_set[frame_index].handle(),
-                        texture.set[frame_index].handle()
-                    };
-
-                    command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, p_impl->depth_shader);
-                    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, p_impl->depth_shader, 0, descriptor_sets, nullptr);
-                    command_buffer.pushConstants<u32>(p_impl->depth_shader, vk::ShaderStageFlagBits::eVertex, 0, constants);
-                    command_buffer.bindVertexBuffers(0, mesh.vbo.handle, static_cast<vk::DeviceSize>(0));
-                    command_buffer.draw(mesh.vertex_count, 1, 0, 0);
+                vk::ClearAttachment clear_attachment{}; {
+                    clear_attachment.aspectMask = vk::ImageAspectFlagBits::eDepth;
+                    clear_attachment.clearValue.depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
                 }
-            }
-
-            for (usize i = 0; i < commands.point_lights.size(); ++i) {
-                auto& light = commands.point_lights[i];
 
-                vk::Viewport viewport{}; {
-                    viewport.width = light.light_atlas_size * p_impl->depth_pass["depth"].width;
-                    viewport.height = light.light_atlas_size * p_impl->depth_pass["depth"].height;
-                    viewport.x = light.light_atlas_pos.x * p_impl->depth_pass["depth"].width;
-                    viewport.y = light.light_atlas_pos.y * p_impl->depth_pass["depth"].height;
-                    viewport.minDepth = 0.0f;
-                    viewport.maxDepth = 1.0f;
+                vk::ClearRect clear_rect{}; {
+                    clear_rect.rect = scissor;
+                    clear_rect.baseArrayLayer = 0;
+                    clear_rect.layerCount = 1;
                 }
+                command_buffer.clearAttachments(clear_attachment, clear_rect);
 
-                vk::Rect2D scissor{}; {
-                    scissor.extent.width = p_impl->depth_pass["depth"].width;
-                    scissor.extent.height = p_impl->depth_pass["depth"].height;
-                    scissor.offset = { { 0, 0 } };
-                }
-
-                command_buffer.setViewport(0, viewport);
-                command_buffer.setScissor(0, scissor);
-
-                for (usize j = 0; j < commands.commands.size(); ++j) {
+                for (const auto j : shadow_casters.casters(light_index)) {
                     auto& command = commands.commands[j];
-                    auto& mesh = command.mesh.p_impl->handle;
                     auto& texture = textures[command.texture.p_impl->handle];
 
-                    if (!command.cast_shadows) {
+                    if (!command.mesh.p_impl->is_resident()) {
                         continue;
                     }
 
                     std::array constants{
                         static_cast<u32>(j),
-                        static_cast<u32>(i)
+                        static_cast<u32>(light_index)
                     };
 
                     std::array descriptor_sets{
@@ -911,12 +1230,20 @@ namespace aryibi::renderer {
                         texture.set[frame_index].handle()
                     };
 
-                    command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, p_impl->depth_shader);
-                    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, p_impl->depth_shader, 0, descriptor_sets, nullptr);
-                    command_buffer.pushConstants<u32>(p_impl->depth_shader, vk::ShaderStageFlagBits::eVertex, 0, constants);
-                    command_buffer.bindVertexBuffers(0, mesh.vbo.handle, static_cast<vk::DeviceSize>(0));
-                    command_buffer.draw(mesh.vertex_count, 1, 0, 0);
+                    encoder.bind_pipeline(p_impl->depth_shader);
+                    encoder.bind_descriptor_sets(descriptor_sets);
+                    encoder.push_constants(constants);
+                    impl::draw_mesh(encoder, *command.mesh.p_impl);
+                    ++p_impl->stats.shadow_draws;
                 }
+            };
+
+            usize light_index = 0;
+            for (const auto& light : commands.directional_lights) {
+                draw_shadow_tile(light, light_index++);
+            }
+            for (const auto& light : commands.point_lights) {
+                draw_shadow_tile(light, light_index++);
             }
             command_buffer.endRenderPass();
         }
@@ -949,43 +1276,83 @@ namespace aryibi::renderer {
                 scissor.offset = { { 0, 0 } };
             }
 
+            // Skip the commands whose mesh is completely outside the camera view.
+            const auto camera_rect = common::camera_view_rect(commands.camera, p_impl->swapchain.extent.width, p_impl->swapchain.extent.height);
+            const auto visible_count = common::cull_rects(p_impl->command_bounds, camera_rect, p_impl->visible_commands);
+            p_impl->stats.commands = commands.commands.size();
+            p_impl->stats.culled_commands = commands.commands.size() - visible_count;
+
+            // Opaque commands go front to back so that the fragments they cover are rejected before shading them, and
+            // commands at the same depth are grouped by the state they use.
+            p_impl->draw_sorter.clear();
+            for (u32 i = 0; i < commands.commands.size(); ++i) {
+                if (!p_impl->visible_commands[i]) {
+                    continue;
+                }
+                const auto& command = commands.commands[i];
+                const auto distance = commands.camera.position.z - command.transform.position.z;
+                p_impl->draw_sorter.add(i, common::make_sort_key(
+                    common::DrawPass::color, command.transparent,
+                    common::depth_bucket(distance, camera_near, camera_far, command.transparent),
+                    command.shader.p_impl->sort_id, command.texture.p_impl->handle, impl::mesh_buffer_id(*command.mesh.p_impl)));
+            }
+            p_impl->draw_sorter.sort();
+
             command_buffer.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
             command_buffer.setViewport(0, viewport);
             command_buffer.setScissor(0, scissor);
 
-            for (usize i = 0; i < commands.commands.size(); ++i) {
+            p_impl->stats.shader_switches = 0;
+            p_impl->stats.texture_switches = 0;
+            p_impl->stats.mesh_buffer_switches = 0;
+            u32 last_shader = -1;
+            u64 last_texture = -1;
+            u32 last_mesh_buffer = -1;
+            for (const auto i : p_impl->draw_sorter.order()) {
                 auto& command = commands.commands[i];
-                auto& mesh = command.mesh.p_impl->handle;
                 auto& texture = textures[command.texture.p_impl->handle];
                 auto& shader = command.shader.p_impl->handle;
 
+                // Meshes that are still being uploaded are skipped.
+                if (!command.mesh.p_impl->is_resident()) {
+                    continue;
+                }
+
+                const auto mesh_buffer = impl::mesh_buffer_id(*command.mesh.p_impl);
+                p_impl->stats.shader_switches += command.shader.p_impl->sort_id != last_shader;
+                p_impl->stats.texture_switches += command.texture.p_impl->handle != last_texture;
+                p_impl->stats.mesh_buffer_switches += mesh_buffer != last_mesh_buffer;
+                last_shader = command.shader.p_impl->sort_id;
+                last_texture = command.texture.p_impl->handle;
+                last_mesh_buffer = mesh_buffer;
+
                 std::array constants{
                     static_cast<u32>(i),
                     static_cast<u32>(0)
                 };
 
-                std::vector<vk::DescriptorSet> descriptor_sets{};
+                std::array<vk::DescriptorSet, CommandEncoder::max_descriptor_sets> descriptor_sets{};
+                u32 descriptor_set_count = 0;
 
                 if (shader.handle == p_impl->basic_tile_shader.handle) {
-                    descriptor_sets = {
-                        p_impl->main_set[frame_index].handle(),
-                        texture.set[frame_index].handle()
-                    };
+                    descriptor_sets[0] = p_impl->main_set[frame_index].handle();
+                    descriptor_sets[1] = texture.set[frame_index].handle();
+                    descriptor_set_count = 2;
                 } else if (shader.handle == p_impl->shaded_tile_shader.handle) {
-                    descriptor_sets = {
-                        p_impl->main_set[frame_index].handle(),
-                        p_impl->palette_depth_set[frame_index].handle(),
-                        texture.set[frame_index].handle(),
-                        p_impl->lights_set[frame_index].handle()
-                    };
+                    descriptor_sets[0] = p_impl->main_set[frame_index].handle();
+                    descriptor_sets[1] = p_impl->palette_depth_set[frame_index].handle();
+                    descriptor_sets[2] = texture.set[frame_index].handle();
+                    descriptor_sets[3] = p_impl->lights_set[frame_index].handle();
+                    descriptor_set_count = 4;
                 }
 
-                command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, shader);
-                command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, shader, 0, descriptor_sets, nullptr);
-                command_buffer.pushConstants<u32>(shader, vk::ShaderStageFlagBits::eVertex, 0, constants);
-                command_buffer.bindVertexBuffers(0, mesh.vbo.handle, static_cast<vk::DeviceSize>(0));
-                command_buffer.draw(mesh.vertex_count, 1, 0, 0);
+                encoder.bind_pipeline(shader);
+                encoder.bind_descriptor_sets(descriptor_sets.data(), descriptor_set_count);
+                encoder.push_constants(constants);
+                impl::draw_mesh(encoder, *command.mesh.p_impl);
             }
+            p_impl->stats.state_changes_issued = encoder.issued();
+            p_impl->stats.state_changes_elided = encoder.elided();
 
             command_buffer.endRenderPass();
         }
@@ -1114,7 +1481,7 @@ namespace aryibi::renderer {
             present_info.pImageIndices = &image_index;
         }
 
-        result = ctx.device.graphics.presentKHR(&present_info);
+        (void)ctx.device.graphics.presentKHR(&present_info);
 
         frame_index = (frame_index + 1) % meta::max_in_flight;
         frames++;
@@ -1124,8 +1491,35 @@ namespace aryibi::renderer {
 
     }
 
-    void Renderer::set_shadow_resolution(u32, u32) {
+    void Renderer::set_shadow_resolution(const u32 width, const u32 height) {
+        // Frames in flight might still be drawing into or sampling the old atlas. Changing the resolution is rare enough
+        // to just wait for them.
+        ctx.device.logical.waitIdle();
+        p_impl->depth_pass.resize(width, height);
+        prepare_shadow_atlas(p_impl->depth_pass["depth"]);
+
+        std::vector<SingleUpdateImageInfo> depth_update(2); {
+            depth_update[0].type = vk::DescriptorType::eCombinedImageSampler;
+            depth_update[0].binding = 0;
+            depth_update[0].image = {
+                depth_sampler(),
+                p_impl->depth_pass["depth"].view,
+                vk::ImageLayout::eShaderReadOnlyOptimal
+            };
 
+            depth_update[1].type = vk::DescriptorType::eCombinedImageSampler;
+            depth_update[1].binding = 2;
+            depth_update[1].image = {
+                depth_compare_sampler(),
+                p_impl->depth_pass["depth"].view,
+                vk::ImageLayout::eShaderReadOnlyOptimal
+            };
+        }
+        p_impl->palette_depth_set.update(depth_update);
+
+        // Tiles are placed in the new atlas from scratch, and none of them has contents yet.
+        p_impl->shadow_atlas = {};
+        p_impl->shadow_cache.invalidate();
     }
 
     anton::math::Vector2 Renderer::get_shadow_resolution() const {
@@ -1135,6 +1529,37 @@ namespace aryibi::renderer {
         };
     }
 
+    void Renderer::set_shadow_refresh_budget(const u32 tiles) {
+        p_impl->shadow_cache.set_refresh_budget(tiles);
+    }
+
+    void Renderer::invalidate_shadows() {
+        p_impl->shadow_cache.invalidate();
+    }
+
+    void Renderer::set_shadow_filter(const ShadowFilter filter) {
+        ARYIBI_ASSERT(filter != ShadowFilter::renderer_default, "The renderer can't use its own default shadow filter!");
+        p_impl->shadow_filter = filter;
+    }
+
+    ShadowFilter Renderer::get_shadow_filter() const {
+        return p_impl->shadow_filter;
+    }
+
+    void Renderer::set_light_buffer_divisor(const u32 divisor) {
+        // Light buffers aren't implemented in this backend yet, lighting is always computed per fragment.
+        ARYIBI_ASSERT(divisor == 1, "The Vulkan backend has no light buffers, the divisor must be 1!");
+        (void)divisor;
+    }
+
+    u32 Renderer::get_light_buffer_divisor() const {
+        return 1;
+    }
+
+    const FrameStats& Renderer::frame_stats() const {
+        return p_impl->stats;
+    }
+
     void Renderer::set_palette(const ColorPalette& palette) {
         p_impl->palette_texture.destroy();
         // The palette texture is a regular 2D texture. The X axis represents the
@@ -1179,12 +1604,14 @@ namespace aryibi::renderer {
     ShaderHandle Renderer::lit_shader() const {
         ShaderHandle handle{};
         handle.p_impl->handle = p_impl->shaded_tile_shader;
+        handle.p_impl->sort_id = 1;
         return handle;
     }
 
     ShaderHandle Renderer::lit_paletted_shader() const {
         ShaderHandle handle{};
         handle.p_impl->handle = p_impl->shaded_pal_shader;
+        handle.p_impl->sort_id = 2;
         return handle;
     }
 
@@ -3,6 +3,7 @@
 #include "aryibi/renderer.hpp"
 #include "aryibi/sprites.hpp"
 
+#include "detail/upload_queue.hpp"
 #include "detail/sampler.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -13,6 +14,8 @@
 #include <anton/math/math.hpp>
 
 #include <memory>
+#include <new>
+#include <type_traits>
 #include <cstring>
 #include <fstream>
 #include <filesystem>
@@ -21,7 +24,10 @@ namespace fs = std::filesystem;
 namespace aml = anton::math;
 
 namespace aryibi::renderer {
-    TextureHandle::TextureHandle() : p_impl(std::make_unique<impl>()) {}
+    TextureHandle::TextureHandle() : p_impl(new (impl_storage) impl()) {
+        static_assert(sizeof(impl) <= impl_size && alignof(impl) <= impl_alignment && std::is_trivially_destructible_v<impl>,
+                      "TextureHandle::impl must fit in the inline storage of the handle");
+    }
 
     TextureHandle::~TextureHandle() {
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
@@ -33,7 +39,7 @@ namespace aryibi::renderer {
 #endif
     }
 
-    TextureHandle::TextureHandle(const TextureHandle& other) : p_impl(std::make_unique<impl>()) {
+    TextureHandle::TextureHandle(const TextureHandle& other) : p_impl(new (impl_storage) impl()) {
         *p_impl = *other.p_impl;
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
         impl::handle_ref_count[p_impl->handle]++;
@@ -101,7 +107,7 @@ namespace aryibi::renderer {
     }
 
     bool TextureHandle::exists() const {
-        return p_impl->handle != -1;
+        return p_impl->handle != static_cast<u64>(-1);
     }
 
     u32 TextureHandle::width() const {
@@ -152,8 +158,8 @@ namespace aryibi::renderer {
         /// Indexed only has two channels: Red (color) and green (shade)
         constexpr i32 indexed_bytes_per_pixel = 2;
         auto indexed_data = new u8[width * height * indexed_bytes_per_pixel];
-        for (u32 x = 0; x < width; ++x) {
-            for (u32 y = 0; y < height; ++y) {
+        for (i32 x = 0; x < width; ++x) {
+            for (i32 y = 0; y < height; ++y) {
                 struct {
                     u8 color_index;
                     u8 shade_index;
@@ -239,11 +245,18 @@ namespace aryibi::renderer {
     }
 
     bool MeshHandle::exists() const {
-        return p_impl->handle.vbo.handle;
+        return p_impl->arena_id != common::MeshArena::no_mesh || p_impl->dyn;
     }
 
     void MeshHandle::unload() {
-        Renderer::impl::enqueue_for_deletion(p_impl->handle.vbo);
+        if (p_impl->arena_id == common::MeshArena::no_mesh) {
+            return;
+        }
+
+        // The range can't be reused while it's still being copied to.
+        wait_for_upload(p_impl->upload_ticket);
+        Renderer::impl::enqueue_mesh_free(p_impl->arena_id);
+        p_impl->arena_id = common::MeshArena::no_mesh;
     }
 
 
@@ -270,7 +283,7 @@ namespace aryibi::renderer {
         p_impl->handle.destroy();
     }
 
-    ShaderHandle ShaderHandle::from_file(const std::filesystem::path& vert_path, const std::filesystem::path& frag_path) {
+    ShaderHandle ShaderHandle::from_file(const std::filesystem::path&, const std::filesystem::path&) {
         // Dis be a problem.
         return {};
     }
@@ -299,64 +312,31 @@ namespace aryibi::renderer {
                                  float horizontal_slope,
                                  float z_min,
                                  float z_max) {
-        const auto add_piece = [&](sprites::Sprite::Piece const& piece, std::size_t base_n) {
-            auto& result = p_impl->result;
-            const sprites::Rect2D pos_rect{
-                {piece.destination.start.x + offset.x, piece.destination.start.y + offset.y},
-                {piece.destination.end.x + offset.x, piece.destination.end.y + offset.y}};
-            const sprites::Rect2D uv_rect = piece.source;
-            const sprites::Rect2D z_map{
-                {aml::clamp(piece.destination.start.x * horizontal_slope, z_min, z_max),
-                    aml::clamp(piece.destination.start.y * vertical_slope, z_min, z_max)},
-                {aml::clamp(piece.destination.end.x * horizontal_slope, z_min, z_max),
-                    aml::clamp(piece.destination.end.y * vertical_slope, z_min, z_max)}};
-
-            // First triangle //
-            // First triangle //
-            /* X pos 1st vertex */ result[base_n + 0] = pos_rect.start.x;
-            /* Y pos 1st vertex */ result[base_n + 1] = pos_rect.start.y;
-            /* Z pos 1st vertex */ result[base_n + 2] = z_map.start.x + z_map.start.y + offset.z;
-            /* X UV 1st vertex  */ result[base_n + 3] = uv_rect.start.x;
-            /* Y UV 1st vertex  */ result[base_n + 4] = uv_rect.end.y;
-            /* X pos 2nd vertex */ result[base_n + 5] = pos_rect.end.x;
-            /* Y pos 2nd vertex */ result[base_n + 6] = pos_rect.start.y;
-            /* Z pos 2nd vertex */ result[base_n + 7] = z_map.end.x + z_map.start.y + offset.z;
-            /* X UV 2nd vertex  */ result[base_n + 8] = uv_rect.end.x;
-            /* Y UV 2nd vertex  */ result[base_n + 9] = uv_rect.end.y;
-            /* X pos 3rd vertex */ result[base_n + 10] = pos_rect.start.x;
-            /* Y pos 3rd vertex */ result[base_n + 11] = pos_rect.end.y;
-            /* Z pos 3rd vertex */ result[base_n + 12] = z_map.start.x + z_map.end.y + offset.z;
-            /* X UV 2nd vertex  */ result[base_n + 13] = uv_rect.start.x;
-            /* Y UV 2nd vertex  */ result[base_n + 14] = uv_rect.start.y;
-
-            // Second triangle //
-            /* X pos 1st vertex */ result[base_n + 15] = pos_rect.end.x;
-            /* Y pos 1st vertex */ result[base_n + 16] = pos_rect.start.y;
-            /* Z pos 1st vertex */ result[base_n + 17] = z_map.end.x + z_map.start.y + offset.z;
-            /* X UV 1st vertex  */ result[base_n + 18] = uv_rect.end.x;
-            /* Y UV 1st vertex  */ result[base_n + 19] = uv_rect.end.y;
-            /* X pos 2nd vertex */ result[base_n + 20] = pos_rect.end.x;
-            /* Y pos 2nd vertex */ result[base_n + 21] = pos_rect.end.y;
-            /* Z pos 2nd vertex */ result[base_n + 22] = z_map.end.x + z_map.end.y + offset.z;
-            /* X UV 2nd vertex  */ result[base_n + 23] = uv_rect.end.x;
-            /* Y UV 2nd vertex  */ result[base_n + 24] = uv_rect.start.y;
-            /* X pos 3rd vertex */ result[base_n + 25] = pos_rect.start.x;
-            /* Y pos 3rd vertex */ result[base_n + 26] = pos_rect.end.y;
-            /* Z pos 3rd vertex */ result[base_n + 27] = z_map.start.x + z_map.end.y + offset.z;
-            /* X UV 3rd vertex  */ result[base_n + 28] = uv_rect.start.x;
-            /* Y UV 3rd vertex  */ result[base_n + 29] = uv_rect.start.y;
-        };
-
-        const auto prev_size = p_impl->result.size();
-        p_impl->result.resize(prev_size + spr.pieces.size() * impl::sizeof_quad);
-        for (std::size_t i = 0; i < spr.pieces.size(); ++i) {
-            add_piece(spr.pieces[i], prev_size + i * impl::sizeof_quad);
-        }
+        common::append_sprite_vertices(
+            p_impl->result, spr, {offset, vertical_slope, horizontal_slope, z_min, z_max});
+    }
+
+    void MeshBuilder::add_repeating_sprite(const sprites::Sprite& spr,
+                                           anton::math::Vector2 repeat,
+                                           anton::math::Vector3 offset,
+                                           float vertical_slope,
+                                           float horizontal_slope,
+                                           float z_min,
+                                           float z_max) {
+        common::append_repeating_sprite_vertices(
+            p_impl->result, spr, repeat, {offset, vertical_slope, horizontal_slope, z_min, z_max});
+    }
+
+    std::vector<MeshRegionWriter> MeshBuilder::reserve_regions(const std::vector<usize>& piece_counts) {
+        return common::reserve_regions(p_impl->result, piece_counts);
     }
 
     MeshHandle MeshBuilder::finish() const {
+        const usize quad_count = p_impl->result.size() / common::floats_per_quad;
+        Renderer::impl::reserve_quad_indices(quad_count);
+
         MeshHandle mesh{};
-        mesh.p_impl->handle = make_mesh(p_impl->result);
+        Renderer::impl::make_arena_mesh(*mesh.p_impl, p_impl->result.data(), p_impl->result.size(), false);
 
 #ifdef ARYIBI_DETECT_RENDERER_LEAKS
         MeshHandle::impl::handle_ref_count[mesh.p_impl->vao] = 1;
@@ -366,6 +346,97 @@ namespace aryibi::renderer {
         return mesh;
     }
 
+    MeshBuilder::AsyncMesh MeshBuilder::finish_async() const {
+        const usize quad_count = p_impl->result.size() / common::floats_per_quad;
+        Renderer::impl::reserve_quad_indices(quad_count);
+
+        AsyncMesh result{};
+        auto& mesh = *result.mesh.p_impl;
+        Renderer::impl::make_arena_mesh(mesh, p_impl->result.data(), p_impl->result.size(), true);
+        if (mesh.is_resident()) {
+            std::promise<void> uploaded{};
+            uploaded.set_value();
+            result.ready = uploaded.get_future().share();
+        } else {
+            result.ready = upload_future(mesh.upload_ticket);
+        }
+
+        p_impl->result.clear();
+        return result;
+    }
+
+    DynMeshHandle MeshBuilder::finish_dynamic() const {
+        DynMeshHandle mesh{};
+        mesh.p_impl->data = new DynMesh{};
+        mesh.p_impl->data->vertices = p_impl->result;
+        mesh.p_impl->data->mark_dirty({ 0, p_impl->result.size() / common::floats_per_quad });
+        Renderer::impl::reserve_quad_indices(p_impl->result.size() / common::floats_per_quad);
+
+        p_impl->result.clear();
+        return mesh;
+    }
+
+
+    DynMeshHandle::DynMeshHandle() : p_impl(std::make_unique<impl>()) {}
+
+    DynMeshHandle::~DynMeshHandle() = default;
+
+    DynMeshHandle::DynMeshHandle(const DynMeshHandle& other) : p_impl(std::make_unique<impl>()) {
+        *p_impl = *other.p_impl;
+    }
+
+    DynMeshHandle& DynMeshHandle::operator =(const DynMeshHandle& other) {
+        if (this != &other) {
+            *p_impl = *other.p_impl;
+        }
+        return *this;
+    }
+
+    bool DynMeshHandle::exists() const {
+        return p_impl->data;
+    }
+
+    void DynMeshHandle::unload() {
+        if (!p_impl->data) {
+            return;
+        }
+
+        for (usize i = 0; i < meta::max_in_flight; ++i) {
+            auto buffer = p_impl->data->vbo[i].release();
+            Renderer::impl::enqueue_for_deletion(buffer);
+        }
+        delete p_impl->data;
+        p_impl->data = nullptr;
+    }
+
+    void DynMeshHandle::update(const usize first_quad, const MeshBuilder& data) {
+        ARYIBI_ASSERT(exists(), "Tried to update a dynamic mesh that doesn't exist!");
+        p_impl->data->mark_dirty(common::write_quads(p_impl->data->vertices, first_quad, data.p_impl->result));
+        Renderer::impl::reserve_quad_indices(quad_count());
+
+        data.p_impl->result.clear();
+    }
+
+    void DynMeshHandle::resize(const usize quad_count) {
+        ARYIBI_ASSERT(exists(), "Tried to resize a dynamic mesh that doesn't exist!");
+        const auto prev_quad_count = this->quad_count();
+        p_impl->data->vertices.resize(quad_count * common::floats_per_quad, 0.f);
+        // Only new quads need uploading. Removed ones are just not drawn anymore.
+        p_impl->data->mark_dirty({ prev_quad_count, quad_count });
+        Renderer::impl::reserve_quad_indices(quad_count);
+    }
+
+    usize DynMeshHandle::quad_count() const {
+        return exists() ? p_impl->data->vertices.size() / common::floats_per_quad : 0;
+    }
+
+    MeshHandle DynMeshHandle::mesh() const {
+        MeshHandle mesh{};
+        mesh.p_impl->dyn = p_impl->data;
+        mesh.p_impl->bounds = common::unbounded_rect();
+        return mesh;
+    }
+
 
     Framebuffer::Framebuffer() : p_impl(std::make_unique<impl>()) {
 
@@ -441,4 +512,10 @@ namespace aryibi::renderer {
     bool Framebuffer::impl::exists() const {
         return texture.exists();
     }
-} // namespace aryibi::renderer
\ No newline at end of file
+} // namespace aryibi::renderer
+
+namespace std {
+    std::size_t hash<aryibi::renderer::TextureHandle>::operator()(aryibi::renderer::TextureHandle const& tex) const noexcept {
+        return static_cast<std::size_t>(tex.p_impl->handle);
+    }
+} // namespace std
@@ -0,0 +1,97 @@
+#include "aryibi/sprite_animation.hpp"
+#include "util/aryibi_assert.hpp"
+
+#include <cmath>
+
+using namespace anton;
+namespace aml = anton::math;
+
+namespace aryibi::sprites {
+
+SpriteSheetAnimation::SpriteSheetAnimation(TextureChunk const& chunk,
+                                           Settings const& animation_settings) :
+    tex(chunk.tex), settings(animation_settings) {
+    ARYIBI_ASSERT(settings.direction_count == 4 || settings.direction_count == 8,
+                  "Sprite sheet animations must have either 4 or 8 directions!");
+    ARYIBI_ASSERT(settings.frame_count > 0, "Sprite sheet animations need at least one frame!");
+    ARYIBI_ASSERT(settings.frame_duration > 0,
+                  "Sprite sheet animation frames must last some time!");
+
+    for (u8 dir = 0; dir < direction_rows.size(); ++dir) {
+        const u8 index =
+            direction::get_direction_texture_index(static_cast<direction::Direction>(dir));
+        // 4-directional sheets only have the non-diagonal directions (Same as solve_4_directional)
+        direction_rows[dir] = settings.direction_count == 8 ? index : index / 2;
+    }
+
+    const float directions = static_cast<float>(settings.direction_count);
+    const float frames = static_cast<float>(settings.frame_count);
+    const aml::Vector2 chunk_size = chunk.rect.end - chunk.rect.start;
+    const aml::Vector2 cell_size =
+        settings.directions_horizontal
+            ? aml::Vector2{chunk_size.x / directions, chunk_size.y / frames}
+            : aml::Vector2{chunk_size.x / frames, chunk_size.y / directions};
+    pieces.resize(settings.direction_count * settings.frame_count);
+    for (u32 row = 0; row < settings.direction_count; ++row) {
+        for (u32 frame = 0; frame < settings.frame_count; ++frame) {
+            const aml::Vector2 cell =
+                settings.directions_horizontal
+                    ? aml::Vector2{static_cast<float>(row), static_cast<float>(frame)}
+                    : aml::Vector2{static_cast<float>(frame), static_cast<float>(row)};
+            const aml::Vector2 start = chunk.rect.start + cell * cell_size;
+            pieces[row * settings.frame_count + frame] =
+                Sprite::Piece{{start, start + cell_size}, {{0, 0}, settings.target_size}};
+        }
+    }
+}
+
+u32 SpriteSheetAnimation::frame_index(float time) const {
+    if (settings.frame_count == 1 || time <= 0)
+        return 0;
+    return static_cast<u32>(time / settings.frame_duration) % settings.frame_count;
+}
+
+void SpriteSheetAnimation::write_frame(direction::Direction dir, float time, Sprite& out) const {
+    out.texture = tex;
+    out.pieces.clear();
+    out.pieces.push_back(frame(dir, time));
+}
+
+SpriteAnimatorGroup::AnimatorID
+SpriteAnimatorGroup::add(SpriteSheetAnimation const& animation,
+                         direction::Direction dir,
+                         float speed) {
+    times.emplace_back(0.f);
+    speeds.emplace_back(speed);
+    durations.emplace_back(animation.duration());
+    directions.emplace_back(dir);
+    animations.emplace_back(&animation);
+    return static_cast<AnimatorID>(times.size() - 1);
+}
+
+void SpriteAnimatorGroup::clear() {
+    times.clear();
+    speeds.clear();
+    durations.clear();
+    directions.clear();
+    animations.clear();
+}
+
+void SpriteAnimatorGroup::advance(float dt) {
+    const usize count = times.size();
+    float* const time = times.data();
+    const float* const speed = speeds.data();
+    const float* const duration = durations.data();
+    // Branchless so that it can be vectorized. Times are kept inside [0, duration) so they don't
+    // lose precision after running for a long time.
+    for (usize i = 0; i < count; ++i) {
+        const float t = time[i] + dt * speed[i];
+        time[i] = t - duration[i] * std::floor(t / duration[i]);
+    }
+}
+
+void SpriteAnimatorGroup::current_pieces(Sprite::Piece* out) const {
+    for (usize i = 0; i < times.size(); ++i) { out[i] = current_piece(static_cast<AnimatorID>(i)); }
+}
+
+} // namespace aryibi::sprites
@@ -0,0 +1,143 @@
+#include "aryibi/sprite_cache.hpp"
+#include "aryibi/sprite_solvers.hpp"
+
+using namespace anton;
+namespace aml = anton::math;
+
+namespace aryibi::sprites {
+
+namespace {
+
+void hash_combine(std::size_t& seed, std::size_t value) {
+    seed ^= value + 0x9e3779b9 + (seed << 6u) + (seed >> 2u);
+}
+
+std::size_t piece_heap_size(Sprite const& spr) {
+    return spr.pieces.is_inline() ? 0 : spr.pieces.capacity() * sizeof(Sprite::Piece);
+}
+
+} // namespace
+
+bool SpriteCache::Key::operator==(Key const& other) const {
+    return solver == other.solver && parameter == other.parameter && texture == other.texture &&
+           rect.start.x == other.rect.start.x && rect.start.y == other.rect.start.y &&
+           rect.end.x == other.rect.end.x && rect.end.y == other.rect.end.y &&
+           target_size.x == other.target_size.x && target_size.y == other.target_size.y;
+}
+
+std::size_t SpriteCache::KeyHash::operator()(Key const& key) const {
+    const std::hash<float> float_hash;
+    std::size_t seed = static_cast<std::size_t>(key.solver) << 8u | key.parameter;
+    hash_combine(seed, key.texture);
+    hash_combine(seed, float_hash(key.rect.start.x));
+    hash_combine(seed, float_hash(key.rect.start.y));
+    hash_combine(seed, float_hash(key.rect.end.x));
+    hash_combine(seed, float_hash(key.rect.end.y));
+    hash_combine(seed, float_hash(key.target_size.x));
+    hash_combine(seed, float_hash(key.target_size.y));
+    return seed;
+}
+
+SpriteCache::Key SpriteCache::make_key(Solver solver,
+                                       TextureChunk const& chunk,
+                                       u8 parameter,
+                                       aml::Vector2 target_size) {
+    return Key{solver, parameter, std::hash<renderer::TextureHandle>{}(chunk.tex), chunk.rect,
+               target_size};
+}
+
+template<typename F> SpriteCache::SpriteRef SpriteCache::get_or_solve(Key const& key, F&& solve) {
+    if (const auto it = sprites.find(key); it != sprites.end()) {
+        ++hits;
+        return it->second;
+    }
+    ++misses;
+    auto spr = std::make_shared<Sprite>();
+    solve(*spr);
+    // Compute the bounds now so the cached sprite is never modified again.
+    (void)spr->bounds();
+    piece_heap_memory += piece_heap_size(*spr);
+    return sprites.emplace(key, std::move(spr)).first->second;
+}
+
+SpriteCache::SpriteRef SpriteCache::get_8_directional(TextureChunk const& chunk,
+                                                      direction::Direction dir,
+                                                      aml::Vector2 target_size) {
+    return get_or_solve(make_key(Solver::directional_8, chunk, dir, target_size),
+                        [&](Sprite& out) { solve_8_directional(chunk, dir, target_size, out); });
+}
+
+SpriteCache::SpriteRef SpriteCache::get_4_directional(TextureChunk const& chunk,
+                                                      direction::Direction dir,
+                                                      aml::Vector2 target_size) {
+    return get_or_solve(make_key(Solver::directional_4, chunk, dir, target_size),
+                        [&](Sprite& out) { solve_4_directional(chunk, dir, target_size, out); });
+}
+
+SpriteCache::SpriteRef SpriteCache::get_normal(TextureChunk const& chunk,
+                                               aml::Vector2 target_size) {
+    return get_or_solve(make_key(Solver::normal, chunk, 0, target_size),
+                        [&](Sprite& out) { solve_normal(chunk, target_size, out); });
+}
+
+SpriteCache::SpriteRef SpriteCache::get_rpgmaker_a2(TextureChunk const& chunk,
+                                                    u8 connection_mask) {
+    return get_or_solve(make_key(Solver::rpgmaker_a2, chunk, connection_mask, {0, 0}),
+                        [&](Sprite& out) { solve_rpgmaker_a2(chunk, connection_mask, out); });
+}
+
+SpriteCache::SpriteRef SpriteCache::get_rpgmaker_a2(TextureChunk const& chunk,
+                                                    Tile8Connections const& connections) {
+    return get_rpgmaker_a2(chunk, connections.mask());
+}
+
+SpriteCache::SpriteRef SpriteCache::get_rpgmaker_a4_wall(TextureChunk const& chunk,
+                                                         u8 connection_mask) {
+    connection_mask &= 0xFu;
+    return get_or_solve(make_key(Solver::rpgmaker_a4_wall, chunk, connection_mask, {0, 0}),
+                        [&](Sprite& out) { solve_rpgmaker_a4_wall(chunk, connection_mask, out); });
+}
+
+SpriteCache::SpriteRef SpriteCache::get_rpgmaker_a4_wall(TextureChunk const& chunk,
+                                                         Tile4Connections const& connections) {
+    return get_rpgmaker_a4_wall(chunk, connections.mask());
+}
+
+void SpriteCache::invalidate(renderer::TextureHandle const& tex) {
+    const std::size_t texture = std::hash<renderer::TextureHandle>{}(tex);
+    for (auto it = sprites.begin(); it != sprites.end();) {
+        if (it->first.texture == texture) {
+            piece_heap_memory -= piece_heap_size(*it->second);
+            it = sprites.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SpriteCache::clear() {
+    sprites.clear();
+    piece_heap_memory = 0;
+}
+
+SpriteCache::Stats SpriteCache::stats() const {
+    // Each entry is a hash node (key + reference + next pointer + cached hash) plus the shared
+    // sprite allocation (sprite + control block). The data of the texture handle is stored inside
+    // of it, so sizeof(Sprite) already counts it.
+    constexpr std::size_t node_size = sizeof(Key) + sizeof(SpriteRef) + 2 * sizeof(void*);
+    constexpr std::size_t sprite_size = sizeof(Sprite) + 2 * sizeof(long) + sizeof(void*);
+    Stats result;
+    result.hits = hits;
+    result.misses = misses;
+    result.entries = sprites.size();
+    result.memory_used = sprites.size() * (node_size + sprite_size) +
+                         sprites.bucket_count() * sizeof(void*) + piece_heap_memory;
+    return result;
+}
+
+void SpriteCache::reset_stats() {
+    hits = 0;
+    misses = 0;
+}
+
+} // namespace aryibi::sprites
@@ -1,6 +1,7 @@
 #include "aryibi/sprites.hpp"
 #include "aryibi/sprite_solvers.hpp"
 
+#include <algorithm>
 #include <array>
 
 using namespace anton;
@@ -8,6 +9,29 @@ namespace aml = anton::math;
 
 namespace aryibi::sprites {
 
+namespace {
+
+/// Grows rect so that it contains other.
+void extend_rect(Rect2D& rect, Rect2D const& other) {
+    if (other.start.x < rect.start.x)
+        rect.start.x = other.start.x;
+    if (other.start.y < rect.start.y)
+        rect.start.y = other.start.y;
+    if (other.end.x > rect.end.x)
+        rect.end.x = other.end.x;
+    if (other.end.y > rect.end.y)
+        rect.end.y = other.end.y;
+}
+
+/// Replaces the contents of a sprite with a single piece, reusing its storage.
+void set_single_piece(Sprite& out, TextureChunk const& chunk, Sprite::Piece const& piece) {
+    out.texture = chunk.tex;
+    out.pieces.clear();
+    out.pieces.push_back(piece);
+}
+
+} // namespace
+
 u8 direction::get_direction_texture_index(Direction dir) {
     switch (dir) {
         default:
@@ -26,6 +50,9 @@ TextureChunk TextureChunk::full(renderer::TextureHandle const& tex) {
     return {tex, {{0, 0}, {1, 1}}};
 }
 
+Sprite::Sprite(renderer::TextureHandle const& texture, PieceContainer pieces) :
+    texture(texture), pieces(std::move(pieces)) {}
+
 void Sprite::join_pieces_from(PieceContainer const& container, aml::Vector2 destination_offset) {
     pieces.reserve(container.size() + pieces.size());
     for (const auto& piece : container) {
@@ -37,22 +64,21 @@ void Sprite::join_pieces_from(PieceContainer const& container, aml::Vector2 dest
 
 Rect2D Sprite::bounds() const {
     Rect2D rect{{0, 0}, {0, 0}};
-    for (const auto& piece : pieces) {
-        const Rect2D piece_bounds = piece.destination;
-        if (piece_bounds.start.x < rect.start.x)
-            rect.start.x = piece_bounds.start.x;
-        if (piece_bounds.start.y < rect.start.y)
-            rect.start.y = piece_bounds.start.y;
-        if (piece_bounds.end.x > rect.end.x)
-            rect.end.x = piece_bounds.end.x;
-        if (piece_bounds.end.y > rect.end.y)
-            rect.end.y = piece_bounds.end.y;
-    }
+    for (const auto& piece : pieces) { extend_rect(rect, piece.destination); }
     return rect;
 }
 
 Sprite
 solve_8_directional(TextureChunk const& chunk, direction::Direction dir, aml::Vector2 target_size) {
+    Sprite spr;
+    solve_8_directional(chunk, dir, target_size, spr);
+    return spr;
+}
+
+void solve_8_directional(TextureChunk const& chunk,
+                         direction::Direction dir,
+                         aml::Vector2 target_size,
+                         Sprite& out) {
     bool is_horizontal = chunk.tex.width() * (chunk.rect.end.x - chunk.rect.start.x) >
                          chunk.tex.height() * (chunk.rect.end.y - chunk.rect.start.y);
     const auto dir_tex_index = (float)direction::get_direction_texture_index(dir);
@@ -80,11 +106,20 @@ solve_8_directional(TextureChunk const& chunk, direction::Direction dir, aml::Ve
                               }
                           };
     /* clang-format on */
-    return Sprite{chunk.tex, std::vector<Sprite::Piece>{piece}};
+    set_single_piece(out, chunk, piece);
 }
 
 Sprite
 solve_4_directional(TextureChunk const& chunk, direction::Direction dir, aml::Vector2 target_size) {
+    Sprite spr;
+    solve_4_directional(chunk, dir, target_size, spr);
+    return spr;
+}
+
+void solve_4_directional(TextureChunk const& chunk,
+                         direction::Direction dir,
+                         aml::Vector2 target_size,
+                         Sprite& out) {
     bool is_horizontal = chunk.tex.width() * (chunk.rect.end.x - chunk.rect.start.x) >
                          chunk.tex.height() * (chunk.rect.end.y - chunk.rect.start.y);
     const auto dir_tex_index = (float)(direction::get_direction_texture_index(dir) / 2);
@@ -112,120 +147,425 @@ solve_4_directional(TextureChunk const& chunk, direction::Direction dir, aml::Ve
                            }
                        };
     /* clang-format on */
-    return Sprite{chunk.tex, std::vector<Sprite::Piece>{piece}};
+    set_single_piece(out, chunk, piece);
 }
 
 Sprite solve_normal(TextureChunk const& chunk, aml::Vector2 target_size) {
-    aml::Vector2 tex_start{0, 0};
-    aml::Vector2 tex_end{1, 0.5f};
+    Sprite spr;
+    solve_normal(chunk, target_size, spr);
+    return spr;
+}
+
+void solve_normal(TextureChunk const& chunk, aml::Vector2 target_size, Sprite& out) {
     /* clang-format off */
-    return Sprite{chunk.tex,
-                  std::vector<Sprite::Piece>{
-                      Sprite::Piece{
-                          {
-                              chunk.rect.start,
-                              chunk.rect.end
-                          },
-                          {
-                              {0, 0},
-                              target_size
-                          }
-                      }
-                  }};
+    set_single_piece(out, chunk,
+                     Sprite::Piece{
+                         {
+                             chunk.rect.start,
+                             chunk.rect.end
+                         },
+                         {
+                             {0, 0},
+                             target_size
+                         }
+                     });
     /* clang-format on */
 }
 
-/// Modified RPGMaker A2 algorithm where the X1 tiles are laid out horizontally on the first
-/// minitile row.
-Sprite solve_rpgmaker_a2(TextureChunk const& tex, Tile8Connections const& connections) {
-    static constexpr int rpgmaker_a2_chunk_width = 2;
-    static constexpr int rpgmaker_a2_chunk_height = 3;
+u8 Tile8Connections::mask() const {
+    return static_cast<u8>(down << 0u | down_right << 1u | right << 2u | up_right << 3u |
+                           up << 4u | up_left << 5u | left << 6u | down_left << 7u);
+}
+
+Tile8Connections Tile8Connections::from_mask(u8 mask) {
+    Tile8Connections connections;
+    connections.down = mask & (1u << 0u);
+    connections.down_right = mask & (1u << 1u);
+    connections.right = mask & (1u << 2u);
+    connections.up_right = mask & (1u << 3u);
+    connections.up = mask & (1u << 4u);
+    connections.up_left = mask & (1u << 5u);
+    connections.left = mask & (1u << 6u);
+    connections.down_left = mask & (1u << 7u);
+    return connections;
+}
+
+u8 Tile4Connections::mask() const {
+    return static_cast<u8>(down << 0u | right << 1u | up << 2u | left << 3u);
+}
+
+Tile4Connections Tile4Connections::from_mask(u8 mask) {
+    Tile4Connections connections;
+    connections.down = mask & (1u << 0u);
+    connections.right = mask & (1u << 1u);
+    connections.up = mask & (1u << 2u);
+    connections.left = mask & (1u << 3u);
+    return connections;
+}
+
+namespace {
+
+/// How many tile columns for_each_tile8_mask() handles at once. Each row of a block is a 64-bit
+/// word with one extra column at each side, so that every neighbour of a tile is in the word.
+constexpr u32 tile8_block_width = 62;
+
+/// The tile IDs of a row of a column block. Entry j is the tile at the column before the block
+/// plus j, and bit j of valid is set if that tile is inside the grid. The last entry is never
+/// valid, it only lets every word be compared to the one after it.
+struct Tile8BlockRow {
+    std::array<u32, 65> ids;
+    u64 valid;
+};
+
+/// The connections between a row of a block and the row above it. Bit j is set if:
+struct Tile8RowPair {
+    /// (j, y) is connected to (j, y + 1).
+    u64 vertical;
+    /// (j, y) is connected to (j + 1, y + 1).
+    u64 diagonal_right;
+    /// (j + 1, y) is connected to (j, y + 1).
+    u64 diagonal_left;
+};
+
+void load_tile8_block_row(TileIDGrid const& grid, i64 first_column, i64 y, Tile8BlockRow& row) {
+    row.ids.fill(0);
+    row.valid = 0;
+    if (y < 0 || y >= grid.height)
+        return;
+    const i64 start = std::max<i64>(first_column, 0);
+    const i64 end = std::min<i64>(first_column + 64, grid.width);
+    if (start >= end)
+        return;
+    const u32* ids = grid.ids + static_cast<usize>(y) * grid.width;
+    std::copy(ids + start, ids + end, row.ids.begin() + (start - first_column));
+    const i64 first_bit = start - first_column;
+    const i64 end_bit = end - first_column;
+    row.valid = (end_bit == 64 ? ~u64(0) : (u64(1) << end_bit) - 1) & ~((u64(1) << first_bit) - 1);
+}
+
+/// Bit j is set if a.ids[j + a_offset] == b.ids[j + b_offset]. Doesn't look at validity.
+u64 equal_tile8_bits(Tile8BlockRow const& a, u32 a_offset, Tile8BlockRow const& b, u32 b_offset) {
+    u64 bits = 0;
+    for (u32 j = 0; j < 64; ++j) {
+        bits |= u64(a.ids[j + a_offset] == b.ids[j + b_offset]) << j;
+    }
+    return bits;
+}
+
+Tile8RowPair compute_tile8_row_pair(Tile8BlockRow const& below, Tile8BlockRow const& above) {
+    return {equal_tile8_bits(below, 0, above, 0) & below.valid & above.valid,
+            equal_tile8_bits(below, 0, above, 1) & below.valid & (above.valid >> 1u),
+            equal_tile8_bits(below, 1, above, 0) & (below.valid >> 1u) & above.valid};
+}
+
+/// Spreads the bits of a byte over a word, so that byte k of the result is bit k of the input.
+constexpr u64 spread_bits(u8 byte) {
+    return (((u64(byte) * 0x0101'0101'0101'0101u & 0x8040'2010'0804'0201u) +
+             0x7F7F'7F7F'7F7F'7F7Fu) >>
+            7u) &
+           0x0101'0101'0101'0101u;
+}
+
+/// Calls f(x, y, mask) for every tile inside a rect of a grid, where mask is the Tile8Connections
+/// mask of the tile.
+/// The rect is walked in blocks of tile8_block_width columns. For each row of a block, a single
+/// pass over its IDs compares every pair of neighbours at once into 64-bit words (One bit per
+/// column), and every connection of the row is then one of these words, shifted by a column: The
+/// "left" connections of a row are its "right" connections shifted by one, and its "down"
+/// connections are the "up" connections of the row below. The 8 words are finally transposed into
+/// one mask byte per tile, 8 tiles at a time. Every row and row pair is computed once per block,
+/// in fixed-size storage.
+template<typename F> void for_each_tile8_mask(TileIDGrid const& grid, TileRect rect, F&& f) {
+    if (rect.x >= grid.width || rect.y >= grid.height)
+        return;
+    rect.width = std::min(rect.width, grid.width - rect.x);
+    rect.height = std::min(rect.height, grid.height - rect.y);
+    if (rect.width == 0 || rect.height == 0)
+        return;
+
+    std::array<Tile8BlockRow, 3> rows;
+    for (u32 block_x = rect.x; block_x < rect.x + rect.width; block_x += tile8_block_width) {
+        const u32 tile_count = std::min(tile8_block_width, rect.x + rect.width - block_x);
+        // Bit 0 of every word is the column before the block.
+        const i64 first_column = static_cast<i64>(block_x) - 1;
+        Tile8BlockRow* below = &rows[0];
+        Tile8BlockRow* current = &rows[1];
+        Tile8BlockRow* above = &rows[2];
+        load_tile8_block_row(grid, first_column, static_cast<i64>(rect.y) - 1, *below);
+        load_tile8_block_row(grid, first_column, rect.y, *current);
+        Tile8RowPair below_pair = compute_tile8_row_pair(*below, *current);
+        for (u32 y = rect.y; y < rect.y + rect.height; ++y) {
+            load_tile8_block_row(grid, first_column, static_cast<i64>(y) + 1, *above);
+            const Tile8RowPair above_pair = compute_tile8_row_pair(*current, *above);
+            const u64 horizontal =
+                equal_tile8_bits(*current, 0, *current, 1) & current->valid & (current->valid >> 1u);
+            // In Tile8Connections::mask() order, shifted so that bit k is the tile at
+            // block_x + k.
+            const u64 planes[8] = {
+                /* down       */ below_pair.vertical >> 1u,
+                /* down_right */ below_pair.diagonal_left >> 1u,
+                /* right      */ horizontal >> 1u,
+                /* up_right   */ above_pair.diagonal_right >> 1u,
+                /* up         */ above_pair.vertical >> 1u,
+                /* up_left    */ above_pair.diagonal_left,
+                /* left       */ horizontal,
+                /* down_left  */ below_pair.diagonal_right};
+            for (u32 group = 0; group < tile_count; group += 8) {
+                u64 masks = 0;
+                for (u32 plane = 0; plane < 8; ++plane) {
+                    masks |= spread_bits(static_cast<u8>(planes[plane] >> group)) << plane;
+                }
+                const u32 group_end = std::min(group + 8, tile_count);
+                for (u32 k = group; k < group_end; ++k) {
+                    f(block_x + k, y, static_cast<u8>(masks >> ((k - group) * 8u)));
+                }
+            }
+            below_pair = above_pair;
+            std::swap(below, current);
+            std::swap(current, above);
+        }
+    }
+}
+
+/// A rect with its coordinates normalized to the size of the chunk or tile it lives in.
+struct NormalizedRect {
+    float start_x, start_y, end_x, end_y;
+};
+
+/// The UV source of the 4 minitiles (top-left, top-right, bottom-left, bottom-right) of an
+/// autotile for a given connection mask. Exactly one cache line big, and aligned to one, so that
+/// solving a tile only ever touches a single line of the tables.
+struct alignas(64) MinitileSources {
+    std::array<NormalizedRect, 4> sources;
+};
+static_assert(sizeof(MinitileSources) == 64, "MinitileSources must fill exactly one cache line");
+
+/// Where each minitile of an autotile is drawn, relative to the tile. The same for every
+/// connection mask.
+constexpr std::array<NormalizedRect, 4> minitile_destinations = {
+    NormalizedRect{0.f, .5f, .5f, 1.f}, NormalizedRect{.5f, .5f, 1.f, 1.f},
+    NormalizedRect{0.f, 0.f, .5f, .5f}, NormalizedRect{.5f, 0.f, 1.f, .5f}};
+
+constexpr std::array<MinitileSources, 256> make_rpgmaker_a2_table() {
+    // The RPGMaker A2 layout is 2x3 tiles, or 4x6 minitiles.
+    constexpr float minitile_width = 1.f / 4.f;
+    constexpr float minitile_height = 1.f / 6.f;
 
     /* clang-format off */
-    /// Where each minitile is located locally in the RPGMaker A2 layout.
+    /// Where each minitile is located locally in the RPGMaker A2 layout, in minitiles.
     /// Explanation: https://imgur.com/a/vlRJ9cY
-    const std::array<aml::Vector2, 20> layout = {
-        /* A1 */ aml::Vector2{2, 0},
-        /* A2 */ aml::Vector2{0, 2},
-        /* A3 */ aml::Vector2{2, 4},
-        /* A4 */ aml::Vector2{2, 2},
-        /* A5 */ aml::Vector2{0, 4},
-        /* B1 */ aml::Vector2{3, 0},
-        /* B2 */ aml::Vector2{3, 2},
-        /* B3 */ aml::Vector2{1, 4},
-        /* B4 */ aml::Vector2{1, 2},
-        /* B5 */ aml::Vector2{3, 4},
-        /* C1 */ aml::Vector2{2, 1},
-        /* C2 */ aml::Vector2{0, 5},
-        /* C3 */ aml::Vector2{2, 3},
-        /* C4 */ aml::Vector2{2, 5},
-        /* C5 */ aml::Vector2{0, 3},
-        /* D1 */ aml::Vector2{3, 1},
-        /* D2 */ aml::Vector2{3, 5},
-        /* D3 */ aml::Vector2{1, 3},
-        /* D4 */ aml::Vector2{1, 5},
-        /* D5 */ aml::Vector2{3, 3}
+    constexpr int layout[20][2] = {
+        /* A1 */ {2, 0}, /* A2 */ {0, 2}, /* A3 */ {2, 4}, /* A4 */ {2, 2}, /* A5 */ {0, 4},
+        /* B1 */ {3, 0}, /* B2 */ {3, 2}, /* B3 */ {1, 4}, /* B4 */ {1, 2}, /* B5 */ {3, 4},
+        /* C1 */ {2, 1}, /* C2 */ {0, 5}, /* C3 */ {2, 3}, /* C4 */ {2, 5}, /* C5 */ {0, 3},
+        /* D1 */ {3, 1}, /* D2 */ {3, 5}, /* D3 */ {1, 3}, /* D4 */ {1, 5}, /* D5 */ {3, 3}
     };
     /* clang-format on */
 
-    Sprite spr;
-    for (int minitile = 0; minitile < 4; ++minitile) {
-        bool is_connected_vertically, is_connected_horizontally, is_connected_via_corner;
-        /* clang-format off */
-        std::array<std::tuple<bool, bool, bool>, 4> conn{
-            std::tuple{connections.up, connections.left, connections.up_left}, // Top-left minitile
-            std::tuple{connections.up, connections.right, connections.up_right}, // Top-right minitile
-            std::tuple{connections.down, connections.left, connections.down_left}, // Bottom-left minitile
-            std::tuple{connections.down, connections.right, connections.down_right} // Bottom-right minitile
-        };
-        /* clang-format on */
-        is_connected_vertically = std::get<0>(conn[minitile]);
-        is_connected_horizontally = std::get<1>(conn[minitile]);
-        is_connected_via_corner = std::get<2>(conn[minitile]);
-
-        u8 layout_index = minitile * 5; // Set the minitile position: AX, BX, CX, DX
-        switch ((is_connected_via_corner << 2u) | (is_connected_vertically << 1u) |
-                (is_connected_horizontally)) {
-            case (0b011):
-                /* layout_index += 0; */ // X1; All connected except corner
-                break;
-            case (0b100):
-            case (0b000):
-                layout_index += 1; // X2; No connections
-                break;
-            case (0b111):
-                layout_index += 2; // X3; All connected
-                break;
-            case (0b101):
-            case (0b001):
+    std::array<MinitileSources, 256> table{};
+    for (unsigned mask = 0; mask < 256; ++mask) {
+        const auto bit = [mask](unsigned index) -> unsigned { return (mask >> index) & 1u; };
+        // Bits as laid out by Tile8Connections::mask().
+        const unsigned down = bit(0), down_right = bit(1), right = bit(2), up_right = bit(3),
+                       up = bit(4), up_left = bit(5), left = bit(6), down_left = bit(7);
+        // (vertical, horizontal, corner) connections that affect each minitile.
+        const unsigned minitile_connections[4][3] = {{up, left, up_left},
+                                                     {up, right, up_right},
+                                                     {down, left, down_left},
+                                                     {down, right, down_right}};
+        for (int minitile = 0; minitile < 4; ++minitile) {
+            const unsigned vertical = minitile_connections[minitile][0];
+            const unsigned horizontal = minitile_connections[minitile][1];
+            const unsigned corner = minitile_connections[minitile][2];
+
+            int layout_index = minitile * 5; // Set the minitile position: AX, BX, CX, DX
+            if (vertical && horizontal)
+                layout_index += corner ? 2 : 0; // X3 if all connected, X1 if missing corner
+            else if (horizontal)
                 layout_index += 3; // X4; Vertical connection
-                break;
-            case (0b110):
-            case (0b010):
+            else if (vertical)
                 layout_index += 4; // X5; Horizontal connection
-                break;
+            else
+                layout_index += 1; // X2; No connections
+
+            const float x = static_cast<float>(layout[layout_index][0]) * minitile_width;
+            const float y = static_cast<float>(layout[layout_index][1]) * minitile_height;
+            table[mask].sources[minitile] = {x, y, x + minitile_width, y + minitile_height};
+        }
+    }
+    return table;
+}
+
+/// Every possible RPGMaker A2 autotile, indexed by connection mask.
+constexpr std::array<MinitileSources, 256> rpgmaker_a2_table = make_rpgmaker_a2_table();
+
+constexpr std::array<MinitileSources, 16> make_rpgmaker_a4_wall_table() {
+    // The RPGMaker A4 wall layout is 2x2 tiles, or 4x4 minitiles. The outer minitiles are the
+    // edges of the wall, and the inner ones are used when the tile continues in that direction.
+    constexpr float minitile_size = 1.f / 4.f;
+
+    /* clang-format off */
+    /// Where each minitile is located locally in the RPGMaker A4 wall layout, in minitiles.
+    /// Indexed by minitile, then by (vertical << 1 | horizontal) connections.
+    constexpr int layout[4][4][2] = {
+        /* Top-left */     {{0, 0}, {2, 0}, {0, 2}, {2, 2}},
+        /* Top-right */    {{3, 0}, {1, 0}, {3, 2}, {1, 2}},
+        /* Bottom-left */  {{0, 3}, {2, 3}, {0, 1}, {2, 1}},
+        /* Bottom-right */ {{3, 3}, {1, 3}, {3, 1}, {1, 1}}
+    };
+    /* clang-format on */
+
+    std::array<MinitileSources, 16> table{};
+    for (unsigned mask = 0; mask < 16; ++mask) {
+        const auto bit = [mask](unsigned index) -> unsigned { return (mask >> index) & 1u; };
+        // Bits as laid out by Tile4Connections::mask().
+        const unsigned down = bit(0), right = bit(1), up = bit(2), left = bit(3);
+        // (vertical, horizontal) connections that affect each minitile.
+        const unsigned minitile_connections[4][2] = {
+            {up, left}, {up, right}, {down, left}, {down, right}};
+        for (int minitile = 0; minitile < 4; ++minitile) {
+            const unsigned pattern =
+                minitile_connections[minitile][0] << 1u | minitile_connections[minitile][1];
+            const float x = static_cast<float>(layout[minitile][pattern][0]) * minitile_size;
+            const float y = static_cast<float>(layout[minitile][pattern][1]) * minitile_size;
+            table[mask].sources[minitile] = {x, y, x + minitile_size, y + minitile_size};
         }
-        const float single_tile_width = 1.f / static_cast<float>(rpgmaker_a2_chunk_width);
-        const float single_tile_height = 1.f / static_cast<float>(rpgmaker_a2_chunk_height);
-
-        const auto apply_tex_rect = [&tex](aml::Vector2 const& vec) -> aml::Vector2 {
-            return tex.rect.start + vec * (tex.rect.end - tex.rect.start);
-        };
-        Sprite::Piece piece;
-        const auto normalized_start_pos =
-            aml::Vector2{(float)layout[layout_index].x, (float)layout[layout_index].y} / 2.f *
-            aml::Vector2(single_tile_width, single_tile_height);
-        piece.source = {apply_tex_rect(normalized_start_pos),
-                        apply_tex_rect(normalized_start_pos +
-                                       aml::Vector2(single_tile_width, single_tile_height) / 2.f)};
-        piece.destination = {{static_cast<float>(minitile % 2) / 2.f,
-                              (1.f - static_cast<float>(minitile / 2)) / 2.f},
-                             {static_cast<float>(minitile % 2) / 2.f + .5f,
-                              (1.f - static_cast<float>(minitile / 2)) / 2.f + .5f}};
-        spr.pieces.emplace_back(Sprite::Piece{piece});
     }
+    return table;
+}
+
+/// Every possible RPGMaker A4 wall autotile, indexed by connection mask.
+constexpr std::array<MinitileSources, 16> rpgmaker_a4_wall_table = make_rpgmaker_a4_wall_table();
+
+/// Converts a Tile8Connections mask into a Tile4Connections one by dropping the diagonals.
+constexpr u8 tile8_mask_to_tile4(u8 mask) {
+    return static_cast<u8>((mask >> 0u & 1u) | (mask >> 2u & 1u) << 1u | (mask >> 4u & 1u) << 2u |
+                           (mask >> 6u & 1u) << 3u);
+}
+
+/// Writes the 4 pieces of an autotile to out, remapping the sources to the chunk rect and
+/// offsetting their destinations.
+void write_minitile_pieces(TextureChunk const& tex,
+                           MinitileSources const& minitiles,
+                           aml::Vector2 offset,
+                           Sprite::Piece* out) {
+    const aml::Vector2 uv_start = tex.rect.start;
+    const aml::Vector2 uv_size = tex.rect.end - tex.rect.start;
+    for (int minitile = 0; minitile < 4; ++minitile) {
+        const NormalizedRect& src = minitiles.sources[minitile];
+        const NormalizedRect& dst = minitile_destinations[minitile];
+        out[minitile].source = {
+            {uv_start.x + src.start_x * uv_size.x, uv_start.y + src.start_y * uv_size.y},
+            {uv_start.x + src.end_x * uv_size.x, uv_start.y + src.end_y * uv_size.y}};
+        out[minitile].destination = {{offset.x + dst.start_x, offset.y + dst.start_y},
+                                     {offset.x + dst.end_x, offset.y + dst.end_y}};
+    }
+}
+
+/// Solves every tile inside a rect of a grid as an autotile. sources_for_mask must return the
+/// MinitileSources of a tile given its Tile8Connections mask.
+template<typename F>
+void solve_autotile_grid(TileIDGrid const& grid,
+                         std::vector<TextureChunk> const& chunks,
+                         TileRect rect,
+                         Sprite::Piece* out_pieces,
+                         F&& sources_for_mask) {
+    for_each_tile8_mask(grid, rect, [&](u32 x, u32 y, u8 mask) {
+        Sprite::Piece* pieces = out_pieces + (x + y * grid.width) * 4;
+        const u32 id = grid.at(x, y);
+        if (id >= chunks.size()) {
+            std::fill(pieces, pieces + 4, Sprite::Piece{});
+            return;
+        }
+        write_minitile_pieces(chunks[id], sources_for_mask(mask),
+                              {static_cast<float>(x), static_cast<float>(y)}, pieces);
+    });
+}
+
+/// Grows a dirty rect by one tile in every direction. Editing a tile changes the connections of
+/// its 8 neighbours, so they have to be solved again too.
+TileRect grow_dirty_rect(TileRect dirty) {
+    const u32 start_x = dirty.x > 0 ? dirty.x - 1 : 0;
+    const u32 start_y = dirty.y > 0 ? dirty.y - 1 : 0;
+    return {start_x, start_y, dirty.x + dirty.width + 1 - start_x,
+            dirty.y + dirty.height + 1 - start_y};
+}
+
+MinitileSources const& rpgmaker_a2_sources(u8 tile8_mask) { return rpgmaker_a2_table[tile8_mask]; }
+
+MinitileSources const& rpgmaker_a4_wall_sources(u8 tile8_mask) {
+    return rpgmaker_a4_wall_table[tile8_mask_to_tile4(tile8_mask)];
+}
 
+} // namespace
+
+/// Modified RPGMaker A2 algorithm where the X1 tiles are laid out horizontally on the first
+/// minitile row.
+Sprite solve_rpgmaker_a2(TextureChunk const& tex, Tile8Connections const& connections) {
+    return solve_rpgmaker_a2(tex, connections.mask());
+}
+
+Sprite solve_rpgmaker_a2(TextureChunk const& tex, u8 connection_mask) {
+    Sprite spr;
+    solve_rpgmaker_a2(tex, connection_mask, spr);
     return spr;
 }
 
+void solve_rpgmaker_a2(TextureChunk const& tex, u8 connection_mask, Sprite& out) {
+    out.texture = tex.tex;
+    out.pieces.resize(4);
+    write_minitile_pieces(tex, rpgmaker_a2_table[connection_mask], {0, 0}, out.pieces.data());
+}
+
+Sprite solve_rpgmaker_a4_wall(TextureChunk const& tex, Tile4Connections const& connections) {
+    return solve_rpgmaker_a4_wall(tex, connections.mask());
+}
+
+Sprite solve_rpgmaker_a4_wall(TextureChunk const& tex, u8 connection_mask) {
+    Sprite spr;
+    solve_rpgmaker_a4_wall(tex, connection_mask, spr);
+    return spr;
+}
+
+void solve_rpgmaker_a4_wall(TextureChunk const& tex, u8 connection_mask, Sprite& out) {
+    out.texture = tex.tex;
+    out.pieces.resize(4);
+    write_minitile_pieces(tex, rpgmaker_a4_wall_table[connection_mask & 0xFu], {0, 0},
+                          out.pieces.data());
+}
+
+void compute_tile8_masks(TileIDGrid const& grid, TileRect rect, u8* out_masks) {
+    for_each_tile8_mask(grid, rect,
+                        [&](u32 x, u32 y, u8 mask) { out_masks[x + y * grid.width] = mask; });
+}
+
+void solve_rpgmaker_a2_grid(TileIDGrid const& grid,
+                            std::vector<TextureChunk> const& chunks,
+                            Sprite::Piece* out_pieces) {
+    solve_autotile_grid(grid, chunks, {0, 0, grid.width, grid.height}, out_pieces,
+                        rpgmaker_a2_sources);
+}
+
+void solve_rpgmaker_a2_grid(TileIDGrid const& grid,
+                            std::vector<TextureChunk> const& chunks,
+                            TileRect dirty,
+                            Sprite::Piece* out_pieces) {
+    solve_autotile_grid(grid, chunks, grow_dirty_rect(dirty), out_pieces, rpgmaker_a2_sources);
+}
+
+void solve_rpgmaker_a4_wall_grid(TileIDGrid const& grid,
+                                 std::vector<TextureChunk> const& chunks,
+                                 Sprite::Piece* out_pieces) {
+    solve_autotile_grid(grid, chunks, {0, 0, grid.width, grid.height}, out_pieces,
+                        rpgmaker_a4_wall_sources);
+}
+
+void solve_rpgmaker_a4_wall_grid(TileIDGrid const& grid,
+                                 std::vector<TextureChunk> const& chunks,
+                                 TileRect dirty,
+                                 Sprite::Piece* out_pieces) {
+    solve_autotile_grid(grid, chunks, grow_dirty_rect(dirty), out_pieces,
+                        rpgmaker_a4_wall_sources);
+}
+
 } // namespace aryibi::sprites
\ No newline at end of file
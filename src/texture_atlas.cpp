@@ -0,0 +1,244 @@
+#include "aryibi/texture_atlas.hpp"
+#include "util/aryibi_assert.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+using namespace anton;
+namespace aml = anton::math;
+
+namespace aryibi::sprites {
+
+namespace {
+
+/// Skyline bottom-left rect packer. The skyline is the list of horizontal segments that form the
+/// top edge of everything packed so far; new rects are placed on top of it, as low as possible.
+class SkylinePacker {
+public:
+    SkylinePacker(u32 width, u32 height) : width(width), height(height) {
+        skyline.emplace_back(Segment{0, 0, width});
+    }
+
+    /// Tries to place a rect. @returns Whether it fit. If it did, x and y are set to its position.
+    bool insert(u32 rect_width, u32 rect_height, u32& x, u32& y) {
+        usize best_index = std::numeric_limits<usize>::max();
+        u32 best_top = std::numeric_limits<u32>::max();
+        u32 best_width = std::numeric_limits<u32>::max();
+        u32 best_y = 0;
+        for (usize i = 0; i < skyline.size(); ++i) {
+            u32 fit_y;
+            if (!fits(i, rect_width, rect_height, fit_y))
+                continue;
+            const u32 top = fit_y + rect_height;
+            if (top < best_top || (top == best_top && skyline[i].width < best_width)) {
+                best_index = i;
+                best_top = top;
+                best_width = skyline[i].width;
+                best_y = fit_y;
+            }
+        }
+        if (best_index == std::numeric_limits<usize>::max())
+            return false;
+
+        x = skyline[best_index].x;
+        y = best_y;
+        add_segment(best_index, Segment{x, y + rect_height, rect_width});
+        return true;
+    }
+
+private:
+    struct Segment {
+        u32 x, y, width;
+    };
+
+    /// Checks if a rect fits with its left edge at the start of the segment given.
+    bool fits(usize index, u32 rect_width, u32 rect_height, u32& fit_y) const {
+        const u32 x = skyline[index].x;
+        if (x + rect_width > width)
+            return false;
+        fit_y = 0;
+        u32 width_left = rect_width;
+        for (usize i = index; width_left > 0; ++i) {
+            fit_y = std::max(fit_y, skyline[i].y);
+            if (fit_y + rect_height > height)
+                return false;
+            width_left -= std::min(width_left, skyline[i].width);
+        }
+        return true;
+    }
+
+    void add_segment(usize index, Segment segment) {
+        skyline.insert(skyline.begin() + index, segment);
+        // Shrink or remove the segments that are now below the new one.
+        const u32 segment_end = segment.x + segment.width;
+        for (usize i = index + 1; i < skyline.size();) {
+            Segment& next = skyline[i];
+            if (next.x >= segment_end)
+                break;
+            const u32 overlap = segment_end - next.x;
+            if (overlap >= next.width) {
+                skyline.erase(skyline.begin() + i);
+                continue;
+            }
+            next.x += overlap;
+            next.width -= overlap;
+            break;
+        }
+        // Merge neighbouring segments at the same height.
+        for (usize i = 0; i + 1 < skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    u32 width, height;
+    std::vector<Segment> skyline;
+};
+
+} // namespace
+
+TextureAtlasBuilder::TextureAtlasBuilder(Settings const& settings) : settings(settings) {}
+
+u32 TextureAtlasBuilder::bytes_per_pixel() const {
+    switch (settings.color_type) {
+        case renderer::TextureHandle::ColorType::rgba: return 4;
+        case renderer::TextureHandle::ColorType::indexed_palette: return 2;
+        default:
+            ARYIBI_ASSERT(false, "Texture atlases only support rgba and indexed_palette textures!");
+            return 4;
+    }
+}
+
+TextureAtlasBuilder::ImageID
+TextureAtlasBuilder::add_image(u32 width, u32 height, const void* data) {
+    return add_image_region(width, height, data, {{0, 0}, {1, 1}});
+}
+
+TextureAtlasBuilder::ImageID
+TextureAtlasBuilder::add_image_region(u32 width, u32 height, const void* data, Rect2D region) {
+    const u32 start_x = static_cast<u32>(std::lround(region.start.x * static_cast<float>(width)));
+    const u32 start_y = static_cast<u32>(std::lround(region.start.y * static_cast<float>(height)));
+    const u32 end_x = static_cast<u32>(std::lround(region.end.x * static_cast<float>(width)));
+    const u32 end_y = static_cast<u32>(std::lround(region.end.y * static_cast<float>(height)));
+    ARYIBI_ASSERT(start_x < end_x && start_y < end_y && end_x <= width && end_y <= height,
+                  "Invalid image region given to add_image_region(...)!");
+    // Checked for real, because build() can only place images that fit in an empty page.
+    if (end_x - start_x + settings.padding * 2 > settings.page_width ||
+        end_y - start_y + settings.padding * 2 > settings.page_height)
+        throw std::runtime_error("Image is too big to fit in a texture atlas page!");
+
+    const u32 bpp = bytes_per_pixel();
+    Image image{end_x - start_x, end_y - start_y, {}};
+    image.pixels.resize(static_cast<usize>(image.width) * image.height * bpp);
+    const auto* src = static_cast<const u8*>(data);
+    for (u32 row = 0; row < image.height; ++row) {
+        std::memcpy(image.pixels.data() + static_cast<usize>(row) * image.width * bpp,
+                    src + (static_cast<usize>(start_y + row) * width + start_x) * bpp,
+                    static_cast<usize>(image.width) * bpp);
+    }
+    images.emplace_back(std::move(image));
+    return static_cast<ImageID>(images.size() - 1);
+}
+
+TextureAtlas TextureAtlasBuilder::build() const {
+    TextureAtlas atlas;
+    atlas.placements.resize(images.size());
+
+    // Packing the tallest images first gives much flatter skylines.
+    std::vector<ImageID> order(images.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](ImageID a, ImageID b) {
+        return images[a].height > images[b].height;
+    });
+
+    struct PixelPosition {
+        u32 page, x, y;
+    };
+    std::vector<PixelPosition> positions(images.size());
+    std::vector<SkylinePacker> packers;
+    for (const ImageID id : order) {
+        const u32 padded_width = images[id].width + settings.padding * 2;
+        const u32 padded_height = images[id].height + settings.padding * 2;
+        u32 x, y;
+        u32 page = 0;
+        for (; page < packers.size(); ++page) {
+            if (packers[page].insert(padded_width, padded_height, x, y))
+                break;
+        }
+        if (page == packers.size()) {
+            packers.emplace_back(settings.page_width, settings.page_height);
+            // add_image_region() only accepts images that fit in an empty page.
+            [[maybe_unused]] const bool inserted =
+                packers.back().insert(padded_width, padded_height, x, y);
+            ARYIBI_ASSERT(inserted, "Image doesn't fit in an empty texture atlas page!");
+        }
+        positions[id] = {page, x + settings.padding, y + settings.padding};
+    }
+
+    const u32 bpp = bytes_per_pixel();
+    const usize page_stride = static_cast<usize>(settings.page_width) * bpp;
+    std::vector<std::vector<u8>> page_pixels(
+        packers.size(), std::vector<u8>(page_stride * settings.page_height, 0));
+    for (ImageID id = 0; id < images.size(); ++id) {
+        const Image& image = images[id];
+        const PixelPosition& pos = positions[id];
+        std::vector<u8>& pixels = page_pixels[pos.page];
+        // When extruding, copy the padding too by clamping the source coordinates to the image.
+        const i64 border = settings.extrude_edges ? settings.padding : 0;
+        for (i64 row = -border; row < static_cast<i64>(image.height) + border; ++row) {
+            const i64 src_row = std::clamp<i64>(row, 0, image.height - 1);
+            u8* dst = pixels.data() + (pos.y + row) * page_stride + pos.x * bpp;
+            const u8* src = image.pixels.data() + src_row * image.width * bpp;
+            for (i64 col = -border; col < 0; ++col) {
+                std::memcpy(dst + col * bpp, src, bpp);
+            }
+            std::memcpy(dst, src, static_cast<usize>(image.width) * bpp);
+            for (i64 col = image.width; col < static_cast<i64>(image.width) + border; ++col) {
+                std::memcpy(dst + col * bpp, src + (image.width - 1) * bpp, bpp);
+            }
+        }
+
+        const float page_width = static_cast<float>(settings.page_width);
+        const float page_height = static_cast<float>(settings.page_height);
+        atlas.placements[id] = {pos.page,
+                                {{static_cast<float>(pos.x) / page_width,
+                                  static_cast<float>(pos.y) / page_height},
+                                 {static_cast<float>(pos.x + image.width) / page_width,
+                                  static_cast<float>(pos.y + image.height) / page_height}}};
+    }
+
+    atlas.page_list.resize(packers.size());
+    for (usize page = 0; page < packers.size(); ++page) {
+        atlas.page_list[page].init(settings.page_width, settings.page_height, settings.color_type,
+                                   settings.filter, page_pixels[page].data());
+    }
+    return atlas;
+}
+
+TextureChunk TextureAtlas::chunk(TextureAtlasBuilder::ImageID id) const {
+    return chunk(id, {{0, 0}, {1, 1}});
+}
+
+TextureChunk TextureAtlas::chunk(TextureAtlasBuilder::ImageID id, Rect2D const& rect) const {
+    ARYIBI_ASSERT(id < placements.size(), "Invalid texture atlas image ID!");
+    const Placement& placement = placements[id];
+    const aml::Vector2 start = placement.rect.start;
+    const aml::Vector2 size = placement.rect.end - placement.rect.start;
+    return {page_list[placement.page], {start + rect.start * size, start + rect.end * size}};
+}
+
+void TextureAtlas::unload() {
+    for (auto& page : page_list) { page.unload(); }
+    page_list.clear();
+    placements.clear();
+}
+
+} // namespace aryibi::sprites
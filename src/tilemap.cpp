@@ -0,0 +1,220 @@
+#include "aryibi/tilemap.hpp"
+#include "aryibi/sprite_solvers.hpp"
+#include "util/aryibi_assert.hpp"
+
+#include <algorithm>
+
+using namespace anton;
+namespace aml = anton::math;
+
+namespace aryibi::tilemap {
+
+TileMapLayer::TileMapLayer(Settings const& settings) : layer_settings(settings) {
+    ARYIBI_ASSERT(settings.chunk_size > 0, "Tilemap chunks must be at least one tile big!");
+    for (const auto& type : settings.tile_types) {
+        ARYIBI_ASSERT(type.chunk.tex == settings.texture,
+                      "Every tile type of a layer must use the layer texture!");
+    }
+
+    const u32 chunk_size = settings.chunk_size;
+    chunks_x = (settings.width + chunk_size - 1) / chunk_size;
+    chunks_y = (settings.height + chunk_size - 1) / chunk_size;
+    tiles.assign(settings.width * settings.height, empty_tile);
+    masks.resize(settings.width * settings.height);
+    if (settings.merge_repeating_tiles)
+        merged.resize(chunk_size * chunk_size);
+
+    chunk_list.resize(chunks_x * chunks_y);
+    dirty_chunks.reserve(chunk_list.size());
+    for (u32 y = 0; y < chunks_y; ++y) {
+        for (u32 x = 0; x < chunks_x; ++x) {
+            const u32 index = x + y * chunks_x;
+            Chunk& chunk = chunk_list[index];
+            const aml::Vector2 start{static_cast<float>(x * chunk_size),
+                                     static_cast<float>(y * chunk_size)};
+            chunk.position = {start.x, start.y, 0};
+            chunk.bounds = {start,
+                            {static_cast<float>(std::min((x + 1) * chunk_size, settings.width)),
+                             static_cast<float>(std::min((y + 1) * chunk_size, settings.height))}};
+            dirty_chunks.emplace_back(index);
+        }
+    }
+}
+
+u32 TileMapLayer::tile(u32 x, u32 y) const {
+    ARYIBI_ASSERT(x < layer_settings.width && y < layer_settings.height,
+                  "Tile position out of bounds!");
+    return tiles[x + y * layer_settings.width];
+}
+
+void TileMapLayer::set_tile(u32 x, u32 y, u32 id) {
+    ARYIBI_ASSERT(x < layer_settings.width && y < layer_settings.height,
+                  "Tile position out of bounds!");
+    u32& current = tiles[x + y * layer_settings.width];
+    if (current == id)
+        return;
+    current = id;
+    mark_dirty({x, y, 1, 1});
+}
+
+void TileMapLayer::fill(sprites::TileRect rect, u32 id) {
+    if (rect.x >= layer_settings.width || rect.y >= layer_settings.height)
+        return;
+    rect.width = std::min(rect.width, layer_settings.width - rect.x);
+    rect.height = std::min(rect.height, layer_settings.height - rect.y);
+    if (rect.width == 0 || rect.height == 0)
+        return;
+
+    for (u32 y = rect.y; y < rect.y + rect.height; ++y) {
+        u32* const row = tiles.data() + y * layer_settings.width;
+        std::fill(row + rect.x, row + rect.x + rect.width, id);
+    }
+    mark_dirty(rect);
+}
+
+void TileMapLayer::mark_dirty(sprites::TileRect rect) {
+    // The tiles around the rect may be autotiles connected to the ones that changed, so their
+    // chunks must be rebuilt too.
+    const u32 first_x = rect.x == 0 ? 0 : rect.x - 1;
+    const u32 first_y = rect.y == 0 ? 0 : rect.y - 1;
+    const u32 last_x = std::min(rect.x + rect.width, layer_settings.width - 1);
+    const u32 last_y = std::min(rect.y + rect.height, layer_settings.height - 1);
+    const u32 chunk_size = layer_settings.chunk_size;
+    for (u32 y = first_y / chunk_size; y <= last_y / chunk_size; ++y) {
+        for (u32 x = first_x / chunk_size; x <= last_x / chunk_size; ++x) {
+            const u32 index = x + y * chunks_x;
+            if (chunk_list[index].dirty)
+                continue;
+            chunk_list[index].dirty = true;
+            dirty_chunks.emplace_back(index);
+        }
+    }
+}
+
+std::size_t TileMapLayer::rebuild_dirty(std::size_t max_chunks) {
+    const std::size_t count = std::min(max_chunks, dirty_chunks.size());
+    for (std::size_t i = 0; i < count; ++i) { rebuild_chunk(dirty_chunks[i]); }
+    dirty_chunks.erase(dirty_chunks.begin(), dirty_chunks.begin() + count);
+    return count;
+}
+
+void TileMapLayer::rebuild_chunk(u32 chunk_index) {
+    Chunk& chunk = chunk_list[chunk_index];
+    const u32 chunk_size = layer_settings.chunk_size;
+    const u32 first_x = (chunk_index % chunks_x) * chunk_size;
+    const u32 first_y = (chunk_index / chunks_x) * chunk_size;
+    const sprites::TileRect rect{first_x, first_y,
+                                 std::min(chunk_size, layer_settings.width - first_x),
+                                 std::min(chunk_size, layer_settings.height - first_y)};
+    const sprites::TileIDGrid grid{tiles.data(), layer_settings.width, layer_settings.height};
+    sprites::compute_tile8_masks(grid, rect, masks.data());
+    std::fill(merged.begin(), merged.end(), false);
+
+    bool has_tiles = false;
+    for (u32 y = rect.y; y < rect.y + rect.height; ++y) {
+        for (u32 x = rect.x; x < rect.x + rect.width; ++x) {
+            const u32 id = grid.at(x, y);
+            if (id >= layer_settings.tile_types.size())
+                continue;
+            const TileType& type = layer_settings.tile_types[id];
+            if (layer_settings.merge_repeating_tiles && type.kind == TileKind::normal) {
+                if (merged[(x - first_x) + (y - first_y) * chunk_size])
+                    continue;
+                const sprites::TileRect quad = merge_tiles(rect, x, y);
+                if (quad.width != 1 || quad.height != 1) {
+                    const aml::Vector2 size{static_cast<float>(quad.width),
+                                            static_cast<float>(quad.height)};
+                    // The shaders repeat the tile once per tile unit, so every tile covered by
+                    // the quad looks exactly like it would with a quad of its own.
+                    sprites::solve_normal(type.chunk, size, sprite);
+                    builder.add_repeating_sprite(sprite, size,
+                                                 {static_cast<float>(x - first_x),
+                                                  static_cast<float>(y - first_y), 0});
+                    has_tiles = true;
+                    continue;
+                }
+            }
+
+            const u8 mask = masks[x + y * grid.width];
+            switch (type.kind) {
+                case TileKind::normal: sprites::solve_normal(type.chunk, {1, 1}, sprite); break;
+                case TileKind::rpgmaker_a2:
+                    sprites::solve_rpgmaker_a2(type.chunk, mask, sprite);
+                    break;
+                case TileKind::rpgmaker_a4_wall: {
+                    const auto connections = sprites::Tile8Connections::from_mask(mask);
+                    const sprites::Tile4Connections wall_connections{
+                        connections.down, connections.right, connections.up, connections.left};
+                    sprites::solve_rpgmaker_a4_wall(type.chunk, wall_connections.mask(), sprite);
+                    break;
+                }
+                default: ARYIBI_ASSERT(false, "Unknown TileKind!");
+            }
+            // Vertices are relative to the chunk position
+            builder.add_sprite(sprite, {static_cast<float>(x - first_x),
+                                        static_cast<float>(y - first_y), 0});
+            has_tiles = true;
+        }
+    }
+
+    if (chunk.has_mesh)
+        chunk.mesh.unload();
+    chunk.has_mesh = has_tiles;
+    if (has_tiles)
+        chunk.mesh = builder.finish();
+    chunk.dirty = false;
+}
+
+sprites::TileRect TileMapLayer::merge_tiles(sprites::TileRect chunk_rect, u32 x, u32 y) {
+    const u32 id = tile(x, y);
+    const auto can_merge = [&](u32 tile_x, u32 tile_y) {
+        return tiles[tile_x + tile_y * layer_settings.width] == id &&
+               !merged[(tile_x - chunk_rect.x) + (tile_y - chunk_rect.y) * layer_settings.chunk_size];
+    };
+
+    u32 width = 1;
+    while (x + width < chunk_rect.x + chunk_rect.width && can_merge(x + width, y)) ++width;
+    u32 height = 1;
+    for (; y + height < chunk_rect.y + chunk_rect.height; ++height) {
+        bool row_matches = true;
+        for (u32 i = 0; i < width && row_matches; ++i) { row_matches = can_merge(x + i, y + height); }
+        if (!row_matches)
+            break;
+    }
+
+    for (u32 j = 0; j < height; ++j) {
+        for (u32 i = 0; i < width; ++i) {
+            merged[(x + i - chunk_rect.x) + (y + j - chunk_rect.y) * layer_settings.chunk_size] =
+                true;
+        }
+    }
+    return {x, y, width, height};
+}
+
+void TileMapLayer::add_draw_commands(renderer::DrawCmdList& commands,
+                                     renderer::ShaderHandle const& shader,
+                                     aml::Vector3 position,
+                                     bool cast_shadows) const {
+    for (const auto& chunk : chunk_list) {
+        if (!chunk.has_mesh)
+            continue;
+        commands.commands.emplace_back(renderer::DrawCmd{layer_settings.texture, chunk.mesh, shader,
+                                                         {position + chunk.position},
+                                                         cast_shadows});
+    }
+}
+
+void TileMapLayer::unload() {
+    for (u32 index = 0; index < chunk_list.size(); ++index) {
+        Chunk& chunk = chunk_list[index];
+        if (chunk.has_mesh)
+            chunk.mesh.unload();
+        chunk.has_mesh = false;
+        if (!chunk.dirty) {
+            chunk.dirty = true;
+            dirty_chunks.emplace_back(index);
+        }
+    }
+}
+
+} // namespace aryibi::tilemap
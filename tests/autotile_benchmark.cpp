@@ -0,0 +1,156 @@
+// How long solving RPGMaker A2 autotiles takes with the compile-time table, compared to the
+// solver it replaced, which worked out the minitiles of every tile from its connections. Solves
+// every possible connection mask many times with both, prints the time per tile, and checks that
+// both give the same pieces.
+
+#include "benchmark.hpp"
+#include "check.hpp"
+
+#include "aryibi/sprites.hpp"
+#include "aryibi/sprite_solvers.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <tuple>
+
+using namespace aryibi;
+using namespace aryibi::sprites;
+using namespace anton;
+namespace aml = anton::math;
+
+namespace {
+
+constexpr u32 rounds = 2000;
+
+/// The solver before the table, only changed to write to an existing sprite so that both versions
+/// are timed without allocating.
+void solve_rpgmaker_a2_reference(TextureChunk const& tex,
+                                 Tile8Connections const& connections,
+                                 Sprite& spr) {
+    static constexpr int rpgmaker_a2_chunk_width = 2;
+    static constexpr int rpgmaker_a2_chunk_height = 3;
+
+    /* clang-format off */
+    const std::array<aml::Vector2, 20> layout = {
+        /* A1 */ aml::Vector2{2, 0}, /* A2 */ aml::Vector2{0, 2}, /* A3 */ aml::Vector2{2, 4},
+        /* A4 */ aml::Vector2{2, 2}, /* A5 */ aml::Vector2{0, 4}, /* B1 */ aml::Vector2{3, 0},
+        /* B2 */ aml::Vector2{3, 2}, /* B3 */ aml::Vector2{1, 4}, /* B4 */ aml::Vector2{1, 2},
+        /* B5 */ aml::Vector2{3, 4}, /* C1 */ aml::Vector2{2, 1}, /* C2 */ aml::Vector2{0, 5},
+        /* C3 */ aml::Vector2{2, 3}, /* C4 */ aml::Vector2{2, 5}, /* C5 */ aml::Vector2{0, 3},
+        /* D1 */ aml::Vector2{3, 1}, /* D2 */ aml::Vector2{3, 5}, /* D3 */ aml::Vector2{1, 3},
+        /* D4 */ aml::Vector2{1, 5}, /* D5 */ aml::Vector2{3, 3}
+    };
+    /* clang-format on */
+
+    spr.pieces.clear();
+    for (int minitile = 0; minitile < 4; ++minitile) {
+        const std::array<std::tuple<bool, bool, bool>, 4> conn{
+            std::tuple{connections.up, connections.left, connections.up_left},
+            std::tuple{connections.up, connections.right, connections.up_right},
+            std::tuple{connections.down, connections.left, connections.down_left},
+            std::tuple{connections.down, connections.right, connections.down_right}};
+        const bool is_connected_vertically = std::get<0>(conn[minitile]);
+        const bool is_connected_horizontally = std::get<1>(conn[minitile]);
+        const bool is_connected_via_corner = std::get<2>(conn[minitile]);
+
+        u8 layout_index = minitile * 5;
+        switch ((is_connected_via_corner << 2u) | (is_connected_vertically << 1u) |
+                (is_connected_horizontally)) {
+            case (0b011): break;
+            case (0b100):
+            case (0b000): layout_index += 1; break;
+            case (0b111): layout_index += 2; break;
+            case (0b101):
+            case (0b001): layout_index += 3; break;
+            case (0b110):
+            case (0b010): layout_index += 4; break;
+        }
+        const float single_tile_width = 1.f / static_cast<float>(rpgmaker_a2_chunk_width);
+        const float single_tile_height = 1.f / static_cast<float>(rpgmaker_a2_chunk_height);
+
+        const auto apply_tex_rect = [&tex](aml::Vector2 const& vec) -> aml::Vector2 {
+            return tex.rect.start + vec * (tex.rect.end - tex.rect.start);
+        };
+        Sprite::Piece piece;
+        const auto normalized_start_pos =
+            aml::Vector2{(float)layout[layout_index].x, (float)layout[layout_index].y} / 2.f *
+            aml::Vector2(single_tile_width, single_tile_height);
+        piece.source = {apply_tex_rect(normalized_start_pos),
+                        apply_tex_rect(normalized_start_pos +
+                                       aml::Vector2(single_tile_width, single_tile_height) / 2.f)};
+        piece.destination = {{static_cast<float>(minitile % 2) / 2.f,
+                              (1.f - static_cast<float>(minitile / 2)) / 2.f},
+                             {static_cast<float>(minitile % 2) / 2.f + .5f,
+                              (1.f - static_cast<float>(minitile / 2)) / 2.f + .5f}};
+        spr.pieces.push_back(piece);
+    }
+}
+
+bool nearly_equal(aml::Vector2 a, aml::Vector2 b) {
+    return std::abs(a.x - b.x) < 1e-6f && std::abs(a.y - b.y) < 1e-6f;
+}
+
+void test_table_matches_reference() {
+    const TextureChunk chunk{renderer::TextureHandle(), {{.25f, .5f}, {.75f, 1.f}}};
+    Sprite expected;
+    Sprite solved;
+    for (unsigned mask = 0; mask < 256; ++mask) {
+        solve_rpgmaker_a2_reference(chunk, Tile8Connections::from_mask(static_cast<u8>(mask)),
+                                    expected);
+        solve_rpgmaker_a2(chunk, static_cast<u8>(mask), solved);
+        ARYIBI_CHECK(solved.pieces.size() == expected.pieces.size());
+        for (std::size_t i = 0; i < solved.pieces.size() && i < expected.pieces.size(); ++i) {
+            const Sprite::Piece& a = solved.pieces[i];
+            const Sprite::Piece& b = expected.pieces[i];
+            ARYIBI_CHECK(nearly_equal(a.source.start, b.source.start) &&
+                         nearly_equal(a.source.end, b.source.end) &&
+                         nearly_equal(a.destination.start, b.destination.start) &&
+                         nearly_equal(a.destination.end, b.destination.end));
+        }
+    }
+}
+
+void benchmark_solvers() {
+    const TextureChunk chunk{renderer::TextureHandle(), {{.25f, .5f}, {.75f, 1.f}}};
+    std::array<Tile8Connections, 256> connections;
+    for (unsigned mask = 0; mask < 256; ++mask) {
+        connections[mask] = Tile8Connections::from_mask(static_cast<u8>(mask));
+    }
+    Sprite spr;
+    // Checked at the end, so that the compiler can't skip solving.
+    float sink = 0;
+
+    const double reference_ms = tests::best_time_ms(10, [&] {
+        for (u32 round = 0; round < rounds; ++round) {
+            for (auto const& tile : connections) {
+                solve_rpgmaker_a2_reference(chunk, tile, spr);
+                sink += spr.pieces[3].source.end.x;
+            }
+        }
+    });
+    const double table_ms = tests::best_time_ms(10, [&] {
+        for (u32 round = 0; round < rounds; ++round) {
+            for (unsigned mask = 0; mask < 256; ++mask) {
+                solve_rpgmaker_a2(chunk, static_cast<u8>(mask), spr);
+                sink += spr.pieces[3].source.end.x;
+            }
+        }
+    });
+
+    constexpr double tiles = rounds * 256.0;
+    std::printf("%.0f autotiles solved:\n", tiles);
+    std::printf("  reference: %.3f ms (%.2f ns per tile)\n", reference_ms,
+                reference_ms * 1e6 / tiles);
+    std::printf("  table:     %.3f ms (%.2f ns per tile, %.2fx)\n", table_ms,
+                table_ms * 1e6 / tiles, reference_ms / table_ms);
+    ARYIBI_CHECK(sink > 0);
+}
+
+} // namespace
+
+int main() {
+    test_table_matches_reference();
+    benchmark_solvers();
+    return tests::result();
+}
@@ -0,0 +1,31 @@
+#ifndef ARYIBI_TESTS_BENCHMARK_HPP
+#define ARYIBI_TESTS_BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+
+namespace aryibi::tests {
+
+/// Calls setup and then fn the given number of times, and returns how long the fastest call to fn
+/// took in milliseconds. The fastest one is the least disturbed by everything else running on the
+/// machine.
+template<typename Setup, typename F> double best_time_ms(int runs, Setup&& setup, F&& fn) {
+    double best = 0;
+    for (int run = 0; run < runs; ++run) {
+        setup();
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const std::chrono::duration<double, std::milli> time =
+            std::chrono::steady_clock::now() - start;
+        best = run == 0 ? time.count() : std::min(best, time.count());
+    }
+    return best;
+}
+
+template<typename F> double best_time_ms(int runs, F&& fn) {
+    return best_time_ms(runs, [] {}, fn);
+}
+
+} // namespace aryibi::tests
+
+#endif // ARYIBI_TESTS_BENCHMARK_HPP
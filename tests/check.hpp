@@ -0,0 +1,30 @@
+#ifndef ARYIBI_TESTS_CHECK_HPP
+#define ARYIBI_TESTS_CHECK_HPP
+
+#include <cstdio>
+
+namespace aryibi::tests {
+
+/// How many checks failed so far. Tests are plain executables run by ctest, which fail if any
+/// check did (See result()).
+inline int failed_checks = 0;
+
+/// What main() should return.
+inline int result() {
+    if (failed_checks != 0)
+        std::fprintf(stderr, "%d checks failed\n", failed_checks);
+    return failed_checks == 0 ? 0 : 1;
+}
+
+} // namespace aryibi::tests
+
+/// Checks that a condition is true, printing where it failed if not. Doesn't stop the test.
+#define ARYIBI_CHECK(...)                                                                          \
+    do {                                                                                           \
+        if (!(__VA_ARGS__)) {                                                                      \
+            std::fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #__VA_ARGS__);   \
+            ++aryibi::tests::failed_checks;                                                        \
+        }                                                                                          \
+    } while (false)
+
+#endif // ARYIBI_TESTS_CHECK_HPP
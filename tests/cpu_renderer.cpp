@@ -0,0 +1,122 @@
+#include "cpu_renderer.hpp"
+
+#include "aryibi/renderer.hpp"
+
+#include <new>
+#include <type_traits>
+
+namespace aryibi::renderer {
+
+struct TextureHandle::impl {
+    /// Every texture initialized gets a different one. 0 means no texture.
+    u32 id = 0;
+    u32 width = 0;
+    u32 height = 0;
+};
+
+TextureHandle::TextureHandle() : p_impl(new (impl_storage) impl()) {
+    static_assert(sizeof(impl) <= impl_size && alignof(impl) <= impl_alignment &&
+                      std::is_trivially_destructible_v<impl>,
+                  "TextureHandle::impl must fit in the inline storage of the handle");
+}
+TextureHandle::~TextureHandle() = default;
+TextureHandle::TextureHandle(TextureHandle const& other) :
+    p_impl(new (impl_storage) impl(*other.p_impl)) {}
+TextureHandle& TextureHandle::operator=(TextureHandle const& other) {
+    *p_impl = *other.p_impl;
+    return *this;
+}
+
+void TextureHandle::init(u32 width, u32 height, ColorType, FilteringMethod, const void*) {
+    static u32 last_id = 0;
+    p_impl->id = ++last_id;
+    p_impl->width = width;
+    p_impl->height = height;
+}
+void TextureHandle::unload() { *p_impl = impl(); }
+bool TextureHandle::exists() const { return p_impl->id != 0; }
+u32 TextureHandle::width() const { return p_impl->width; }
+u32 TextureHandle::height() const { return p_impl->height; }
+
+bool operator==(TextureHandle const& a, TextureHandle const& b) {
+    return a.p_impl->id == b.p_impl->id;
+}
+
+struct MeshHandle::impl {
+    bool exists = false;
+};
+
+MeshHandle::MeshHandle() : p_impl(std::make_unique<impl>()) {}
+MeshHandle::~MeshHandle() = default;
+MeshHandle::MeshHandle(MeshHandle const& other) : p_impl(std::make_unique<impl>(*other.p_impl)) {}
+MeshHandle& MeshHandle::operator=(MeshHandle const& other) {
+    *p_impl = *other.p_impl;
+    return *this;
+}
+bool MeshHandle::exists() const { return p_impl->exists; }
+void MeshHandle::unload() { p_impl->exists = false; }
+
+struct ShaderHandle::impl {};
+
+ShaderHandle::ShaderHandle() : p_impl(std::make_unique<impl>()) {}
+ShaderHandle::~ShaderHandle() = default;
+ShaderHandle::ShaderHandle(ShaderHandle const&) : p_impl(std::make_unique<impl>()) {}
+ShaderHandle& ShaderHandle::operator=(ShaderHandle const&) { return *this; }
+
+struct MeshBuilder::impl {
+    common::VertexBuffer result;
+};
+
+MeshBuilder::MeshBuilder() : p_impl(std::make_unique<impl>()) {}
+MeshBuilder::~MeshBuilder() = default;
+MeshBuilder::MeshBuilder(MeshBuilder const& other) :
+    p_impl(std::make_unique<impl>(*other.p_impl)) {}
+MeshBuilder& MeshBuilder::operator=(MeshBuilder const& other) {
+    *p_impl = *other.p_impl;
+    return *this;
+}
+
+void MeshBuilder::add_sprite(sprites::Sprite const& spr,
+                             anton::math::Vector3 offset,
+                             float vertical_slope,
+                             float horizontal_slope,
+                             float z_min,
+                             float z_max) {
+    common::append_sprite_vertices(
+        p_impl->result, spr, {offset, vertical_slope, horizontal_slope, z_min, z_max});
+}
+
+void MeshBuilder::add_repeating_sprite(sprites::Sprite const& spr,
+                                       anton::math::Vector2 repeat,
+                                       anton::math::Vector3 offset,
+                                       float vertical_slope,
+                                       float horizontal_slope,
+                                       float z_min,
+                                       float z_max) {
+    common::append_repeating_sprite_vertices(
+        p_impl->result, spr, repeat, {offset, vertical_slope, horizontal_slope, z_min, z_max});
+}
+
+std::vector<MeshRegionWriter>
+MeshBuilder::reserve_regions(std::vector<usize> const& piece_counts) {
+    return common::reserve_regions(p_impl->result, piece_counts);
+}
+
+MeshHandle MeshBuilder::finish() const {
+    tests::finished_meshes.push_back(p_impl->result);
+    p_impl->result.clear();
+    MeshHandle mesh;
+    mesh.p_impl->exists = true;
+    return mesh;
+}
+
+} // namespace aryibi::renderer
+
+namespace std {
+
+size_t hash<aryibi::renderer::TextureHandle>::operator()(
+    aryibi::renderer::TextureHandle const& tex) const noexcept {
+    return tex.p_impl->id;
+}
+
+} // namespace std
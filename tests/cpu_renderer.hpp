@@ -0,0 +1,18 @@
+#ifndef ARYIBI_TESTS_CPU_RENDERER_HPP
+#define ARYIBI_TESTS_CPU_RENDERER_HPP
+
+#include "renderer/common/mesh_kernels.hpp"
+
+#include <vector>
+
+/// The tests run the CPU side of the library without a GPU, linking cpu_renderer.cpp instead of a
+/// backend. It implements the renderer handles that side uses: Textures only remember their size,
+/// and meshes only their vertices.
+namespace aryibi::tests {
+
+/// The vertices of every mesh finished with a MeshBuilder, in the order they were finished.
+inline std::vector<renderer::common::VertexBuffer> finished_meshes;
+
+} // namespace aryibi::tests
+
+#endif // ARYIBI_TESTS_CPU_RENDERER_HPP
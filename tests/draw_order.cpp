@@ -0,0 +1,74 @@
+// The draw sorter must order commands exactly like a stable sort by key would, no matter which
+// bits of the keys differ, and transparent commands must keep their submission order.
+
+#include "check.hpp"
+
+#include "renderer/common/draw_order.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+using namespace aryibi::renderer;
+using namespace anton;
+
+namespace {
+
+/// Sorts keys with the sorter and with std::stable_sort, and checks that both agree.
+void check_matches_stable_sort(std::vector<u64> const& keys) {
+    common::DrawSorter sorter;
+    for (u32 i = 0; i < keys.size(); ++i) { sorter.add(i, keys[i]); }
+    sorter.sort();
+
+    std::vector<u32> expected(keys.size());
+    std::iota(expected.begin(), expected.end(), 0);
+    std::stable_sort(expected.begin(), expected.end(),
+                     [&keys](u32 a, u32 b) { return keys[a] < keys[b]; });
+    ARYIBI_CHECK(sorter.order() == expected);
+}
+
+void test_matches_stable_sort() {
+    std::mt19937_64 rng(1);
+    // Which bits of the keys vary: None, all of them, only the top or the bottom ones, and sparse
+    // ones like the fields of real sort keys.
+    const u64 masks[] = {0,
+                         ~u64(0),
+                         0xFF00'0000'0000'0000,
+                         0x0000'0000'0000'0007,
+                         0x8000'0000'0000'0001,
+                         0x0001'F000'0F00'00F0,
+                         0x5555'5555'5555'5555};
+    for (const u64 mask : masks) {
+        for (const std::size_t count : {0, 1, 2, 100, 5000}) {
+            const u64 base = rng();
+            std::vector<u64> keys(count);
+            // Few distinct values, so that there are plenty of equal keys.
+            for (u64& key : keys) { key = (base & ~mask) | (rng() & rng() & mask); }
+            check_matches_stable_sort(keys);
+        }
+    }
+}
+
+void test_transparent_keeps_submission_order() {
+    common::DrawSorter sorter;
+    // Transparent commands at the same depth with different state, then opaque ones.
+    for (u32 i = 0; i < 8; ++i) {
+        sorter.add(i, common::make_sort_key(common::DrawPass::color, true, 100, 7 - i, i * 3,
+                                            i % 2));
+    }
+    for (u32 i = 8; i < 16; ++i) {
+        sorter.add(i, common::make_sort_key(common::DrawPass::color, false, 100, i % 2, 0, 0));
+    }
+    sorter.sort();
+
+    const std::vector<u32> expected{8, 10, 12, 14, 9, 11, 13, 15, 0, 1, 2, 3, 4, 5, 6, 7};
+    ARYIBI_CHECK(sorter.order() == expected);
+}
+
+} // namespace
+
+int main() {
+    test_matches_stable_sort();
+    test_transparent_keeps_submission_order();
+    return aryibi::tests::result();
+}
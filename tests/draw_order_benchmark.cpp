@@ -0,0 +1,61 @@
+// How long sorting the color pass of a frame with 100k commands takes. Prints the time of each
+// scene, and checks that the sorted order is still right.
+
+#include "benchmark.hpp"
+#include "check.hpp"
+
+#include "renderer/common/draw_order.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <random>
+
+using namespace aryibi::renderer;
+using namespace anton;
+
+namespace {
+
+constexpr u32 command_count = 100'000;
+
+/// Commands at random distances, a tenth of them transparent, using random states out of the
+/// given amounts.
+std::vector<u64> make_keys(u32 shaders, u32 textures, u32 mesh_buffers) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> distance(0, 20);
+    std::vector<u64> keys(command_count);
+    for (u64& key : keys) {
+        const bool transparent = rng() % 10 == 0;
+        key = common::make_sort_key(common::DrawPass::color, transparent,
+                                    common::depth_bucket(distance(rng), 0, 20, transparent),
+                                    rng() % shaders, rng() % textures, rng() % mesh_buffers);
+    }
+    return keys;
+}
+
+void benchmark_scene(char const* name, std::vector<u64> const& keys) {
+    common::DrawSorter sorter;
+    const double ms = aryibi::tests::best_time_ms(
+        20,
+        [&] {
+            sorter.clear();
+            for (u32 i = 0; i < keys.size(); ++i) { sorter.add(i, keys[i]); }
+        },
+        [&] { sorter.sort(); });
+    std::printf("%-40s %zu commands sorted in %.3f ms\n", name, keys.size(), ms);
+
+    std::vector<u32> expected(keys.size());
+    std::iota(expected.begin(), expected.end(), 0);
+    std::stable_sort(expected.begin(), expected.end(),
+                     [&keys](u32 a, u32 b) { return keys[a] < keys[b]; });
+    ARYIBI_CHECK(sorter.order() == expected);
+}
+
+} // namespace
+
+int main() {
+    // Static meshes share a few vertex buffers, and textures are usually atlases.
+    benchmark_scene("3 shaders, 16 textures, 8 buffers:", make_keys(3, 16, 8));
+    benchmark_scene("4 shaders, 256 textures, 1024 buffers:", make_keys(4, 256, 1024));
+    return aryibi::tests::result();
+}
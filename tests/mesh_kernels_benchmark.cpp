@@ -0,0 +1,174 @@
+// How long writing the vertices of a tile chunk takes, with every tile made of 4 minitiles like
+// autotiles are. Compares the shared kernel against the per-piece scalar code that
+// MeshBuilder::add_sprite() used before it, prints both times, and checks that the kernel writes
+// exactly what the documented vertex layout says. A 64x64 chunk fits in the caches, while the
+// vertices of a 256x256 one are about 29MiB, so writing them out to memory takes a big part of the
+// time of both versions.
+
+#include "benchmark.hpp"
+#include "check.hpp"
+
+#include "aryibi/sprites.hpp"
+#include "renderer/common/mesh_kernels.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+using namespace aryibi;
+using namespace anton;
+namespace common = aryibi::renderer::common;
+namespace aml = anton::math;
+
+namespace {
+
+constexpr std::size_t pieces_per_tile = 4;
+
+/// Tiles made of 4 minitiles with random sources, some of them flipped.
+std::vector<sprites::Sprite::Piece> make_tiles(std::size_t tile_count) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uv(0, 1);
+    std::vector<sprites::Sprite::Piece> pieces;
+    for (std::size_t tile = 0; tile < tile_count; ++tile) {
+        for (std::size_t i = 0; i < pieces_per_tile; ++i) {
+            const aml::Vector2 start{(i % 2) * .5f, (i / 2) * .5f};
+            const sprites::Rect2D source{{uv(rng), uv(rng)}, {uv(rng), uv(rng)}};
+            pieces.push_back({source, {start, start + aml::Vector2{.5f, .5f}}});
+        }
+    }
+    return pieces;
+}
+
+/// Where each tile of a chunk goes, with the slopes and Z range of a tilemap layer.
+common::SpriteVertexParams tile_params(u32 chunk_size, u32 tile) {
+    return {{float(tile % chunk_size), float(tile / chunk_size), 2}, .3f, .1f, -1.f, 1.f};
+}
+
+/// The vertices of a piece as described in mesh_kernels.hpp, written one float at a time.
+void write_expected(sprites::Sprite::Piece const& piece,
+                    common::SpriteVertexParams const& params,
+                    float* out) {
+    const auto z = [&params](float x, float y) {
+        return std::clamp(x * params.horizontal_slope, params.z_min, params.z_max) +
+               std::clamp(y * params.vertical_slope, params.z_min, params.z_max) + params.offset.z;
+    };
+    const sprites::Rect2D& src = piece.source;
+    const sprites::Rect2D& dst = piece.destination;
+    const float vertices[common::vertices_per_quad][5] = {
+        {dst.start.x, dst.start.y, z(dst.start.x, dst.start.y), src.start.x, src.end.y},
+        {dst.end.x, dst.start.y, z(dst.end.x, dst.start.y), src.end.x, src.end.y},
+        {dst.start.x, dst.end.y, z(dst.start.x, dst.end.y), src.start.x, src.start.y},
+        {dst.end.x, dst.end.y, z(dst.end.x, dst.end.y), src.end.x, src.start.y}};
+    for (std::size_t i = 0; i < common::vertices_per_quad; ++i) {
+        float* const vertex = out + i * common::floats_per_vertex;
+        std::copy(vertices[i], vertices[i] + 5, vertex);
+        vertex[0] += params.offset.x;
+        vertex[1] += params.offset.y;
+        // An empty tile rect.
+        vertex[common::tile_rect_slot] = 0;
+        vertex[common::tile_rect_slot + 1] = 0;
+    }
+}
+
+/// What MeshBuilder::add_sprite() did before the shared kernel: Resize a zero-filled vector and
+/// write 6 vertices of 5 floats per piece.
+void add_sprite_scalar(std::vector<float>& result,
+                       sprites::Sprite::Piece const* pieces,
+                       std::size_t count,
+                       common::SpriteVertexParams const& params) {
+    constexpr std::size_t sizeof_quad = 30;
+    const auto add_piece = [&](sprites::Sprite::Piece const& piece, std::size_t base_n) {
+        const auto clamp = [&](float x) { return std::clamp(x, params.z_min, params.z_max); };
+        const sprites::Rect2D& dst = piece.destination;
+        const aml::Vector2 offset{params.offset.x, params.offset.y};
+        const sprites::Rect2D pos_rect{dst.start + offset, dst.end + offset};
+        const sprites::Rect2D uv_rect = piece.source;
+        const sprites::Rect2D z_map{{clamp(dst.start.x * params.horizontal_slope),
+                                     clamp(dst.start.y * params.vertical_slope)},
+                                    {clamp(dst.end.x * params.horizontal_slope),
+                                     clamp(dst.end.y * params.vertical_slope)}};
+        const float corners[6][5] = {
+            {pos_rect.start.x, pos_rect.start.y, z_map.start.x + z_map.start.y, uv_rect.start.x,
+             uv_rect.end.y},
+            {pos_rect.end.x, pos_rect.start.y, z_map.end.x + z_map.start.y, uv_rect.end.x,
+             uv_rect.end.y},
+            {pos_rect.start.x, pos_rect.end.y, z_map.start.x + z_map.end.y, uv_rect.start.x,
+             uv_rect.start.y},
+            {pos_rect.end.x, pos_rect.start.y, z_map.end.x + z_map.start.y, uv_rect.end.x,
+             uv_rect.end.y},
+            {pos_rect.end.x, pos_rect.end.y, z_map.end.x + z_map.end.y, uv_rect.end.x,
+             uv_rect.start.y},
+            {pos_rect.start.x, pos_rect.end.y, z_map.start.x + z_map.end.y, uv_rect.start.x,
+             uv_rect.start.y}};
+        for (std::size_t i = 0; i < 6; ++i) {
+            result[base_n + i * 5 + 0] = corners[i][0];
+            result[base_n + i * 5 + 1] = corners[i][1];
+            result[base_n + i * 5 + 2] = corners[i][2] + params.offset.z;
+            result[base_n + i * 5 + 3] = corners[i][3];
+            result[base_n + i * 5 + 4] = corners[i][4];
+        }
+    };
+    const auto prev_size = result.size();
+    result.resize(prev_size + count * sizeof_quad);
+    for (std::size_t i = 0; i < count; ++i) { add_piece(pieces[i], prev_size + i * sizeof_quad); }
+}
+
+void test_matches_vertex_layout() {
+    const auto pieces = make_tiles(3);
+    // Every count up to a few tiles, so that the pieces left over by the vectorized loop are
+    // written too.
+    for (std::size_t count = 0; count <= pieces.size(); ++count) {
+        const common::SpriteVertexParams params = tile_params(2, static_cast<u32>(count));
+        std::vector<float> written(count * common::floats_per_quad + 1, -1.f);
+        std::vector<float> expected(written.size(), -1.f);
+        common::write_sprite_vertices(pieces.data(), count, params, written.data());
+        for (std::size_t i = 0; i < count; ++i) {
+            write_expected(pieces[i], params, expected.data() + i * common::floats_per_quad);
+        }
+        // Compares the bits, so that the tile rects must be exactly zero.
+        ARYIBI_CHECK(std::memcmp(written.data(), expected.data(), written.size() * sizeof(float)) ==
+                     0);
+    }
+}
+
+void benchmark_chunk(u32 chunk_size) {
+    const std::size_t tile_count = chunk_size * chunk_size;
+    const auto pieces = make_tiles(tile_count);
+
+    std::vector<float> scalar_result;
+    const double scalar_ms = tests::best_time_ms(
+        10, [&] { scalar_result.clear(); },
+        [&] {
+            for (u32 tile = 0; tile < tile_count; ++tile) {
+                add_sprite_scalar(scalar_result, pieces.data() + tile * pieces_per_tile,
+                                  pieces_per_tile, tile_params(chunk_size, tile));
+            }
+        });
+
+    common::VertexBuffer kernel_result;
+    const double kernel_ms = tests::best_time_ms(
+        10, [&] { kernel_result.clear(); },
+        [&] {
+            for (u32 tile = 0; tile < tile_count; ++tile) {
+                common::write_sprite_vertices(
+                    pieces.data() + tile * pieces_per_tile, pieces_per_tile,
+                    tile_params(chunk_size, tile),
+                    common::append_uninitialized_quads(kernel_result, pieces_per_tile));
+            }
+        });
+
+    std::printf("%ux%u tiles, %zu pieces:\n", chunk_size, chunk_size, pieces.size());
+    std::printf("  scalar add_sprite:     %.3f ms\n", scalar_ms);
+    std::printf("  write_sprite_vertices: %.3f ms (%.2fx)\n", kernel_ms, scalar_ms / kernel_ms);
+    ARYIBI_CHECK(kernel_result.size() == pieces.size() * common::floats_per_quad);
+}
+
+} // namespace
+
+int main() {
+    test_matches_vertex_layout();
+    benchmark_chunk(64);
+    benchmark_chunk(256);
+    return tests::result();
+}
@@ -0,0 +1,207 @@
+// How much each shadow filter costs to shade a screen of fragments lit by several lights. The
+// filtering of the shaded_tile shaders is ported to the CPU, sampling a shadow atlas like the
+// samplers of the Vulkan renderer do, and run for every fragment and light. Prints how many atlas
+// texels each filter reads per fragment and how long it took, which is what the filter adds to the
+// fill rate cost of lit tiles. Also checks that every filter agrees on fully lit and fully
+// shadowed areas.
+
+#include "benchmark.hpp"
+#include "check.hpp"
+
+#include "aryibi/renderer.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+using namespace aryibi;
+using namespace anton;
+using renderer::ShadowFilter;
+
+namespace {
+
+constexpr u32 atlas_size = 1024;
+/// Every light has a tile this big in the atlas.
+constexpr u32 light_tile_size = 256;
+constexpr u32 view_width = 480;
+constexpr u32 view_height = 270;
+constexpr u32 lights_per_fragment = 4;
+/// Same as in the shaders.
+constexpr float filter_radius = 10;
+constexpr float bias = .0005f;
+
+/// Same as in the shaders.
+constexpr std::array<std::array<float, 2>, 8> poisson_disk = {{{-0.94201624f, -0.39906216f},
+                                                               {0.94558609f, -0.76890725f},
+                                                               {-0.09418410f, -0.92938870f},
+                                                               {0.34495938f, 0.29387760f},
+                                                               {-0.91588581f, 0.45771432f},
+                                                               {-0.81544232f, -0.87912464f},
+                                                               {-0.38277543f, 0.27676845f},
+                                                               {0.97484398f, 0.75648379f}}};
+
+/// A shadow atlas, with a counter of how many texels were read from it.
+struct Atlas {
+    std::vector<float> depths;
+    mutable u64 texel_reads = 0;
+
+    float texel(i64 x, i64 y) const {
+        ++texel_reads;
+        // Repeat addressing, like the samplers of the Vulkan renderer. The size is a power of two.
+        constexpr i64 wrap = atlas_size - 1;
+        return depths[static_cast<usize>((x & wrap) + (y & wrap) * atlas_size)];
+    }
+    /// Like textureLod() with the depth sampler (Nearest filtering).
+    float sample(float u, float v) const {
+        return texel(static_cast<i64>(std::floor(u * atlas_size)),
+                     static_cast<i64>(std::floor(v * atlas_size)));
+    }
+    /// Like textureLod() with the depth comparison sampler: Compares the 4 nearest texels and
+    /// filters the results linearly. 1 if lit, 0 if shadowed.
+    float sample_compare(float u, float v, float depth) const {
+        const float x = u * atlas_size - .5f;
+        const float y = v * atlas_size - .5f;
+        const float x0 = std::floor(x);
+        const float y0 = std::floor(y);
+        const float fx = x - x0;
+        const float fy = y - y0;
+        const auto lit = [&](float tx, float ty) {
+            return depth <= texel(static_cast<i64>(tx), static_cast<i64>(ty)) ? 1.f : 0.f;
+        };
+        return (lit(x0, y0) * (1 - fx) + lit(x0 + 1, y0) * fx) * (1 - fy) +
+               (lit(x0, y0 + 1) * (1 - fx) + lit(x0 + 1, y0 + 1) * fx) * fy;
+    }
+};
+
+/// ShadowCalculation() from shaded_tile.frag, from the projected coordinates on. Returns how much
+/// of the light is blocked.
+float shadow(Atlas const& atlas,
+             ShadowFilter filter,
+             float u,
+             float v,
+             float depth,
+             float frag_x,
+             float frag_y) {
+    if (filter == ShadowFilter::off)
+        return 0;
+    if (filter == ShadowFilter::hardware_pcf)
+        return 1 - atlas.sample_compare(u, v, depth - bias);
+
+    constexpr float texel_size = 1.f / atlas_size;
+    float blocked = 0;
+    if (filter == ShadowFilter::grid_25) {
+        for (int x = -2; x <= 2; ++x) {
+            for (int y = -2; y <= 2; ++y) {
+                const float offset = texel_size * filter_radius / 2;
+                blocked += depth - bias > atlas.sample(u + x * offset, v + y * offset) ? 1 : 0;
+            }
+        }
+        return blocked / 25;
+    }
+
+    const auto fract = [](float x) { return x - std::floor(x); };
+    const float angle =
+        6.2831853f * fract(52.9829189f * fract(frag_x * 0.06711056f + frag_y * 0.00583715f));
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    const int sample_count = filter == ShadowFilter::poisson_4 ? 4 : 8;
+    for (int i = 0; i < sample_count; ++i) {
+        const float px = poisson_disk[i][0];
+        const float py = poisson_disk[i][1];
+        // mat2(c, s, -s, c) * p, with GLSL's column-major order.
+        const float ox = (c * px - s * py) * texel_size * filter_radius;
+        const float oy = (s * px + c * py) * texel_size * filter_radius;
+        blocked += depth - bias > atlas.sample(u + ox, v + oy) ? 1 : 0;
+    }
+    return blocked / sample_count;
+}
+
+/// An atlas with a tile per light, each of them with a grid of square occluders in front of a
+/// far background.
+Atlas make_atlas() {
+    Atlas atlas;
+    atlas.depths.resize(atlas_size * atlas_size);
+    for (u32 y = 0; y < atlas_size; ++y) {
+        for (u32 x = 0; x < atlas_size; ++x) {
+            const bool occluder = (x / 32) % 2 == 0 && (y / 32) % 2 == 0;
+            atlas.depths[x + y * atlas_size] = occluder ? .25f : 1.f;
+        }
+    }
+    return atlas;
+}
+
+/// Shades every fragment of the view with every light, and returns the total of the shadows so
+/// that nothing can be skipped.
+float shade_view(Atlas const& atlas, ShadowFilter filter) {
+    constexpr float tile_uv = float(light_tile_size) / atlas_size;
+    float total = 0;
+    for (u32 y = 0; y < view_height; ++y) {
+        for (u32 x = 0; x < view_width; ++x) {
+            for (u32 light = 0; light < lights_per_fragment; ++light) {
+                // Each light projects the view onto its own tile of the atlas.
+                const float u = light * tile_uv + (x + .5f) / view_width * tile_uv;
+                const float v = (y + .5f) / view_height * tile_uv;
+                total += shadow(atlas, filter, u, v, .5f, x + .5f, y + .5f);
+            }
+        }
+    }
+    return total;
+}
+
+void test_filters_agree_away_from_edges() {
+    const Atlas atlas = make_atlas();
+    // The middle of an occluder square and of the background around them, further than the
+    // filter radius from any edge.
+    const float shadowed_uv = 16.f / atlas_size;
+    const float lit_uv = 48.f / atlas_size;
+    for (const ShadowFilter filter : {ShadowFilter::hardware_pcf, ShadowFilter::poisson_4,
+                                      ShadowFilter::poisson_8, ShadowFilter::grid_25}) {
+        ARYIBI_CHECK(shadow(atlas, filter, shadowed_uv, shadowed_uv, .5f, 3, 7) == 1);
+        ARYIBI_CHECK(shadow(atlas, filter, lit_uv, lit_uv, .5f, 3, 7) == 0);
+    }
+    ARYIBI_CHECK(shadow(atlas, ShadowFilter::off, shadowed_uv, shadowed_uv, .5f, 3, 7) == 0);
+}
+
+void benchmark_filters() {
+    const Atlas atlas = make_atlas();
+    struct Tier {
+        ShadowFilter filter;
+        const char* name;
+        /// How many atlas texels the filter reads per light.
+        u64 texels;
+    };
+    const Tier tiers[] = {{ShadowFilter::off, "off", 0},
+                          {ShadowFilter::hardware_pcf, "hardware_pcf", 4},
+                          {ShadowFilter::poisson_4, "poisson_4", 4},
+                          {ShadowFilter::poisson_8, "poisson_8", 8},
+                          {ShadowFilter::grid_25, "grid_25", 25}};
+    constexpr u64 fragments = u64(view_width) * view_height;
+
+    std::printf("%ux%u fragments, %u lights each:\n", view_width, view_height,
+                lights_per_fragment);
+    double grid_25_ms = 0;
+    for (auto it = std::rbegin(tiers); it != std::rend(tiers); ++it) {
+        float total = 0;
+        atlas.texel_reads = 0;
+        const double ms = tests::best_time_ms(5, [&] { total = shade_view(atlas, it->filter); });
+        const u64 reads_per_fragment = atlas.texel_reads / 5 / fragments;
+        if (it->filter == ShadowFilter::grid_25)
+            grid_25_ms = ms;
+        std::printf("  %-12s %3llu texels per fragment, %8.3f ms (%.1fx vs grid_25)\n",
+                    it->name, static_cast<unsigned long long>(reads_per_fragment), ms,
+                    grid_25_ms / ms);
+        ARYIBI_CHECK(reads_per_fragment == it->texels * lights_per_fragment);
+        // Part of the view is always in shadow, unless shadows are off.
+        ARYIBI_CHECK((total > 0) == (it->filter != ShadowFilter::off));
+    }
+}
+
+} // namespace
+
+int main() {
+    test_filters_agree_away_from_edges();
+    benchmark_filters();
+    return tests::result();
+}
@@ -0,0 +1,119 @@
+// Solving and composing sprites into sprites that are reused must never allocate once their piece
+// storage is big enough, since games do it for thousands of sprites every frame.
+
+#include "check.hpp"
+
+#include "aryibi/sprites.hpp"
+#include "aryibi/sprite_solvers.hpp"
+
+#include <cstdlib>
+#include <new>
+
+static std::size_t allocation_count = 0;
+
+void* operator new(std::size_t size) {
+    ++allocation_count;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+using namespace aryibi;
+using namespace aryibi::sprites;
+
+namespace {
+
+constexpr direction::Direction directions[] = {
+    direction::dir_down,     direction::dir_down_right, direction::dir_right,
+    direction::dir_up_right, direction::dir_up,         direction::dir_up_left,
+    direction::dir_left,     direction::dir_down_left};
+
+/// Solves a sprite with every solver and joins them all into composite, like a tilemap layer or a
+/// character made of several parts would.
+void solve_all(TextureChunk const& chunk, anton::u32 i, Sprite& solved, Sprite& composite) {
+    composite.texture = chunk.tex;
+    composite.pieces.clear();
+    solve_8_directional(chunk, directions[i % 8], {1, 1}, solved);
+    composite.join_pieces_from(solved.pieces, {0, 0});
+    solve_4_directional(chunk, directions[i % 8], {1, 1}, solved);
+    composite.join_pieces_from(solved.pieces, {1, 0});
+    solve_normal(chunk, {2, 2}, solved);
+    composite.join_pieces_from(solved.pieces, {2, 0});
+    solve_rpgmaker_a2(chunk, static_cast<anton::u8>(i), solved);
+    composite.join_pieces_from(solved.pieces, {0, 1});
+    solve_rpgmaker_a4_wall(chunk, static_cast<anton::u8>(i), solved);
+    composite.join_pieces_from(solved.pieces, {1, 1});
+    (void)composite.bounds();
+}
+
+void test_steady_state_doesnt_allocate() {
+    // No texture is created, since that needs a GPU. The solvers only read the size of the
+    // texture, which is left as is.
+    const TextureChunk chunk{renderer::TextureHandle(), {{0, 0}, {1, 1}}};
+    Sprite solved;
+    Sprite composite;
+    // The first round grows the piece storage of composite past its inline capacity.
+    for (anton::u32 i = 0; i < 256; ++i) { solve_all(chunk, i, solved, composite); }
+
+    allocation_count = 0;
+    for (anton::u32 i = 0; i < 256; ++i) { solve_all(chunk, i, solved, composite); }
+    ARYIBI_CHECK(allocation_count == 0);
+}
+
+void test_solving_few_pieces_doesnt_allocate() {
+    const TextureChunk chunk{renderer::TextureHandle(), {{0, 0}, {1, 1}}};
+    Sprite solved;
+    allocation_count = 0;
+    // Every solver makes 4 pieces at most, which fit inline even in a new sprite.
+    solve_rpgmaker_a2(chunk, 0xFF, solved);
+    solve_8_directional(chunk, direction::dir_up, {1, 1}, solved);
+    ARYIBI_CHECK(allocation_count == 0);
+}
+
+void test_returning_new_sprites_doesnt_allocate() {
+    const TextureChunk chunk{renderer::TextureHandle(), {{0, 0}, {1, 1}}};
+    allocation_count = 0;
+    // The pieces fit inline, and texture handles don't allocate either, so a new sprite can be
+    // returned without touching the heap.
+    const Sprite directional = solve_8_directional(chunk, direction::dir_up, {1, 1});
+    const Sprite normal = solve_normal(chunk, {1, 1});
+    const Sprite autotile = solve_rpgmaker_a2(chunk, Tile8Connections::from_mask(0x5A));
+    const Sprite wall = solve_rpgmaker_a4_wall(chunk, Tile4Connections::from_mask(0x3));
+    const Sprite copy = autotile;
+    ARYIBI_CHECK(allocation_count == 0);
+    ARYIBI_CHECK(directional.pieces.size() == 1 && normal.pieces.size() == 1);
+    ARYIBI_CHECK(copy.pieces.size() == 4 && wall.pieces.size() == 4);
+}
+
+void test_bounds_follow_piece_changes() {
+    Sprite sprite;
+    sprite.pieces.push_back({{{0, 0}, {1, 1}}, {{0, 0}, {4, 4}}});
+    ARYIBI_CHECK(sprite.bounds().end.x == 4 && sprite.bounds().end.y == 4);
+
+    // Replacing the pieces without changing their amount must be noticed too.
+    sprite.pieces.clear();
+    sprite.pieces.push_back({{{0, 0}, {1, 1}}, {{-1, 0}, {1, 2}}});
+    ARYIBI_CHECK(sprite.bounds().start.x == -1 && sprite.bounds().end.x == 1);
+    ARYIBI_CHECK(sprite.bounds().end.y == 2);
+
+    sprite.pieces[0].destination.end = {3, 3};
+    ARYIBI_CHECK(sprite.bounds().end.x == 3 && sprite.bounds().end.y == 3);
+
+    sprite.join_pieces_from(sprite.pieces, {10, 0});
+    ARYIBI_CHECK(sprite.bounds().start.x == -1 && sprite.bounds().end.x == 13);
+}
+
+} // namespace
+
+int main() {
+    test_steady_state_doesnt_allocate();
+    test_solving_few_pieces_doesnt_allocate();
+    test_returning_new_sprites_doesnt_allocate();
+    test_bounds_follow_piece_changes();
+    return tests::result();
+}
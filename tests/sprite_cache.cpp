@@ -0,0 +1,113 @@
+// The sprite cache must return the same sprite for lookups with the same solver, texture, rect and
+// parameters, solve a new one when any of them differ, and forget the sprites of a texture once
+// it's invalidated, without breaking the references handed out before.
+
+#include "check.hpp"
+
+#include "aryibi/sprite_cache.hpp"
+#include "aryibi/sprite_solvers.hpp"
+
+using namespace aryibi;
+using namespace aryibi::sprites;
+
+namespace {
+
+renderer::TextureHandle make_texture() {
+    renderer::TextureHandle tex;
+    tex.init(64, 64, renderer::TextureHandle::ColorType::rgba,
+             renderer::TextureHandle::FilteringMethod::point);
+    return tex;
+}
+
+void test_same_lookup_hits() {
+    const TextureChunk chunk = TextureChunk::full(make_texture());
+    SpriteCache cache;
+    const SpriteCache::SpriteRef first = cache.get_rpgmaker_a2(chunk, 0x5A);
+    const SpriteCache::SpriteRef second = cache.get_rpgmaker_a2(chunk, 0x5A);
+    ARYIBI_CHECK(first == second);
+    // The other overloads share the entries of the masks they stand for.
+    ARYIBI_CHECK(cache.get_rpgmaker_a2(chunk, Tile8Connections::from_mask(0x5A)) == first);
+    // Only the low 4 bits of A4 wall masks are connections.
+    const SpriteCache::SpriteRef wall = cache.get_rpgmaker_a4_wall(chunk, 0x03);
+    ARYIBI_CHECK(cache.get_rpgmaker_a4_wall(chunk, 0xF3) == wall);
+    ARYIBI_CHECK(cache.get_rpgmaker_a4_wall(chunk, Tile4Connections::from_mask(0x3)) == wall);
+
+    const SpriteCache::Stats stats = cache.stats();
+    ARYIBI_CHECK(stats.hits == 4 && stats.misses == 2 && stats.entries == 2);
+    ARYIBI_CHECK(stats.hit_rate() == 4.f / 6.f);
+
+    // The cached sprite is the one the solver gives.
+    const Sprite solved = solve_rpgmaker_a2(chunk, 0x5A);
+    ARYIBI_CHECK(first->texture == chunk.tex && first->pieces.size() == solved.pieces.size());
+    for (std::size_t i = 0; i < solved.pieces.size(); ++i) {
+        ARYIBI_CHECK(first->pieces[i].source.start.x == solved.pieces[i].source.start.x &&
+                     first->pieces[i].source.end.y == solved.pieces[i].source.end.y);
+    }
+}
+
+void test_different_lookups_miss() {
+    const renderer::TextureHandle texture = make_texture();
+    const renderer::TextureHandle other_texture = make_texture();
+    const TextureChunk chunk{texture, {{0, 0}, {.5f, .5f}}};
+    SpriteCache cache;
+    const SpriteCache::SpriteRef base = cache.get_8_directional(chunk, direction::dir_up, {1, 1});
+
+    // Changing any part of the key must solve a new sprite.
+    const SpriteCache::SpriteRef others[] = {
+        cache.get_8_directional(chunk, direction::dir_left, {1, 1}),
+        cache.get_8_directional(chunk, direction::dir_up, {2, 1}),
+        cache.get_8_directional({texture, {{0, 0}, {.5f, 1}}}, direction::dir_up, {1, 1}),
+        cache.get_8_directional({other_texture, chunk.rect}, direction::dir_up, {1, 1}),
+        cache.get_4_directional(chunk, direction::dir_up, {1, 1}),
+        cache.get_normal(chunk, {1, 1})};
+    for (SpriteCache::SpriteRef const& other : others) { ARYIBI_CHECK(other != base); }
+
+    const SpriteCache::Stats stats = cache.stats();
+    ARYIBI_CHECK(stats.hits == 0 && stats.misses == 7 && stats.entries == 7);
+    ARYIBI_CHECK(stats.hit_rate() == 0);
+}
+
+void test_invalidate_evicts_only_that_texture() {
+    const renderer::TextureHandle texture = make_texture();
+    const renderer::TextureHandle other_texture = make_texture();
+    SpriteCache cache;
+    const SpriteCache::SpriteRef evicted = cache.get_normal(TextureChunk::full(texture), {1, 1});
+    (void)cache.get_rpgmaker_a2(TextureChunk::full(texture), 0xFF);
+    const SpriteCache::SpriteRef kept = cache.get_normal(TextureChunk::full(other_texture), {1, 1});
+    const std::size_t memory_before = cache.stats().memory_used;
+
+    cache.invalidate(texture);
+    ARYIBI_CHECK(cache.stats().entries == 1);
+    ARYIBI_CHECK(cache.stats().memory_used < memory_before);
+    // References handed out before stay valid.
+    ARYIBI_CHECK(evicted->pieces.size() == 1 && evicted->texture == texture);
+
+    cache.reset_stats();
+    // Evicted sprites are solved again, the rest are still there.
+    ARYIBI_CHECK(cache.get_normal(TextureChunk::full(texture), {1, 1}) != evicted);
+    ARYIBI_CHECK(cache.get_normal(TextureChunk::full(other_texture), {1, 1}) == kept);
+    ARYIBI_CHECK(cache.stats().hits == 1 && cache.stats().misses == 1);
+}
+
+void test_clear_evicts_everything() {
+    const TextureChunk chunk = TextureChunk::full(make_texture());
+    SpriteCache cache;
+    const SpriteCache::SpriteRef before = cache.get_normal(chunk, {1, 1});
+    (void)cache.get_normal(chunk, {1, 1});
+    cache.clear();
+    ARYIBI_CHECK(cache.stats().entries == 0);
+    // Clearing doesn't reset the counters.
+    ARYIBI_CHECK(cache.stats().hits == 1 && cache.stats().misses == 1);
+    ARYIBI_CHECK(cache.get_normal(chunk, {1, 1}) != before);
+    ARYIBI_CHECK(cache.stats().misses == 2);
+}
+
+} // namespace
+
+int main() {
+    test_same_lookup_hits();
+    test_different_lookups_miss();
+    test_invalidate_evicts_only_that_texture();
+    test_clear_evicts_everything();
+    return tests::result();
+}
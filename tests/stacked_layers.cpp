@@ -0,0 +1,162 @@
+// A scene of fully covered tilemap layers stacked over each other, the worst case for fill rate.
+// The chunks are sorted like the color pass of the renderers sorts them, then rasterized on the
+// CPU with a depth test to count how many fragments would be shaded: Opaque commands must shade
+// each sample once, while transparent ones (The default) shade every layer. Prints both counts and
+// how long sorting the commands took.
+
+#include "check.hpp"
+#include "cpu_renderer.hpp"
+
+#include "aryibi/renderer.hpp"
+#include "aryibi/tilemap.hpp"
+#include "renderer/common/draw_order.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+using namespace aryibi;
+namespace common = aryibi::renderer::common;
+
+namespace {
+
+constexpr anton::u32 layer_count = 6;
+constexpr anton::u32 layer_size = 64;
+constexpr anton::u32 samples_per_tile = 4;
+constexpr float camera_z = 10;
+/// Same as the range of the OpenGL renderer.
+constexpr float camera_near = 0;
+constexpr float camera_far = 20;
+
+struct Command {
+    common::VertexBuffer const* vertices;
+    anton::math::Vector3 position;
+    bool transparent;
+};
+
+/// Builds every layer, one above the other. Each chunk of each layer becomes a command.
+std::vector<Command> build_scene(renderer::TextureHandle const& tileset, bool transparent) {
+    tilemap::TileMapLayer::Settings settings;
+    settings.width = layer_size;
+    settings.height = layer_size;
+    settings.chunk_size = 16;
+    settings.texture = tileset;
+    // Tiles that don't repeat, so that each one is a quad.
+    for (anton::u32 i = 0; i < 4; ++i) {
+        const float start = i / 4.f;
+        settings.tile_types.push_back(
+            {{tileset, {{start, 0}, {start + .25f, .25f}}}, tilemap::TileKind::normal});
+    }
+    settings.merge_repeating_tiles = false;
+
+    tests::finished_meshes.clear();
+    // Commands point into it, so it must not reallocate.
+    const anton::u32 chunks_per_side = layer_size / settings.chunk_size;
+    tests::finished_meshes.reserve(layer_count * chunks_per_side * chunks_per_side);
+    std::vector<Command> commands;
+    for (anton::u32 layer = 0; layer < layer_count; ++layer) {
+        tilemap::TileMapLayer tilemap(settings);
+        for (anton::u32 y = 0; y < layer_size; ++y) {
+            for (anton::u32 x = 0; x < layer_size; ++x) { tilemap.set_tile(x, y, (x + y) % 4); }
+        }
+        const std::size_t first_mesh = tests::finished_meshes.size();
+        tilemap.rebuild_dirty();
+        for (std::size_t i = 0; i < tilemap.chunks().size(); ++i) {
+            auto position = tilemap.chunks()[i].position;
+            position.z += layer * .5f;
+            commands.push_back({&tests::finished_meshes[first_mesh + i], position, transparent});
+        }
+    }
+    return commands;
+}
+
+/// Sorts the commands like the color pass does, returning the order to draw them in.
+std::vector<anton::u32> sort_commands(std::vector<Command> const& commands, double& sort_ms) {
+    common::DrawSorter sorter;
+    const auto start = std::chrono::steady_clock::now();
+    for (anton::u32 i = 0; i < commands.size(); ++i) {
+        const float distance = camera_z - commands[i].position.z;
+        // Every chunk uses the same shader and texture, but has its own vertex buffer.
+        sorter.add(i, common::make_sort_key(common::DrawPass::color, commands[i].transparent,
+                                            common::depth_bucket(distance, camera_near, camera_far,
+                                                                 commands[i].transparent),
+                                            1, 1, i));
+    }
+    sorter.sort();
+    sort_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                  .count();
+    return sorter.order();
+}
+
+/// Rasterizes the commands in order with an early depth test, and returns how many fragments pass
+/// it. Transparent commands don't write depth, so nothing behind them is rejected.
+std::size_t count_shaded_fragments(std::vector<Command> const& commands,
+                                   std::vector<anton::u32> const& order) {
+    constexpr anton::u32 image_size = layer_size * samples_per_tile;
+    std::vector<float> depth(image_size * image_size, std::numeric_limits<float>::max());
+    std::size_t shaded = 0;
+    for (const anton::u32 index : order) {
+        const Command& cmd = commands[index];
+        const auto& vertices = *cmd.vertices;
+        for (std::size_t quad = 0; quad < vertices.size() / common::floats_per_quad; ++quad) {
+            // The first and last vertex of a quad are opposite corners.
+            const float* first = vertices.data() + quad * common::floats_per_quad;
+            const float* last = first + 3 * common::floats_per_vertex;
+            const float distance = camera_z - (cmd.position.z + first[2]);
+            auto to_samples = [](float position) {
+                return static_cast<anton::u32>(position * samples_per_tile);
+            };
+            const anton::u32 start_x = to_samples(first[0] + cmd.position.x);
+            const anton::u32 start_y = to_samples(first[1] + cmd.position.y);
+            const anton::u32 end_x = to_samples(last[0] + cmd.position.x);
+            const anton::u32 end_y = to_samples(last[1] + cmd.position.y);
+            for (anton::u32 y = start_y; y < end_y; ++y) {
+                for (anton::u32 x = start_x; x < end_x; ++x) {
+                    float& sample_depth = depth[x + y * image_size];
+                    if (distance >= sample_depth)
+                        continue;
+                    ++shaded;
+                    if (!cmd.transparent)
+                        sample_depth = distance;
+                }
+            }
+        }
+    }
+    return shaded;
+}
+
+void test_opaque_layers_shade_each_sample_once() {
+    renderer::TextureHandle tileset;
+    tileset.init(64, 64, renderer::TextureHandle::ColorType::rgba,
+                 renderer::TextureHandle::FilteringMethod::point);
+    // DrawCmd::transparent defaults to true, so opaque commands must be asked for.
+    ARYIBI_CHECK(renderer::DrawCmd{}.transparent);
+
+    constexpr std::size_t sample_count =
+        layer_size * layer_size * samples_per_tile * samples_per_tile;
+    double opaque_sort_ms = 0;
+    double transparent_sort_ms = 0;
+    const auto opaque = build_scene(tileset, false);
+    const std::size_t opaque_shaded =
+        count_shaded_fragments(opaque, sort_commands(opaque, opaque_sort_ms));
+    const auto transparent = build_scene(tileset, true);
+    const std::size_t transparent_shaded =
+        count_shaded_fragments(transparent, sort_commands(transparent, transparent_sort_ms));
+
+    std::printf("%u stacked %ux%u layers, %zu commands:\n", layer_count, layer_size, layer_size,
+                opaque.size());
+    std::printf("  opaque:      %zu fragments shaded (%.2f per sample), sorted in %.3f ms\n",
+                opaque_shaded, double(opaque_shaded) / sample_count, opaque_sort_ms);
+    std::printf("  transparent: %zu fragments shaded (%.2f per sample), sorted in %.3f ms\n",
+                transparent_shaded, double(transparent_shaded) / sample_count,
+                transparent_sort_ms);
+    ARYIBI_CHECK(opaque_shaded == sample_count);
+    ARYIBI_CHECK(transparent_shaded == sample_count * layer_count);
+}
+
+} // namespace
+
+int main() {
+    test_opaque_layers_shade_each_sample_once();
+    return tests::result();
+}
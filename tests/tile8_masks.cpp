@@ -0,0 +1,89 @@
+// The connection masks computed for a whole rect of a grid at once must be the same as the ones
+// obtained by comparing every tile with each of its 8 neighbours, on random maps of sizes around
+// the width of the blocks the rect is split into, and for rects that don't cover the whole grid.
+
+#include "check.hpp"
+
+#include "aryibi/sprites.hpp"
+#include "aryibi/sprite_solvers.hpp"
+
+#include <random>
+#include <vector>
+
+using namespace aryibi;
+using namespace aryibi::sprites;
+using namespace anton;
+
+namespace {
+
+/// What every entry outside of the rect must keep.
+constexpr u8 untouched = 0xA5;
+
+/// The mask of a tile, found by comparing its ID with each neighbour.
+u8 scalar_tile8_mask(TileIDGrid const& grid, u32 x, u32 y) {
+    const auto connected = [&grid, x, y](i64 dx, i64 dy) {
+        const i64 nx = static_cast<i64>(x) + dx;
+        const i64 ny = static_cast<i64>(y) + dy;
+        if (nx < 0 || ny < 0 || nx >= grid.width || ny >= grid.height)
+            return false;
+        return grid.at(static_cast<u32>(nx), static_cast<u32>(ny)) == grid.at(x, y);
+    };
+    Tile8Connections connections;
+    connections.down = connected(0, -1);
+    connections.down_right = connected(1, -1);
+    connections.right = connected(1, 0);
+    connections.up_right = connected(1, 1);
+    connections.up = connected(0, 1);
+    connections.up_left = connected(-1, 1);
+    connections.left = connected(-1, 0);
+    connections.down_left = connected(-1, -1);
+    return connections.mask();
+}
+
+void check_rect(TileIDGrid const& grid, TileRect rect) {
+    std::vector<u8> masks(grid.width * grid.height, untouched);
+    compute_tile8_masks(grid, rect, masks.data());
+    for (u32 y = 0; y < grid.height; ++y) {
+        for (u32 x = 0; x < grid.width; ++x) {
+            const bool inside = x >= rect.x && x - rect.x < rect.width && y >= rect.y &&
+                                y - rect.y < rect.height;
+            const u8 expected = inside ? scalar_tile8_mask(grid, x, y) : untouched;
+            ARYIBI_CHECK(masks[x + y * grid.width] == expected);
+        }
+    }
+}
+
+void test_matches_scalar_masks() {
+    std::mt19937 rng(1);
+    // Widths that fit in a block, fill it exactly, cross into the next one, and span several.
+    const u32 widths[] = {1, 2, 7, 61, 62, 63, 64, 65, 124, 125, 200};
+    const u32 heights[] = {1, 2, 5, 33};
+    // Few distinct IDs, so that most tiles have some connections but not all of them.
+    for (const u32 id_count : {1u, 2u, 3u, 1000u}) {
+        std::uniform_int_distribution<u32> random_id(0, id_count - 1);
+        for (const u32 width : widths) {
+            for (const u32 height : heights) {
+                std::vector<u32> ids(width * height);
+                for (u32& id : ids) { id = random_id(rng); }
+                const TileIDGrid grid{ids.data(), width, height};
+
+                check_rect(grid, {0, 0, width, height});
+                std::uniform_int_distribution<u32> random_x(0, width - 1);
+                std::uniform_int_distribution<u32> random_y(0, height - 1);
+                for (int i = 0; i < 4; ++i) {
+                    const u32 x = random_x(rng);
+                    const u32 y = random_y(rng);
+                    // Some of the rects go past the edges of the grid, and must be clipped.
+                    check_rect(grid, {x, y, random_x(rng) + 1, random_y(rng) + 1});
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    test_matches_scalar_masks();
+    return tests::result();
+}
@@ -0,0 +1,173 @@
+// Merging tiles into repeating quads must not change what a layer looks like. Both versions of a
+// layer are rasterized on the CPU, sampling the tileset like the shaders do, and every sample must
+// land on the same texel of the tileset.
+
+#include "check.hpp"
+#include "cpu_renderer.hpp"
+
+#include "aryibi/tilemap.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace aryibi;
+namespace common = aryibi::renderer::common;
+
+namespace {
+
+constexpr anton::u32 tile_pixels = 16;
+constexpr anton::u32 tileset_tiles = 8;
+constexpr anton::u32 tileset_pixels = tile_pixels * tileset_tiles;
+/// A sample per texel.
+constexpr anton::u32 samples_per_tile = tile_pixels;
+/// Texel index + 1 of each sample, or 0 if nothing was drawn there. -1 if more than one quad was.
+using Image = std::vector<anton::i64>;
+
+struct Layer {
+    anton::u32 width;
+    anton::u32 height;
+    std::vector<anton::u32> tiles;
+};
+
+/// Same as tile_uv() in the shaders.
+float tile_uv(float uv, anton::u16 rect_start, anton::u16 rect_size) {
+    if (rect_size == 0)
+        return uv;
+    return rect_start / 65535.f + (uv - std::floor(uv)) * (rect_size / 65535.f);
+}
+
+/// Draws every quad of a chunk mesh into an image of the whole layer.
+void rasterize(common::VertexBuffer const& vertices,
+               anton::math::Vector3 chunk_position,
+               Layer const& layer,
+               Image& image) {
+    const anton::u32 image_width = layer.width * samples_per_tile;
+    for (std::size_t quad = 0; quad < vertices.size() / common::floats_per_quad; ++quad) {
+        // The first and last vertex of a quad are opposite corners (See write_piece_scalar()).
+        const float* first = vertices.data() + quad * common::floats_per_quad;
+        const float* last = first + 3 * common::floats_per_vertex;
+        anton::u16 rect[4];
+        std::memcpy(rect, first + common::tile_rect_slot, sizeof(rect));
+
+        const float start_x = (first[0] + chunk_position.x) * samples_per_tile;
+        const float start_y = (first[1] + chunk_position.y) * samples_per_tile;
+        const float end_x = (last[0] + chunk_position.x) * samples_per_tile;
+        const float end_y = (last[1] + chunk_position.y) * samples_per_tile;
+        for (auto y = static_cast<anton::u32>(start_y); y < end_y; ++y) {
+            for (auto x = static_cast<anton::u32>(start_x); x < end_x; ++x) {
+                // Sample at the center of each pixel, interpolating the UVs like the GPU would.
+                const float tx = (x + 0.5f - start_x) / (end_x - start_x);
+                const float ty = (y + 0.5f - start_y) / (end_y - start_y);
+                const float u = tile_uv(first[3] + (last[3] - first[3]) * tx, rect[0], rect[2]);
+                const float v = tile_uv(first[4] + (last[4] - first[4]) * ty, rect[1], rect[3]);
+                const auto texel_x = static_cast<anton::i64>(std::floor(u * tileset_pixels));
+                const auto texel_y = static_cast<anton::i64>(std::floor(v * tileset_pixels));
+
+                anton::i64& sample = image[x + y * image_width];
+                sample = sample == 0 ? texel_x + texel_y * tileset_pixels + 1 : -1;
+            }
+        }
+    }
+}
+
+/// Builds a tilemap layer with the given tiles and returns it rasterized, along with how many
+/// quads it was made of.
+Image draw_layer(Layer const& layer,
+                 std::vector<tilemap::TileType> const& types,
+                 renderer::TextureHandle const& tileset,
+                 bool merge,
+                 std::size_t& quad_count) {
+    tilemap::TileMapLayer::Settings settings;
+    settings.width = layer.width;
+    settings.height = layer.height;
+    settings.chunk_size = 16;
+    settings.texture = tileset;
+    settings.tile_types = types;
+    settings.merge_repeating_tiles = merge;
+    tilemap::TileMapLayer tilemap(settings);
+    for (anton::u32 y = 0; y < layer.height; ++y) {
+        for (anton::u32 x = 0; x < layer.width; ++x) {
+            tilemap.set_tile(x, y, layer.tiles[x + y * layer.width]);
+        }
+    }
+
+    tests::finished_meshes.clear();
+    tilemap.rebuild_dirty();
+    // Chunks are rebuilt in order, and every one of them has tiles.
+    ARYIBI_CHECK(tests::finished_meshes.size() == tilemap.chunks().size());
+
+    Image image(layer.width * layer.height * samples_per_tile * samples_per_tile, 0);
+    quad_count = 0;
+    for (std::size_t i = 0; i < tests::finished_meshes.size(); ++i) {
+        rasterize(tests::finished_meshes[i], tilemap.chunks()[i].position, layer, image);
+        quad_count += tests::finished_meshes[i].size() / common::floats_per_quad;
+    }
+    return image;
+}
+
+/// Tile type i is the i-th tile of the tileset. Some of them are flipped, and the last one is an
+/// autotile, which is never merged.
+std::vector<tilemap::TileType> make_tile_types(renderer::TextureHandle const& tileset) {
+    std::vector<tilemap::TileType> types;
+    const float tile_uv_size = 1.f / tileset_tiles;
+    for (anton::u32 i = 0; i < 6; ++i) {
+        const anton::math::Vector2 start{(i % tileset_tiles) * tile_uv_size,
+                                         (i / 3) * tile_uv_size};
+        sprites::Rect2D rect{start, {start.x + tile_uv_size, start.y + tile_uv_size}};
+        if (i == 4)
+            std::swap(rect.start.x, rect.end.x);
+        if (i == 5)
+            std::swap(rect.start.y, rect.end.y);
+        types.push_back({{tileset, rect}, tilemap::TileKind::normal});
+    }
+    types.push_back({{tileset, {{0, 4 * tile_uv_size}, {2 * tile_uv_size, 7 * tile_uv_size}}},
+                     tilemap::TileKind::rpgmaker_a2});
+    return types;
+}
+
+void test_merging_keeps_every_texel(anton::u32 seed) {
+    renderer::TextureHandle tileset;
+    tileset.init(tileset_pixels, tileset_pixels, renderer::TextureHandle::ColorType::rgba,
+                 renderer::TextureHandle::FilteringMethod::point);
+    const auto types = make_tile_types(tileset);
+
+    // Big uniform areas (Which is what merging is for) with random tiles sprinkled over them.
+    Layer layer{40, 37, {}};
+    layer.tiles.assign(layer.width * layer.height, 0);
+    std::mt19937 rng(seed);
+    for (int i = 0; i < 12; ++i) {
+        const anton::u32 x = rng() % layer.width;
+        const anton::u32 y = rng() % layer.height;
+        const anton::u32 width = 1 + rng() % (layer.width - x);
+        const anton::u32 height = 1 + rng() % (layer.height - y);
+        const anton::u32 id = rng() % types.size();
+        for (anton::u32 j = y; j < y + height; ++j) {
+            for (anton::u32 k = x; k < x + width; ++k) { layer.tiles[k + j * layer.width] = id; }
+        }
+    }
+    for (int i = 0; i < 100; ++i) {
+        layer.tiles[rng() % layer.tiles.size()] = rng() % types.size();
+    }
+
+    std::size_t separate_quads = 0;
+    std::size_t merged_quads = 0;
+    const Image separate = draw_layer(layer, types, tileset, false, separate_quads);
+    const Image merged = draw_layer(layer, types, tileset, true, merged_quads);
+    ARYIBI_CHECK(merged_quads < separate_quads);
+
+    std::size_t mismatches = 0;
+    for (std::size_t i = 0; i < separate.size(); ++i) {
+        // Every sample must be covered by exactly one quad.
+        if (separate[i] <= 0 || merged[i] != separate[i])
+            ++mismatches;
+    }
+    ARYIBI_CHECK(mismatches == 0);
+}
+
+} // namespace
+
+int main() {
+    for (anton::u32 seed = 0; seed < 8; ++seed) { test_merging_keeps_every_texel(seed); }
+    return tests::result();
+}